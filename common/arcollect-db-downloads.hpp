@@ -21,7 +21,10 @@
  */
 #pragma once
 #include <sqlite3.hpp>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <limits>
 #include <optional>
 #include <string>
 #include <stdio.h>
@@ -101,6 +104,8 @@ namespace Arcollect {
 					 * This function set dwn_path() and sanitize the filename to avoid
 					 * security issues. The dir IS NOT sanitized, so always hardcode a
 					 * directory.
+					 *
+					 * The file is placed in a shard of the dir, see shard_path().
 					 */
 					void set_dwn_path(const std::filesystem::path& dir, const std::string_view& filename);
 					/** Return the if the download info is valid
@@ -138,6 +143,11 @@ namespace Arcollect {
 					SQLite3::sqlite3 *db;
 					std::unique_ptr<SQLite3::stmt> query_cache_stmt;
 					std::unique_ptr<SQLite3::stmt> unsource_stmt;
+					std::unique_ptr<SQLite3::stmt> delete_download_stmt;
+					std::unique_ptr<SQLite3::stmt> find_by_hash_stmt;
+					std::unique_ptr<SQLite3::stmt> set_hash_stmt;
+					std::unique_ptr<SQLite3::stmt> path_used_stmt;
+					std::unique_ptr<SQLite3::stmt> share_file_stmt;
 					/** List of deleted files
 					 *
 					 * This is a list of (logically) deleted files, they are really erased
@@ -161,6 +171,10 @@ namespace Arcollect {
 					 *       break things, at worst that's a no-op.
 					 */
 					std::string move_refs(sqlite3_int64 from, sqlite3_int64 to);
+					/** Check if a download use a path
+					 * \return true if used or on error
+					 */
+					bool path_used(const std::filesystem::path &dwn_path);
 				public:
 					/** Query cache for an URL
 					 * \param db_key The URL to query from (might not be the real one)
@@ -185,10 +199,25 @@ namespace Arcollect {
 					/** Attempt to delete a download
 					 * \return `true` if the download will be removed upon a commit()
 					 *
-					 * It may delete it or not if used by another key.
+					 * It may delete it or not if used by another key. The file is kept
+					 * while another download share it.
 					 * \warning It rely on SQLite foreign keys enforcement.
 					 */
 					bool delete_cache(sqlite3_int64 dwn_id);
+					/** Reuse an identical download
+					 * \param[in/out] infos of a download written with write_cache()
+					 * \param hash XXH64 of the file content
+					 * \return An empty string on success, the error message else
+					 *
+					 * If another download has the same content, the download is pointed
+					 * to its file, `infos` is updated and the new file is removed upon
+					 * commit(). The download keeps its own row and `dwn_source`. The hash
+					 * is stored for future lookups.
+					 *
+					 * Contents are compared byte per byte, a hash collision never share
+					 * different files.
+					 */
+					std::string deduplicate(DownloadInfo& infos, std::uint64_t hash);
 					/** Unsource a download
 					 * \return An empty string on success or the error message
 					 *
@@ -226,6 +255,214 @@ namespace Arcollect {
 					 */
 					~Transaction(void) noexcept;
 			};
+			/** Missing download hashes computation
+			 *
+			 * Downloads saved before the v7 schema have no `dwn_hash`. They are
+			 * hashed by bounded batches in three phases so the caller choose where
+			 * they run :
+			 * 1. list() fetch the next batch from the database,
+			 * 2. hash() read files in parallel without touching the database, it
+			 *    may run on another thread,
+			 * 3. write() store hashes in a short transaction.
+			 *
+			 * Missing or unreadable files are left without a hash.
+			 *
+			 * The desktop-app run it in the background after starting.
+			 */
+			class HashBackfill {
+				public:
+					/** Default number of downloads per batch
+					 */
+					static constexpr std::size_t default_batch_size = 64;
+					/** Number of hashes written so far
+					 */
+					std::size_t written_count = 0;
+					/** List the next batch
+					 * \param batch_size The maximum number of downloads to list
+					 * \return false when all downloads have been seen or on error
+					 */
+					bool list(std::size_t batch_size = default_batch_size);
+					/** Hash listed files
+					 *
+					 * Files are hashed in parallel. It does not touch the database.
+					 */
+					void hash(void);
+					/** Write hashes of the batch
+					 * \return SQLITE_OK on success, SQLITE_BUSY to retry later or the
+					 *         error code
+					 *
+					 * The batch is kept until written, errors are reported on std::cerr.
+					 */
+					int write(void);
+					/** Backfill all downloads synchronously
+					 * \return The number of hashes written
+					 */
+					std::size_t run(void);
+					
+					HashBackfill(std::unique_ptr<SQLite3::sqlite3> &database);
+				private:
+					/** Reference to the database
+					 */
+					SQLite3::sqlite3 *db;
+					std::unique_ptr<SQLite3::stmt> hash_missing_stmt;
+					std::unique_ptr<SQLite3::stmt> set_hash_stmt;
+					/** Last listed dwn_id
+					 */
+					sqlite3_int64 last_dwn_id = std::numeric_limits<sqlite3_int64>::min();
+					/** Current batch of downloads
+					 */
+					std::vector<std::pair<sqlite3_int64,std::filesystem::path>> downloads;
+					/** Hashes of #downloads, nothing if unreadable
+					 */
+					std::vector<std::optional<std::uint64_t>> hashes;
+			};
+			/** Shard a download path
+			 * \param dir The hardcoded directory like `artworks`
+			 * \param filename The file name
+			 * \return `dir/X/Y/filename`
+			 *
+			 * Files are spread in two levels of 16 subdirectories picked from the
+			 * XXH64 of the file name. The 256 leaves keep directories small with a
+			 * million of files without creating thousands of near empty ones.
+			 */
+			std::filesystem::path shard_path(const std::filesystem::path &dir, const std::filesystem::path &filename);
+			/** Check if a download path is sharded
+			 * \param dwn_path relative to Arcollect::path::arco_data_home
+			 * \return true if the path looks like a shard_path() result
+			 */
+			bool is_sharded(const std::filesystem::path &dwn_path);
+			/** Online migration to sharded paths
+			 *
+			 * Older Arcollect versions stored all files of a directory flat. This
+			 * class move them to shard_path() by batches while other processes use
+			 * the database.
+			 *
+			 * Each batch runs in a short `BEGIN IMMEDIATE` transaction. Moves are
+			 * first written in a #journal_path, then files are renamed and the
+			 * `dwn_path` are updated. If interrupted, the next step() roll the
+			 * journal forward, the migration is resumable at any point.
+			 */
+			class ShardMigration {
+				public:
+					/** Move filter function
+					 * \return false to skip the download in this migration
+					 */
+					using can_move_function = std::function<bool(sqlite3_int64 dwn_id)>;
+					/** Move notification function
+					 *
+					 * Called after the commit of each moved download, including downloads
+					 * sharing the same file.
+					 */
+					using moved_function = std::function<void(sqlite3_int64 dwn_id, const std::filesystem::path &dwn_path)>;
+					/** Default number of downloads per batch
+					 */
+					static constexpr std::size_t default_batch_size = 64;
+					/** Journal of the ongoing batch
+					 *
+					 * This path is relative to Arcollect::path::arco_data_home.
+					 */
+					static const std::filesystem::path journal_path;
+					/** Optional move filter
+					 *
+					 * Skipped downloads are migrated by another ShardMigration.
+					 */
+					can_move_function can_move;
+					/** Optional move notification
+					 */
+					moved_function moved;
+					/** Number of downloads moved so far
+					 */
+					std::size_t moved_count = 0;
+					/** Number of downloads skipped so far
+					 *
+					 * It counts downloads refused by #can_move, missing files and moves
+					 * that failed again when retried at the end of the pass.
+					 */
+					std::size_t skipped_count = 0;
+					/** Migrate a batch
+					 * \param batch_size The number of downloads to look at
+					 * \return false when all downloads have been seen or on error
+					 *
+					 * It always returns false if statements failed to prepare.
+					 *
+					 * When the database is busy, nothing is done and true is returned to
+					 * retry later.
+					 */
+					bool step(std::size_t batch_size = default_batch_size);
+					ShardMigration(std::unique_ptr<SQLite3::sqlite3> &database);
+				private:
+					/** A planned move
+					 */
+					struct move {
+						sqlite3_int64 dwn_id;
+						std::filesystem::path from;
+						std::filesystem::path to;
+						/** File size to recognize the moved file
+						 */
+						std::uintmax_t size;
+					};
+					/** Reference to the database
+					 */
+					SQLite3::sqlite3 *db;
+					std::unique_ptr<SQLite3::stmt> list_paths_stmt;
+					std::unique_ptr<SQLite3::stmt> path_used_stmt;
+					std::unique_ptr<SQLite3::stmt> set_path_stmt;
+					/** Last dwn_id seen
+					 */
+					sqlite3_int64 last_dwn_id = 0;
+					/** Downloads whose move failed in apply() in this pass
+					 */
+					std::vector<sqlite3_int64> requeued;
+					/** Sorted downloads retried at the end of the pass
+					 *
+					 * It is not empty when the pass is retrying #requeued downloads.
+					 */
+					std::vector<sqlite3_int64> retry_ids;
+					/** Requeue a download whose move failed
+					 *
+					 * Downloads failing again in the retry are counted in #skipped_count.
+					 */
+					void requeue(sqlite3_int64 dwn_id);
+					/** Tell whether step() should continue
+					 * \param more true if the list of downloads is not exhausted
+					 * \return the step() return value
+					 *
+					 * At the end of the pass, it rewinds to retry #requeued downloads.
+					 */
+					bool next_batch(bool more);
+					/** Pick a free sharded path
+					 */
+					std::filesystem::path plan_path(const std::filesystem::path &from, const std::vector<move> &moves);
+					/** Check if the target of a move is the moved file
+					 *
+					 * When rolling a journal forward, the file is trusted only if it has
+					 * the expected size and no download use it.
+					 */
+					bool is_moved(const move &planned);
+					/** Check #can_move for all downloads sharing a file
+					 */
+					bool can_move_file(const std::filesystem::path &from);
+					/** Apply moves and commit
+					 * \return false on error
+					 *
+					 * Must be called within a transaction and the #journal_path written.
+					 * Moves already done are skipped, so it also roll forward a journal.
+					 * If the transaction fails, files are moved back and the journal is
+					 * removed if nothing is left to roll forward.
+					 */
+					bool apply(const std::vector<move> &moves);
+			};
+			/** Check downloads files consistency
+			 * \param database to check
+			 * \param dirs to look for orphan files into, relative to
+			 *        Arcollect::path::arco_data_home
+			 * \return A list of problems, empty if consistent
+			 *
+			 * It reports downloads with a missing file, files not referenced by a
+			 * download and an unfinished ShardMigration journal. This is intended
+			 * to be used in crash-recovery tests.
+			 */
+			std::vector<std::string> check_consistency(std::unique_ptr<SQLite3::sqlite3> &database, const std::vector<std::filesystem::path> &dirs = {"artworks","account-avatars"});
 		}
 	}
 }
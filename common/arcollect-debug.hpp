@@ -71,6 +71,7 @@ namespace Arcollect {
 		
 		Flag fonts       {"fonts","       Debug text rendering"};
 		Flag icc_profile {"icc-profile"," Print color management informations."};
+		Flag memory      {"memory","      Print memory freed on low memory warnings."};
 		Flag redraws     {"redraws","     Display redraws and main-loop timings."};
 		Flag rtf         {"rtf","         Rich Text Format parsing."};
 		Flag search      {"search","      Print SQL queries made the search engine."};
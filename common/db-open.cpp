@@ -88,6 +88,34 @@ std::unique_ptr<SQLite3::sqlite3> Arcollect::db::open(int flags)
 			}
 		}
 		case 3: {
+			// Upgrade the database using 'upgrade_v4.sql'
+			if (data_db->exec(Arcollect::db::sql::upgrade_v4)) {
+				std::cerr << "Failed to upgrade DB \"" << db_path << "\" (upgrade_v4.sql): " << data_db->errmsg() << " Rollback." << std::endl;
+				data_db->exec("ROLLBACK;");
+			}
+		}
+		case 4: {
+			// Upgrade the database using 'upgrade_v5.sql'
+			if (data_db->exec(Arcollect::db::sql::upgrade_v5)) {
+				std::cerr << "Failed to upgrade DB \"" << db_path << "\" (upgrade_v5.sql): " << data_db->errmsg() << " Rollback." << std::endl;
+				data_db->exec("ROLLBACK;");
+			}
+		}
+		case 5: {
+			// Upgrade the database using 'upgrade_v6.sql'
+			if (data_db->exec(Arcollect::db::sql::upgrade_v6)) {
+				std::cerr << "Failed to upgrade DB \"" << db_path << "\" (upgrade_v6.sql): " << data_db->errmsg() << " Rollback." << std::endl;
+				data_db->exec("ROLLBACK;");
+			}
+		}
+		case 6: {
+			// Upgrade the database using 'upgrade_v7.sql'
+			if (data_db->exec(Arcollect::db::sql::upgrade_v7)) {
+				std::cerr << "Failed to upgrade DB \"" << db_path << "\" (upgrade_v7.sql): " << data_db->errmsg() << " Rollback." << std::endl;
+				data_db->exec("ROLLBACK;");
+			}
+		}
+		case 7: {
 			// Up-to-date database. Do nothing
 		} break;
 		case 0: {
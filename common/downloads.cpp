@@ -17,16 +17,25 @@
 #include "arcollect-db-downloads.hpp"
 #include "arcollect-paths.hpp"
 #include "arcollect-sqls.hpp"
+#include "xxh64.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <set>
+#include <thread>
 void Arcollect::db::downloads::DownloadInfo::set_dwn_path(const std::filesystem::path& dir, const std::string_view& filename)
 {
-	// Set the dir
-	dwn_path_write = dir;
-	dwn_path_write += dir.preferred_separator;
 	// Sanitize filename
+	std::string sanitized_filename;
 	for (const char c: filename)
 		if (((c >= 'A') && (c <= 'Z'))||((c >= 'a') && (c <= 'z'))||((c >= '0') && (c <= '9'))||(c == '.')||(c == '_')||(c == '-'))
-			dwn_path_write += c;
+			sanitized_filename += c;
+	// Set the path
+	dwn_path_write = shard_path(dir,sanitized_filename);
 }
 
 Arcollect::db::downloads::Transaction::Transaction(std::unique_ptr<SQLite3::sqlite3> &database) : db(database.get())
@@ -34,6 +43,11 @@ Arcollect::db::downloads::Transaction::Transaction(std::unique_ptr<SQLite3::sqli
 	// TODO Checks
 	db->prepare(Arcollect::db::sql::cache_query_by_source,query_cache_stmt);
 	db->prepare(Arcollect::db::sql::downloads_unsource,unsource_stmt);
+	db->prepare(Arcollect::db::sql::delete_download,delete_download_stmt);
+	db->prepare(Arcollect::db::sql::downloads_find_by_hash,find_by_hash_stmt);
+	db->prepare(Arcollect::db::sql::downloads_set_hash,set_hash_stmt);
+	db->prepare(Arcollect::db::sql::downloads_path_used,path_used_stmt);
+	db->prepare(Arcollect::db::sql::downloads_share_file,share_file_stmt);
 }
 void Arcollect::db::downloads::Transaction::commit(void) noexcept
 {
@@ -98,6 +112,15 @@ std::string Arcollect::db::downloads::Transaction::move_refs(sqlite3_int64 from,
 	}
 	return "";
 }
+bool Arcollect::db::downloads::Transaction::path_used(const std::filesystem::path &dwn_path)
+{
+	const std::string path_string = dwn_path.string();
+	path_used_stmt->reset();
+	path_used_stmt->bind(1,path_string);
+	const int code = path_used_stmt->step();
+	path_used_stmt->reset();
+	return code != SQLITE_DONE;
+}
 std::string Arcollect::db::downloads::Transaction::write_cache(const std::string_view &db_key, const std::string_view &mimetype, Arcollect::db::downloads::DownloadInfo& infos)
 {
 	if (infos)
@@ -113,6 +136,16 @@ std::string Arcollect::db::downloads::Transaction::write_cache(const std::string
 			new_path += std::filesystem::path("-"+std::to_string(i));
 			continue; // This download is still used in the database
 		}
+		// Never overwrite a file, it may be shared or moved by an interrupted ShardMigration
+		std::error_code ec;
+		if (std::filesystem::exists(Arcollect::path::arco_data_home/new_path,ec)||path_used(new_path)) {
+			new_path = infos.dwn_path();
+			new_path.replace_filename(filename);
+			new_path += "-";
+			new_path += std::to_string(i);
+			new_path += extension;
+			continue;
+		}
 		// Perform transaction
 		std::unique_ptr<SQLite3::stmt> downloads_new_entry_stmt;
 		db->prepare(Arcollect::db::sql::downloads_new_entry,downloads_new_entry_stmt);
@@ -131,6 +164,8 @@ std::string Arcollect::db::downloads::Transaction::write_cache(const std::string
 				std::optional<sqlite3_int64> old_ref = infos.dwn_id_write;
 				infos.dwn_id_write = downloads_new_entry_stmt->column_int64(0);
 				infos.dwn_path_write = new_path;
+				// Create the shard
+				std::filesystem::create_directories(Arcollect::path::arco_data_home/new_path.parent_path(),ec);
 				created_files.emplace_back(std::move(new_path));
 				// Get a SQLITE_DONE
 				if (downloads_new_entry_stmt->step() != SQLITE_DONE)
@@ -143,20 +178,6 @@ std::string Arcollect::db::downloads::Transaction::write_cache(const std::string
 					delete_cache(*old_ref);
 				}
 			} return std::string();
-			case SQLITE_CONSTRAINT: {
-				if (db->extended_errcode() == SQLITE_CONSTRAINT_UNIQUE) {
-					const std::string_view errmsg(db->errmsg());
-					if (errmsg.ends_with("dwn_path")) {
-						// dwn_path duplicate, try another one
-						new_path = infos.dwn_path();
-						new_path.replace_filename(filename);
-						new_path += "-";
-						new_path += std::to_string(i);
-						new_path += extension;
-						continue; // This download is still used in the database
-					}
-				}
-			} // falltrough;
 			default:
 				return std::string("Failed to add cache entry in database: "+std::string(db->errmsg()));
 		}
@@ -166,13 +187,15 @@ std::string Arcollect::db::downloads::Transaction::write_cache(const std::string
 }
 bool Arcollect::db::downloads::Transaction::delete_cache(sqlite3_int64 dwn_id)
 {
-	std::unique_ptr<SQLite3::stmt> delete_download_stmt;
-	db->prepare(Arcollect::db::sql::delete_download,delete_download_stmt);
+	delete_download_stmt->reset();
 	delete_download_stmt->bind(1,dwn_id);
 	switch (delete_download_stmt->step()) {
 		case SQLITE_ROW: {
-			// Success
-			deleted_files.emplace(delete_download_stmt->column_string(0));
+			// Success, remove the file unless shared
+			std::filesystem::path dwn_path = delete_download_stmt->column_string(0);
+			delete_download_stmt->reset();
+			if (!path_used(dwn_path))
+				deleted_files.emplace(std::move(dwn_path));
 		} return true;
 		case SQLITE_DONE: {
 			std::cerr << "Tried to delete non existant download (dwn_id = " << dwn_id << ")" << std::endl;
@@ -186,3 +209,471 @@ bool Arcollect::db::downloads::Transaction::delete_cache(sqlite3_int64 dwn_id)
 		} return false;
 	}
 }
+/** Size of buffers used to read files
+ */
+static constexpr std::size_t read_buffer_size = 64*1024;
+/** Compare two files
+ * \return true if both files exist and have the same content
+ */
+static bool same_content(const std::filesystem::path &left, const std::filesystem::path &right)
+{
+	std::error_code ec;
+	const std::uintmax_t left_size = std::filesystem::file_size(left,ec);
+	if (ec || (std::filesystem::file_size(right,ec) != left_size) || ec)
+		return false;
+	std::ifstream left_file(left,std::ios::binary);
+	std::ifstream right_file(right,std::ios::binary);
+	std::vector<char> left_buffer(read_buffer_size), right_buffer(read_buffer_size);
+	while (left_file && right_file) {
+		left_file.read(left_buffer.data(),left_buffer.size());
+		right_file.read(right_buffer.data(),right_buffer.size());
+		const std::streamsize count = left_file.gcount();
+		if ((count != right_file.gcount()) || std::memcmp(left_buffer.data(),right_buffer.data(),count))
+			return false;
+	}
+	return left_file.eof() && right_file.eof();
+}
+/** Hash a file
+ * \return The XXH64 of the file or nothing if it cannot be read
+ */
+static std::optional<std::uint64_t> hash_file(const std::filesystem::path &path)
+{
+	std::ifstream file(path,std::ios::binary);
+	if (!file)
+		return std::nullopt;
+	XXH64_CTX hasher;
+	std::vector<char> buffer(read_buffer_size);
+	do {
+		file.read(buffer.data(),buffer.size());
+		hasher.Update(buffer.data(),file.gcount());
+	} while (file);
+	if (file.bad())
+		return std::nullopt;
+	return hasher.Final();
+}
+std::string Arcollect::db::downloads::Transaction::deduplicate(Arcollect::db::downloads::DownloadInfo& infos, std::uint64_t hash)
+{
+	// SQLite integers are signed, store the hash bits as is
+	const sqlite3_int64 dwn_hash = static_cast<sqlite3_int64>(hash);
+	const std::filesystem::path new_path = Arcollect::path::arco_data_home/infos.dwn_path();
+	find_by_hash_stmt->reset();
+	find_by_hash_stmt->bind(1,dwn_hash);
+	find_by_hash_stmt->bind(2,infos.dwn_id());
+	int code;
+	while ((code = find_by_hash_stmt->step()) == SQLITE_ROW) {
+		std::filesystem::path existing_path = find_by_hash_stmt->column_string(1);
+		if (!same_content(new_path,Arcollect::path::arco_data_home/existing_path))
+			continue; // Hash collision or missing file
+		// Share the existing file
+		find_by_hash_stmt->reset();
+		const std::string existing_string = existing_path.string();
+		share_file_stmt->reset();
+		share_file_stmt->bind(1,infos.dwn_id());
+		share_file_stmt->bind(2,existing_string);
+		if (share_file_stmt->step() != SQLITE_DONE)
+			return std::string("Failed to share the download file: "+std::string(db->errmsg()));
+		deleted_files.emplace(infos.dwn_path());
+		infos.dwn_path_write = std::move(existing_path);
+		break;
+	}
+	if ((code != SQLITE_DONE)&&(code != SQLITE_ROW))
+		return std::string("Failed to search duplicated downloads: "+std::string(db->errmsg()));
+	// Remember the hash
+	set_hash_stmt->reset();
+	set_hash_stmt->bind(1,infos.dwn_id());
+	set_hash_stmt->bind(2,dwn_hash);
+	if (set_hash_stmt->step() != SQLITE_DONE)
+		return std::string("Failed to store the download hash: "+std::string(db->errmsg()));
+	return std::string();
+}
+Arcollect::db::downloads::HashBackfill::HashBackfill(std::unique_ptr<SQLite3::sqlite3> &database) : db(database.get())
+{
+	if ((db->prepare(Arcollect::db::sql::downloads_hash_missing,hash_missing_stmt) != SQLITE_OK)
+	  ||(db->prepare(Arcollect::db::sql::downloads_set_hash,set_hash_stmt) != SQLITE_OK)) {
+		std::cerr << "Hash backfill, failed to prepare: " << db->errmsg() << ". Downloads will not be hashed." << std::endl;
+		hash_missing_stmt.reset();
+		set_hash_stmt.reset();
+	}
+}
+bool Arcollect::db::downloads::HashBackfill::list(std::size_t batch_size)
+{
+	downloads.clear();
+	hashes.clear();
+	if (!hash_missing_stmt)
+		return false; // Failed to prepare
+	hash_missing_stmt->reset();
+	hash_missing_stmt->bind(1,last_dwn_id);
+	hash_missing_stmt->bind(2,static_cast<sqlite3_int64>(batch_size));
+	int code;
+	while ((code = hash_missing_stmt->step()) == SQLITE_ROW) {
+		last_dwn_id = hash_missing_stmt->column_int64(0);
+		downloads.emplace_back(last_dwn_id,Arcollect::path::arco_data_home/hash_missing_stmt->column_string(1));
+	}
+	hash_missing_stmt->reset();
+	if (code != SQLITE_DONE) {
+		std::cerr << "Hash backfill, failed to list downloads: " << db->errmsg() << std::endl;
+		downloads.clear();
+		return false;
+	}
+	return !downloads.empty();
+}
+void Arcollect::db::downloads::HashBackfill::hash(void)
+{
+	// Hash files in parallel, workers don't touch the database
+	hashes.assign(downloads.size(),std::nullopt);
+	std::atomic<std::size_t> next_download = 0;
+	std::vector<std::thread> workers(std::min<std::size_t>(std::max(std::thread::hardware_concurrency(),1u),downloads.size()));
+	for (std::thread &worker: workers)
+		worker = std::thread([&]() {
+			for (std::size_t i; (i = next_download++) < downloads.size();)
+				hashes[i] = hash_file(downloads[i].second);
+		});
+	for (std::thread &worker: workers)
+		worker.join();
+}
+int Arcollect::db::downloads::HashBackfill::write(void)
+{
+	if (hashes.size() != downloads.size())
+		return SQLITE_MISUSE; // hash() not called
+	int code = db->exec("BEGIN IMMEDIATE;");
+	switch (code) {
+		case SQLITE_OK:
+			break;
+		case SQLITE_BUSY:
+			return code; // Retry later
+		default: {
+			std::cerr << "Hash backfill, failed to begin: " << db->errmsg() << std::endl;
+		} return code;
+	}
+	std::size_t written = 0;
+	for (std::size_t i = 0; i < downloads.size(); i++)
+		if (hashes[i]) {
+			set_hash_stmt->reset();
+			set_hash_stmt->bind(1,downloads[i].first);
+			set_hash_stmt->bind(2,static_cast<sqlite3_int64>(*hashes[i]));
+			code = set_hash_stmt->step();
+			set_hash_stmt->reset();
+			if (code != SQLITE_DONE) {
+				std::cerr << "Hash backfill, failed to store the hash of " << downloads[i].second << ": " << db->errmsg() << ". Rollback." << std::endl;
+				db->exec("ROLLBACK;");
+				return code;
+			}
+			written++;
+		}
+	code = db->exec("COMMIT;");
+	if (code != SQLITE_OK) {
+		std::cerr << "Hash backfill, failed to commit: " << db->errmsg() << ". Rollback." << std::endl;
+		db->exec("ROLLBACK;");
+		return code;
+	}
+	written_count += written;
+	downloads.clear();
+	hashes.clear();
+	return SQLITE_OK;
+}
+std::size_t Arcollect::db::downloads::HashBackfill::run(void)
+{
+	while (list()) {
+		hash();
+		if (write() != SQLITE_OK)
+			break;
+	}
+	return written_count;
+}
+std::filesystem::path Arcollect::db::downloads::shard_path(const std::filesystem::path &dir, const std::filesystem::path &filename)
+{
+	static constexpr char hex_digits[] = "0123456789abcdef";
+	const std::uint64_t hash = XXH64_CTX::hash(filename.string());
+	return dir / std::string(1,hex_digits[hash >> 60]) / std::string(1,hex_digits[(hash >> 56)&0xF]) / filename;
+}
+bool Arcollect::db::downloads::is_sharded(const std::filesystem::path &dwn_path)
+{
+	// Look for 'dir/X/Y/filename', the file name is not checked because
+	// write_cache() append a suffix to resolve conflicts.
+	const std::filesystem::path shard = dwn_path.parent_path();
+	return (shard.filename().native().size() == 1)&&(shard.parent_path().filename().native().size() == 1)&&shard.parent_path().has_parent_path();
+}
+
+const std::filesystem::path Arcollect::db::downloads::ShardMigration::journal_path("shard-migration.journal");
+
+Arcollect::db::downloads::ShardMigration::ShardMigration(std::unique_ptr<SQLite3::sqlite3> &database) : db(database.get())
+{
+	if ((db->prepare(Arcollect::db::sql::downloads_list_paths,list_paths_stmt) != SQLITE_OK)
+	  ||(db->prepare(Arcollect::db::sql::downloads_path_used,path_used_stmt) != SQLITE_OK)
+	  ||(db->prepare(Arcollect::db::sql::downloads_set_path,set_path_stmt) != SQLITE_OK)) {
+		std::cerr << "Shard migration, failed to prepare: " << db->errmsg() << ". Downloads will not be migrated." << std::endl;
+		list_paths_stmt.reset();
+		path_used_stmt.reset();
+		set_path_stmt.reset();
+	}
+}
+bool Arcollect::db::downloads::ShardMigration::is_moved(const move &planned)
+{
+	// Check the size
+	std::error_code ec;
+	const std::uintmax_t size = std::filesystem::file_size(Arcollect::path::arco_data_home/planned.to,ec);
+	if (ec || (size != planned.size))
+		return false;
+	// Check that no download use it
+	const std::string to_string = planned.to.string();
+	path_used_stmt->reset();
+	path_used_stmt->bind(1,to_string);
+	const int code = path_used_stmt->step();
+	path_used_stmt->reset();
+	return code == SQLITE_DONE;
+}
+bool Arcollect::db::downloads::ShardMigration::can_move_file(const std::filesystem::path &from)
+{
+	if (!can_move)
+		return true;
+	// Check all downloads sharing the file
+	const std::string from_string = from.string();
+	path_used_stmt->reset();
+	path_used_stmt->bind(1,from_string);
+	int code;
+	while ((code = path_used_stmt->step()) == SQLITE_ROW)
+		if (!can_move(path_used_stmt->column_int64(0)))
+			break;
+	path_used_stmt->reset();
+	return code == SQLITE_DONE;
+}
+std::filesystem::path Arcollect::db::downloads::ShardMigration::plan_path(const std::filesystem::path &from, const std::vector<move> &moves)
+{
+	const std::filesystem::path target = shard_path(from.parent_path(),from.filename());
+	std::filesystem::path candidate = target;
+	for (unsigned int i = 0; i < std::numeric_limits<decltype(i)>::max(); ++i) {
+		// Check the disk, the database and this batch
+		std::error_code ec;
+		bool used = std::filesystem::exists(Arcollect::path::arco_data_home/candidate,ec);
+		if (!used) {
+			const std::string candidate_string = candidate.string();
+			path_used_stmt->reset();
+			path_used_stmt->bind(1,candidate_string);
+			used = path_used_stmt->step() != SQLITE_DONE;
+			path_used_stmt->reset();
+		}
+		if (!used)
+			used = std::any_of(moves.begin(),moves.end(),[&](const move &planned) {
+				return planned.to == candidate;
+			});
+		if (!used)
+			return candidate;
+		// Try another one like write_cache() does
+		candidate = target;
+		candidate.replace_filename(target.stem());
+		candidate += "-";
+		candidate += std::to_string(i);
+		candidate += target.extension();
+	}
+	return target; // Will fail on the UNIQUE constraint
+}
+void Arcollect::db::downloads::ShardMigration::requeue(sqlite3_int64 dwn_id)
+{
+	if (retry_ids.empty())
+		requeued.push_back(dwn_id);
+	else skipped_count++; // Already retried
+}
+bool Arcollect::db::downloads::ShardMigration::next_batch(bool more)
+{
+	if (more)
+		return retry_ids.empty() || (last_dwn_id < retry_ids.back());
+	if (!retry_ids.empty() || requeued.empty())
+		return false;
+	// Retry requeued downloads once at the end of the pass
+	retry_ids = std::move(requeued);
+	requeued.clear();
+	std::sort(retry_ids.begin(),retry_ids.end());
+	last_dwn_id = retry_ids.front()-1;
+	return true;
+}
+bool Arcollect::db::downloads::ShardMigration::apply(const std::vector<move> &moves)
+{
+	std::vector<std::pair<sqlite3_int64,const std::filesystem::path*>> updated;
+	// Moves done by this call, undone if the transaction fails
+	std::vector<const move*> renamed;
+	bool moved_before = false;
+	const auto rollback = [&]() {
+		db->exec("ROLLBACK;");
+		bool undone = !moved_before;
+		for (auto iter = renamed.rbegin(); iter != renamed.rend(); ++iter) {
+			std::error_code ec;
+			std::filesystem::rename(Arcollect::path::arco_data_home/(*iter)->to,Arcollect::path::arco_data_home/(*iter)->from,ec);
+			if (ec) {
+				std::cerr << "Shard migration, failed to move " << (*iter)->to << " back: " << ec.message() << ". It will be rolled forward." << std::endl;
+				undone = false;
+			}
+		}
+		// Keep the journal to roll forward files not at their old path
+		if (undone) {
+			std::error_code ec;
+			std::filesystem::remove(Arcollect::path::arco_data_home/journal_path,ec);
+		}
+	};
+	for (const move &planned: moves) {
+		std::error_code ec;
+		const std::filesystem::path from = Arcollect::path::arco_data_home/planned.from;
+		const std::filesystem::path to = Arcollect::path::arco_data_home/planned.to;
+		// Move the file unless already done
+		if (std::filesystem::exists(from,ec)) {
+			if (std::filesystem::exists(to,ec)) {
+				std::cerr << "Shard migration, " << to << " already exists. " << from << " will be moved later." << std::endl;
+				requeue(planned.dwn_id);
+				continue;
+			}
+			std::filesystem::create_directories(to.parent_path(),ec);
+			std::filesystem::rename(from,to,ec);
+			if (ec) {
+				std::cerr << "Shard migration, failed to move " << from << " to " << to << ": " << ec.message() << ". It will be retried." << std::endl;
+				requeue(planned.dwn_id);
+				continue;
+			}
+			renamed.push_back(&planned);
+		} else if (is_moved(planned))
+			moved_before = true;
+		else {
+			std::cerr << "Shard migration, " << from << " is missing and " << to << " is not the moved file. Download " << planned.dwn_id << " is left as is." << std::endl;
+			continue;
+		}
+		// Update downloads sharing the file
+		const std::string from_string = planned.from.string();
+		const std::string to_string = planned.to.string();
+		set_path_stmt->reset();
+		set_path_stmt->bind(1,from_string);
+		set_path_stmt->bind(2,to_string);
+		int code;
+		while ((code = set_path_stmt->step()) == SQLITE_ROW)
+			updated.emplace_back(set_path_stmt->column_int64(0),&planned.to);
+		set_path_stmt->reset();
+		if (code != SQLITE_DONE) {
+			std::cerr << "Shard migration, failed to update download " << planned.dwn_id << ": " << db->errmsg() << ". Rollback." << std::endl;
+			rollback();
+			return false;
+		}
+	}
+	if (db->exec("COMMIT;")) {
+		std::cerr << "Shard migration, failed to commit: " << db->errmsg() << ". Rollback." << std::endl;
+		rollback();
+		return false;
+	}
+	// The batch is done
+	std::error_code ec;
+	std::filesystem::remove(Arcollect::path::arco_data_home/journal_path,ec);
+	moved_count += updated.size();
+	if (moved)
+		for (const auto &[dwn_id, to]: updated)
+			moved(dwn_id,*to);
+	return true;
+}
+bool Arcollect::db::downloads::ShardMigration::step(std::size_t batch_size)
+{
+	const std::filesystem::path journal = Arcollect::path::arco_data_home/journal_path;
+	if (!set_path_stmt)
+		return false; // Failed to prepare
+	switch (db->exec("BEGIN IMMEDIATE;")) {
+		case SQLITE_OK:
+			break;
+		case SQLITE_BUSY:
+			return true; // Retry later
+		default: {
+			std::cerr << "Shard migration, \"BEGIN IMMEDIATE;\" failed: " << db->errmsg() << std::endl;
+		} return false;
+	}
+	std::vector<move> moves;
+	// Roll forward an interrupted batch
+	std::ifstream journal_file(journal);
+	if (journal_file) {
+		for (std::string line; std::getline(journal_file,line);) {
+			const std::string::size_type tab1 = line.find('\t');
+			const std::string::size_type tab2 = line.find('\t',tab1+1);
+			const std::string::size_type tab3 = line.find('\t',tab2+1);
+			if (tab3 == line.npos)
+				break; // Truncated journal
+			moves.push_back({std::strtoll(line.c_str(),NULL,10),line.substr(tab1+1,tab2-tab1-1),line.substr(tab2+1,tab3-tab2-1),std::strtoull(line.c_str()+tab3+1,NULL,10)});
+		}
+		journal_file.close();
+		return apply(moves);
+	}
+	// Plan moves
+	std::size_t seen = 0;
+	list_paths_stmt->reset();
+	list_paths_stmt->bind(1,last_dwn_id);
+	list_paths_stmt->bind(2,static_cast<sqlite3_int64>(batch_size));
+	int code;
+	while ((code = list_paths_stmt->step()) == SQLITE_ROW) {
+		seen++;
+		last_dwn_id = list_paths_stmt->column_int64(0);
+		if (!retry_ids.empty() && !std::binary_search(retry_ids.begin(),retry_ids.end(),last_dwn_id))
+			continue; // Only retry requeued downloads
+		std::filesystem::path from = list_paths_stmt->column_string(1);
+		if (is_sharded(from)||std::any_of(moves.begin(),moves.end(),[&](const move &planned) {
+			return planned.from == from;
+		}))
+			continue; // Already sharded or shared with a planned move
+		std::error_code ec;
+		const std::uintmax_t size = std::filesystem::file_size(Arcollect::path::arco_data_home/from,ec);
+		if (ec||!can_move_file(from)) {
+			skipped_count++;
+			continue;
+		}
+		std::filesystem::path to = plan_path(from,moves);
+		moves.push_back({last_dwn_id,std::move(from),std::move(to),size});
+	}
+	list_paths_stmt->reset();
+	if (code != SQLITE_DONE) {
+		std::cerr << "Shard migration, failed to list downloads: " << db->errmsg() << ". Rollback." << std::endl;
+		db->exec("ROLLBACK;");
+		return false;
+	}
+	if (moves.empty()) {
+		db->exec("ROLLBACK;");
+		return next_batch(seen == batch_size);
+	}
+	// Write the journal atomically
+	std::filesystem::path journal_tmp = journal;
+	journal_tmp += ".tmp";
+	std::ofstream journal_tmp_file(journal_tmp);
+	for (const move &planned: moves)
+		journal_tmp_file << planned.dwn_id << '\t' << planned.from.string() << '\t' << planned.to.string() << '\t' << planned.size << '\n';
+	journal_tmp_file.close();
+	std::error_code ec;
+	if (!journal_tmp_file.fail())
+		std::filesystem::rename(journal_tmp,journal,ec);
+	if (journal_tmp_file.fail() || ec) {
+		std::cerr << "Shard migration, failed to write " << journal << ". Rollback." << std::endl;
+		db->exec("ROLLBACK;");
+		return false;
+	}
+	return apply(moves) && next_batch(seen == batch_size);
+}
+std::vector<std::string> Arcollect::db::downloads::check_consistency(std::unique_ptr<SQLite3::sqlite3> &database, const std::vector<std::filesystem::path> &dirs)
+{
+	std::vector<std::string> problems;
+	std::error_code ec;
+	// Check downloads files
+	std::set<std::filesystem::path> known_files;
+	std::unique_ptr<SQLite3::stmt> stmt;
+	if (database->prepare(Arcollect::db::sql::downloads_list_paths,stmt)) {
+		problems.push_back("Failed to list downloads: "+std::string(database->errmsg()));
+		return problems;
+	}
+	stmt->bind(1,std::numeric_limits<sqlite3_int64>::min());
+	stmt->bind(2,-1); // No limit
+	while (stmt->step() == SQLITE_ROW) {
+		const std::filesystem::path dwn_path = std::filesystem::path(stmt->column_string(1)).lexically_normal();
+		if (!std::filesystem::is_regular_file(Arcollect::path::arco_data_home/dwn_path,ec))
+			problems.push_back("Download "+std::to_string(stmt->column_int64(0))+" file is missing: "+dwn_path.string());
+		known_files.insert(dwn_path);
+	}
+	// Look for orphan files
+	for (const std::filesystem::path &dir: dirs)
+		for (const std::filesystem::directory_entry &entry: std::filesystem::recursive_directory_iterator(Arcollect::path::arco_data_home/dir,ec))
+			if (entry.is_regular_file(ec)) {
+				const std::filesystem::path relative = entry.path().lexically_relative(Arcollect::path::arco_data_home);
+				if (known_files.find(relative) == known_files.end())
+					problems.push_back("Orphan file: "+relative.string());
+			}
+	// Check for an interrupted migration
+	if (std::filesystem::exists(Arcollect::path::arco_data_home/ShardMigration::journal_path,ec))
+		problems.push_back("Unfinished shard migration journal: "+ShardMigration::journal_path.string());
+	return problems;
+}
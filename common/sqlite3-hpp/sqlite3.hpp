@@ -124,6 +124,9 @@ namespace SQLite3 {
 		inline int bind_null(int column) {
 			return sqlite3_bind_null((sqlite3_stmt*)this,column);
 		}
+		inline int bind_blob(int column, const void* blob, int size, void(*dtor)(void*) = NULL) {
+			return sqlite3_bind_blob((sqlite3_stmt*)this,column,blob,size,dtor);
+		}
 		/* TODO
 		int sqlite3_bind_text(sqlite3_stmt*,int,const char*,int,void(*)(void*));
 		int sqlite3_bind_text16(sqlite3_stmt*, int, const void*, int, void(*)(void*));
@@ -145,9 +148,12 @@ namespace SQLite3 {
 		bool column_null(int iCol) {
 			return column_type(iCol) == SQLITE_NULL;
 		}
-		/* TODO
-		const void *sqlite3_column_blob(sqlite3_stmt*, int iCol);
-		*/
+		inline const void *column_blob(int iCol) {
+			return sqlite3_column_blob((sqlite3_stmt*)this,iCol);
+		}
+		inline int column_bytes(int iCol) {
+			return sqlite3_column_bytes((sqlite3_stmt*)this,iCol);
+		}
 		inline double column_double(int iCol) {
 			return sqlite3_column_double((sqlite3_stmt*)this,iCol);
 		}
@@ -172,7 +178,6 @@ namespace SQLite3 {
 		/*
 		const void *sqlite3_column_text16(sqlite3_stmt*, int iCol);
 		sqlite3_value *sqlite3_column_value(sqlite3_stmt*, int iCol);
-		int sqlite3_column_bytes(sqlite3_stmt*, int iCol);
 		int sqlite3_column_bytes16(sqlite3_stmt*, int iCol);
 		*/
 		inline int step(void) {
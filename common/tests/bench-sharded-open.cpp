@@ -0,0 +1,144 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2021 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-sharded-open.cpp
+ *  \brief Cost of a flat downloads directory versus sharded paths
+ *
+ * Fill a flat directory like older Arcollect versions did, measure the open
+ * latency of random files and listing the directory, migrate it with
+ * Arcollect::db::downloads::ShardMigration and measure again.
+ */
+#include "arcollect-db-open.hpp"
+#include "arcollect-db-downloads.hpp"
+#include "arcollect-paths.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace Arcollect::db::downloads;
+
+static constexpr int files_count = 100000;
+static constexpr int opens_count = 20000;
+static const std::filesystem::path bench_dir("bench");
+
+using duration = std::chrono::duration<double,std::micro>;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+struct measures {
+	duration mean_open;
+	duration p99_open;
+	duration listing;
+};
+/** Measure the current layout
+ */
+static measures measure(std::unique_ptr<SQLite3::sqlite3> &database)
+{
+	// Query paths like the desktop-app does
+	std::vector<std::filesystem::path> paths;
+	std::unique_ptr<SQLite3::stmt> stmt;
+	database->prepare("SELECT dwn_path FROM downloads ORDER BY dwn_id;",stmt);
+	while (stmt->step() == SQLITE_ROW)
+		paths.emplace_back(Arcollect::path::arco_data_home/stmt->column_string(0));
+	// Open random files
+	std::mt19937 rng(42);
+	std::vector<duration> latencies;
+	latencies.reserve(opens_count);
+	for (int i = 0; i < opens_count; i++) {
+		const std::string path = paths[rng()%paths.size()].string();
+		const auto start = std::chrono::steady_clock::now();
+		std::FILE *file = std::fopen(path.c_str(),"rb");
+		latencies.push_back(std::chrono::steady_clock::now() - start);
+		if (file)
+			std::fclose(file);
+		else std::cout << "# Failed to open " << path << std::endl;
+	}
+	std::sort(latencies.begin(),latencies.end());
+	duration total(0);
+	for (const duration &latency: latencies)
+		total += latency;
+	// List the top directory
+	const auto start = std::chrono::steady_clock::now();
+	std::size_t entries = 0;
+	for (const auto &entry: std::filesystem::directory_iterator(Arcollect::path::arco_data_home/bench_dir))
+		entries += !entry.path().empty();
+	const duration listing = std::chrono::steady_clock::now() - start;
+	return {total/opens_count,latencies[latencies.size()*99/100],listing};
+}
+static void print(const std::string_view &name, const measures &result)
+{
+	std::cout << "# " << name << ": open " << result.mean_open.count() << "us mean " << result.p99_open.count() << "us p99, listing " << result.listing.count() << "us" << std::endl;
+}
+
+int main(void)
+{
+	std::cout << "TAP version 13\n1..3" << std::endl;
+	std::unique_ptr<SQLite3::sqlite3> database = Arcollect::db::test_open();
+	std::filesystem::remove_all(Arcollect::path::arco_data_home/bench_dir);
+	std::filesystem::create_directories(Arcollect::path::arco_data_home/bench_dir);
+	
+	// Make a flat collection
+	std::cout << "# Generating " << files_count << " files" << std::endl;
+	std::unique_ptr<SQLite3::stmt> insert_stmt;
+	database->exec("BEGIN IMMEDIATE;");
+	database->prepare("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_lastedit) VALUES (?,?,'image/png',0);",insert_stmt);
+	for (int i = 1; i <= files_count; i++) {
+		const std::string dwn_path = (bench_dir/("artwork-"+std::to_string(i)+".png")).string();
+		std::FILE *file = std::fopen((Arcollect::path::arco_data_home/dwn_path).string().c_str(),"wb");
+		if (!file) {
+			std::cout << "Bail out! Failed to create " << dwn_path << std::endl;
+			return 1;
+		}
+		std::fclose(file);
+		insert_stmt->reset();
+		insert_stmt->bind(1,i);
+		insert_stmt->bind(2,dwn_path);
+		insert_stmt->step();
+	}
+	database->exec("COMMIT;");
+	const measures flat = measure(database);
+	print("Flat",flat);
+	
+	// Migrate
+	const auto start = std::chrono::steady_clock::now();
+	ShardMigration migration(database);
+	std::size_t steps = 0;
+	while (migration.step())
+		steps++;
+	const std::chrono::duration<double> migration_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# Migrated " << migration.moved_count << " files in " << steps << " steps and " << migration_time.count() << "s" << std::endl;
+	tap_result(migration.moved_count == files_count,"All files are migrated");
+	const measures sharded = measure(database);
+	print("Sharded",sharded);
+	
+	tap_result(sharded.listing < flat.listing,"Listing the top directory is faster");
+	// A warm cache hide the cost of huge directories, only check for regressions
+	tap_result(sharded.p99_open < 2*flat.p99_open,"Open latency does not regress");
+	std::filesystem::remove_all(Arcollect::path::arco_data_home/bench_dir);
+	return result_code;
+}
@@ -0,0 +1,120 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2021 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "arcollect-db-open.hpp"
+#include "arcollect-db-downloads.hpp"
+#include "arcollect-paths.hpp"
+#include "../xxh64.hpp"
+#include <fstream>
+#include <iostream>
+using Arcollect::db::downloads::DownloadInfo;
+using Arcollect::db::downloads::Transaction;
+
+static int test_num = 1;
+static decltype(std::cout)& ok_nok(bool result)
+{
+	return std::cout << (result ? "ok " : "not ok ") << test_num++ << " - ";
+}
+
+static std::unique_ptr<SQLite3::sqlite3> database;
+
+/** Write a download like the webext-adder does
+ * \return The error message
+ */
+static std::string write_download(Transaction &cache, const std::string_view &db_key, const std::string_view &content, DownloadInfo &infos, XXH64_CTX::DIGEST hash)
+{
+	infos.dwn_lastedit = 0;
+	infos.set_dwn_path("test","art.png");
+	std::string error = cache.write_cache(db_key,"image/png",infos);
+	if (!error.empty())
+		return error;
+	std::ofstream(Arcollect::path::arco_data_home/infos.dwn_path(),std::ios::binary) << content;
+	return cache.deduplicate(infos,hash);
+}
+static std::optional<sqlite3_int64> stored_hash(sqlite3_int64 dwn_id)
+{
+	std::unique_ptr<SQLite3::stmt> stmt;
+	database->prepare("SELECT dwn_hash FROM downloads WHERE dwn_id = ?;",stmt);
+	stmt->bind(1,dwn_id);
+	if ((stmt->step() != SQLITE_ROW) || stmt->column_null(0))
+		return std::nullopt;
+	return stmt->column_int64(0);
+}
+
+int main(void)
+{
+	std::cout << "TAP version 13\n1..10" << std::endl;
+	database = Arcollect::db::test_open();
+	std::filesystem::create_directories(Arcollect::path::arco_data_home/"test");
+	static constexpr std::string_view content = "Not really a PNG";
+	static constexpr std::string_view other_content = "Not a PNG either";
+	const XXH64_CTX::DIGEST hash = XXH64_CTX::hash(content);
+	database->exec("BEGIN IMMEDIATE;");
+	Transaction cache(database);
+	
+	// 1. A new content keeps its download and stores the hash
+	DownloadInfo first;
+	std::string error = write_download(cache,"https://example.com/first.png",content,first,hash);
+	ok_nok(error.empty() && (stored_hash(first.dwn_id()) == static_cast<sqlite3_int64>(hash))) << "First download stores its hash " << error << std::endl;
+	
+	// 2. The same content from another URL share the first download file
+	DownloadInfo mirror;
+	error = write_download(cache,"https://mirror.example.com/first.png",content,mirror,hash);
+	ok_nok(error.empty() && (mirror.dwn_id() != first.dwn_id()) && (mirror.dwn_path() == first.dwn_path())) << "Identical content share the existing file " << error << std::endl;
+	ok_nok((cache.query_cache("https://mirror.example.com/first.png").dwn_id() == mirror.dwn_id()) && (cache.query_cache("https://example.com/first.png").dwn_id() == first.dwn_id())) << "Both downloads keep their source " << std::endl;
+	
+	// 3. A hash collision is not a duplicate
+	DownloadInfo collision;
+	error = write_download(cache,"https://example.com/collision.png",other_content,collision,hash);
+	ok_nok(error.empty() && (collision.dwn_id() != first.dwn_id()) && (collision.dwn_path() != first.dwn_path())) << "Different content with the same hash is kept apart " << error << std::endl;
+	
+	// 4. Only the duplicated file is removed
+	database->exec("COMMIT;");
+	cache.commit();
+	std::size_t files_count = 0;
+	for (const auto &entry: std::filesystem::recursive_directory_iterator(Arcollect::path::arco_data_home/"test"))
+		files_count += entry.is_regular_file();
+	ok_nok(std::filesystem::exists(Arcollect::path::arco_data_home/first.dwn_path()) && (files_count == 2)) << "Duplicated file is removed on commit" << std::endl;
+	
+	// 5. The shared file is removed with the last download
+	database->exec("BEGIN IMMEDIATE;");
+	cache.delete_cache(first.dwn_id());
+	database->exec("COMMIT;");
+	cache.commit();
+	const bool kept = std::filesystem::exists(Arcollect::path::arco_data_home/mirror.dwn_path());
+	database->exec("BEGIN IMMEDIATE;");
+	cache.delete_cache(mirror.dwn_id());
+	database->exec("COMMIT;");
+	cache.commit();
+	ok_nok(kept) << "Shared file is kept while used" << std::endl;
+	ok_nok(!std::filesystem::exists(Arcollect::path::arco_data_home/mirror.dwn_path())) << "Shared file is removed with the last download" << std::endl;
+	
+	// 6. Backfill existing downloads
+	std::ofstream(Arcollect::path::arco_data_home/"test"/"old.png",std::ios::binary) << other_content;
+	database->exec("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_lastedit) VALUES (100,'test/old.png','image/png',0);");
+	database->exec("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_lastedit) VALUES (101,'test/missing.png','image/png',0);");
+	Arcollect::db::downloads::HashBackfill backfill(database);
+	std::unique_ptr<SQLite3::sqlite3> other_connection = Arcollect::db::open();
+	other_connection->exec("BEGIN IMMEDIATE;");
+	backfill.list(1);
+	backfill.hash();
+	const bool busy_kept = backfill.write() == SQLITE_BUSY;
+	other_connection->exec("ROLLBACK;");
+	ok_nok(busy_kept && (backfill.write() == SQLITE_OK) && (backfill.written_count == 1)) << "Backfill batch is kept while the database is busy" << std::endl;
+	const std::size_t backfilled = backfill.run();
+	ok_nok((backfilled == 1) && (stored_hash(100) == static_cast<sqlite3_int64>(XXH64_CTX::hash(other_content)))) << "Backfill hashes existing downloads" << std::endl;
+	ok_nok(!stored_hash(101)) << "Missing files are left without hash" << std::endl;
+}
@@ -0,0 +1,205 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2021 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "arcollect-db-open.hpp"
+#include "arcollect-db-downloads.hpp"
+#include "arcollect-paths.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace Arcollect::db::downloads;
+
+static int test_num = 1;
+static decltype(std::cout)& ok_nok(bool result)
+{
+	return std::cout << (result ? "ok " : "not ok ") << test_num++ << " - ";
+}
+
+static std::unique_ptr<SQLite3::sqlite3> database;
+static const std::filesystem::path test_dir("test");
+static constexpr int flat_count = 300;
+
+/** Add a download like older Arcollect did
+ */
+static void add_download(sqlite3_int64 dwn_id, const std::filesystem::path &dwn_path, bool with_file = true)
+{
+	if (with_file) {
+		std::filesystem::create_directories((Arcollect::path::arco_data_home/dwn_path).parent_path());
+		std::ofstream(Arcollect::path::arco_data_home/dwn_path) << dwn_path.string();
+	}
+	std::unique_ptr<SQLite3::stmt> stmt;
+	database->prepare("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_lastedit) VALUES (?,?,'image/png',0);",stmt);
+	const std::string path_string = dwn_path.string();
+	stmt->bind(1,dwn_id);
+	stmt->bind(2,path_string);
+	stmt->step();
+}
+static std::filesystem::path stored_path(sqlite3_int64 dwn_id)
+{
+	std::unique_ptr<SQLite3::stmt> stmt;
+	database->prepare("SELECT dwn_path FROM downloads WHERE dwn_id = ?;",stmt);
+	stmt->bind(1,dwn_id);
+	return stmt->step() == SQLITE_ROW ? std::filesystem::path(stmt->column_string(0)) : std::filesystem::path();
+}
+/** Check that a download has been moved with its content
+ */
+static bool is_migrated(sqlite3_int64 dwn_id, const std::filesystem::path &old_path)
+{
+	const std::filesystem::path dwn_path = stored_path(dwn_id);
+	std::string content;
+	std::ifstream(Arcollect::path::arco_data_home/dwn_path) >> content;
+	return is_sharded(dwn_path) && (content == old_path.string()) && !std::filesystem::exists(Arcollect::path::arco_data_home/old_path);
+}
+static std::filesystem::path flat_path(int i)
+{
+	return test_dir/("flat-"+std::to_string(i)+".png");
+}
+
+int main(void)
+{
+	std::cout << "TAP version 13\n1..14" << std::endl;
+	database = Arcollect::db::test_open();
+	std::filesystem::remove_all(Arcollect::path::arco_data_home/test_dir);
+	std::filesystem::remove(Arcollect::path::arco_data_home/ShardMigration::journal_path);
+	
+	// 1. New downloads are sharded
+	DownloadInfo infos;
+	infos.dwn_lastedit = 0;
+	infos.set_dwn_path(test_dir,"new.png");
+	Transaction cache(database);
+	const std::string error = cache.write_cache("",std::string_view("image/png"),infos);
+	ok_nok(error.empty() && is_sharded(infos.dwn_path()) && (infos.dwn_path() == shard_path(test_dir,"new.png")) && std::ofstream(Arcollect::path::arco_data_home/infos.dwn_path())) << "New downloads are written in a shard " << error << std::endl;
+	std::filesystem::remove(Arcollect::path::arco_data_home/infos.dwn_path());
+	database->exec("DELETE FROM downloads;");
+	
+	// Make a flat collection
+	for (int i = 1; i <= flat_count; i++)
+		add_download(i,flat_path(i));
+	add_download(1000,test_dir/"missing.png",false);
+	// A new download already use the shard path of this one
+	add_download(1001,test_dir/"conflict.png");
+	add_download(1002,shard_path(test_dir,"conflict.png"));
+	ok_nok(!check_consistency(database,{test_dir}).empty()) << "Missing files are reported" << std::endl;
+	database->exec("DELETE FROM downloads WHERE dwn_id = 1000;");
+	
+	// 2. Migrate by batches, skipping one download like in-use ones
+	ShardMigration migration(database);
+	migration.can_move = [](sqlite3_int64 dwn_id) {
+		return dwn_id != 42;
+	};
+	std::size_t moved_notifications = 0;
+	migration.moved = [&](sqlite3_int64 dwn_id, const std::filesystem::path &dwn_path) {
+		moved_notifications += stored_path(dwn_id) == dwn_path;
+	};
+	int steps = 0;
+	while (migration.step())
+		steps++;
+	bool all_migrated = true;
+	for (int i = 1; i <= flat_count; i++)
+		if (i != 42)
+			all_migrated &= is_migrated(i,flat_path(i));
+	// All flat downloads but #42, plus the conflicting one
+	ok_nok(all_migrated && (steps >= flat_count/static_cast<int>(ShardMigration::default_batch_size)) && (migration.moved_count == flat_count) && (moved_notifications == flat_count)) << "Downloads are migrated by batches (" << steps << " steps, " << migration.moved_count << " moved)" << std::endl;
+	ok_nok(is_migrated(1001,test_dir/"conflict.png") && (stored_path(1001) != shard_path(test_dir,"conflict.png")) && (stored_path(1002) == shard_path(test_dir,"conflict.png"))) << "Conflicting paths are renamed" << std::endl;
+	ok_nok((stored_path(42) == flat_path(42)) && (migration.skipped_count == 1)) << "Refused downloads are skipped" << std::endl;
+	
+	// 3. A later migration resume the work
+	ShardMigration resume(database);
+	while (resume.step());
+	ok_nok(is_migrated(42,flat_path(42)) && (resume.moved_count == 1) && check_consistency(database,{test_dir}).empty()) << "Migration is resumable" << std::endl;
+	
+	// 4. Crash after renaming files but before the commit
+	add_download(2000,test_dir/"crash-moved.png");
+	add_download(2001,test_dir/"crash-pending.png");
+	{
+		std::ofstream journal(Arcollect::path::arco_data_home/ShardMigration::journal_path);
+		for (sqlite3_int64 dwn_id: {2000,2001})
+			journal << dwn_id << '\t' << stored_path(dwn_id).string() << '\t' << shard_path(test_dir,stored_path(dwn_id).filename()).string() << '\t' << stored_path(dwn_id).string().size() << '\n';
+	}
+	std::filesystem::create_directories((Arcollect::path::arco_data_home/shard_path(test_dir,"crash-moved.png")).parent_path());
+	std::filesystem::rename(Arcollect::path::arco_data_home/test_dir/"crash-moved.png",Arcollect::path::arco_data_home/shard_path(test_dir,"crash-moved.png"));
+	const std::vector<std::string> crash_problems = check_consistency(database,{test_dir});
+	ok_nok(crash_problems.size() == 3) << "Interrupted migration is detected" << std::endl;
+	for (const std::string &problem: crash_problems)
+		std::cout << "# " << problem << std::endl;
+	ShardMigration recovery(database);
+	recovery.step();
+	const std::vector<std::string> problems = check_consistency(database,{test_dir});
+	ok_nok(problems.empty() && is_migrated(2000,test_dir/"crash-moved.png") && is_migrated(2001,test_dir/"crash-pending.png")) << "Interrupted migration is rolled forward" << std::endl;
+	for (const std::string &problem: problems)
+		std::cout << "# " << problem << std::endl;
+	
+	// 5. Files left by an interrupted migration are never overwritten
+	add_download(3000,test_dir/"lost.png");
+	{
+		std::ofstream journal(Arcollect::path::arco_data_home/ShardMigration::journal_path);
+		journal << 3000 << '\t' << stored_path(3000).string() << '\t' << shard_path(test_dir,"lost.png").string() << '\t' << stored_path(3000).string().size() << '\n';
+	}
+	std::filesystem::create_directories((Arcollect::path::arco_data_home/shard_path(test_dir,"lost.png")).parent_path());
+	std::filesystem::rename(Arcollect::path::arco_data_home/test_dir/"lost.png",Arcollect::path::arco_data_home/shard_path(test_dir,"lost.png"));
+	DownloadInfo overwriter;
+	overwriter.dwn_lastedit = 0;
+	overwriter.set_dwn_path(test_dir,"lost.png");
+	Transaction overwriter_cache(database);
+	const std::string overwriter_error = overwriter_cache.write_cache("",std::string_view("image/png"),overwriter);
+	overwriter_cache.commit();
+	ok_nok(overwriter_error.empty() && (overwriter.dwn_path() != shard_path(test_dir,"lost.png")) && std::filesystem::exists(Arcollect::path::arco_data_home/shard_path(test_dir,"lost.png"))) << "New downloads do not overwrite existing files " << overwriter_error << std::endl;
+	// Pretend that the moved file was replaced by another one
+	std::ofstream(Arcollect::path::arco_data_home/shard_path(test_dir,"lost.png")) << "not the lost file";
+	ShardMigration suspicious(database);
+	suspicious.step();
+	ok_nok((stored_path(3000) == test_dir/"lost.png") && !std::filesystem::exists(Arcollect::path::arco_data_home/ShardMigration::journal_path)) << "Unexpected files are not trusted when rolling forward" << std::endl;
+	database->exec("DELETE FROM downloads WHERE dwn_id = 3000;");
+	std::filesystem::remove(Arcollect::path::arco_data_home/shard_path(test_dir,"lost.png"));
+	database->exec(("DELETE FROM downloads WHERE dwn_path = '"+overwriter.dwn_path().string()+"';").c_str());
+	
+	// 6. Shared files are moved for all their downloads
+	add_download(4000,test_dir/"shared.png");
+	add_download(4001,test_dir/"shared.png");
+	ShardMigration shared(database);
+	while (shared.step());
+	ok_nok(is_migrated(4000,test_dir/"shared.png") && (stored_path(4001) == stored_path(4000)) && (shared.moved_count == 2)) << "Shared files are moved once for all downloads" << std::endl;
+	
+	// 7. Files are moved back when the transaction fails
+	add_download(5000,test_dir/"rollback.png");
+	database->exec("CREATE TEMP TRIGGER fail_set_path BEFORE UPDATE OF dwn_path ON downloads BEGIN SELECT RAISE(ABORT,'Test failure'); END;");
+	ShardMigration failing(database);
+	while (failing.step());
+	database->exec("DROP TRIGGER fail_set_path;");
+	ok_nok(!failing.moved_count && (stored_path(5000) == test_dir/"rollback.png") && std::filesystem::exists(Arcollect::path::arco_data_home/test_dir/"rollback.png") && !std::filesystem::exists(Arcollect::path::arco_data_home/shard_path(test_dir,"rollback.png")) && !std::filesystem::exists(Arcollect::path::arco_data_home/ShardMigration::journal_path)) << "Failed transactions move files back" << std::endl;
+	
+	// 8. Moves failing in a batch are retried in the same pass
+	add_download(6000,test_dir/"late.png");
+	add_download(6001,test_dir/"blocker.png");
+	const std::filesystem::path late_blocker = Arcollect::path::arco_data_home/shard_path(test_dir,"late.png");
+	ShardMigration retry(database);
+	retry.can_move = [&](sqlite3_int64 dwn_id) {
+		// Take the target of #6000 after it has been planned
+		if (dwn_id == 6001) {
+			std::filesystem::create_directories(late_blocker.parent_path());
+			std::ofstream(late_blocker) << "blocker";
+		}
+		return true;
+	};
+	while (retry.step());
+	ok_nok(is_migrated(5000,test_dir/"rollback.png") && is_migrated(6000,test_dir/"late.png") && (stored_path(6000) != shard_path(test_dir,"late.png")) && (retry.moved_count == 3) && !retry.skipped_count) << "Failed moves are retried in the same pass" << std::endl;
+	std::filesystem::remove(late_blocker);
+	
+	// 9. Nothing left
+	ShardMigration noop(database);
+	while (noop.step());
+	ok_nok(!noop.moved_count && !noop.skipped_count) << "Migrated collection is left untouched" << std::endl;
+}
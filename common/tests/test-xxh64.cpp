@@ -0,0 +1,56 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2021 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "../xxh64.hpp"
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+static constexpr std::pair<XXH64_CTX::DIGEST,std::string_view> xxh64s[] = {
+	{0xef46db3751d8e999,""},
+	{0xd24ec4f1a98c6e5b,"a"},
+	{0x44bc2cf5ad770999,"abc"},
+	{0x79c0848d4bf94277,"Arcollect"},
+};
+
+static constexpr auto xxh64_n = sizeof(xxh64s)/sizeof(xxh64s)[0];
+
+int main(void)
+{
+	std::cout << "TAP version 13\n1.." << xxh64_n+1 << std::endl;
+	unsigned int i = 0;
+	for (const std::pair<XXH64_CTX::DIGEST,std::string_view> &xxh64: xxh64s) {
+		if (xxh64.first != XXH64_CTX::hash(xxh64.second))
+			std::cout << "not ";
+		std::cout << "ok " << ++i << " - " << std::hex << xxh64.first << std::dec << " = xxh64(\"" << xxh64.second << "\")" << std::endl;
+	}
+	// Streaming must not depend on how data is split
+	std::string data;
+	for (unsigned int c = 0; c < 1000; c++)
+		data += static_cast<char>(c*7);
+	const XXH64_CTX::DIGEST oneshot = XXH64_CTX::hash(data);
+	bool chunked_ok = true;
+	for (std::size_t chunk = 1; chunk <= 65; chunk++) {
+		XXH64_CTX ctx;
+		for (std::size_t pos = 0; pos < data.size(); pos += chunk)
+			ctx.Update(std::string_view(data).substr(pos,chunk));
+		chunked_ok &= ctx.Final() == oneshot;
+	}
+	if (!chunked_ok)
+		std::cout << "not ";
+	std::cout << "ok " << ++i << " - Chunked updates match a one-shot hash" << std::endl;
+}
@@ -0,0 +1,124 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "xxh64.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+static constexpr std::uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr std::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr std::uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static constexpr std::uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr std::uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline std::uint64_t rotl(std::uint64_t value, int count)
+{
+	return (value << count) | (value >> (64 - count));
+}
+/** Read a little-endian integer
+ */
+template <typename T>
+static inline T read_le(const unsigned char *data)
+{
+	if constexpr (std::endian::native == std::endian::little) {
+		T result;
+		std::memcpy(&result,data,sizeof(result));
+		return result;
+	} else {
+		T result = 0;
+		for (unsigned int i = 0; i < sizeof(T); i++)
+			result |= static_cast<T>(data[i]) << (8*i);
+		return result;
+	}
+}
+static inline std::uint64_t xxh64_round(std::uint64_t acc, std::uint64_t lane)
+{
+	return rotl(acc + lane * PRIME64_2,31) * PRIME64_1;
+}
+static inline std::uint64_t merge_accumulator(std::uint64_t acc, std::uint64_t lane_acc)
+{
+	return (acc ^ xxh64_round(0,lane_acc)) * PRIME64_1 + PRIME64_4;
+}
+/** Process 32 bytes stripes
+ * \return The number of bytes processed
+ */
+static inline std::size_t process_stripes(std::uint64_t (&acc)[4], const unsigned char *data, std::size_t size)
+{
+	// Local copies let the compiler keep the 4 lanes in registers
+	std::uint64_t acc0 = acc[0], acc1 = acc[1], acc2 = acc[2], acc3 = acc[3];
+	const unsigned char *const begin = data;
+	for (const unsigned char *const end = data + (size & ~static_cast<std::size_t>(31)); data != end; data += 32) {
+		acc0 = xxh64_round(acc0,read_le<std::uint64_t>(data+ 0));
+		acc1 = xxh64_round(acc1,read_le<std::uint64_t>(data+ 8));
+		acc2 = xxh64_round(acc2,read_le<std::uint64_t>(data+16));
+		acc3 = xxh64_round(acc3,read_le<std::uint64_t>(data+24));
+	}
+	acc[0] = acc0; acc[1] = acc1; acc[2] = acc2; acc[3] = acc3;
+	return data - begin;
+}
+
+XXH64_CTX::XXH64_CTX(void)
+: acc{PRIME64_1 + PRIME64_2, PRIME64_2, 0, -PRIME64_1}
+{
+}
+void XXH64_CTX::Update(const void *data, std::size_t size)
+{
+	const unsigned char *input = static_cast<const unsigned char*>(data);
+	const std::size_t buffered = total_size % sizeof(buffer);
+	total_size += size;
+	// Complete the buffer
+	if (buffered) {
+		const std::size_t fill = std::min(size,sizeof(buffer)-buffered);
+		std::memcpy(buffer+buffered,input,fill);
+		input += fill;
+		size  -= fill;
+		if (buffered + fill < sizeof(buffer))
+			return;
+		process_stripes(acc,buffer,sizeof(buffer));
+	}
+	// Process stripes and buffer the rest
+	const std::size_t processed = process_stripes(acc,input,size);
+	std::memcpy(buffer,input+processed,size-processed);
+}
+XXH64_CTX::DIGEST XXH64_CTX::Final(void) const
+{
+	std::uint64_t hash;
+	if (total_size >= sizeof(buffer)) {
+		hash = rotl(acc[0],1) + rotl(acc[1],7) + rotl(acc[2],12) + rotl(acc[3],18);
+		for (std::uint64_t lane_acc: acc)
+			hash = merge_accumulator(hash,lane_acc);
+	} else hash = PRIME64_5;
+	hash += total_size;
+	// Consume remaining input
+	const unsigned char *data = buffer;
+	const unsigned char *const end = buffer + total_size % sizeof(buffer);
+	for (; end - data >= 8; data += 8)
+		hash = rotl(hash ^ xxh64_round(0,read_le<std::uint64_t>(data)),27) * PRIME64_1 + PRIME64_4;
+	if (end - data >= 4) {
+		hash = rotl(hash ^ (read_le<std::uint32_t>(data) * PRIME64_1),23) * PRIME64_2 + PRIME64_3;
+		data += 4;
+	}
+	for (; data != end; data++)
+		hash = rotl(hash ^ (*data * PRIME64_5),11) * PRIME64_1;
+	// Avalanche
+	hash ^= hash >> 33;
+	hash *= PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
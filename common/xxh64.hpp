@@ -0,0 +1,54 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file xxh64.hpp
+ *  \brief XXH64 non-cryptographic hash
+ *
+ * A streaming implementation of the [XXH64](https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md)
+ * algorithm with a seed of 0. It is used to find duplicated downloads, it runs
+ * at several GB/s which is way faster than the network or the disk.
+ *
+ * The API mimics MD5_CTX.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+struct XXH64_CTX {
+	using DIGEST = std::uint64_t;
+	std::uint64_t acc[4];
+	std::uint64_t total_size = 0;
+	/** Input not processed yet
+	 *
+	 * XXH64 process 32 bytes stripes, the rest is kept here.
+	 */
+	unsigned char buffer[32];
+	XXH64_CTX(void);
+	void Update(const void *data, std::size_t size);
+	template <typename StringViewLike>
+	void Update(const StringViewLike& data) {
+		return Update(data.data(),data.size()*sizeof(typename StringViewLike::value_type));
+	}
+	template <typename T>
+	XXH64_CTX operator<<(const T& data) {
+		Update(data);
+		return *this;
+	}
+	DIGEST Final(void) const;
+	template <typename ...Args>
+	static DIGEST hash(Args... args) {
+		return (XXH64_CTX() << ... << args).Final();
+	}
+};
@@ -0,0 +1,112 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "file-source.hpp"
+#include <config.h>
+#if WITH_XDG
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+bool Arcollect::art_reader::file_source::open(const std::filesystem::path &path)
+{
+	close();
+	#if WITH_XDG
+	const int fd = ::open(path.c_str(),O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	struct stat file_stat;
+	if (fstat(fd,&file_stat)) {
+		::close(fd);
+		return false;
+	}
+	const std::size_t size = file_stat.st_size;
+	// Map large files
+	if (size >= mmap_min_size) {
+		void* mapping = mmap(NULL,size,PROT_READ,MAP_PRIVATE,fd,0);
+		if (mapping != MAP_FAILED) {
+			::close(fd);
+			madvise(mapping,size,MADV_SEQUENTIAL);
+			contents = std::string_view(static_cast<const char*>(mapping),size);
+			mapped = true;
+			return true;
+		}
+	}
+	// Read small files at once
+	buffer.reset(new char[size]);
+	std::size_t read_size = 0;
+	while (read_size < size) {
+		const ssize_t result = ::read(fd,&buffer[read_size],size-read_size);
+		if (result > 0)
+			read_size += result;
+		else if ((result == 0) || (errno != EINTR))
+			break;
+	}
+	::close(fd);
+	contents = std::string_view(buffer.get(),read_size);
+	#else
+	std::ifstream stream(path,std::ios::binary|std::ios::ate);
+	if (!stream)
+		return false;
+	const std::size_t size = stream.tellg();
+	stream.seekg(0);
+	buffer.reset(new char[size]);
+	stream.read(buffer.get(),size);
+	contents = std::string_view(buffer.get(),stream.gcount());
+	#endif
+	return true;
+}
+void Arcollect::art_reader::file_source::close(void)
+{
+	proxy.reset();
+	#if WITH_XDG
+	if (mapped)
+		munmap(const_cast<char*>(contents.data()),contents.size());
+	#endif
+	mapped = false;
+	buffer.reset();
+	contents = std::string_view();
+}
+/** OIIO configuration to open images
+ *
+ * Keep straight alpha like native decoders do, as expected by SDL blending.
+ */
+static const OIIO::ImageSpec &open_config(void)
+{
+	static const OIIO::ImageSpec config = []() {
+		OIIO::ImageSpec config;
+		config.attribute("oiio:UnassociatedAlpha",1);
+		return config;
+	}();
+	return config;
+}
+OIIO::ImageInput::unique_ptr Arcollect::art_reader::file_source::open_image(const std::filesystem::path &path)
+{
+	if (*this) {
+		proxy.reset(new OIIO::Filesystem::IOMemReader(const_cast<char*>(contents.data()),contents.size()));
+		OIIO::ImageInput::unique_ptr image = OIIO::ImageInput::open(path.string(),&open_config(),proxy.get());
+		if (image)
+			return image;
+		proxy.reset();
+	}
+	// Fallback to OIIO own I/O
+	return OIIO::ImageInput::open(path.native(),&open_config());
+}
@@ -0,0 +1,94 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file file-source.hpp
+ *  \brief Artwork files access (#Arcollect::art_reader::file_source)
+ */
+#pragma once
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/filesystem.h>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+namespace Arcollect {
+	namespace art_reader {
+		/** Read-only content of a file
+		 *
+		 * Art readers use this instead of stream I/O that perform many small
+		 * `read()` calls per file. Small files, like thumbnails, are read with
+		 * one `read()`. Large files are memory-mapped with `MADV_SEQUENTIAL` so
+		 * the kernel reads ahead aggressively.
+		 *
+		 * On platforms without `mmap()`, the file is read in a buffer.
+		 */
+		class file_source {
+			private:
+				std::string_view contents;
+				std::unique_ptr<char[]> buffer;
+				bool mapped = false;
+				std::unique_ptr<OIIO::Filesystem::IOProxy> proxy;
+			public:
+				/** Minimum file size to use `mmap()`
+				 *
+				 * Mapping costs more than reading small files.
+				 */
+				static constexpr std::size_t mmap_min_size = 256*1024;
+				file_source(void) = default;
+				file_source(const file_source&) = delete;
+				file_source &operator=(const file_source&) = delete;
+				/** Open a file
+				 * \param path of the file
+				 *
+				 * Check for success with `operator bool()`.
+				 */
+				file_source(const std::filesystem::path &path) {
+					open(path);
+				}
+				~file_source(void) {
+					close();
+				}
+				/** Open a file
+				 * \param path of the file
+				 * \return true on success
+				 *
+				 * The previous file is closed.
+				 */
+				bool open(const std::filesystem::path &path);
+				/** Close the file
+				 *
+				 * Images opened with open_image() must be destroyed before.
+				 */
+				void close(void);
+				/** File content
+				 */
+				std::string_view data(void) const {
+					return contents;
+				}
+				explicit operator bool(void) const {
+					return mapped || buffer;
+				}
+				/** Open an image with OIIO reading from this file
+				 * \param path of the file, used to find the format
+				 * \return The image or NULL on failure
+				 *
+				 * The file must stay open while the image is in use. Formats that
+				 * don't support OIIO::Filesystem::IOProxy are opened directly.
+				 * Alpha is kept straight like load_native() does.
+				 */
+				OIIO::ImageInput::unique_ptr open_image(const std::filesystem::path &path);
+		};
+	}
+}
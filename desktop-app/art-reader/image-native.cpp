@@ -0,0 +1,303 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file image-native.cpp
+ *  \brief Native decoders for common formats
+ *
+ * Most artworks are JPEG, PNG or WebP. These are decoded with their own
+ * libraries directly into the surface rows, skipping OIIO plugins lookup and
+ * the conversion copy. The ICC profile is extracted while decoding. Files
+ * are decoded from memory through an #Arcollect::art_reader::file_source.
+ *
+ * Decoders are optional and enabled by the build system when the library is
+ * found. Unsupported variants (CMYK JPEG, animated WebP, ...) are left to
+ * OIIO.
+ *
+ * \warning libjpeg and libpng report errors with `longjmp()`, don't put
+ *          objects with destructors in these decoders.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "image.hpp"
+#include "file-source.hpp"
+#include <algorithm>
+#include <cmath>
+#include <csetjmp>
+#include <cstdlib>
+#include <cstring>
+#if WITH_LIBJPEG
+#include <jpeglib.h>
+#endif
+#if WITH_LIBPNG
+#include <png.h>
+#endif
+#if WITH_LIBWEBP
+#include <webp/decode.h>
+#include <webp/demux.h>
+#endif
+
+using Arcollect::art_reader::cancel_function;
+
+/** Store an ICC profile in a spec like OIIO does
+ */
+static void set_icc_profile(OIIO::ImageSpec &spec, const void* data, std::size_t size)
+{
+	if (size)
+		spec.attribute("ICCProfile",OIIO::TypeDesc(OIIO::TypeDesc::UINT8,size),data);
+}
+
+#if WITH_LIBJPEG
+struct jpeg_error_handler {
+	jpeg_error_mgr pub;
+	std::jmp_buf jump;
+};
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+	std::longjmp(reinterpret_cast<jpeg_error_handler*>(cinfo->err)->jump,1);
+}
+static void jpeg_output_message(j_common_ptr cinfo)
+{
+	// Silence, OIIO report errors on fallback
+}
+static SDL::Surface* load_jpeg(std::string_view data, OIIO::ImageSpec &spec, const cancel_function &cancelled)
+{
+	jpeg_decompress_struct cinfo;
+	jpeg_error_handler error;
+	cinfo.err = jpeg_std_error(&error.pub);
+	error.pub.error_exit = jpeg_error_exit;
+	error.pub.output_message = jpeg_output_message;
+	SDL::Surface* volatile surface = NULL;
+	if (setjmp(error.jump)) {
+		jpeg_destroy_decompress(&cinfo);
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo,reinterpret_cast<const unsigned char*>(data.data()),data.size());
+	jpeg_save_markers(&cinfo,JPEG_APP0+2,0xFFFF);
+	jpeg_read_header(&cinfo,TRUE);
+	// CMYK and exotic color-spaces are left to OIIO
+	if ((cinfo.jpeg_color_space != JCS_YCbCr) && (cinfo.jpeg_color_space != JCS_RGB) && (cinfo.jpeg_color_space != JCS_GRAYSCALE)) {
+		jpeg_destroy_decompress(&cinfo);
+		return NULL;
+	}
+	cinfo.out_color_space = JCS_RGB;
+	jpeg_start_decompress(&cinfo);
+	spec = OIIO::ImageSpec(cinfo.output_width,cinfo.output_height,3,OIIO::TypeDesc::UINT8);
+	#if defined(LIBJPEG_TURBO_VERSION_NUMBER) && (LIBJPEG_TURBO_VERSION_NUMBER >= 2000000)
+	JOCTET* icc_data;
+	unsigned int icc_size;
+	if (jpeg_read_icc_profile(&cinfo,&icc_data,&icc_size)) {
+		set_icc_profile(spec,icc_data,icc_size);
+		free(icc_data);
+	}
+	#else
+	// No ICC profile reader, let OIIO handle images with a profile
+	for (jpeg_saved_marker_ptr marker = cinfo.marker_list; marker; marker = marker->next)
+		if ((marker->marker == JPEG_APP0+2) && (marker->data_length >= 12) && !std::memcmp(marker->data,"ICC_PROFILE",12)) {
+			jpeg_destroy_decompress(&cinfo);
+			return NULL;
+		}
+	#endif
+	surface = reinterpret_cast<SDL::Surface*>(SDL_CreateRGBSurfaceWithFormat(0,cinfo.output_width,cinfo.output_height,24,SDL_PIXELFORMAT_RGB24));
+	if (!surface) {
+		jpeg_destroy_decompress(&cinfo);
+		return NULL;
+	}
+	// Decode in the surface by chunks
+	const int chunk_rows = std::max(1,Arcollect::art_reader::load_chunk_size/surface->pitch);
+	JDIMENSION next_check = 0;
+	JSAMPROW rows[16];
+	while (cinfo.output_scanline < cinfo.output_height) {
+		if (cinfo.output_scanline >= next_check) {
+			next_check += chunk_rows;
+			if (cancelled && cancelled())
+				std::longjmp(error.jump,1);
+		}
+		const JDIMENSION rows_count = std::min<JDIMENSION>(sizeof(rows)/sizeof(rows[0]),cinfo.output_height-cinfo.output_scanline);
+		for (JDIMENSION i = 0; i < rows_count; i++)
+			rows[i] = static_cast<JSAMPROW>(surface->pixels) + (cinfo.output_scanline+i)*surface->pitch;
+		jpeg_read_scanlines(&cinfo,rows,rows_count);
+	}
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+	return surface;
+}
+#endif
+
+#if WITH_LIBPNG
+static void png_error_silent(png_structp png, png_const_charp message)
+{
+	png_longjmp(png,1);
+}
+static void png_warning_silent(png_structp png, png_const_charp message)
+{
+}
+/** In-memory PNG reader position
+ */
+struct png_memory_reader {
+	const char* data;
+	std::size_t size;
+};
+static void png_read_memory(png_structp png, png_bytep out, std::size_t length)
+{
+	png_memory_reader &reader = *static_cast<png_memory_reader*>(png_get_io_ptr(png));
+	if (length > reader.size)
+		png_error(png,"Truncated file");
+	std::memcpy(out,reader.data,length);
+	reader.data += length;
+	reader.size -= length;
+}
+static SDL::Surface* load_png(std::string_view data, OIIO::ImageSpec &spec, const cancel_function &cancelled)
+{
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING,NULL,png_error_silent,png_warning_silent);
+	if (!png)
+		return NULL;
+	png_infop info = png_create_info_struct(png);
+	if (!info) {
+		png_destroy_read_struct(&png,NULL,NULL);
+		return NULL;
+	}
+	SDL::Surface* volatile surface = NULL;
+	if (setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png,&info,NULL);
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	png_memory_reader reader = {data.data(),data.size()};
+	png_set_read_fn(png,&reader,png_read_memory);
+	png_read_info(png,info);
+	// Convert everything to 8 bits RGB or RGBA
+	png_set_expand(png);
+	#ifdef PNG_READ_SCALE_16_TO_8_SUPPORTED
+	png_set_scale_16(png);
+	#else
+	png_set_strip_16(png);
+	#endif
+	png_set_gray_to_rgb(png);
+	const int passes = png_set_interlace_handling(png);
+	png_read_update_info(png,info);
+	const int width = png_get_image_width(png,info);
+	const int height = png_get_image_height(png,info);
+	const int channels = png_get_channels(png,info);
+	spec = OIIO::ImageSpec(width,height,channels,OIIO::TypeDesc::UINT8);
+	png_charp icc_name;
+	int icc_compression;
+	png_bytep icc_data;
+	png_uint_32 icc_size;
+	if (png_get_iCCP(png,info,&icc_name,&icc_compression,&icc_data,&icc_size))
+		set_icc_profile(spec,icc_data,icc_size);
+	double gamma;
+	if (png_get_gAMA(png,info,&gamma) && (std::abs(gamma-1.0) < 0.01))
+		spec.attribute("oiio:ColorSpace","Linear");
+	surface = reinterpret_cast<SDL::Surface*>(channels == 4 ?
+		SDL_CreateRGBSurfaceWithFormat(0,width,height,32,SDL_PIXELFORMAT_ABGR8888) :
+		SDL_CreateRGBSurfaceWithFormat(0,width,height,24,SDL_PIXELFORMAT_RGB24));
+	if (!surface) {
+		png_destroy_read_struct(&png,&info,NULL);
+		return NULL;
+	}
+	// Decode in the surface by chunks, once per interlacing pass
+	const int chunk_rows = std::max(1,Arcollect::art_reader::load_chunk_size/surface->pitch);
+	png_bytep rows[16];
+	for (int pass = 0; pass < passes; pass++)
+		for (int y = 0, next_check = 0; y < height;) {
+			if (y >= next_check) {
+				next_check += chunk_rows;
+				if (cancelled && cancelled())
+					png_longjmp(png,1);
+			}
+			const int rows_count = std::min<int>(sizeof(rows)/sizeof(rows[0]),height-y);
+			for (int i = 0; i < rows_count; i++)
+				rows[i] = static_cast<png_bytep>(surface->pixels) + (y+i)*surface->pitch;
+			png_read_rows(png,rows,NULL,rows_count);
+			y += rows_count;
+		}
+	png_read_end(png,NULL);
+	png_destroy_read_struct(&png,&info,NULL);
+	return surface;
+}
+#endif
+
+#if WITH_LIBWEBP
+/** Compressed bytes fed to WebP decoder between cancellation checks
+ */
+static constexpr std::size_t webp_chunk_size = 64*1024;
+static SDL::Surface* load_webp(std::string_view file, OIIO::ImageSpec &spec, const cancel_function &cancelled)
+{
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(file.data());
+	const std::size_t size = file.size();
+	// Animations are left to OIIO
+	WebPBitstreamFeatures features;
+	if ((WebPGetFeatures(data,size,&features) != VP8_STATUS_OK) || features.has_animation)
+		return NULL;
+	const int channels = features.has_alpha ? 4 : 3;
+	spec = OIIO::ImageSpec(features.width,features.height,channels,OIIO::TypeDesc::UINT8);
+	// Get the ICC profile
+	const WebPData webp_data = {data,size};
+	WebPDemuxer* demuxer = WebPDemux(&webp_data);
+	if (demuxer) {
+		WebPChunkIterator chunk;
+		if ((WebPDemuxGetI(demuxer,WEBP_FF_FORMAT_FLAGS) & ICCP_FLAG) && WebPDemuxGetChunk(demuxer,"ICCP",1,&chunk)) {
+			set_icc_profile(spec,chunk.chunk.bytes,chunk.chunk.size);
+			WebPDemuxReleaseChunkIterator(&chunk);
+		}
+		WebPDemuxDelete(demuxer);
+	}
+	SDL::Surface* surface = reinterpret_cast<SDL::Surface*>(channels == 4 ?
+		SDL_CreateRGBSurfaceWithFormat(0,features.width,features.height,32,SDL_PIXELFORMAT_ABGR8888) :
+		SDL_CreateRGBSurfaceWithFormat(0,features.width,features.height,24,SDL_PIXELFORMAT_RGB24));
+	if (!surface)
+		return NULL;
+	// Decode in the surface, feeding the decoder by chunks
+	WebPIDecoder* decoder = WebPINewRGB(channels == 4 ? MODE_RGBA : MODE_RGB,static_cast<uint8_t*>(surface->pixels),static_cast<std::size_t>(surface->pitch)*surface->h,surface->pitch);
+	if (!decoder) {
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	VP8StatusCode status = VP8_STATUS_SUSPENDED;
+	for (std::size_t fed = 0; (status == VP8_STATUS_SUSPENDED) && (fed < size);) {
+		if (cancelled && cancelled())
+			break;
+		fed = std::min(fed+webp_chunk_size,size);
+		status = WebPIUpdate(decoder,data,fed);
+	}
+	WebPIDelete(decoder);
+	if (status != VP8_STATUS_OK) {
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	return surface;
+}
+#endif
+
+SDL::Surface* Arcollect::art_reader::load_native(const file_source &file, OIIO::ImageSpec &spec, const cancel_function &cancelled)
+{
+	const std::string_view data = file.data();
+	SDL::Surface* surface = NULL;
+	#if WITH_LIBJPEG
+	if ((data.size() >= 3) && !std::memcmp(data.data(),"\xFF\xD8\xFF",3))
+		surface = load_jpeg(data,spec,cancelled);
+	#endif
+	#if WITH_LIBPNG
+	if ((data.size() >= 8) && !std::memcmp(data.data(),"\x89PNG\r\n\x1A\n",8))
+		surface = load_png(data,spec,cancelled);
+	#endif
+	#if WITH_LIBWEBP
+	if ((data.size() >= 12) && !std::memcmp(data.data(),"RIFF",4) && !std::memcmp(&data[8],"WEBP",4))
+		surface = load_webp(data,spec,cancelled);
+	#endif
+	return surface;
+}
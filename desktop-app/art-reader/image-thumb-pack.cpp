@@ -0,0 +1,380 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file desktop-app/art-reader/image-thumb-pack.cpp
+ *  \brief Arcollect private thumbnails pack
+ *
+ * The pack is an append-only file in `$XDG_CACHE_HOME/arcollect` that store
+ * #thumbnail_pack_size thumbnails decoded in the surface pixel format. It is
+ * memory-mapped and surfaces are created directly on mapped pages, a lookup
+ * cost no open(), no read() and no PNG inflation.
+ *
+ * The file start with a #pack_file_header followed by records. Each record is
+ * a #pack_record_header, the ICC profile, the `oiio:ColorSpace` string and the
+ * pixels. Records are aligned on #pack_alignment bytes. Records replaced or
+ * outdated are dead, they are dropped by a compaction when the pack is opened.
+ *
+ * XDG thumbnails are still written for interoperability.
+ * \note This is only implemented with `-DWITH_XDG'. Others platforms don't
+ *       have a pack.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "image.hpp"
+#include <arcollect-debug.hpp>
+#include <config.h>
+#include <iostream>
+#if WITH_XDG
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char pack_file_magic[16] = {'A','r','c','o','l','l','e','c','t','T','h','P','a','c','k','1'};
+static constexpr char pack_record_magic[4] = {'A','T','P','1'};
+static constexpr std::uint64_t pack_alignment = 64;
+/** Size of the address space reserved for the pack
+ *
+ * The mapping is never remapped so surfaces remain valid. Nothing is appended
+ * beyond this size.
+ */
+static constexpr std::uint64_t pack_max_size = sizeof(void*) >= 8 ? std::uint64_t(16) << 30 : std::uint64_t(256) << 20;
+/** Dead bytes tolerated before a compaction
+ *
+ * Compaction happens when there is more dead bytes than live bytes plus this.
+ */
+static constexpr std::uint64_t pack_compaction_slack = 16 << 20;
+
+struct pack_file_header {
+	char magic[sizeof(pack_file_magic)];
+	char reserved[pack_alignment-sizeof(pack_file_magic)];
+};
+struct pack_record_header {
+	char magic[sizeof(pack_record_magic)];
+	/** Record size including this header, a multiple of #pack_alignment
+	 */
+	std::uint32_t record_size;
+	/** The thumbnail_id, NUL padded
+	 */
+	char thumbnail_id[32];
+	/** Original modification time
+	 */
+	std::int64_t source_mtime;
+	std::uint32_t sdl_format;
+	std::uint16_t width;
+	std::uint16_t height;
+	std::uint32_t pitch;
+	std::uint32_t icc_profile_size;
+	std::uint32_t color_space_size;
+	/** Offset of pixels from the record start, a multiple of #pack_alignment
+	 */
+	std::uint32_t pixels_offset;
+};
+
+static std::uint64_t pack_align(std::uint64_t size)
+{
+	return (size + pack_alignment - 1) & ~(pack_alignment - 1);
+}
+
+/** Pack lock
+ *
+ * Guard all the `pack_*` variables below. Records themselves are immutable once
+ * written and can be read without the lock.
+ */
+static std::mutex pack_lock;
+static bool pack_opened = false;
+static int pack_fd = -1;
+static const char *pack_map = NULL;
+/** End of the last valid record
+ */
+static std::uint64_t pack_size = 0;
+static std::uint64_t pack_dead_bytes = 0;
+/** Map thumbnail_id to the offset of the record
+ */
+static std::unordered_map<std::string,std::uint64_t> pack_index;
+
+static const pack_record_header &pack_record(std::uint64_t offset)
+{
+	return *reinterpret_cast<const pack_record_header*>(&pack_map[offset]);
+}
+/** Check a record header
+ * \param offset of the record
+ * \param file_size of the pack
+ * \return true if the record is sane
+ */
+static bool pack_record_valid(std::uint64_t offset, std::uint64_t file_size)
+{
+	if (offset + sizeof(pack_record_header) > file_size)
+		return false;
+	const pack_record_header &record = pack_record(offset);
+	if (std::memcmp(record.magic,pack_record_magic,sizeof(pack_record_magic)))
+		return false;
+	if ((record.record_size % pack_alignment) || (offset + record.record_size > file_size))
+		return false;
+	int bpp;
+	switch (record.sdl_format) {
+		case SDL_PIXELFORMAT_ABGR8888:bpp = 4;break;
+		case SDL_PIXELFORMAT_RGB24:bpp = 3;break;
+		default:return false;
+	}
+	if (record.pitch != std::uint32_t(record.width*bpp))
+		return false;
+	if (sizeof(pack_record_header) + std::uint64_t(record.icc_profile_size) + record.color_space_size > record.pixels_offset)
+		return false;
+	return std::uint64_t(record.pixels_offset) + std::uint64_t(record.pitch)*record.height <= record.record_size;
+}
+/** Insert a record in the index
+ * \warning #pack_lock must be held.
+ */
+static void pack_index_set(std::uint64_t offset)
+{
+	const pack_record_header &record = pack_record(offset);
+	auto [iter, inserted] = pack_index.emplace(std::string(record.thumbnail_id,strnlen(record.thumbnail_id,sizeof(record.thumbnail_id))),offset);
+	if (!inserted) {
+		pack_dead_bytes += pack_record(iter->second).record_size;
+		iter->second = offset;
+	}
+}
+/** Map the pack and index records
+ * \return The end of the last valid record
+ * \warning #pack_lock must be held.
+ */
+static std::uint64_t pack_map_and_scan(void)
+{
+	pack_index.clear();
+	pack_dead_bytes = 0;
+	struct stat pack_stat;
+	if (fstat(pack_fd,&pack_stat))
+		return 0;
+	void* map = mmap(NULL,pack_max_size,PROT_READ,MAP_SHARED,pack_fd,0);
+	if (map == MAP_FAILED) {
+		pack_map = NULL;
+		return 0;
+	}
+	pack_map = static_cast<const char*>(map);
+	std::uint64_t offset = sizeof(pack_file_header);
+	const std::uint64_t file_size = std::min<std::uint64_t>(pack_stat.st_size,pack_max_size);
+	if ((file_size < offset) || std::memcmp(pack_map,pack_file_magic,sizeof(pack_file_magic)))
+		return 0;
+	while (pack_record_valid(offset,file_size)) {
+		pack_index_set(offset);
+		offset += pack_record(offset).record_size;
+	}
+	return offset;
+}
+/** Rewrite the pack without dead records
+ * \param pack_path of the pack
+ * \return true on success
+ * \warning #pack_lock must be held.
+ */
+static bool pack_compact(const std::filesystem::path &pack_path)
+{
+	std::filesystem::path compact_path(pack_path);
+	compact_path += ".compact";
+	int compact_fd = open(compact_path.c_str(),O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC,0600);
+	if (compact_fd < 0)
+		return false;
+	if (flock(compact_fd,LOCK_EX|LOCK_NB)) {
+		close(compact_fd);
+		return false;
+	}
+	// Copy the header and live records
+	bool success = pwrite(compact_fd,pack_map,sizeof(pack_file_header),0) == sizeof(pack_file_header);
+	std::uint64_t offset = sizeof(pack_file_header);
+	for (const auto& entry: pack_index) {
+		if (!success)
+			break;
+		const std::uint32_t record_size = pack_record(entry.second).record_size;
+		success = pwrite(compact_fd,&pack_map[entry.second],record_size,offset) == record_size;
+		offset += record_size;
+	}
+	if (success)
+		success = !fdatasync(compact_fd) && !rename(compact_path.c_str(),pack_path.c_str());
+	if (!success) {
+		unlink(compact_path.c_str());
+		close(compact_fd);
+		return false;
+	}
+	// Swap files
+	munmap(const_cast<char*>(pack_map),pack_max_size);
+	close(pack_fd);
+	pack_fd = compact_fd;
+	pack_size = pack_map_and_scan();
+	return true;
+}
+/** Open the pack if not done yet
+ * \return true if the pack is usable
+ * \warning #pack_lock must be held.
+ *
+ * Opening is done lazily by a loader thread. The pack is disabled if another
+ * process use it.
+ */
+static bool pack_open(void)
+{
+	if (pack_opened)
+		return pack_map != NULL;
+	pack_opened = true;
+	const std::filesystem::path pack_dir = Arcollect::art_reader::lookup_cache_root()/"arcollect";
+	const std::filesystem::path pack_path = pack_dir/"thumbnails.pack";
+	std::error_code ec;
+	std::filesystem::create_directories(pack_dir,ec);
+	pack_fd = open(pack_path.c_str(),O_RDWR|O_CREAT|O_CLOEXEC,0600);
+	if (pack_fd < 0) {
+		std::cerr << "Failed to open " << pack_path.string() << ": " << strerror(errno) << ". Thumbnails pack disabled." << std::endl;
+		return false;
+	}
+	if (flock(pack_fd,LOCK_EX|LOCK_NB)) {
+		if (Arcollect::debug.thumbnails)
+			std::cerr << pack_path.string() << " is used by another process. Thumbnails pack disabled." << std::endl;
+		close(pack_fd);
+		pack_fd = -1;
+		return false;
+	}
+	pack_size = pack_map_and_scan();
+	if (!pack_map) {
+		std::cerr << "Failed to mmap() " << pack_path.string() << ": " << strerror(errno) << ". Thumbnails pack disabled." << std::endl;
+		close(pack_fd);
+		pack_fd = -1;
+		return false;
+	}
+	if (!pack_size) {
+		// Reset the pack
+		pack_file_header header{};
+		std::memcpy(header.magic,pack_file_magic,sizeof(pack_file_magic));
+		if (ftruncate(pack_fd,0) || (pwrite(pack_fd,&header,sizeof(header),0) != sizeof(header))) {
+			std::cerr << "Failed to initialize " << pack_path.string() << ": " << strerror(errno) << ". Thumbnails pack disabled." << std::endl;
+			munmap(const_cast<char*>(pack_map),pack_max_size);
+			pack_map = NULL;
+			close(pack_fd);
+			pack_fd = -1;
+			return false;
+		}
+		pack_size = sizeof(header);
+	} else if (ftruncate(pack_fd,pack_size)) {
+		// Drop the corrupted tail, if any
+		std::cerr << "Failed to truncate " << pack_path.string() << ": " << strerror(errno) << std::endl;
+	}
+	// Compact the pack
+	if (pack_dead_bytes > pack_size - pack_dead_bytes + pack_compaction_slack) {
+		if (Arcollect::debug.thumbnails)
+			std::cerr << "Compacting " << pack_path.string() << " (" << pack_dead_bytes << "/" << pack_size << " bytes are dead)" << std::endl;
+		if (!pack_compact(pack_path))
+			std::cerr << "Failed to compact " << pack_path.string() << std::endl;
+	}
+	if (Arcollect::debug.thumbnails)
+		std::cerr << "Thumbnails pack has " << pack_index.size() << " thumbnails in " << pack_size << " bytes" << std::endl;
+	return pack_map;
+}
+
+SDL::Surface *Arcollect::art_reader::load_thumbnail_pack(const std::filesystem::path &path, SDL::Point size, std::string &thumbnail_id, std::string_view &icc_profile, std::string_view &color_space)
+{
+	const auto target_thumbnail_size = std::max(size.x,size.y);
+	if (target_thumbnail_size >= thumbnail_pack_size)
+		return NULL;
+	if (thumbnail_id.empty())
+		thumbnail_id = make_thumbnail_id(path);
+	// Lookup the index
+	std::uint64_t offset;
+	{
+		std::lock_guard<std::mutex> lock(pack_lock);
+		if (!pack_open())
+			return NULL;
+		auto iter = pack_index.find(thumbnail_id);
+		if (iter == pack_index.end())
+			return NULL;
+		offset = iter->second;
+	}
+	const pack_record_header &record = pack_record(offset);
+	if (std::max(record.width,record.height) <= target_thumbnail_size)
+		return NULL;
+	// Check the modification time
+	struct stat source_stat;
+	count_thumbnail_fs_access();
+	if (stat(path.c_str(),&source_stat))
+		return NULL;
+	if (source_stat.st_mtim.tv_sec != record.source_mtime) {
+		if (Arcollect::debug.thumbnails)
+			std::cerr << "Packed thumbnail of " << path.string() << " is outdated" << std::endl;
+		std::lock_guard<std::mutex> lock(pack_lock);
+		auto iter = pack_index.find(thumbnail_id);
+		if ((iter != pack_index.end()) && (iter->second == offset)) {
+			pack_dead_bytes += record.record_size;
+			pack_index.erase(iter);
+		}
+		return NULL;
+	}
+	// Create the surface on mapped pages
+	const char *record_data = &pack_map[offset];
+	icc_profile = std::string_view(&record_data[sizeof(pack_record_header)],record.icc_profile_size);
+	color_space = std::string_view(&record_data[sizeof(pack_record_header)+record.icc_profile_size],record.color_space_size);
+	return reinterpret_cast<SDL::Surface*>(SDL_CreateRGBSurfaceWithFormatFrom(const_cast<char*>(&record_data[record.pixels_offset]),record.width,record.height,SDL_BITSPERPIXEL(record.sdl_format),record.pitch,record.sdl_format));
+}
+void Arcollect::art_reader::write_thumbnail_pack(const std::filesystem::path &path, SDL::Surface &surface, std::string_view icc_profile, std::string_view color_space, const std::string &thumbnail_id)
+{
+	if ((surface.w > thumbnail_pack_size) || (surface.h > thumbnail_pack_size) || (thumbnail_id.size() > sizeof(pack_record_header::thumbnail_id)))
+		return;
+	struct stat source_stat;
+	if (stat(path.c_str(),&source_stat))
+		return;
+	// Build the record
+	pack_record_header record{};
+	std::memcpy(record.magic,pack_record_magic,sizeof(pack_record_magic));
+	std::memcpy(record.thumbnail_id,thumbnail_id.data(),thumbnail_id.size());
+	record.source_mtime = source_stat.st_mtim.tv_sec;
+	record.sdl_format = surface.format->format;
+	record.width  = surface.w;
+	record.height = surface.h;
+	record.pitch  = surface.w*surface.format->BytesPerPixel;
+	record.icc_profile_size = icc_profile.size();
+	record.color_space_size = color_space.size();
+	record.pixels_offset = pack_align(sizeof(record)+icc_profile.size()+color_space.size());
+	record.record_size = pack_align(record.pixels_offset+std::uint64_t(record.pitch)*record.height);
+	std::vector<char> data(record.record_size);
+	std::memcpy(data.data(),&record,sizeof(record));
+	std::memcpy(&data[sizeof(record)],icc_profile.data(),icc_profile.size());
+	std::memcpy(&data[sizeof(record)+icc_profile.size()],color_space.data(),color_space.size());
+	for (int y = 0; y < surface.h; y++)
+		std::memcpy(&data[record.pixels_offset+y*record.pitch],&static_cast<const char*>(surface.pixels)[y*surface.pitch],record.pitch);
+	// Append it
+	std::lock_guard<std::mutex> lock(pack_lock);
+	if (!pack_open())
+		return;
+	if (pack_size + record.record_size > pack_max_size) {
+		if (Arcollect::debug.thumbnails)
+			std::cerr << "Thumbnails pack is full" << std::endl;
+		return;
+	}
+	if (pwrite(pack_fd,data.data(),data.size(),pack_size) != ssize_t(data.size())) {
+		std::cerr << "Failed to write in the thumbnails pack: " << strerror(errno) << std::endl;
+		return;
+	}
+	pack_index_set(pack_size);
+	pack_size += record.record_size;
+}
+#else
+SDL::Surface *Arcollect::art_reader::load_thumbnail_pack(const std::filesystem::path &path, SDL::Point size, std::string &thumbnail_id, std::string_view &icc_profile, std::string_view &color_space)
+{
+	return NULL;
+}
+void Arcollect::art_reader::write_thumbnail_pack(const std::filesystem::path &path, SDL::Surface &surface, std::string_view icc_profile, std::string_view color_space, const std::string &thumbnail_id)
+{
+}
+#endif
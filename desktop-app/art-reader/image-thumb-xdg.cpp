@@ -25,12 +25,16 @@
  */
 #include <OpenImageIO/imageio.h> // Enable some stuff
 #include "image.hpp"
+#include "file-source.hpp"
+#include "../config.hpp"
 #include <cstdlib>
 #include <arcollect-debug.hpp>
 #include <config.h>
 #include <arcollect-paths.hpp>
 #include <md5.hpp>
 #include <zlib.h>
+#include <mutex>
+#include <unordered_map>
 #if WITH_XDG
 #include <sys/stat.h>
 #endif
@@ -51,25 +55,34 @@ static std::string xdg_hash_uri(const std::filesystem::path &path) {
 	return std::to_string(MD5_CTX::hash(path.native()));
 }
 
+std::string Arcollect::art_reader::make_thumbnail_id(const std::filesystem::path &path)
+{
+	return xdg_hash_uri(xdg_make_uri(path));
+}
+
 static const std::filesystem::path thumbnails_dir = "thumbnails";
 
 static std::filesystem::path thumbnails_root;
-static std::filesystem::path lookup_thumbnails_root(void)
+std::filesystem::path Arcollect::art_reader::lookup_cache_root(void)
 {
 	// Lookup for XDG_CACHE_HOME
 	const char* cache_root = std::getenv("XDG_CACHE_HOME");
 	if (cache_root)
-		return std::filesystem::path(cache_root)/thumbnails_dir;
+		return std::filesystem::path(cache_root);
 	// Query XDG compliant fallback
 	#if WITH_XDG
 	cache_root = std::getenv("HOME");
 	if (cache_root) {
 		static const std::filesystem::path cache_subdir = ".cache";
-		return std::filesystem::path(cache_root)/cache_subdir/thumbnails_dir;
+		return std::filesystem::path(cache_root)/cache_subdir;
 	}
 	#endif
 	// Fallback in the collection
-	return Arcollect::path::arco_data_home/thumbnails_dir;
+	return Arcollect::path::arco_data_home;
+}
+static std::filesystem::path lookup_thumbnails_root(void)
+{
+	return Arcollect::art_reader::lookup_cache_root()/thumbnails_dir;
 }
 
 static const std::pair<int,std::filesystem::path> dirs_sizes[] = {
@@ -87,39 +100,136 @@ static constexpr auto dirs_sizes_n = sizeof(dirs_sizes)/sizeof(dirs_sizes[0]);
 static const auto min_thumbnail_size = dirs_sizes[0].first;
 static const auto max_thumbnail_size = dirs_sizes[dirs_sizes_n-1].first;
 
-OIIO::ImageInput::unique_ptr Arcollect::art_reader::load_thumbnail(const std::filesystem::path &path, SDL::Point size)
+#if WITH_TEST_COUNTERS
+std::atomic<unsigned int> Arcollect::art_reader::thumbnail_fs_accesses = 0;
+#endif
+
+/** Thumbnails index
+ *
+ * Map thumbnails hash to a bitmask of #dirs_sizes indexes where a thumbnail
+ * exists. It is seeded by listing each size directory once per session and
+ * updated when thumbnails are written or found to be invalid.
+ *
+ * Thumbnails missing in the index are assumed to not exist, this is the
+ * negative cache that save a stat() and failed opens for every thumbnail size
+ * on each lookup. Thumbnails created by others apps during the session are
+ * missed, in this case the original is loaded and a new thumbnail written.
+ */
+static std::unordered_map<std::string,unsigned int> thumbnails_index;
+static std::mutex thumbnails_index_lock;
+static bool thumbnails_index_seeded = false;
+/** Seed the #thumbnails_index if not done yet
+ *
+ * \warning #thumbnails_index_lock must be held.
+ */
+static void thumbnails_index_seed(void)
+{
+	if (thumbnails_index_seeded)
+		return;
+	thumbnails_index_seeded = true;
+	// Compute thumbnails_root
+	thumbnails_root = lookup_thumbnails_root();
+	// List thumbnails
+	for (unsigned int i = 0; i < dirs_sizes_n; i++) {
+		Arcollect::art_reader::count_thumbnail_fs_access();
+		std::error_code ec;
+		for (const std::filesystem::directory_entry &entry: std::filesystem::directory_iterator(thumbnails_root/dirs_sizes[i].second,ec)) {
+			const std::filesystem::path &filename = entry.path().filename();
+			if (filename.extension() == ".png")
+				thumbnails_index[filename.stem().string()] |= 1 << i;
+		}
+	}
+	if (Arcollect::debug.thumbnails)
+		std::cerr << "Indexed " << thumbnails_index.size() << " thumbnails in " << thumbnails_root.string() << std::endl;
+}
+/** Get the thumbnails sizes available
+ * \param thumbnail_id The thumbnail hash
+ * \return A bitmask of #dirs_sizes indexes
+ */
+static unsigned int thumbnails_index_query(const std::string &thumbnail_id)
+{
+	std::lock_guard<std::mutex> lock(thumbnails_index_lock);
+	thumbnails_index_seed();
+	auto iter = thumbnails_index.find(thumbnail_id);
+	return iter == thumbnails_index.end() ? 0 : iter->second;
+}
+/** Set a thumbnail presence in the index
+ * \param thumbnail_id The thumbnail hash
+ * \param dir_index The #dirs_sizes index
+ * \param exists If the thumbnail exists
+ */
+static void thumbnails_index_set(const std::string &thumbnail_id, unsigned int dir_index, bool exists)
+{
+	std::lock_guard<std::mutex> lock(thumbnails_index_lock);
+	if (exists)
+		thumbnails_index[thumbnail_id] |= 1 << dir_index;
+	else {
+		auto iter = thumbnails_index.find(thumbnail_id);
+		if (iter != thumbnails_index.end())
+			if (!(iter->second &= ~(1 << dir_index)))
+				thumbnails_index.erase(iter);
+	}
+}
+
+std::filesystem::path Arcollect::art_reader::find_thumbnail(const std::filesystem::path &path, int size)
+{
+	const std::string thumbnail_id = make_thumbnail_id(path);
+	const unsigned int thumbnails_available = thumbnails_index_query(thumbnail_id);
+	for (unsigned int i = 0; i < dirs_sizes_n; i++)
+		if ((thumbnails_available & (1 << i)) && ((dirs_sizes[i].first >= size) || !(thumbnails_available >> (i+1))))
+			return thumbnails_root/dirs_sizes[i].second/(thumbnail_id+".png");
+	return std::filesystem::path();
+}
+OIIO::ImageInput::unique_ptr Arcollect::art_reader::load_thumbnail(const std::filesystem::path &path, SDL::Point size, std::string &thumbnail_id, file_source &source)
 {
 	
 	const std::string uri = xdg_make_uri(path);
-	const std::filesystem::path thumbnail_filename(xdg_hash_uri(uri)+".png");
+	if (thumbnail_id.empty())
+		thumbnail_id = make_thumbnail_id(path);
+	const std::filesystem::path thumbnail_filename(thumbnail_id+".png");
 	auto target_thumbnail_size = std::max(size.x,size.y);
 	if (Arcollect::debug.thumbnails)
 		std::cerr << "Loading " << target_thumbnail_size << "px thumbnail for " << path.string() << " (" << thumbnail_filename << ") ";
+	// Check for thumbnails in the index
+	const unsigned int thumbnails_available = thumbnails_index_query(thumbnail_id);
+	bool has_candidate = false;
+	for (unsigned int i = 0; i < dirs_sizes_n; i++)
+		if ((dirs_sizes[i].first > target_thumbnail_size)&&(thumbnails_available & (1 << i)))
+			has_candidate = true;
+	if (!has_candidate) {
+		if (Arcollect::debug.thumbnails)
+			std::cerr << "no thumbnail in the index." << std::endl;
+		return OIIO::ImageInput::unique_ptr();
+	}
 	#if WITH_XDG
 	// Stat the file
 	struct stat source_stat;
+	count_thumbnail_fs_access();
 	if (stat(path.c_str(),&source_stat)) {
 		if (Arcollect::debug.thumbnails)
 			std::cerr << "stat(" << path.string() << ") failed, abort" << std::endl;
 		return OIIO::ImageInput::unique_ptr();
 	}
 	#endif
-	// Compute thumbnails_root if empty
-	if (thumbnails_root.empty()) {
-		thumbnails_root = lookup_thumbnails_root();
-	}
 	// Attempt to load thumbnails
-	for (const auto& dir: dirs_sizes) {
+	for (unsigned int i = 0; i < dirs_sizes_n; i++) {
+		const auto& dir = dirs_sizes[i];
 		// Check the thumbnail size
 		if (dir.first <= target_thumbnail_size)
 			continue;
+		// Check the index
+		if (!(thumbnails_available & (1 << i)))
+			continue;
 		if (Arcollect::debug.thumbnails)
 			std::cerr << dir.first << "/" << dir.second.string() << "... ";
 		// Try to load the thumbnail
 		const std::filesystem::path thumbnail_path = thumbnails_root/dir.second/thumbnail_filename;
-		auto image = OIIO::ImageInput::open(thumbnail_path.native());
+		count_thumbnail_fs_access();
+		source.open(thumbnail_path);
+		auto image = source.open_image(thumbnail_path);
 		if (!image) {
 			std::filesystem::remove(thumbnail_path); // Erase because it's defective.
+			thumbnails_index_set(thumbnail_id,i,false);
 			if (Arcollect::debug.thumbnails)
 				std::cerr << "OIIO failed to open! ";
 			continue;
@@ -129,12 +239,14 @@ OIIO::ImageInput::unique_ptr Arcollect::art_reader::load_thumbnail(const std::fi
 		// Perform XDG specific checks
 		if (atol(spec.get_string_attribute("Thumb::MTime","1").c_str()) != source_stat.st_mtim.tv_sec) {
 			std::filesystem::remove(thumbnail_path);
+			thumbnails_index_set(thumbnail_id,i,false);
 			if (Arcollect::debug.thumbnails)
 				std::cerr << "Thumb::MTime mismatch! ";
 			continue;
 		}
 		#endif
 		if (spec.get_string_attribute("Thumb::URI") != uri) {
+			thumbnails_index_set(thumbnail_id,i,false);
 			if (Arcollect::debug.thumbnails)
 				std::cerr << "Thumb::URI mismatch! ";
 			continue;
@@ -148,7 +260,7 @@ OIIO::ImageInput::unique_ptr Arcollect::art_reader::load_thumbnail(const std::fi
 			std::cerr << "no thumbnail loaded." << std::endl;
 	return OIIO::ImageInput::unique_ptr();
 }
-void Arcollect::art_reader::write_thumbnail(const std::filesystem::path &path, SDL::Surface& surface, OIIO::ImageSpec spec)
+void Arcollect::art_reader::write_thumbnail(const std::filesystem::path &path, SDL::Surface& surface, OIIO::ImageSpec spec, std::string &thumbnail_id)
 {
 	// Check if making a thumbnail makes sense
 	const auto largest_surf_edge = std::max(surface.w,surface.h);
@@ -156,7 +268,14 @@ void Arcollect::art_reader::write_thumbnail(const std::filesystem::path &path, S
 		return;
 	// Prepare things
 	const std::string uri = xdg_make_uri(path);
-	const std::filesystem::path thumbnail_filename(xdg_hash_uri(uri)+".png");
+	if (thumbnail_id.empty())
+		thumbnail_id = make_thumbnail_id(path);
+	const std::filesystem::path thumbnail_filename(thumbnail_id+".png");
+	{
+		// Ensure thumbnails_root is set
+		std::lock_guard<std::mutex> lock(thumbnails_index_lock);
+		thumbnails_index_seed();
+	}
 	const SDL_PixelFormat* const surf_format = surface.format;
 	if (Arcollect::debug.thumbnails)
 		std::cerr << "Writing thumbnails for " << path.string() << " (" << thumbnail_filename << ") ";
@@ -205,6 +324,17 @@ void Arcollect::art_reader::write_thumbnail(const std::filesystem::path &path, S
 		spec.height = thumb_out.h = thumbnail_surf->h/div_ratio;
 		if (Arcollect::debug.thumbnails)
 			std::cerr << dir.second <<" (" << thumb_out.w << "×" << thumb_out.h << ")... ";
+		// Scale down the image
+		SDL_BlitScaled(&surface,NULL,thumbnail_surf.get(),(SDL_Rect*)&thumb_out);
+		// Write in the thumbnails pack
+		if ((dir.first == thumbnail_pack_size) && Arcollect::config::thumbnails_pack) {
+			const OIIO::ParamValue *icc_profile = spec.find_attribute("ICCProfile");
+			std::unique_ptr<SDL::Surface> pack_surf(reinterpret_cast<SDL::Surface*>(SDL_CreateRGBSurfaceWithFormatFrom(thumbnail_surf->pixels,thumb_out.w,thumb_out.h,surf_format->BitsPerPixel,thumbnail_surf->pitch,surf_format->format)));
+			if (pack_surf)
+				write_thumbnail_pack(path,*pack_surf,
+					icc_profile ? std::string_view(static_cast<const char*>(icc_profile->data()),icc_profile->datasize()) : std::string_view(),
+					spec.get_string_attribute("oiio:ColorSpace"),thumbnail_id);
+		}
 		// Open the thumbnail file
 		// TODO Support O_TMPFILE
 		std::filesystem::path thumbnail_path = thumbnails_root/dir.second;
@@ -218,11 +348,14 @@ void Arcollect::art_reader::write_thumbnail(const std::filesystem::path &path, S
 				std::cerr << "failed to create() " << tmp_thumbnail_path.string() << "!";
 			continue;
 		}
-		// Scale down and write the image
-		SDL_BlitScaled(&surface,NULL,thumbnail_surf.get(),(SDL_Rect*)&thumb_out);
-		if (out_thumbnail->write_image(OIIO::TypeDesc::UINT8,thumbnail_surf->pixels,surf_format->BytesPerPixel,thumbnail_surf->pitch))
+		// Write the image
+		if (out_thumbnail->write_image(OIIO::TypeDesc::UINT8,thumbnail_surf->pixels,surf_format->BytesPerPixel,thumbnail_surf->pitch)) {
 			std::filesystem::rename(tmp_thumbnail_path,thumbnail_path);
-		else {
+			// Update the index
+			for (unsigned int i = 0; i < dirs_sizes_n; i++)
+				if (dirs_sizes[i].first == dir.first)
+					thumbnails_index_set(thumbnail_id,i,true);
+		} else {
 			if (Arcollect::debug.thumbnails)
 				std::cerr << "failed to write_image() " << tmp_thumbnail_path.string() << "!";
 		}
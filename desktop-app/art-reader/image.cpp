@@ -16,13 +16,28 @@
  */
 #include <OpenImageIO/imageio.h> // Enable some stuff
 #include "image.hpp"
+#include "file-source.hpp"
 #include "../config.hpp"
 #include "../db/artwork.hpp"
 #define CMSREGISTER // Remove warnings about 'register' keyword
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "lcms2.h"
 #include <arcollect-debug.hpp>
-cmsHPROFILE cms_screenprofile = NULL;
+/** Screen profile
+ *
+ * Loader threads snapshot it under #cms_screenprofile_lock as it may be swapped
+ * by set_screen_icc_profile() during loads.
+ */
+static std::shared_ptr<void> cms_screenprofile;
+static std::mutex cms_screenprofile_lock;
+static std::atomic<unsigned int> cms_screenprofile_generation = 0;
 
 void Arcollect::art_reader::set_screen_icc_profile(SDL_Window *window)
 {
@@ -35,29 +50,55 @@ void Arcollect::art_reader::set_screen_icc_profile(SDL_Window *window)
 }
 void Arcollect::art_reader::set_screen_icc_profile(const std::string_view& icc_profile)
 {
-	Arcollect::db::download::nuke_image_cache();
-	// Swap profiles
-	cmsCloseProfile(cms_screenprofile);
-	if (icc_profile.empty()) {
+	std::shared_ptr<void> screen_profile;
+	if (icc_profile.empty())
 		std::cerr << "Removed screen ICC profile. Color management disabled." << std::endl;
-		cms_screenprofile = NULL;
-	} else {
-		cms_screenprofile = cmsOpenProfileFromMem(icc_profile.data(),icc_profile.size());
+	else {
+		screen_profile.reset(cmsOpenProfileFromMem(icc_profile.data(),icc_profile.size()),cmsCloseProfile);
 		if (Arcollect::debug.icc_profile) {
 			char description[64];
 			char manufacturer[64];
 			char model[64];
 			char copyright[64];
-			cmsGetProfileInfoASCII(cms_screenprofile,cmsInfoDescription,cmsNoLanguage,cmsNoCountry,description,sizeof(description));
-			cmsGetProfileInfoASCII(cms_screenprofile,cmsInfoManufacturer,cmsNoLanguage,cmsNoCountry,manufacturer,sizeof(manufacturer));
-			cmsGetProfileInfoASCII(cms_screenprofile,cmsInfoModel,cmsNoLanguage,cmsNoCountry,model,sizeof(model));
-			cmsGetProfileInfoASCII(cms_screenprofile,cmsInfoCopyright,cmsNoLanguage,cmsNoCountry,copyright,sizeof(copyright));
+			cmsGetProfileInfoASCII(screen_profile.get(),cmsInfoDescription,cmsNoLanguage,cmsNoCountry,description,sizeof(description));
+			cmsGetProfileInfoASCII(screen_profile.get(),cmsInfoManufacturer,cmsNoLanguage,cmsNoCountry,manufacturer,sizeof(manufacturer));
+			cmsGetProfileInfoASCII(screen_profile.get(),cmsInfoModel,cmsNoLanguage,cmsNoCountry,model,sizeof(model));
+			cmsGetProfileInfoASCII(screen_profile.get(),cmsInfoCopyright,cmsNoLanguage,cmsNoCountry,copyright,sizeof(copyright));
 			std::cerr << "Setting screen ICC profile for " << manufacturer << " " << model << " (" << copyright << "): " << description << std::endl;
 		}
 	}
+	// Swap profiles, loads in progress keep the old one
+	{
+		std::lock_guard<std::mutex> lock(cms_screenprofile_lock);
+		cms_screenprofile = std::move(screen_profile);
+		cms_screenprofile_generation++;
+	}
+	Arcollect::db::download::screen_profile_changed();
+}
+unsigned int Arcollect::art_reader::screen_icc_profile_generation(void)
+{
+	return cms_screenprofile_generation;
+}
+
+/** Split rows into bands processed in parallel
+ * \param rows count
+ * \param threads to use, the calling thread included
+ * \param func called with the first and past-the-end rows of each band
+ */
+template <typename Function>
+static void parallel_bands(int rows, unsigned int threads, Function func)
+{
+	threads = std::max(1u,std::min<unsigned int>(threads,rows));
+	const int band_rows = (rows+threads-1)/threads;
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < threads; i++)
+		workers.emplace_back(func,std::min<int>(i*band_rows,rows),std::min<int>((i+1)*band_rows,rows));
+	func(0,std::min(band_rows,rows));
+	for (std::thread &worker: workers)
+		worker.join();
 }
 
-SDL::Surface* Arcollect::art_reader::load_surface(OIIO::ImageInput &image)
+SDL::Surface* Arcollect::art_reader::load_surface(OIIO::ImageInput &image, const cancel_function &cancelled)
 {
 	const OIIO::ImageSpec &spec = image.spec();
 	image.seek_subimage(0,0); // Just in case weird stuff happen
@@ -75,43 +116,63 @@ SDL::Surface* Arcollect::art_reader::load_surface(OIIO::ImageInput &image)
 	 * We check things ourself to avoid this situation.
 	 */
 	// Check if encoding and pixel stride matchs the native format
-	if ((spec.format == OIIO::TypeDesc::UINT8) && (spec.format.size() * spec.nchannels == surface->format->BytesPerPixel) && spec.channelformats.empty()) {
-		// Check for the pitch and adapt mismatchs on our side
-		if (surface->format->BytesPerPixel * spec.width == surface->pitch)
-			image.read_native_scanlines(0,0,0,spec.height,0,surface->pixels);
-		else for (int y = 0; y < spec.height; ++y)
-			image.read_native_scanline(0,0,y,0,&((char*)surface->pixels)[y*surface->pitch]);
-	} else image.read_scanlines(0,0,0,spec.height,0,0,spec.nchannels,OIIO::TypeDesc::UINT8,surface->pixels,surface->format->BytesPerPixel,surface->pitch);
-	if (spec.nchannels == 1) {
-		// FIXME Optimize that
-		// Monochrome picture, populate green and blue
-		image.read_scanlines(0,0,0,spec.height,0,0,spec.nchannels,OIIO::TypeDesc::UINT8,&((char*)surface->pixels)[1],surface->format->BytesPerPixel,surface->pitch);
-		image.read_scanlines(0,0,0,spec.height,0,0,spec.nchannels,OIIO::TypeDesc::UINT8,&((char*)surface->pixels)[2],surface->format->BytesPerPixel,surface->pitch);
+	const int bytes_per_pixel = surface->format->BytesPerPixel;
+	const bool native_format = (spec.format == OIIO::TypeDesc::UINT8) && (spec.format.size() * spec.nchannels == surface->format->BytesPerPixel) && spec.channelformats.empty();
+	// Check for the pitch and adapt mismatchs on our side
+	const bool native_pitch = native_format && (bytes_per_pixel * spec.width == surface->pitch);
+	// Read by chunks so the load can be cancelled
+	const int chunk_rows = std::max(1,load_chunk_size*std::max(1,image.threads())/surface->pitch);
+	for (int y = 0; y < spec.height; y += chunk_rows) {
+		if (cancelled && cancelled()) {
+			SDL_FreeSurface(surface);
+			return NULL;
+		}
+		const int y_end = std::min(y+chunk_rows,spec.height);
+		char* pixels = static_cast<char*>(surface->pixels) + y*surface->pitch;
+		if (native_pitch)
+			image.read_native_scanlines(0,0,y,y_end,0,pixels);
+		else if (native_format)
+			for (int row = y; row < y_end; ++row)
+				image.read_native_scanline(0,0,row,0,&pixels[(row-y)*surface->pitch]);
+		else image.read_scanlines(0,0,y,y_end,0,0,spec.nchannels,OIIO::TypeDesc::UINT8,pixels,bytes_per_pixel,surface->pitch);
+		if (spec.nchannels == 1) {
+			// Monochrome picture, populate green and blue
+			for (int row = y; row < y_end; ++row, pixels += surface->pitch)
+				for (char* pixel = pixels; pixel != pixels + bytes_per_pixel*spec.width; pixel += bytes_per_pixel)
+					pixel[1] = pixel[2] = pixel[0];
+		}
 	}
 	return surface;
 }
-SDL::Surface* Arcollect::art_reader::image(const std::filesystem::path &path, SDL::Point size)
+/** Transform pixels to the screen color-space
+ * \param input surface to transform
+ * \param keep_input to not modify nor free `input`
+ * \param path of the image, for diagnostics
+ * \param icc_profile of the image, may be empty
+ * \param color_space of the image `oiio:ColorSpace`
+ * \param threads to use for large images
+ * \param cancelled Optional cancellation check
+ * \return The transformed surface or NULL on failure or cancellation
+ *
+ * Unless `keep_input` is set, `input` is transformed in-place or freed.
+ */
+static SDL::Surface *screen_transform(SDL::Surface *input, bool keep_input, const std::filesystem::path &path, std::string_view icc_profile, std::string_view color_space, unsigned int threads, const Arcollect::art_reader::cancel_function &cancelled)
 {
-	// Attempt to open the thumbnail
-	SDL::Surface* surface = NULL;
-	OIIO::ImageInput::unique_ptr image = load_thumbnail(path,size);
-	if (image)
-		surface = load_surface(*image);
-	// Load the original on failure
-	if (!surface) {
-		image = OIIO::ImageInput::open(path.native());
-		if (!image) {
-			std::cerr << "Failed to open " << path << ". " << OIIO::geterror();
-			return NULL;
-		}
-		surface = load_surface(*image);
-		if (!surface) {
-			std::cerr << "Failed to load pixels from " << path << ". " << image->geterror() << std::endl;
-			return NULL;
-		}
-		write_thumbnail(path,*surface,image->spec());
+	using namespace Arcollect::art_reader;
+	// Make cancellation sticky, a half-transformed surface must not be returned
+	std::atomic<bool> is_cancelled = false;
+	const cancel_function cancel_check = [&]() {
+		if (!is_cancelled && cancelled && cancelled())
+			is_cancelled = true;
+		return is_cancelled.load();
+	};
+	// Snapshot the screen profile, it may be swapped meanwhile
+	std::shared_ptr<void> screen_profile;
+	{
+		std::lock_guard<std::mutex> lock(cms_screenprofile_lock);
+		screen_profile = cms_screenprofile;
 	}
-	const OIIO::ImageSpec &spec = image->spec();
+	SDL::Surface *surface = input;
 	// Set pixel format for lcms2
 	cmsUInt32Number cms_pixel_format;
 	switch (surface->format->BytesPerPixel) {
@@ -122,11 +183,10 @@ SDL::Surface* Arcollect::art_reader::image(const std::filesystem::path &path, SD
 	
 	// Get image profile
 	cmsHPROFILE image_profile = NULL;
-	const OIIO::ParamValue *icc_profile = spec.find_attribute("ICCProfile");
 	if (Arcollect::debug.icc_profile)
 		std::cerr << path << ":";
-	if (icc_profile) {
-		image_profile = cmsOpenProfileFromMem(icc_profile->data(),icc_profile->datasize());
+	if (!icc_profile.empty()) {
+		image_profile = cmsOpenProfileFromMem(icc_profile.data(),icc_profile.size());
 		if (Arcollect::debug.icc_profile) {
 			std::cerr << " embed ICC profile ";
 			if (image_profile) {
@@ -159,7 +219,6 @@ SDL::Surface* Arcollect::art_reader::image(const std::filesystem::path &path, SD
 		static GammaTriplet gamma2_2(2.2);
 		static GammaTriplet gamma2_4(2.4);
 		
-		auto color_space = spec.get_string_attribute("oiio:ColorSpace","no");
 		if (Arcollect::debug.icc_profile)
 			std::cerr << " OIIO report " << color_space << " color-space.";
 		if (color_space == "Linear") {
@@ -187,14 +246,33 @@ SDL::Surface* Arcollect::art_reader::image(const std::filesystem::path &path, SD
 			std::cerr << " Fallback to sRGB.";
 		image_profile = cmsCreate_sRGBProfile();
 	}
-	if (cms_screenprofile) {
-		cmsHTRANSFORM hTransform = cmsCreateTransform(image_profile,cms_pixel_format,cms_screenprofile,cms_pixel_format,Arcollect::config::littlecms_intent,Arcollect::config::littlecms_flags);
+	if (screen_profile) {
+		cmsHTRANSFORM hTransform = cmsCreateTransform(image_profile,cms_pixel_format,screen_profile.get(),cms_pixel_format,Arcollect::config::littlecms_intent,Arcollect::config::littlecms_flags);
 		if (hTransform) {
 			if (Arcollect::debug.icc_profile)
 				std::cerr << " Colors are managed.";
-			for (int y = 0; y < spec.height; y++) {
-				char* pixels = static_cast<char*>(surface->pixels) + y*surface->pitch;
-				cmsDoTransform(hTransform,pixels,pixels,spec.width);
+			// Packed thumbnails pixels are read-only, transform into a new surface
+			SDL::Surface* dest_surface = surface;
+			if ((surface->flags & SDL_PREALLOC) || keep_input)
+				dest_surface = reinterpret_cast<SDL::Surface*>(SDL_CreateRGBSurfaceWithFormat(0,surface->w,surface->h,surface->format->BitsPerPixel,surface->format->format));
+			if (dest_surface) {
+				// Transform large images by bands in parallel
+				const unsigned int transform_threads = static_cast<std::int64_t>(surface->w)*surface->h >= parallel_min_pixels ? threads : 1;
+				const int chunk_rows = std::max(1,load_chunk_size/surface->pitch);
+				parallel_bands(surface->h,transform_threads,[&](int y_begin, int y_end) {
+					for (int y = y_begin; y < y_end; y++) {
+						if (((y - y_begin) % chunk_rows == 0) && cancel_check())
+							break;
+						const char* src_pixels = static_cast<const char*>(surface->pixels) + y*surface->pitch;
+						char* dest_pixels = static_cast<char*>(dest_surface->pixels) + y*dest_surface->pitch;
+						cmsDoTransform(hTransform,src_pixels,dest_pixels,surface->w);
+					}
+				});
+				if (dest_surface != surface) {
+					if (!keep_input)
+						SDL_FreeSurface(surface);
+					surface = dest_surface;
+				}
 			}
 			cmsDeleteTransform(hTransform);
 		} else if (Arcollect::debug.icc_profile)
@@ -203,5 +281,116 @@ SDL::Surface* Arcollect::art_reader::image(const std::filesystem::path &path, SD
 	if (Arcollect::debug.icc_profile)
 		std::cerr << std::endl;
 	cmsCloseProfile(image_profile);
+	if (is_cancelled) {
+		if (!keep_input || (surface != input))
+			SDL_FreeSurface(surface);
+		return NULL;
+	}
+	// Return a copy if the input must be kept and was not transformed
+	if (keep_input && (surface == input))
+		surface = reinterpret_cast<SDL::Surface*>(SDL_ConvertSurface(surface,surface->format,0));
 	return surface;
 }
+SDL::Surface* Arcollect::art_reader::image(const std::filesystem::path &path, SDL::Point size, std::string &thumbnail_id, const cancel_function &cancelled, unsigned int threads, source_image *source)
+{
+	// Make cancellation sticky, a load cancelled once must not look like a failure
+	std::atomic<bool> is_cancelled = false;
+	const cancel_function cancel_check = [&]() {
+		if (!is_cancelled && cancelled && cancelled())
+			is_cancelled = true;
+		return is_cancelled.load();
+	};
+	// Attempt to open the thumbnail
+	SDL::Surface* surface = NULL;
+	std::string_view icc_profile;
+	std::string_view color_space;
+	std::string color_space_storage;
+	// Declared before the image that read from them
+	file_source thumbnail_source;
+	file_source original_source;
+	OIIO::ImageInput::unique_ptr image;
+	if (Arcollect::config::thumbnails_pack)
+		surface = load_thumbnail_pack(path,size,thumbnail_id,icc_profile,color_space);
+	if (!surface) {
+		image = load_thumbnail(path,size,thumbnail_id,thumbnail_source);
+		if (image)
+			surface = load_surface(*image,cancel_check);
+		if (is_cancelled)
+			return NULL;
+	}
+	const bool from_xdg_thumbnail = surface && image;
+	// Specification of the loaded image, NULL for packed thumbnails
+	const OIIO::ImageSpec *spec = from_xdg_thumbnail ? &image->spec() : NULL;
+	OIIO::ImageSpec native_spec;
+	// Load the original on failure
+	if (!surface) {
+		if (cancel_check())
+			return NULL;
+		if (!original_source.open(path)) {
+			std::cerr << "Failed to read " << path << std::endl;
+			return NULL;
+		}
+		// Try native decoders of common formats first
+		surface = load_native(original_source,native_spec,cancel_check);
+		if (is_cancelled)
+			return NULL;
+		if (surface)
+			spec = &native_spec;
+		else {
+			image = original_source.open_image(path);
+			if (!image) {
+				std::cerr << "Failed to open " << path << ". " << OIIO::geterror();
+				return NULL;
+			}
+			// Let OIIO decode large images in parallel
+			const OIIO::ImageSpec &image_spec = image->spec();
+			if ((threads > 1) && (static_cast<std::int64_t>(image_spec.width)*image_spec.height >= parallel_min_pixels))
+				image->threads(threads);
+			surface = load_surface(*image,cancel_check);
+			if (!surface) {
+				if (!is_cancelled)
+					std::cerr << "Failed to load pixels from " << path << ". " << image->geterror() << std::endl;
+				return NULL;
+			}
+			spec = &image_spec;
+		}
+		// Don't spend time in thumbnails of cancelled loads
+		if (cancel_check()) {
+			SDL_FreeSurface(surface);
+			return NULL;
+		}
+		write_thumbnail(path,*surface,*spec,thumbnail_id);
+	}
+	if (spec) {
+		const OIIO::ParamValue *icc_param = spec->find_attribute("ICCProfile");
+		if (icc_param)
+			icc_profile = std::string_view(static_cast<const char*>(icc_param->data()),icc_param->datasize());
+		color_space_storage = spec->get_string_attribute("oiio:ColorSpace","no");
+		color_space = color_space_storage;
+		// Fill the thumbnails pack with existing XDG thumbnails
+		if (from_xdg_thumbnail && Arcollect::config::thumbnails_pack && (std::max(surface->w,surface->h) == thumbnail_pack_size))
+			write_thumbnail_pack(path,*surface,icc_profile,color_space,thumbnail_id);
+	}
+	// Keep untransformed pixels for retransform()
+	if (source) {
+		// Packed thumbnails borrow the pack mapping pixels (SDL_PREALLOC), the
+		// source outlives this load so it must own a copy
+		if (surface->flags & SDL_PREALLOC) {
+			SDL::Surface *copy = reinterpret_cast<SDL::Surface*>(SDL_ConvertSurface(surface,surface->format,0));
+			SDL_FreeSurface(surface);
+			if (!copy)
+				return NULL;
+			surface = copy;
+		}
+		source->surface.reset(surface);
+		source->path = path;
+		source->icc_profile = icc_profile;
+		source->color_space = color_space;
+		return screen_transform(surface,true,path,icc_profile,color_space,threads,cancel_check);
+	}
+	return screen_transform(surface,false,path,icc_profile,color_space,threads,cancel_check);
+}
+SDL::Surface* Arcollect::art_reader::retransform(const source_image &source, const cancel_function &cancelled, unsigned int threads)
+{
+	return screen_transform(source.surface.get(),true,source.path,source.icc_profile,source.color_space,threads,cancelled);
+}
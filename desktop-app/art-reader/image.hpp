@@ -14,50 +14,206 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
+#pragma once
+#include <atomic>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
 #include <string_view>
 #include "../sdl2-hpp/SDL.hpp"
+#include <config.h>
 namespace Arcollect {
 	namespace art_reader {
+		class file_source;
 		static constexpr SDL::Point nothumbnail_size{65535,65535};
+		/** Cancellation check
+		 * \return true to abort the load
+		 *
+		 * It is polled by the loading thread between chunks of work.
+		 */
+		using cancel_function = std::function<bool(void)>;
+		/** Amount of pixels bytes processed between cancellation checks
+		 *
+		 * This is a few milliseconds of work.
+		 */
+		static constexpr int load_chunk_size = 256*1024;
+		/** Minimum image size in pixels to use multiple threads
+		 *
+		 * Smaller images are faster to decode than to start threads.
+		 */
+		static constexpr int parallel_min_pixels = 4*1024*1024;
+		/** Untransformed image
+		 *
+		 * Pixels in the image color-space kept by image() to run retransform()
+		 * when the screen ICC profile change instead of decoding the file again.
+		 */
+		struct source_image {
+			std::unique_ptr<SDL::Surface> surface;
+			/** Original image path, for diagnostics
+			 */
+			std::filesystem::path path;
+			std::string icc_profile;
+			std::string color_space;
+			/** Memory used by pixels in bytes
+			 */
+			std::size_t memory(void) const {
+				return surface ? static_cast<std::size_t>(surface->pitch)*surface->h : 0;
+			}
+		};
 		/** Load an image artwork
 		 * \param size of the image for thumbnail lookups
-		 * \return A surface with pixels data, or NULL on error
+		 * \param thumbnail_id Cached thumbnail identifier, computed if empty
+		 * \param cancelled Optional cancellation check
+		 * \param threads Number of threads to use for large images
+		 * \param[out] source Optional untransformed image to fill
+		 * \return A surface with pixels data, or NULL on error or cancellation
+		 *
+		 * Keep the `thumbnail_id` with the image and pass it again on next calls
+		 * to avoid recomputing it.
+		 *
+		 * `cancelled` is checked while reading pixels, before writing thumbnails
+		 * and during the color transform. Thumbnails are not written for
+		 * cancelled loads.
+		 *
+		 * Images of at least #parallel_min_pixels are decoded with OIIO threading
+		 * and color transformed by bands on `threads` threads, the calling one
+		 * included. `cancelled` may be called from these threads.
 		 */
-		SDL::Surface *image(const std::filesystem::path &path, SDL::Point size);
+		SDL::Surface *image(const std::filesystem::path &path, SDL::Point size, std::string &thumbnail_id, const cancel_function &cancelled = cancel_function(), unsigned int threads = 1, source_image *source = NULL);
+		/** Transform an untransformed image to the current screen profile
+		 * \param source filled by image()
+		 * \param cancelled Optional cancellation check
+		 * \param threads Number of threads to use for large images
+		 * \return A new surface with pixels data, or NULL on error or
+		 *         cancellation
+		 *
+		 * This is what image() does after decoding, without decoding.
+		 */
+		SDL::Surface *retransform(const source_image &source, const cancel_function &cancelled = cancel_function(), unsigned int threads = 1);
+		
+		#if WITH_TEST_COUNTERS
+		/** Thumbnails filesystem accesses counter
+		 *
+		 * Count stat(), open() and directory listings done to lookup thumbnails.
+		 * This is for tests and only built with `-Dtest_counters=true`.
+		 */
+		extern std::atomic<unsigned int> thumbnail_fs_accesses;
+		#endif
+		/** Count a thumbnails filesystem access
+		 *
+		 * This is a no-op unless built with `-Dtest_counters=true`.
+		 */
+		inline void count_thumbnail_fs_access(void) {
+			#if WITH_TEST_COUNTERS
+			thumbnail_fs_accesses++;
+			#endif
+		}
+		
+		/** Get the cache directory
+		 * \return `$XDG_CACHE_HOME` or a fallback
+		 */
+		std::filesystem::path lookup_cache_root(void);
+		/** Compute the thumbnail identifier of an image
+		 * \param path to the original image
+		 * \return The thumbnail identifier
+		 *
+		 * This is the XDG thumbnail filename without the extension.
+		 */
+		std::string make_thumbnail_id(const std::filesystem::path &path);
+		/** Find an existing XDG thumbnail file
+		 * \param path to the original image
+		 * \param size wanted
+		 * \return The path to the smallest thumbnail of at least `size` or the
+		 *         largest one, empty if there is none
+		 *
+		 * This only check the thumbnails index and doesn't validate the thumbnail.
+		 * This is intended for other apps, like desktop search, to display.
+		 */
+		std::filesystem::path find_thumbnail(const std::filesystem::path &path, int size);
+		
+		/** Read a thumbnail from the thumbnails pack
+		 * \param path to the original image
+		 * \param size requested
+		 * \param thumbnail_id Cached thumbnail identifier, computed if empty
+		 * \param[out] icc_profile Set to the original image ICC profile if any
+		 * \param[out] color_space Set to the original image `oiio:ColorSpace`
+		 * \return A read-only surface pointing in the pack or NULL on failure
+		 *
+		 * The surface pixels are memory-mapped from the pack, they must not be
+		 * modified. The surface is flagged `SDL_PREALLOC` as such.
+		 *
+		 * This code is OS dependant and intended for image() usage only.
+		 */
+		SDL::Surface *load_thumbnail_pack(const std::filesystem::path &path, SDL::Point size, std::string &thumbnail_id, std::string_view &icc_profile, std::string_view &color_space);
+		/** Write a thumbnail in the thumbnails pack
+		 * \param path to the original image
+		 * \param surface of the thumbnail, at most #thumbnail_pack_size
+		 * \param icc_profile of the original image, may be empty
+		 * \param color_space of the original image `oiio:ColorSpace`
+		 * \param thumbnail_id The thumbnail identifier
+		 *
+		 * This code is OS dependant and intended for write_thumbnail() usage only.
+		 */
+		void write_thumbnail_pack(const std::filesystem::path &path, SDL::Surface &surface, std::string_view icc_profile, std::string_view color_space, const std::string &thumbnail_id);
+		/** Largest thumbnail size stored in the thumbnails pack
+		 */
+		static constexpr int thumbnail_pack_size = 256;
 		
 		#if OIIO_VERSION
 		/** Load a SDL surface from an OIIO image
-		 * \return A surface with raw pixels data, or NULL on error
+		 * \param cancelled Optional cancellation check
+		 * \return A surface with raw pixels data, or NULL on error or cancellation
 		 *
 		 * This is a low-level function to avoid code duplication. It simply load
 		 * pixels without further processing as in image().
+		 *
+		 * Pixels are read in chunks of about #load_chunk_size bytes and
+		 * `cancelled` is checked before each chunk. Chunks are scaled by
+		 * `image.threads()` so threaded reads have enough work.
 		 */
-		SDL::Surface *load_surface(OIIO::ImageInput &image);
+		SDL::Surface *load_surface(OIIO::ImageInput &image, const cancel_function &cancelled = cancel_function());
+		
+		/** Load a JPEG, PNG or WebP with its native decoder
+		 * \param file of the image
+		 * \param[out] spec Set to the image specification with the `ICCProfile`
+		 *                  and `oiio:ColorSpace` attributes like OIIO does
+		 * \param cancelled Optional cancellation check
+		 * \return A surface with raw pixels data, or NULL if the format is not
+		 *         supported, on error or cancellation
+		 *
+		 * This is a fast path for image() that fallback to OIIO on failure.
+		 * Decoders are only available if their library was found at build time.
+		 */
+		SDL::Surface *load_native(const file_source &file, OIIO::ImageSpec &spec, const cancel_function &cancelled = cancel_function());
 		
 		/** Read a thumbnail
 		 * \param path to the original image
 		 * \param size requested
+		 * \param thumbnail_id Cached thumbnail identifier, computed if empty
+		 * \param source to read the thumbnail from, must outlive the image
 		 * \return An image of the thumbnail or NULL on failure
 		 * 
 		 * This code is OS dependant and intended for image() usage only.
 		 */
-		OIIO::ImageInput::unique_ptr load_thumbnail(const std::filesystem::path &path, SDL::Point size);
+		OIIO::ImageInput::unique_ptr load_thumbnail(const std::filesystem::path &path, SDL::Point size, std::string &thumbnail_id, file_source &source);
 		
 		/** Write a thumbnail
 		 * \param path to the original image
 		 * \param surface containing the picture
 		 * \param spec of the original image
+		 * \param thumbnail_id Cached thumbnail identifier, computed if empty
 		 * 
 		 * This code is OS dependant and intended for image() usage only.
 		 */
-		void write_thumbnail(const std::filesystem::path &path, SDL::Surface& surface, OIIO::ImageSpec spec);
+		void write_thumbnail(const std::filesystem::path &path, SDL::Surface& surface, OIIO::ImageSpec spec, std::string &thumbnail_id);
 		#endif
 		
 		/** Set screen ICC profile
 		 * \param icc_profile The ICC profile to read
 		 *
-		 * Replace the screen ICC profile.
+		 * Replace the screen ICC profile. Loaded images are transformed again
+		 * with Arcollect::db::download::screen_profile_changed().
 		 */
 		void set_screen_icc_profile(const std::string_view& icc_profile);
 		/** Set screen ICC profile
@@ -66,5 +222,11 @@ namespace Arcollect {
 		 * Replace the screen ICC profile.
 		 */
 		void set_screen_icc_profile(SDL_Window *window);
+		/** Screen ICC profile generation
+		 * \return A counter incremented on each set_screen_icc_profile() call
+		 *
+		 * Loads that started with another generation may use the old profile.
+		 */
+		unsigned int screen_icc_profile_generation(void);
 	};
 }
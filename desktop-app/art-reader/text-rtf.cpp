@@ -22,19 +22,25 @@
  */
 #include "text.hpp"
 #include <arcollect-debug.hpp>
+#include <array>
+#include <bit>
 #include <charconv>
+#include <cstdint>
+#include <initializer_list>
 #include <optional>
+#include <stdexcept>
 #include <system_error>
+#include <unordered_map>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 struct ControlWord {
 	std::string_view command;
 	std::optional<int> param;
 	static constexpr bool is_valid_command_char(char chr) {
 		return ((chr <= 'z')&&(chr >= 'a')) || ((chr <= 'Z')&&(chr >= 'A'));
 	}
-	void param_set_default(int value) {
-		if (!param)
-			param = value;
-	}
 	ControlWord(const char*& iter, const char *const end)
 	{
 		// Read the command name
@@ -42,7 +48,7 @@ struct ControlWord {
 		for (;(iter != end) && is_valid_command_char(*iter); ++iter);
 		command = std::string_view(start,std::distance(start,iter));
 		// Read the numeric value if so
-		if (((*iter >= '0')&(*iter <= '9')) || (*iter == '-')) {
+		if ((iter != end) && (((*iter >= '0')&(*iter <= '9')) || (*iter == '-'))) {
 			std::from_chars_result parse_result = std::from_chars(iter,end,param.emplace());
 			if (parse_result.ec != std::errc())
 				throw std::system_error(std::make_error_code(parse_result.ec));
@@ -54,15 +60,66 @@ struct ControlWord {
 			++iter;
 	}
 };
-struct RTFGroupState;
-struct RTFGlobalState {
-	Arcollect::art_reader::TextElements main_elements;
-	const Arcollect::gui::font::Attributes plain_attributes = main_elements.current_attributes(); // Used for \plain
+struct RTFParser;
+/** Control word handler
+ * \param parser The parser
+ * \param control_word to handle
+ * \param arg of the #RTFCommand
+ */
+using RTFHandler = void (*)(RTFParser &parser, const ControlWord &control_word, std::string_view arg);
+struct RTFCommand {
+	std::string_view name;
+	RTFHandler handler;
+	std::string_view arg;
+};
+/** Set of control words
+ *
+ * Control words are dispatched with a perfect hash table computed at
+ * compile-time: the constructor search a seed without collisions.
+ */
+class RTFCommandSet {
+	private:
+		static constexpr std::size_t max_commands = 32;
+		static constexpr std::size_t table_size = 64;
+		std::array<RTFCommand,max_commands> commands{};
+		/** #commands index+1 or 0 if empty
+		 */
+		std::array<std::uint8_t,table_size> slots{};
+		std::uint32_t seed = 0;
+		static constexpr std::size_t hash(std::string_view name, std::uint32_t seed) {
+			// FNV-1a
+			std::uint32_t result = 2166136261u ^ seed;
+			for (char chr: name) {
+				result ^= static_cast<unsigned char>(chr);
+				result *= 16777619u;
+			}
+			return (result ^ (result >> 16)) & (table_size-1);
+		}
+	public:
+		constexpr RTFCommandSet(std::initializer_list<RTFCommand> list) {
+			if (list.size() > max_commands)
+				throw std::length_error("Too many RTF commands in the set");
+			std::size_t count = 0;
+			for (const RTFCommand &command: list)
+				commands[count++] = command;
+			for (;; seed++) {
+				slots.fill(0);
+				std::size_t i;
+				for (i = 0; i < count; i++) {
+					std::uint8_t &slot = slots[hash(commands[i].name,seed)];
+					if (slot)
+						break;
+					slot = i+1;
+				}
+				if (i == count)
+					return;
+			}
+		}
+		const RTFCommand *find(std::string_view name) const {
+			const std::uint8_t slot = slots[hash(name,seed)];
+			return slot && (commands[slot-1].name == name) ? &commands[slot-1] : nullptr;
+		}
 };
-
-using RTFCommand     = std::function<void(ControlWord,RTFGroupState&)>;
-using RTFCommandSet  = std::unordered_map<std::string_view,RTFCommand>;
-using RTFTextHandler = std::function<void(const std::string_view&,RTFGroupState&, bool utf8)>;
 
 using WindowsHCodepage = std::u32string_view;
 static const char32_t default_hcodepage[128] = U"                                                                                                                               ";
@@ -70,116 +127,146 @@ static const std::unordered_map<int,WindowsHCodepage> windows_hcodepages{
 	{1252,U"€ ‚ƒ„…†‡ˆ‰Š‹Œ Ž  ‘’“”•–—˜™š›œ žŸ\x00A0¡¢£¤¥¦§¨©ª«¬ ®¯°±²³´µ¶·¸¹º»¼½¾¿ÀÁÂÃÄÅÆÇÈÉÊËÌÍÎÏÐÑÒÓÔÕÖ×ØÙÚÛÜÝÞßàáâãäåæçèéêëìíîïðñòóôõö÷øùúûüýþÿ",
 	},
 };
+/** Group state
+ *
+ * It is small and trivially copyable, a copy is pushed on each '{'.
+ */
 struct RTFGroupState {
-	RTFGlobalState& global;
-	Arcollect::art_reader::TextElements &current_elements;
-	RTFTextHandler text_handler;
-	RTFCommandSet command_set;
-	RTFCommand unknow_command;
+	const RTFCommandSet *command_set;
+	RTFHandler unknow_command;
 	const char32_t *hcodepage;
+	bool skip_text;
 };
-
-static void rtf_echo_text(const std::string_view& text, RTFGroupState& state, bool utf8)
+struct RTFParser {
+	Arcollect::art_reader::TextElements main_elements;
+	const Arcollect::gui::font::Attributes plain_attributes = main_elements.current_attributes(); // Used for \plain
+	std::vector<RTFGroupState> group_stack;
+	RTFGroupState &state(void) {
+		return group_stack.back();
+	}
+	/** Append text
+	 * \param text to append
+	 * \param utf8 if the text is UTF-8, else it is in the group hcodepage
+	 */
+	void text(const std::string_view& text, bool utf8);
+	/** Echo a control word in Arcollect::debug.rtf mode
+	 */
+	void debug_control_word(const ControlWord &control_word, SDL::Color command_color, SDL::Color param_color);
+};
+void RTFParser::text(const std::string_view& text, bool utf8)
 {
+	const RTFGroupState &current = state();
+	if (current.skip_text)
+		return;
 	if (utf8)
-		state.current_elements << text;
+		main_elements << text;
 	else {
 		// Map non-ASCII chars to Unicode equivalent
-		const char *current = text.data();
-		std::size_t remaining = text.size();
-		for (std::size_t i = 0; i < remaining; ++i) {
-			unsigned char byte = reinterpret_cast<const unsigned char&>(current[i]);
+		const char *run = text.data();
+		const char *const end = run + text.size();
+		for (const char *iter = run; iter != end; ++iter) {
+			unsigned char byte = reinterpret_cast<const unsigned char&>(*iter);
 			if (byte >= 0x80) {
-				// Print special character
-				state.current_elements << std::string_view(current,i) << std::u32string_view(&state.hcodepage[byte-0x80],1);
-				// Reset counters
-				current += ++i;
-				remaining -= i;
-				i = 0;
+				// Print ASCII text before and the special character
+				if (iter != run)
+					main_elements << std::string_view(run,iter-run);
+				main_elements << std::u32string_view(&current.hcodepage[byte-0x80],1);
+				run = iter+1;
 			}
 		}
-		state.current_elements << std::string_view(current,remaining);
+		if (run != end)
+			main_elements << std::string_view(run,end-run);
 	}
 }
-static void rtf_skip_text(const std::string_view& text, RTFGroupState& state, bool utf8)
+void RTFParser::debug_control_word(const ControlWord &control_word, SDL::Color command_color, SDL::Color param_color)
 {
-	// Do nothing
+	main_elements << command_color;
+	text("\\",true);
+	text(control_word.command,true);
+	if (control_word.param) {
+		main_elements << param_color;
+		text(std::to_string(*control_word.param),true);
+	}
+	text(" ",true);
+	main_elements << SDL::Color(255,255,255,255);
+}
+/** Find the next character that is not plain text
+ * \return The next '\\', '{', '}', '\\r' or '\\n' or end
+ */
+static const char *rtf_find_special(const char *iter, const char *const end)
+{
+	#ifdef __SSE2__
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i open_brace = _mm_set1_epi8('{');
+	const __m128i close_brace = _mm_set1_epi8('}');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	for (; end - iter >= 16; iter += 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(iter));
+		const __m128i match = _mm_or_si128(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk,backslash),_mm_cmpeq_epi8(chunk,open_brace)),
+		                                                _mm_or_si128(_mm_cmpeq_epi8(chunk,close_brace),_mm_cmpeq_epi8(chunk,cr))),
+		                                   _mm_cmpeq_epi8(chunk,lf));
+		const unsigned int mask = _mm_movemask_epi8(match);
+		if (mask)
+			return iter + std::countr_zero(mask);
+	}
+	#endif
+	for (; iter != end; ++iter)
+		switch (*iter) {
+			case '\\':case '{':case '}':case '\r':case '\n':
+				return iter;
+		}
+	return end;
 }
 
-static void rtf_command_noop(ControlWord control_word, RTFGroupState& state)
+static void rtf_command_noop(RTFParser&, const ControlWord&, std::string_view)
 {
 }
-static void rtf_skip_command_group(ControlWord control_word, RTFGroupState& state)
+static constexpr RTFCommandSet skip_command_set{};
+static void rtf_skip_command_group(RTFParser& parser, const ControlWord&, std::string_view)
 {
-	state.command_set.clear();
-	state.text_handler = rtf_skip_text;
+	RTFGroupState &state = parser.state();
+	state.command_set = &skip_command_set;
+	state.skip_text = true;
 	state.unknow_command = rtf_command_noop;
 }
 
-static void rtf_unsupported_charset(ControlWord control_word, RTFGroupState& state)
+static void rtf_unsupported_charset(RTFParser&, const ControlWord& control_word, std::string_view)
 {
 	throw std::runtime_error("Only \\ansi encoding is supported, document use \\"s+std::string(control_word.command));
 }
-static void rtf_unknow_command(ControlWord control_word, RTFGroupState& state)
+static void rtf_unknow_command(RTFParser& parser, const ControlWord& control_word, std::string_view)
 {
-	if (Arcollect::debug.rtf) {
-		state.global.main_elements << SDL::Color(0,255,0,255);
-		state.text_handler("\\",state,true);
-		state.text_handler(control_word.command,state,true);
-		if (control_word.param) {
-			state.global.main_elements << SDL::Color(0,0,255,255);
-			state.text_handler(std::to_string(*control_word.param),state,true);
-		}
-		state.text_handler(" ",state,true);
-		state.global.main_elements << SDL::Color(255,255,255,255);
-	}
+	if (Arcollect::debug.rtf)
+		parser.debug_control_word(control_word,SDL::Color(0,255,0,255),SDL::Color(0,0,255,255));
+}
+static void rtf_put_chars(RTFParser& parser, const ControlWord& control_word, std::string_view chars)
+{
+	if (Arcollect::debug.rtf)
+		parser.debug_control_word(control_word,SDL::Color(255,255,0,255),SDL::Color(255,0,0,255));
+	parser.text(chars,true);
 }
-struct rtf_put_chars {
-	const std::string_view chars;
-	void operator()(ControlWord control_word, RTFGroupState& state) {
-		if (Arcollect::debug.rtf) {
-			state.global.main_elements << SDL::Color(255,255,0,255);
-			state.text_handler("\\",state,true);
-			state.text_handler(control_word.command,state,true);
-			if (control_word.param) {
-				state.global.main_elements << SDL::Color(255,0,0,255);
-				state.text_handler(std::to_string(*control_word.param),state,true);
-			}
-			state.text_handler(" ",state,true);
-			state.global.main_elements << SDL::Color(255,255,255,255);
-		}
-		state.text_handler(chars,state,true);
-	}
-	rtf_put_chars(const std::string_view& chars) : chars(chars) {}
-};
 template <typename T, T on = T(true), T off = T(false)>
-static void rtf_binary_attribute(ControlWord control_word, RTFGroupState& state) {
+static void rtf_binary_attribute(RTFParser& parser, const ControlWord& control_word, std::string_view) {
 	bool turn_on = control_word.param != 0; // FIXME What to do if the param is not zero ? [Currently enable the flag]
 	if (Arcollect::debug.rtf) {
-		state.global.main_elements << SDL::Color(255,255,0,255);
-		state.text_handler("\\",state,true);
-		state.global.main_elements << (turn_on ? SDL::Color(128,255,0,255) : SDL::Color(255,128,0,255));
-		state.text_handler(control_word.command,state,true);
-		if (control_word.param) {
-			state.text_handler(std::to_string(*control_word.param),state,true);
-		}
-		state.text_handler(" ",state,true);
-		state.global.main_elements << SDL::Color(255,255,255,255);
+		const SDL::Color color = turn_on ? SDL::Color(128,255,0,255) : SDL::Color(255,128,0,255);
+		parser.debug_control_word(control_word,color,color);
 	}
-	state.current_elements << (turn_on ? on : off);
+	parser.main_elements << (turn_on ? on : off);
 };
 
-static RTFCommandSet main_command_set{
+static constexpr RTFCommandSet main_command_set{
 	// Character sets
 	{"ansi",rtf_command_noop},
 	{"mac" ,rtf_unsupported_charset},
 	{"pc"  ,rtf_unsupported_charset},
 	{"pca" ,rtf_unsupported_charset},
-	{"ansicpg",[](ControlWord control_word, RTFGroupState& state) {
+	{"ansicpg",[](RTFParser& parser, const ControlWord& control_word, std::string_view) {
 		if (control_word.param) {
 			auto iter = windows_hcodepages.find(*control_word.param);
 			if (iter != windows_hcodepages.end())
-				state.hcodepage = iter->second.data();
+				parser.state().hcodepage = iter->second.data();
 		}
 	}},
 	// Header commands
@@ -189,45 +276,43 @@ static RTFCommandSet main_command_set{
 	// Document commands
 	{"info",rtf_skip_command_group},
 	// Escapes
-	{"bullet",rtf_put_chars("•")},
-	{"ldblquote",rtf_put_chars("“")},
-	{"rdblquote",rtf_put_chars("”")},
-	{"par",rtf_put_chars("\n\n")},
-	{"line",rtf_put_chars("\n")},
-	{"lquote",rtf_put_chars("‘")},
-	{"rquote",rtf_put_chars("’")},
+	{"bullet",rtf_put_chars,"•"},
+	{"ldblquote",rtf_put_chars,"“"},
+	{"rdblquote",rtf_put_chars,"”"},
+	{"par",rtf_put_chars,"\n\n"},
+	{"line",rtf_put_chars,"\n"},
+	{"lquote",rtf_put_chars,"‘"},
+	{"rquote",rtf_put_chars,"’"},
 	// Formatting
-	{"plain",[](ControlWord, RTFGroupState& state) { state.current_elements << state.global.plain_attributes; }},
+	{"plain",[](RTFParser& parser, const ControlWord&, std::string_view) { parser.main_elements << parser.plain_attributes; }},
 	{"b",rtf_binary_attribute<Arcollect::gui::font::Weight,200,80>},
-	};
-static RTFCommandSet start_command_set{
-	{"rtf", [](ControlWord control_word, RTFGroupState& state) {
+};
+static constexpr RTFCommandSet start_command_set{
+	{"rtf", [](RTFParser& parser, const ControlWord& control_word, std::string_view) {
 		if (!control_word.param)
 			throw std::runtime_error("\\rtf must have a version (Arcollect only support 1.x versions)");
 		if (control_word.param != 1)
 			throw std::runtime_error("RTF version "s+std::to_string(*control_word.param)+" not supported (Arcollect only support 1.x versions)");
 		// Version is okay
-		state.command_set = main_command_set;
-		state.unknow_command = rtf_unknow_command;
+		parser.state().command_set = &main_command_set;
+		parser.state().unknow_command = rtf_unknow_command;
 	}},
 };
 Arcollect::art_reader::TextElements Arcollect::art_reader::text_rtf(const char* iter, const char *const end)
 {
 	try {
-		RTFGlobalState global;
-		std::vector<RTFGroupState> group_stack{{
+		RTFParser parser;
+		parser.group_stack.push_back({
 			// Head of the stack
-			global,
-			global.main_elements,
-			rtf_echo_text,
-			start_command_set,
-			[](ControlWord, RTFGroupState& state) {
+			&start_command_set,
+			[](RTFParser&, const ControlWord&, std::string_view) {
 				throw std::runtime_error("RTF documents must begin with an \\rtf1 command");
 			},
 			default_hcodepage,
-		}};
+			false,
+		});
 		for (;iter != end; ++iter) {
-			RTFGroupState &state = group_stack.back();
+			RTFGroupState &state = parser.state();
 			switch (*iter) {
 				case '\\': {
 					// Process command
@@ -236,7 +321,7 @@ Arcollect::art_reader::TextElements Arcollect::art_reader::text_rtf(const char*
 					switch (*iter) {
 						case '*': {
 							// Ignore next commands
-							state.text_handler = rtf_skip_text;
+							state.skip_text = true;
 						} break;
 						case '\'': {
 							if (++iter == end)
@@ -252,19 +337,19 @@ Arcollect::art_reader::TextElements Arcollect::art_reader::text_rtf(const char*
 							if (parse_result.ptr != iter)
 								// Parsing went wrong
 								return Arcollect::art_reader::TextElements::build(U"Invalid hexa in \\'xx sequence"sv);
-							state.text_handler(std::string_view(&reinterpret_cast<const char&>(character),1),state,false);
+							parser.text(std::string_view(&reinterpret_cast<const char&>(character),1),false);
 							--iter;
 						} break;
 						case '\\':case '{':case '}': {
 							// Print escaped character as is
-							state.text_handler(std::string_view(iter,1),state,true);
+							parser.text(std::string_view(iter,1),true);
 						} break;
 						default: {
 							ControlWord control_word(iter,end);
-							auto cmd_iter = state.command_set.find(control_word.command);
-							if (cmd_iter != state.command_set.end())
-								cmd_iter->second(control_word,state);
-							else state.unknow_command(control_word,state);
+							const RTFCommand *command = state.command_set->find(control_word.command);
+							if (command)
+								command->handler(parser,control_word,command->arg);
+							else state.unknow_command(parser,control_word,{});
 							--iter;
 						} break;
 					}
@@ -272,37 +357,38 @@ Arcollect::art_reader::TextElements Arcollect::art_reader::text_rtf(const char*
 				case '{': {
 					// Push a copy of the current state
 					if (Arcollect::debug.rtf) {
-						global.main_elements << SDL::Color(255,0,0,255);
-						state.text_handler("{",state,true);
-						global.main_elements << SDL::Color(255,255,255,255);
+						parser.main_elements << SDL::Color(255,0,0,255);
+						parser.text("{",true);
+						parser.main_elements << SDL::Color(255,255,255,255);
 					}
-					group_stack.push_back(state);
+					parser.group_stack.push_back(state);
 				} break;
 				case '}': {
-					group_stack.pop_back();
 					// Pop state from stack
+					parser.group_stack.pop_back();
+					if (parser.group_stack.empty())
+						return Arcollect::art_reader::TextElements::build(U"Mismatched '}' in RTF file"sv);
 					if (Arcollect::debug.rtf) {
-						global.main_elements << SDL::Color(255,255,0,255);
-						group_stack.back().text_handler("}",group_stack.back(),true);
-						global.main_elements << SDL::Color(255,255,255,255);
+						parser.main_elements << SDL::Color(255,255,0,255);
+						parser.text("}",true);
+						parser.main_elements << SDL::Color(255,255,255,255);
 					}
-					if (group_stack.empty())
-						return Arcollect::art_reader::TextElements::build(U"Mismatched '}' in RTF file"sv);
 				} break;
 				case '\r':case '\n': {
 					// Skip line breaks
 				} break;
 				default: {
-					// Process text
-					// TODO Do bulk addition, no individual char
-					state.text_handler(std::string_view(iter,1),state,false);
+					// Process a run of text
+					const char *run_end = rtf_find_special(iter,end);
+					parser.text(std::string_view(iter,run_end-iter),false);
+					iter = run_end-1;
 				} break;
 			}
 		}
 		if (Arcollect::debug.rtf) {
-			global.main_elements.dump_to_stderr();
+			parser.main_elements.dump_to_stderr();
 		}
-		return global.main_elements;
+		return parser.main_elements;
 	} catch (std::exception &e) {
 		return Arcollect::art_reader::TextElements::build(SDL::Color(255,0,0,255),std::string_view(e.what()));
 	}
@@ -21,7 +21,7 @@
  * in another source files.
  */
 #include "text.hpp"
-#include <fstream>
+#include "file-source.hpp"
 
 Arcollect::art_reader::Charset Arcollect::art_reader::mime_extract_charset(const std::string_view &mime, std::string_view &charset_name)
 {
@@ -49,9 +49,9 @@ Arcollect::gui::font::Elements Arcollect::art_reader::text(const std::filesystem
 	constexpr SDL::Color Y{0xFFFF00ff}; // Yellow
 	constexpr SDL::Color W{0xFFFFFFff}; // White
 	// Load artwork
-	std::string file_content;
-	std::getline(std::ifstream(path),file_content,'\0');
-	const std::u32string_view file_content_as_utf32(reinterpret_cast<char32_t*>(file_content.data()),file_content.size()/sizeof(char32_t));
+	const file_source file(path);
+	const std::string_view file_content = file.data();
+	const std::u32string_view file_content_as_utf32(reinterpret_cast<const char32_t*>(file_content.data()),file_content.size()/sizeof(char32_t));
 	// Configure elements
 	TextElements elements;
 	// TODO elements.initial_height = ;
@@ -76,9 +76,9 @@ Arcollect::gui::font::Elements Arcollect::art_reader::text(const std::filesystem
 					return elements << file_content_as_utf32;
 			}
 		else if (subtype == "rtf") {
-			return text_rtf(&*file_content.begin(),&*file_content.end());
+			return text_rtf(file_content.data(),file_content.data()+file_content.size());
 		} return elements << Y << mime << W << U" text types are not supported."sv;
 	} else if (mime == "application/rtf")
-		return text_rtf(&*file_content.begin(),&*file_content.end());
+		return text_rtf(file_content.data(),file_content.data()+file_content.size());
 	return elements << Y << mime << W << U" text types are not supported."sv;
 }
@@ -25,6 +25,7 @@ Arcollect::config::Param<int> Arcollect::config::littlecms_intent(INTENT_PERCEPT
 Arcollect::config::Param<int> Arcollect::config::littlecms_flags(cmsFLAGS_HIGHRESPRECALC|cmsFLAGS_BLACKPOINTCOMPENSATION);
 Arcollect::config::Param<int> Arcollect::config::writing_font_size(18);
 Arcollect::config::Param<int> Arcollect::config::rows_per_screen(5);
+Arcollect::config::Param<int> Arcollect::config::thumbnails_pack(1);
 
 void Arcollect::config::read_config(void)
 {
@@ -36,6 +37,7 @@ void Arcollect::config::read_config(void)
 	littlecms_intent.value = reader.GetInteger("arcollect","littlecms_intent",littlecms_intent.default_value);
 	writing_font_size.value = reader.GetInteger("arcollect","writing_font_size",writing_font_size.default_value);
 	rows_per_screen.value = reader.GetInteger("arcollect","rows_per_screen",rows_per_screen.default_value);
+	thumbnails_pack.value = reader.GetInteger("arcollect","thumbnails_pack",thumbnails_pack.default_value);
 }
 #define stringify_macro(s) stringify(s)
 #define stringify(s) #s
@@ -91,5 +93,10 @@ void Arcollect::config::write_config(void)
 	          "; This adjust the height of rows in the grid view to display the given number of rows at full screen.\n"
 	          "; Default is " << rows_per_screen.default_value << "\n"
 	          "rows_per_screen=" << rows_per_screen << "\n"
+	          "\n"
+	          "; thumbnails_pack - Use the thumbnails pack\n"
+	          "; When non-zero, grid thumbnails are also stored decoded in a pack in the cache directory. It load faster than XDG thumbnails but use more disk space.\n"
+	          "; Default is " << thumbnails_pack.default_value << "\n"
+	          "thumbnails_pack=" << thumbnails_pack << "\n"
 	;
 }
@@ -113,5 +113,12 @@ namespace Arcollect {
 		 * number of rows at full screen.
 		 */
 		extern Param<int> rows_per_screen;
+		
+		/** thumbnails_pack - Use the thumbnails pack
+		 *
+		 * When non-zero, grid thumbnails are also stored decoded in a
+		 * memory-mapped pack in the cache directory to load them faster.
+		 */
+		extern Param<int> thumbnails_pack;
 	}
 }
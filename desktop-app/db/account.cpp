@@ -17,8 +17,8 @@
 #include "account.hpp"
 #include "db.hpp"
 #include "download.hpp"
-#include <unordered_map>
-static std::unordered_map<sqlite_int64,std::shared_ptr<Arcollect::db::account>> accounts_pool;
+#include "object-pool.hpp"
+static Arcollect::db::object_pool<Arcollect::db::account> accounts_pool;
 
 Arcollect::db::account::account(Arcollect::db::account_id arcoid) :
 	arcoid(arcoid)
@@ -26,10 +26,14 @@ Arcollect::db::account::account(Arcollect::db::account_id arcoid) :
 }
 std::shared_ptr<Arcollect::db::account> &Arcollect::db::account::query(Arcollect::db::account_id arcoid)
 {
-	std::shared_ptr<Arcollect::db::account> &pointer = accounts_pool.try_emplace(arcoid).first->second;
-	if (!pointer)
-		pointer = std::shared_ptr<Arcollect::db::account>(new Arcollect::db::account(arcoid));
-	return pointer;
+	std::shared_ptr<Arcollect::db::account> *pointer = accounts_pool.find(arcoid);
+	return pointer ? *pointer : accounts_pool.emplace(arcoid,arcoid);
+}
+std::size_t Arcollect::db::account::reclaim(bool all)
+{
+	return accounts_pool.reclaim([](const account&) {
+		return true;
+	},all ? 0 : accounts_pool.reclaim_min_age,all ? std::numeric_limits<std::uint32_t>::max() : accounts_pool.reclaim_budget);
 }
 
 void Arcollect::db::account::db_sync(void)
@@ -31,6 +31,7 @@ namespace Arcollect {
 		 */
 		class account {
 			private:
+				friend slab_allocator<account>;
 				account(Arcollect::db::account_id arcoid);
 				// Cached DB infos
 				sqlite_int64 data_version = -1;
@@ -77,6 +78,17 @@ namespace Arcollect {
 				 * This function create or return a cached version of the #Arcollect::db::account.
 				 */
 				static std::shared_ptr<account> &query(Arcollect::db::account_id arcoid);
+				/** Reclaim unused accounts
+				 *
+				 * Destroy accounts no longer referenced and not queried recently,
+				 * see Arcollect::db::object_pool::reclaim().
+				 *
+				 * It is called by Arcollect::gui::main() on each frame, and with
+				 * `all` by Arcollect::gui::reclaim_memory().
+				 * \param all Scan all objects and ignore their age
+				 * \return The number of objects destroyed
+				 */
+				static std::size_t reclaim(bool all = false);
 		};
 	}
 }
@@ -17,9 +17,13 @@
 #include "artwork-collection.hpp"
 #include "db.hpp"
 #include "sorting.hpp"
-#include <arcollect-db-downloads.hpp>
-#include <arcollect-paths.hpp>
+#include "write-behind.hpp"
+#include "../gui/task.hpp"
 #include <arcollect-sqls.hpp>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <unordered_set>
 Arcollect::db::artwork_collection::artwork_collection(void)
 {
 	while (!need_entries(4096));
@@ -57,121 +61,151 @@ Arcollect::db::artwork_collection::iterator Arcollect::db::artwork_collection::f
 	else return end();
 }
 
-int Arcollect::db::artwork_collection::db_delete(void)
+/** Artworks per bulk statement
+ *
+ * SQLite may be built with a maximum of 999 variables per statement.
+ */
+static constexpr std::size_t bulk_chunk_size = 500;
+/** Run a statement over a set of ids
+ * \param db The connection to use
+ * \param prefix The SQL before the "(?,?,...)" ids list
+ * \param suffix The SQL after the ids list
+ * \param ids The ids to bind
+ * \param bind_extra Bind other parameters after each prepare and return the
+ *        index of the first id parameter
+ * \param on_row Called for each returned row
+ * \return SQLITE_OK on success or an SQLite error code
+ *
+ * Ids are bound in chunks of #bulk_chunk_size, statements are only prepared
+ * twice at most (for full chunks and the remainder).
+ */
+template <typename BindFunction, typename RowFunction>
+static int bulk_exec(std::unique_ptr<SQLite3::sqlite3> &db, const std::string_view &prefix, const std::string_view &suffix, const std::vector<sqlite_int64> &ids, BindFunction bind_extra, RowFunction on_row)
 {
-	std::unordered_set<sqlite_int64> downloads_to_remove;
-	int code;
-	if ((code = database->exec("BEGIN IMMEDIATE;")) != SQLITE_OK) {
-		switch (code) {
-			case SQLITE_BUSY: {
-				std::cerr << "Deleting artworks, \"BEGIN IMMEDIATE;\" failed with SQLITE_BUSY. Another is writing on the database. Abort." << std::endl;
-			} return SQLITE_BUSY;
-			default: {
-				std::cerr << "Deleting artworks, \"BEGIN IMMEDIATE;\" failed: " << database->errmsg() << ". Ignoring..." << std::endl;
-			} break;
-		}
-	}
 	std::unique_ptr<SQLite3::stmt> stmt;
-	
-	// Run the query
-	if (database->prepare(Arcollect::db::sql::delete_artwork,stmt) != SQLITE_OK) {
-		std::cerr << "Deleting artworks, failed to prepare: " << database->errmsg() << ". Rollback." << std::endl;
-		database->exec("ROLLBACK;");
-		return SQLITE_ERROR;
-	}
-	for (artwork_id art_id: *this) {
-		stmt->reset();
-		if (stmt->bind(1,art_id) != SQLITE_OK) {
-			std::cerr << "Deleting artworks, failed to bind art_artid: " << database->errmsg() << ". Rollback." << std::endl;
-			database->exec("ROLLBACK;");
-			return SQLITE_ERROR;
+	std::size_t stmt_size = 0;
+	int first_id_param = 1;
+	for (std::size_t offset = 0; offset < ids.size(); offset += bulk_chunk_size) {
+		const std::size_t count = std::min(bulk_chunk_size,ids.size()-offset);
+		if (count != stmt_size) {
+			std::string sql(prefix);
+			sql += "(?";
+			for (std::size_t i = 1; i < count; i++)
+				sql += ",?";
+			sql += ")";
+			sql += suffix;
+			if (db->prepare(sql.c_str(),stmt) != SQLITE_OK) {
+				std::cerr << "Bulk edit, failed to prepare \"" << prefix << "(...)" << suffix << "\": " << db->errmsg() << std::endl;
+				return SQLITE_ERROR;
+			}
+			stmt_size = count;
+			first_id_param = bind_extra(stmt);
+		} else stmt->reset();
+		for (std::size_t i = 0; i < count; i++)
+			stmt->bind(first_id_param+static_cast<int>(i),ids[offset+i]);
+		int code;
+		while ((code = stmt->step()) == SQLITE_ROW)
+			on_row(stmt);
+		if (code != SQLITE_DONE) {
+			std::cerr << "Bulk edit, failed to run \"" << prefix << "(...)" << suffix << "\": " << db->errmsg() << std::endl;
+			return code;
 		}
-		switch (stmt->step()) {
-			case SQLITE_ROW: {
-				downloads_to_remove.insert(stmt->column_int64(0));
-				downloads_to_remove.insert(stmt->column_int64(1));
-			} break;
-			case SQLITE_DONE: {
-				std::cerr << "Tried to delete non existing artwork " << art_id << ". Continue normally." << std::endl;
-			} break;
-		}
-		if (stmt->step() != SQLITE_DONE) {
-			std::cerr << "Deleting artworks, the step() did not SQLITE_DONE: " << database->errmsg() << ". Rollback." << std::endl;
-			database->exec("ROLLBACK;"); // TODO Error checkings
-			return SQLITE_ERROR;
-		}
-	}
-	// Erase downloads
-	Arcollect::db::download::Transaction dwn_transaction(database);
-	for (sqlite3_int64 dwn_id: downloads_to_remove)
-		Arcollect::db::download::delete_cache(dwn_id,dwn_transaction);
-	
-	// Commit changes
-	if (database->exec("COMMIT;") != SQLITE_OK) {
-		std::cerr << "Deleting artworks, failed to commit changes: " << database->errmsg() << ". Rollback." << std::endl;
-		database->exec("ROLLBACK;"); // TODO Error checkings
-		return SQLITE_ERROR;
 	}
-	
-	dwn_transaction.commit();
-	std::cerr << "Artworks has been deleted" << std::endl;
-	// Update data_version
-	Arcollect::local_data_version_changed();
-	return 0;
+	return SQLITE_OK;
 }
-int Arcollect::db::artwork_collection::db_set_rating(Arcollect::config::Rating rating)
+static int bulk_bind_nothing(std::unique_ptr<SQLite3::stmt> &stmt)
 {
-	int code;
-	if ((code = database->exec("BEGIN IMMEDIATE;")) != SQLITE_OK) {
-		switch (code) {
-			case SQLITE_BUSY: {
-				std::cerr << "Setting artworks rating, \"BEGIN IMMEDIATE;\" failed with SQLITE_BUSY. Another is writing on the database. Abort." << std::endl;
-			} return SQLITE_BUSY;
-			default: {
-				std::cerr << "Setting artworks rating, \"BEGIN IMMEDIATE;\" failed: " << database->errmsg() << ". Ignoring..." << std::endl;
-			} break;
-		}
-	}
-	std::unique_ptr<SQLite3::stmt> stmt;
-	
-	// Run all substeps from 'delete_artwork.sql'
-	if (database->prepare("UPDATE artworks SET art_rating = ? WHERE art_artid = ?;",stmt) != SQLITE_OK) {
-		std::cerr << "Setting artworks ratings, failed to prepare: " << database->errmsg() << ". Rollback." << std::endl;
-		database->exec("ROLLBACK;");
-		return SQLITE_ERROR;
-	}
-	if (stmt->bind(1,static_cast<sqlite_int64>(rating)) != SQLITE_OK) {
-		std::cerr << "Setting artworks ratings, failed to bind art_rating: " << database->errmsg() << ". Rollback." << std::endl;
-		database->exec("ROLLBACK;");
-		return SQLITE_ERROR;
-	}
-	for (artwork_id art_id: *this) {
-		if (stmt->bind(2,art_id) != SQLITE_OK) {
-			std::cerr << "Setting artworks ratings, failed to bind art_artid: " << database->errmsg() << ". Rollback." << std::endl;
-			database->exec("ROLLBACK;");
-			return SQLITE_ERROR;
+	return 1;
+}
+
+std::future<int> Arcollect::db::artwork_collection::db_delete(void)
+{
+	const auto art_ids = std::make_shared<const std::vector<artwork_id>>(begin(),end());
+	const auto deleted_files = std::make_shared<std::vector<std::filesystem::path>>();
+	return Arcollect::db::write_behind::queue([art_ids,deleted_files](std::unique_ptr<SQLite3::sqlite3> &db) -> int {
+		// Forget files of a previous attempt rolled back on lock
+		deleted_files->clear();
+		// Delete artworks and collect their downloads
+		std::unordered_set<sqlite_int64> downloads_set;
+		int code = bulk_exec(db,"DELETE FROM artworks WHERE art_artid IN "," RETURNING art_dwnid, art_thumbnail;",*art_ids,bulk_bind_nothing,[&](std::unique_ptr<SQLite3::stmt> &stmt) {
+			downloads_set.insert(stmt->column_int64(0));
+			if (stmt->column_type(1) != SQLITE_NULL)
+				downloads_set.insert(stmt->column_int64(1));
+		});
+		if (code != SQLITE_OK)
+			return code;
+		// Erase downloads no longer referenced, files are removed once committed
+		const std::vector<sqlite_int64> downloads(downloads_set.begin(),downloads_set.end());
+		std::unordered_set<std::string> paths;
+		code = bulk_exec(db,"DELETE FROM downloads WHERE dwn_id IN ",
+			" AND NOT EXISTS (SELECT 1 FROM artworks WHERE art_dwnid     = dwn_id)"
+			" AND NOT EXISTS (SELECT 1 FROM artworks WHERE art_thumbnail = dwn_id)"
+			" AND NOT EXISTS (SELECT 1 FROM accounts WHERE acc_icon      = dwn_id)"
+			" RETURNING dwn_path;",downloads,bulk_bind_nothing,[&](std::unique_ptr<SQLite3::stmt> &stmt) {
+			paths.emplace(stmt->column_string(0));
+		});
+		if (code != SQLITE_OK)
+			return code;
+		// Keep files still shared with other downloads
+		std::unique_ptr<SQLite3::stmt> stmt;
+		code = db->prepare(Arcollect::db::sql::downloads_path_used,stmt);
+		if (code != SQLITE_OK)
+			return code;
+		for (const std::string &path: paths) {
+			stmt->reset();
+			stmt->bind(1,path);
+			switch (code = stmt->step()) {
+				case SQLITE_ROW: {
+				} break;
+				case SQLITE_DONE: {
+					deleted_files->emplace_back(path);
+				} break;
+				default:
+					return code;
+			}
 		}
-		if (stmt->step() != SQLITE_DONE) {
-			std::cerr << "Setting artworks ratings, failed to run substep: " << database->errmsg() << ". Rollback." << std::endl;
-			database->exec("ROLLBACK;"); // TODO Error checkings
-			return SQLITE_ERROR;
+		return SQLITE_OK;
+	},[deleted_files](int code) {
+		if (code != SQLITE_OK)
+			return;
+		std::cerr << "Artworks has been deleted" << std::endl;
+		Arcollect::db::write_behind::remove_files(std::move(*deleted_files));
+	});
+}
+/** Apply a rating to instanciated artworks
+ *
+ * Artworks not instanciated will read it from the database.
+ */
+static Arcollect::gui::task reset_taint(std::shared_ptr<const std::vector<Arcollect::db::artwork_id>> art_ids, Arcollect::config::Rating rating)
+{
+	Arcollect::gui::tasks::state &state = Arcollect::gui::tasks::current();
+	state.total = art_ids->size();
+	for (Arcollect::db::artwork_id art_id: *art_ids) {
+		std::shared_ptr<Arcollect::db::artwork> artwork = Arcollect::db::artwork::query_instanciated(art_id);
+		if (artwork) {
+			artwork->get_artwork()->reset_taint(rating);
+			artwork->get_thumbnail()->reset_taint(rating);
 		}
-		stmt->reset();
-	}
-	
-	// Commit changes
-	if (database->exec("COMMIT;") != SQLITE_OK) {
-		std::cerr << "Setting artworks ratings, failed to commit changes: " << database->errmsg() << ". Rollback." << std::endl;
-		database->exec("ROLLBACK;"); // TODO Error checkings
-		return SQLITE_ERROR;
+		state.progress++;
+		if (!co_await Arcollect::gui::tasks::yield())
+			co_return;
 	}
-	std::cerr << "Artworks ratings sets" << std::endl;
-	// Update data_version
-	Arcollect::local_data_version_changed();
-	// Reset taint
-	for (auto& art_id: *this) {
-		artwork::query(art_id)->get_artwork()->reset_taint(rating);
-		artwork::query(art_id)->get_thumbnail()->reset_taint(rating);
-	}
-	return 0;
+}
+std::future<int> Arcollect::db::artwork_collection::db_set_rating(Arcollect::config::Rating rating)
+{
+	const auto art_ids = std::make_shared<const std::vector<artwork_id>>(begin(),end());
+	// Apply the rating now
+	Arcollect::gui::tasks::start(::reset_taint(art_ids,rating));
+	return Arcollect::db::write_behind::queue([art_ids,rating](std::unique_ptr<SQLite3::sqlite3> &db) -> int {
+		return bulk_exec(db,"UPDATE artworks SET art_rating = ? WHERE art_artid IN ",";",*art_ids,[rating](std::unique_ptr<SQLite3::stmt> &stmt) {
+			stmt->bind(1,static_cast<sqlite_int64>(rating));
+			return 2;
+		},[](std::unique_ptr<SQLite3::stmt> &stmt) {});
+	},[art_ids,rating](int code) {
+		if (code != SQLITE_OK)
+			return;
+		std::cerr << "Artworks ratings sets" << std::endl;
+		// The sync with the database only raise taints
+		Arcollect::gui::tasks::start(::reset_taint(art_ids,rating));
+	});
 }
@@ -21,6 +21,7 @@
 #include "artwork.hpp"
 #include "search.hpp"
 #include "../config.hpp"
+#include <future>
 namespace Arcollect {
 	namespace db {
 		/** Artwork listing interface
@@ -31,7 +32,8 @@ namespace Arcollect {
 		 * GUI parts displayed artwork collection use this.
 		 *
 		 * \todo Currently, need_entries() is just called in the constructor until
-		 *       no more object are available.
+		 *       no more object are available, or by fetch() for collections
+		 *       built incrementally.
 		 */
 		class artwork_collection {
 			private:
@@ -90,6 +92,17 @@ namespace Arcollect {
 				 */
 				SortingType sorting_type = SORT_NONE;
 				
+				/** Pull more entries
+				 * \param entries_count The number of entries requested
+				 * \return true if the collection is complete
+				 *
+				 * This is used to fill collections built incrementally, typically in a
+				 * #Arcollect::gui::task between yields.
+				 */
+				bool fetch(cache_size_type entries_count) {
+					return need_entries(entries_count);
+				}
+				
 				using iterator = decltype(cache)::const_iterator;
 				iterator begin(void) {
 					return cache.cbegin();
@@ -141,13 +154,20 @@ namespace Arcollect {
 				virtual ~artwork_collection(void) = default;
 				
 				/** Delete all artworks in this collection
+				 * \return A future resolved once committed, see
+				 *         Arcollect::db::write_behind
 				 *
 				 * This is not an innocent function !
 				 */
-				int db_delete(void);
+				std::future<int> db_delete(void);
 				/** Set rating of all artworks in this collection
+				 * \return A future resolved once committed, see
+				 *         Arcollect::db::write_behind
+				 *
+				 * The rating is applied to loaded artworks by an #Arcollect::gui::task
+				 * started immediately, and again after the commit.
 				 */
-				int db_set_rating(Arcollect::config::Rating rating);
+				std::future<int> db_set_rating(Arcollect::config::Rating rating);
 		};
 	}
 }
@@ -32,17 +32,16 @@ namespace Arcollect {
 			public:
 				/** Constructor
 				 * \param stmt The prepared stmts
+				 * \param fill Whether to read all rows now, otherwise rows are read
+				 *        by fetch()
 				 *
 				 * The statement must yield the art_artid and it will be stealed.
 				 */
-				artwork_collection_sqlite(std::unique_ptr<SQLite3::stmt> &&stmt)
+				artwork_collection_sqlite(std::unique_ptr<SQLite3::stmt> &&stmt, bool fill = true) :
+					stmt(std::move(stmt))
 				{
-					int status;
-					while ((status = stmt->step()) == SQLITE_ROW)
-						cache_append(stmt->column_int64(0));
-					if (status != SQLITE_DONE)
-						std::cerr << "artwork_collection_sqlite(stmt) failed to read rows: " << database->errmsg() << std::endl;
-					stmt.reset();
+					if (fill)
+						while (!need_entries(4096));
 				}
 				artwork_collection::iterator find(artwork_id id) override {
 					return find_artid_randomized(id,false);
@@ -50,6 +49,27 @@ namespace Arcollect {
 				artwork_collection::iterator find_nearest(artwork_id id) override {
 					return find_artid_randomized(id,true);
 				}
+			protected:
+				/** Statement to read rows from
+				 *
+				 * It is released once all rows are read.
+				 */
+				std::unique_ptr<SQLite3::stmt> stmt;
+				bool need_entries(cache_size_type entries_count) override {
+					if (!stmt)
+						return true;
+					for (; entries_count; entries_count--) {
+						const int status = stmt->step();
+						if (status != SQLITE_ROW) {
+							if (status != SQLITE_DONE)
+								std::cerr << "artwork_collection_sqlite(stmt) failed to read rows: " << database->errmsg() << std::endl;
+							stmt.reset();
+							return true;
+						}
+						cache_append(stmt->column_int64(0));
+					}
+					return false;
+				}
 		};
 		/** Artwork collection bound to a single artwork
 		 */
@@ -17,41 +17,75 @@
 #include <arcollect-debug.hpp>
 #include "../config.hpp"
 #include "artwork-loader.hpp"
+#include <config.h>
+#if WITH_XDG
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 std::mutex Arcollect::db::artwork_loader::lock;
 std::vector<std::shared_ptr<Arcollect::db::download>> Arcollect::db::artwork_loader::pending_main;
 std::vector<std::shared_ptr<Arcollect::db::download>> Arcollect::db::artwork_loader::pending_thread_first;
 std::vector<std::shared_ptr<Arcollect::db::download>> Arcollect::db::artwork_loader::pending_thread_second;
+std::vector<std::shared_ptr<Arcollect::db::download>> Arcollect::db::artwork_loader::pending_thread_prefetch;
+std::vector<std::filesystem::path> Arcollect::db::artwork_loader::pending_thread_readahead;
 std::unordered_set<std::shared_ptr<Arcollect::db::download>> Arcollect::db::artwork_loader::done;
 std::condition_variable Arcollect::db::artwork_loader::condition_variable;
 std::size_t Arcollect::db::artwork_loader::image_memory_usage = 0;
 std::vector<std::unique_ptr<Arcollect::db::artwork_loader>> Arcollect::db::artwork_loader::threads;
+std::atomic<unsigned int> Arcollect::db::artwork_loader::loading_count = 0;
+
+unsigned int Arcollect::db::artwork_loader::decode_threads(void)
+{
+	const unsigned int cores = std::max(1u,std::thread::hardware_concurrency());
+	// Count loads to perform, stop once there is enough to fill all cores
+	unsigned int loads = loading_count;
+	for (const auto *pending_thread: {&pending_thread_first,&pending_thread_second,&pending_thread_prefetch})
+		for (auto iter = pending_thread->begin(); (iter != pending_thread->end()) && (loads < cores); ++iter)
+			loads += (*iter)->load_state == download::LOAD_PENDING_STAGE1;
+	return std::max(1u,cores/std::max(1u,loads));
+}
 
 void Arcollect::db::artwork_loader::thread_func(volatile bool &stop)
 {
 	while (!stop) {
 		// Find an artwork to load
 		std::shared_ptr<Arcollect::db::download> artwork;
+		std::filesystem::path readahead_path;
+		unsigned int threads = 1;
 		{
 			std::unique_lock<std::mutex> lock_guard(lock);
-			while (pending_thread_first.empty() && pending_thread_second.empty()) {
+			while (pending_thread_first.empty() && pending_thread_second.empty() && pending_thread_prefetch.empty() && pending_thread_readahead.empty()) {
 				if (stop)
 					return;
 				condition_variable.wait(lock_guard);
 			}
-			// Pop artwork
-			auto &pending_thread = pending_thread_first.size() ? pending_thread_first : pending_thread_second;
-			artwork = pending_thread.back();
-			pending_thread.pop_back();
-			// Skip if it has already been loaded
-			if (artwork->load_state != artwork->LOAD_PENDING_STAGE1)
-				continue;
-			// Lock the artwork (it might be in both pending_thread_first and pending_thread_second)
-			artwork->load_state = artwork->LOADING_STAGE1;
+			if (pending_thread_first.empty() && pending_thread_second.empty() && pending_thread_prefetch.empty()) {
+				// Nothing else to do, pop a file to readahead
+				readahead_path = std::move(pending_thread_readahead.back());
+				pending_thread_readahead.pop_back();
+			} else {
+				// Pop artwork
+				auto &pending_thread = pending_thread_first.size() ? pending_thread_first : pending_thread_second.size() ? pending_thread_second : pending_thread_prefetch;
+				artwork = pending_thread.back();
+				pending_thread.pop_back();
+				// Skip if it has already been loaded
+				if (artwork->load_state != artwork->LOAD_PENDING_STAGE1)
+					continue;
+				// Lock the artwork (it might be in both pending_thread_first and pending_thread_second)
+				artwork->load_state = artwork->LOADING_STAGE1;
+				loading_count++;
+				threads = decode_threads();
+			}
+		}
+		if (!artwork) {
+			readahead(readahead_path);
+			continue;
 		}
 		// Check if the artwork is worth to load
 		if (artwork->keep_loaded())
-			artwork->load_stage_one();
+			artwork->load_stage_one(threads);
 		else artwork->load_state = artwork->UNLOADED;
+		loading_count--;
 		// Queue the artwork for load
 		if (artwork->load_state == artwork->LOAD_PENDING_STAGE2) {
 			std::lock_guard<std::mutex> lock_guard(lock);
@@ -67,6 +101,16 @@ void Arcollect::db::artwork_loader::thread_func(volatile bool &stop)
 	}
 }
 
+void Arcollect::db::artwork_loader::readahead(const std::filesystem::path &path)
+{
+	#if WITH_XDG
+	int fd = open(path.c_str(),O_RDONLY|O_CLOEXEC);
+	if (fd < 0)
+		return;
+	posix_fadvise(fd,0,0,POSIX_FADV_WILLNEED);
+	close(fd);
+	#endif
+}
 void Arcollect::db::artwork_loader::start(void)
 {
 	Arcollect::db::artwork_loader::threads.clear();
@@ -16,7 +16,9 @@
  */
 #pragma once
 #include "download.hpp"
+#include <atomic>
 #include <condition_variable>
+#include <filesystem>
 #include <mutex>
 #include <thread>
 #include <memory>
@@ -72,6 +74,13 @@ namespace Arcollect {
 		 * Arcollect::gui::main() load it into an SDL::Texture (this must be done
 		 * in the main thread) and call Arcollect::db::artwork::texture_loaded().
 		 * The artwork is now loaded.
+		 *
+		 * Arcollect::gui::prefetcher adds two lower priority queues for artworks
+		 * that are likely to be displayed soon:
+		 * * Arcollect::db::artwork_loader::pending_thread_prefetch is loaded when
+		 *   both others queues are empty.
+		 * * Arcollect::db::artwork_loader::pending_thread_readahead is a list of
+		 *   files that threads ask the kernel to read in background when idle.
 		 */
 		class artwork_loader: private std::thread {
 			private:
@@ -83,6 +92,26 @@ namespace Arcollect {
 				bool stop;
 				artwork_loader(void) : std::thread(thread_func,std::ref(stop = false)) {}
 				static void thread_func(volatile bool &stop);
+				/** Number of threads in download::load_stage_one()
+				 */
+				static std::atomic<unsigned int> loading_count;
+				/** Compute the number of threads to give to a load
+				 * \return The number of threads to use
+				 *
+				 * When there is less loads to perform than cores, like when the
+				 * slideshow wait for one large image, spare cores are shared between
+				 * ongoing loads. Under load, each load gets one thread.
+				 *
+				 * \warning #lock must be held.
+				 */
+				static unsigned int decode_threads(void);
+				/** Ask the kernel to read a file in background
+				 * \param path of the file
+				 *
+				 * Used for #pending_thread_readahead. It does nothing on platforms
+				 * without `posix_fadvise()`.
+				 */
+				static void readahead(const std::filesystem::path &path);
 			public:
 				~artwork_loader(void);
 				/** Global mutex
@@ -115,6 +144,22 @@ namespace Arcollect {
 				 * into this list (as opposed to move into in for #pending_thread_first).
 				 */
 				static std::vector<std::shared_ptr<Arcollect::db::download>> pending_thread_second;
+				/** Prefetch artwork list (thread side)
+				 *
+				 * This vector contain the list of artworks likely to be displayed soon.
+				 *
+				 * The loading thread load these artworks if #pending_thread_first and
+				 * #pending_thread_second are empty. It is managed by
+				 * Arcollect::gui::prefetcher that cancel artworks no longer wanted.
+				 */
+				static std::vector<std::shared_ptr<Arcollect::db::download>> pending_thread_prefetch;
+				/** Readahead file list (thread side)
+				 *
+				 * The loading thread ask the kernel to read these files in background
+				 * when all others queues are empty. It is managed by
+				 * Arcollect::gui::prefetcher.
+				 */
+				static std::vector<std::filesystem::path> pending_thread_readahead;
 				/** Loaded artwork surface list
 				 *
 				 * This vector contain the list of loaded surfaces. The main thread will
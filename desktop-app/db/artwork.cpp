@@ -18,8 +18,9 @@
 #include "artwork-loader.hpp"
 #include "account.hpp"
 #include "db.hpp"
+#include "object-pool.hpp"
 
-static std::unordered_map<sqlite_int64,std::shared_ptr<Arcollect::db::artwork>> artworks_pool;
+static Arcollect::db::object_pool<Arcollect::db::artwork> artworks_pool;
 
 Arcollect::db::artwork::artwork(Arcollect::db::artwork_id art_id) :
 	data_version(-2),
@@ -29,10 +30,19 @@ Arcollect::db::artwork::artwork(Arcollect::db::artwork_id art_id) :
 }
 std::shared_ptr<Arcollect::db::artwork> &Arcollect::db::artwork::query(Arcollect::db::artwork_id art_id)
 {
-	std::shared_ptr<Arcollect::db::artwork> &pointer = artworks_pool.try_emplace(art_id).first->second;
-	if (!pointer)
-		pointer = std::shared_ptr<Arcollect::db::artwork>(new Arcollect::db::artwork(art_id));
-	return pointer;
+	std::shared_ptr<Arcollect::db::artwork> *pointer = artworks_pool.find(art_id);
+	return pointer ? *pointer : artworks_pool.emplace(art_id,art_id);
+}
+std::shared_ptr<Arcollect::db::artwork> Arcollect::db::artwork::query_instanciated(Arcollect::db::artwork_id art_id)
+{
+	std::shared_ptr<Arcollect::db::artwork> *pointer = artworks_pool.find(art_id);
+	return pointer ? *pointer : std::shared_ptr<Arcollect::db::artwork>();
+}
+std::size_t Arcollect::db::artwork::reclaim(bool all)
+{
+	return artworks_pool.reclaim([](const artwork&) {
+		return true;
+	},all ? 0 : artworks_pool.reclaim_min_age,all ? std::numeric_limits<std::uint32_t>::max() : artworks_pool.reclaim_budget);
 }
 
 static std::string column_string_default(std::unique_ptr<SQLite3::stmt> &stmt, int col)
@@ -45,6 +45,7 @@ namespace Arcollect {
 		 */
 		class artwork {
 			private:
+				friend slab_allocator<artwork>;
 				artwork(Arcollect::db::artwork_id art_id);
 				// Cached DB infos
 				sqlite_int64 data_version;
@@ -77,14 +78,14 @@ namespace Arcollect {
 				 */
 				const Arcollect::db::artwork_id art_id;
 				
-				std::shared_ptr<download> get_artwork(void) {
+				const std::shared_ptr<download> &get_artwork(void) {
 					return data;
 				}
-				std::shared_ptr<download> get_thumbnail(void) {
+				const std::shared_ptr<download> &get_thumbnail(void) {
 					return thumbnail;
 				}
-				std::shared_ptr<download> get(File file) {
-					static std::shared_ptr<download> none;
+				const std::shared_ptr<download> &get(File file) {
+					static const std::shared_ptr<download> none;
 					switch (file) {
 						case FILE_ARTWORK:
 							return data;
@@ -133,6 +134,24 @@ namespace Arcollect {
 				 * This function create or return a cached version of the #Arcollect::db::artwork.
 				 */
 				static std::shared_ptr<artwork> &query(Arcollect::db::artwork_id art_id);
+				/** Query an already instanciated artwork
+				 * \param art_id The artwork identifier
+				 * \return The artwork or NULL if not instanciated
+				 *
+				 * Unlike query(), this never hit the database.
+				 */
+				static std::shared_ptr<artwork> query_instanciated(Arcollect::db::artwork_id art_id);
+				/** Reclaim unused artworks
+				 *
+				 * Destroy artworks no longer referenced and not queried recently,
+				 * see Arcollect::db::object_pool::reclaim().
+				 *
+				 * It is called by Arcollect::gui::main() on each frame, and with
+				 * `all` by Arcollect::gui::reclaim_memory().
+				 * \param all Scan all objects and ignore their age
+				 * \return The number of objects destroyed
+				 */
+				static std::size_t reclaim(bool all = false);
 		};
 	}
 }
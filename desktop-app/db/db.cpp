@@ -19,6 +19,9 @@
 std::unique_ptr<SQLite3::sqlite3> Arcollect::database;
 sqlite_int64 Arcollect::data_version = -1;
 sqlite_int64 Arcollect::private_data_version = 0;
+bool Arcollect::changes_notified = false;
+bool Arcollect::changes_pending = true;
+std::vector<sqlite_int64> Arcollect::changed_artworks;
 
 sqlite_int64 Arcollect::update_data_version(void)
 {
@@ -30,6 +33,12 @@ sqlite_int64 Arcollect::update_data_version(void)
 void Arcollect::local_data_version_changed(void)
 {
 	Arcollect::private_data_version++;
+	Arcollect::changes_pending = true;
+}
+void Arcollect::notify_changes(const sqlite_int64 *art_ids, std::size_t count)
+{
+	Arcollect::changed_artworks.insert(Arcollect::changed_artworks.end(),art_ids,art_ids+count);
+	Arcollect::changes_pending = true;
 }
 void Arcollect::set_filter_rating(config::Rating rating)
 {
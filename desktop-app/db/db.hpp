@@ -17,6 +17,7 @@
 #pragma once
 #include <sqlite3.hpp>
 #include <string>
+#include <vector>
 #include "../config.hpp"
 
 namespace Arcollect {
@@ -51,9 +52,32 @@ namespace Arcollect {
 	 * 
 	 * `PRAGMA data_version;`, return and store the result in #data_version.
 	 *
-	 * This function is regulary called.
+	 * This function is regulary called, or after changes are notified when
+	 * #changes_notified is set.
 	 */
 	sqlite_int64 update_data_version(void);
+	
+	/** Whether other processes notify their changes
+	 *
+	 * When set, the GUI call update_data_version() when #changes_pending and
+	 * every few seconds instead of every frame, as a writer without a session
+	 * bus cannot notify its changes. It is set by the XDG main-loop that receive
+	 * `ArtworksChanged` signals from the webext-adder.
+	 */
+	extern bool changes_notified;
+	/** Whether changes are waiting to be seen by the GUI
+	 *
+	 * Set by notify_changes() and local_data_version_changed().
+	 */
+	extern bool changes_pending;
+	/** Artworks changed by other processes since the last GUI refresh
+	 */
+	extern std::vector<sqlite_int64> changed_artworks;
+	/** Signal a change made by another process
+	 * \param art_ids Changed artworks ids
+	 * \param count Number of ids in `art_ids`
+	 */
+	void notify_changes(const sqlite_int64 *art_ids, std::size_t count);
 		/** Set current rating
 		 */
 	void set_filter_rating(config::Rating rating);
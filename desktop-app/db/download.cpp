@@ -17,9 +17,11 @@
 #include "download.hpp"
 #include "artwork-loader.hpp"
 #include "db.hpp"
+#include "object-pool.hpp"
 #include "../art-reader/image.hpp"
 #include "../art-reader/text.hpp"
 #include <arcollect-paths.hpp>
+#include <algorithm>
 
 // Provide a dummy semaphore if compiler doesn't support it.
 #define counting_semaphore arcollect_counting_semaphore
@@ -53,7 +55,25 @@ namespace std {
 #endif
 
 std::list<std::reference_wrapper<Arcollect::db::download>> Arcollect::db::download::last_rendered;
-static std::unordered_map<sqlite_int64,std::shared_ptr<Arcollect::db::download>> downloads_pool;
+std::atomic<std::size_t> Arcollect::db::download::source_memory_usage = 0;
+static Arcollect::db::object_pool<Arcollect::db::download> downloads_pool;
+
+/** Analysis result pending for write
+ */
+struct pending_analysis_result {
+	sqlite_int64 dwn_id;
+	bool         has_analysis;
+	SDL::Color   background_color;
+	bool         is_pixel_art;
+	/** Placeholder to write, empty if not to write
+	 */
+	std::vector<Uint16> placeholder;
+	/** Image size to write, zero if not to write
+	 */
+	SDL::Point size;
+};
+static std::vector<pending_analysis_result> pending_analysis_results;
+static Arcollect::time_point pending_analysis_results_since;
 
 Arcollect::db::download::download(sqlite_int64 id, std::string &&source, std::filesystem::path &&path, std::string &&mimetype) :
 	artwork_type(artwork_type_from_mime(mimetype)),
@@ -64,32 +84,91 @@ Arcollect::db::download::download(sqlite_int64 id, std::string &&source, std::fi
 	size{0,0}
 {
 }
+Arcollect::db::download::~download(void)
+{
+	release_source();
+	// Downloads reloading for a new screen profile may be reclaimed before
+	set_transient_thumbnail(nullptr);
+}
 
 std::shared_ptr<Arcollect::db::download> &Arcollect::db::download::query(sqlite_int64 dwn_id)
 {
 	static std::shared_ptr<Arcollect::db::download> null_download;
-	auto iter = downloads_pool.find(dwn_id);
-	if (iter == downloads_pool.end()) {
+	std::shared_ptr<Arcollect::db::download> *pointer = downloads_pool.find(dwn_id);
+	if (!pointer) {
 		std::unique_ptr<SQLite3::stmt> stmt;
-		database->prepare("SELECT dwn_source, dwn_path, dwn_mimetype, dwn_width, dwn_height FROM downloads WHERE dwn_id = ?;",stmt); // TODO Error checking
+		database->prepare("SELECT dwn_source, dwn_path, dwn_mimetype, dwn_width, dwn_height, dwn_bgcolor, dwn_pixelart, dwn_analysis, dwn_placeholder FROM downloads WHERE dwn_id = ?;",stmt); // TODO Error checking
 		stmt->bind(1,dwn_id);
 		switch (stmt->step()) {
 			case SQLITE_ROW: {
 				std::string dwn_source;
 				if (stmt->column_type(0) == SQLITE_TEXT)
 					dwn_source = stmt->column_string(0);
-				iter = downloads_pool.emplace(dwn_id,std::make_shared<Arcollect::db::download>(dwn_id,std::move(dwn_source),stmt->column_string(1),stmt->column_string(2))).first;
+				pointer = &downloads_pool.emplace(dwn_id,dwn_id,std::move(dwn_source),stmt->column_string(1),stmt->column_string(2));
 				// Get art size
-				Arcollect::db::download& new_download = *iter->second;
+				Arcollect::db::download& new_download = **pointer;
 				new_download.size.x = stmt->column_int64(3);
 				new_download.size.y = stmt->column_int64(4);
+				// Get cached analysis results
+				if (stmt->column_int64(7) == analysis_version) {
+					new_download.background_color = static_cast<Uint32>(stmt->column_int64(5));
+					new_download.is_pixel_art = stmt->column_int64(6);
+					new_download.analysis_known = true;
+				}
+				// Get the placeholder (stored in little-endian)
+				if (stmt->column_bytes(8) == 2*placeholder_size*placeholder_size) {
+					const Uint8 *blob = static_cast<const Uint8*>(stmt->column_blob(8));
+					new_download.placeholder.resize(placeholder_size*placeholder_size);
+					for (Uint16 &pixel: new_download.placeholder) {
+						pixel = blob[0]|(blob[1] << 8);
+						blob += 2;
+					}
+				}
 			} break;
 			default: {
 				// TODO Error report and handling
 			} return null_download;
 		}
 	}
-	return iter->second;
+	return *pointer;
+}
+bool Arcollect::db::download::can_move(sqlite_int64 dwn_id)
+{
+	std::shared_ptr<Arcollect::db::download> *pointer = downloads_pool.find(dwn_id);
+	if (!pointer)
+		return true;
+	const std::shared_ptr<Arcollect::db::download> &download = *pointer;
+	if (download->load_state != UNLOADED)
+		return false;
+	// Loader threads read the path of queued downloads
+	const auto is_download = [&download](const std::shared_ptr<Arcollect::db::download> &queued) {
+		return queued == download;
+	};
+	const std::filesystem::path full_path = Arcollect::path::arco_data_home/download->dwn_path;
+	if (std::any_of(artwork_loader::pending_main.begin(),artwork_loader::pending_main.end(),is_download))
+		return false;
+	std::lock_guard<std::mutex> lock_guard(artwork_loader::lock);
+	return std::none_of(artwork_loader::pending_thread_first.begin(),artwork_loader::pending_thread_first.end(),is_download)
+	    && std::none_of(artwork_loader::pending_thread_second.begin(),artwork_loader::pending_thread_second.end(),is_download)
+	    && std::none_of(artwork_loader::pending_thread_prefetch.begin(),artwork_loader::pending_thread_prefetch.end(),is_download)
+	    && !artwork_loader::done.contains(download)
+	    && (std::find(artwork_loader::pending_thread_readahead.begin(),artwork_loader::pending_thread_readahead.end(),full_path) == artwork_loader::pending_thread_readahead.end());
+}
+void Arcollect::db::download::moved(sqlite_int64 dwn_id, const std::filesystem::path &dwn_path)
+{
+	std::shared_ptr<Arcollect::db::download> *pointer = downloads_pool.find(dwn_id);
+	if (pointer) {
+		std::lock_guard<std::mutex> lock_guard(artwork_loader::lock);
+		(*pointer)->dwn_path = dwn_path;
+		// The thumbnail identifier is the hash of the old path
+		(*pointer)->thumbnail_id.clear();
+	}
+}
+std::size_t Arcollect::db::download::reclaim(bool all)
+{
+	return downloads_pool.reclaim([](const download &download) {
+		return download.load_state == UNLOADED;
+	},all ? 0 : downloads_pool.reclaim_min_age,all ? std::numeric_limits<std::uint32_t>::max() : downloads_pool.reclaim_budget);
 }
 
 bool Arcollect::db::download::queue_for_load(void)
@@ -113,6 +192,23 @@ void Arcollect::db::download::queue_full_image_for_load(void)
 {
 	query_image(Arcollect::art_reader::nothumbnail_size);
 }
+bool Arcollect::db::download::prefetch(SDL::Point query_size)
+{
+	prefetch_frame_number = Arcollect::frame_number;
+	switch (load_state) {
+		case LOADED: {
+			// Bring to the front of last_rendered list
+			last_rendered.splice(last_rendered.begin(),last_rendered,last_rendered_iterator);
+		} return false;
+		case UNLOADED: {
+			if (artwork_type != ARTWORK_TYPE_IMAGE)
+				return false;
+			requested_size.x = std::max(requested_size.x,query_size.x);
+			requested_size.y = std::max(requested_size.y,query_size.y);
+		} return true;
+		default:return false;
+	}
+}
 
 struct SurfacePixelBordersIterate {
 	SDL::Surface& surface;
@@ -156,6 +252,41 @@ struct SurfacePixelBordersIterate {
 	SurfacePixelBordersIterate(SDL::Surface& surface) : surface(surface) {}
 };
 
+/** Compute the placeholder of an image
+ * \param surf The image
+ * \return The placeholder pixels
+ *
+ * Each placeholder pixel is the average of a grid of samples in the area it
+ * covers, converted to RGB565.
+ */
+static std::vector<Uint16> placeholder_compute(SDL::Surface& surf)
+{
+	static constexpr int placeholder_size = Arcollect::db::download::placeholder_size;
+	static constexpr int samples = 8; // Per placeholder pixel and direction
+	std::vector<Uint16> placeholder;
+	placeholder.reserve(placeholder_size*placeholder_size);
+	for (int py = 0; py < placeholder_size; py++)
+		for (int px = 0; px < placeholder_size; px++) {
+			unsigned int red = 0;
+			unsigned int green = 0;
+			unsigned int blue = 0;
+			for (int sy = 0; sy < samples; sy++)
+				for (int sx = 0; sx < samples; sx++) {
+					const int x = ((px*samples+sx)*2+1)*surf.w/(placeholder_size*samples*2);
+					const int y = ((py*samples+sy)*2+1)*surf.h/(placeholder_size*samples*2);
+					const SDL::Color &color = *reinterpret_cast<SDL::Color*>(&(static_cast<Uint8*>(surf.pixels)[surf.pitch*y+x*surf.format->BytesPerPixel]));
+					red += color.r;
+					green += color.g;
+					blue += color.b;
+				}
+			red /= samples*samples;
+			green /= samples*samples;
+			blue /= samples*samples;
+			placeholder.push_back(((red >> 3) << 11)|((green >> 2) << 5)|(blue >> 3));
+		}
+	return placeholder;
+}
+
 static bool pixel_art_scan(SDL::Surface& surf)
 {
 	if ((surf.w > 64)&&(surf.h > 64)) {
@@ -220,7 +351,7 @@ static bool pixel_art_scan(SDL::Surface& surf)
 // Avoid excessive memory bursts
 static std::counting_semaphore images_loadlimit(std::min<unsigned int>(std::thread::hardware_concurrency(),2));
 
-void Arcollect::db::download::load_stage_one(void)
+void Arcollect::db::download::load_stage_one(unsigned int threads)
 {
 	const std::filesystem::path full_path = Arcollect::path::arco_data_home/dwn_path;
 	switch (artwork_type) {
@@ -229,16 +360,45 @@ void Arcollect::db::download::load_stage_one(void)
 		} break;
 		case ARTWORK_TYPE_IMAGE: {
 			// Lock the semaphore
-			while (!images_loadlimit.try_acquire_for(std::chrono::seconds(1)))
+			while (!(loadlimit_acquired = images_loadlimit.try_acquire_for(std::chrono::seconds(1))))
 				if (load_state == LOADING_STAGE1)
 					break;
 			// Don't load thumbnail if we ignore the artwork size
 			if (!requested_size.x || !requested_size.y || !size.x || !size.y)
 				requested_size = Arcollect::art_reader::nothumbnail_size;
-			data = std::unique_ptr<SDL::Surface>(art_reader::image(full_path,requested_size));
-			if (!std::get<std::unique_ptr<SDL::Surface>>(data))
-				break;
+			screen_profile_generation = art_reader::screen_icc_profile_generation();
+			const art_reader::cancel_function cancelled = [this]() {
+				return load_cancelled();
+			};
+			if (source)
+				// Reloading for a new screen profile, only transform pixels again
+				data = std::unique_ptr<SDL::Surface>(art_reader::retransform(*source,cancelled,threads));
+			else {
+				// Keep untransformed pixels while within the budget
+				std::unique_ptr<art_reader::source_image> new_source;
+				if (source_memory_usage < source_memory_budget)
+					new_source = std::make_unique<art_reader::source_image>();
+				data = std::unique_ptr<SDL::Surface>(art_reader::image(full_path,requested_size,thumbnail_id,cancelled,threads,new_source.get()));
+				if (new_source && new_source->surface && std::get<std::unique_ptr<SDL::Surface>>(data)) {
+					source_memory_usage += new_source->memory();
+					source = std::move(new_source);
+				}
+			}
+			if (!std::get<std::unique_ptr<SDL::Surface>>(data)) {
+				// Failed or cancelled, release the semaphore and let it be queued again
+				release_loadlimit();
+				if (!load_cancelled())
+					release_source();
+				load_state = UNLOADED;
+				return;
+			}
 			SDL::Surface &surf = *std::get<std::unique_ptr<SDL::Surface>>(data);
+			// Compute the placeholder
+			if (placeholder.empty() && surf.w && surf.h)
+				placeholder_to_write = placeholder_compute(surf);
+			// Skip analysis if results are cached in the database
+			if (analysis_known)
+				break;
 			if ((surf.w > 2)&&(surf.h > 2)) {
 				/* Try to auto-detect the best background color
 				 *
@@ -302,6 +462,9 @@ void Arcollect::db::download::load_stage_one(void)
 				}
 			}
 			is_pixel_art = pixel_art_scan(surf);
+			// Cache results if computed on the full image
+			if (((surf.w == size.x)&&(surf.h == size.y))||!size.x||!size.y)
+				analysis_known = analysis_to_write = true;
 		} break;
 		case ARTWORK_TYPE_TEXT: {
 			data = art_reader::text(full_path,dwn_mimetype);
@@ -327,29 +490,24 @@ void Arcollect::db::download::load_stage_two(SDL::Renderer &renderer)
 			}
 			data = std::unique_ptr<SDL::Texture>(text);
 			text->QuerySize(loaded_size);
+			// Queue analysis results write
 			// Set size if missing in the DB
-			if (!size.x || !size.y) {
-				// Read size
-				size = loaded_size;
-				// Set size in the database
-				std::unique_ptr<SQLite3::stmt> set_size_stmt;
-				database->prepare("UPDATE downloads SET dwn_width=?, dwn_height=? WHERE dwn_id = ?;",set_size_stmt); // TODO Error checking
-				set_size_stmt->bind(1,size.x);
-				set_size_stmt->bind(2,size.y);
-				set_size_stmt->bind(3,dwn_id);
-				set_size_stmt->step();
-				database->exec("COMMIT;");
+			SDL::Point size_to_write{0,0};
+			if (!size.x || !size.y)
+				size = size_to_write = loaded_size;
+			if (analysis_to_write || !placeholder_to_write.empty() || size_to_write.x) {
+				if (pending_analysis_results.empty())
+					pending_analysis_results_since = Arcollect::frame_time;
+				placeholder = placeholder_to_write;
+				pending_analysis_results.push_back({dwn_id,analysis_to_write,background_color,is_pixel_art,std::move(placeholder_to_write),size_to_write});
+				placeholder_to_write.clear();
+				analysis_to_write = false;
 			}
 			// Erase transient thumbnail
-			if (transient_thumbnail) {
-				SDL::Point thumbnail_size;
-				transient_thumbnail->QuerySize(thumbnail_size);
-				Arcollect::db::artwork_loader::image_memory_usage -= 4*sizeof(Uint8)*thumbnail_size.x*thumbnail_size.y;
-				transient_thumbnail.reset();
-			}
+			set_transient_thumbnail(nullptr);
 			// Increase image memory usage
 			Arcollect::db::artwork_loader::image_memory_usage += 4*sizeof(Uint8)*loaded_size.x*loaded_size.y;
-			images_loadlimit.release();
+			release_loadlimit();
 		} break;
 		case ARTWORK_TYPE_TEXT: {
 			// Already loaded
@@ -360,6 +518,48 @@ void Arcollect::db::download::load_stage_two(SDL::Renderer &renderer)
 	last_rendered_iterator = last_rendered.begin();
 	// Update state
 	load_state = LOADED;
+	// The screen profile changed during the load
+	if ((artwork_type == ARTWORK_TYPE_IMAGE) && (screen_profile_generation != art_reader::screen_icc_profile_generation()))
+		reload_for_screen_profile();
+}
+void Arcollect::db::download::release_loadlimit(void)
+{
+	if (loadlimit_acquired) {
+		images_loadlimit.release();
+		loadlimit_acquired = false;
+	}
+}
+void Arcollect::db::download::release_source(void)
+{
+	if (source) {
+		source_memory_usage -= source->memory();
+		source.reset();
+	}
+}
+std::unique_ptr<SDL::Texture> &Arcollect::db::download::set_transient_thumbnail(std::unique_ptr<SDL::Texture> &&texture)
+{
+	SDL::Point texture_size;
+	if (transient_thumbnail) {
+		transient_thumbnail->QuerySize(texture_size);
+		Arcollect::db::artwork_loader::image_memory_usage -= 4*sizeof(Uint8)*texture_size.x*texture_size.y;
+	}
+	transient_thumbnail = std::move(texture);
+	if (transient_thumbnail) {
+		transient_thumbnail->QuerySize(texture_size);
+		Arcollect::db::artwork_loader::image_memory_usage += 4*sizeof(Uint8)*texture_size.x*texture_size.y;
+	}
+	return transient_thumbnail;
+}
+void Arcollect::db::download::reload_for_screen_profile(void)
+{
+	std::unique_ptr<SDL::Texture> texture = std::move(std::get<std::unique_ptr<SDL::Texture>>(data));
+	const SDL::Point kept_requested_size = requested_size;
+	std::unique_ptr<art_reader::source_image> kept_source = std::move(source);
+	unload();
+	// Restore what unload() reset
+	requested_size = kept_requested_size;
+	source = std::move(kept_source);
+	set_transient_thumbnail(std::move(texture));
 }
 void Arcollect::db::download::unload(void)
 {
@@ -369,16 +569,12 @@ void Arcollect::db::download::unload(void)
 		case ARTWORK_TYPE_IMAGE: {
 			// Reset thumbnail stuff
 			requested_size.x = requested_size.y = 0;
-			if (transient_thumbnail) {
-				SDL::Point thumbnail_size;
-				transient_thumbnail->QuerySize(thumbnail_size);
-				Arcollect::db::artwork_loader::image_memory_usage -= 4*sizeof(Uint8)*thumbnail_size.x*thumbnail_size.y;
-				transient_thumbnail.reset();
-			}
+			set_transient_thumbnail(nullptr);
+			release_source();
 			// Decrease image memory usage
 			Arcollect::db::artwork_loader::image_memory_usage -= 4*sizeof(Uint8)*loaded_size.x*loaded_size.y;
 			if (load_state == LOAD_PENDING_STAGE2)
-				images_loadlimit.release();
+				release_loadlimit();
 		} break;
 		case ARTWORK_TYPE_TEXT: {
 			// Already loaded
@@ -408,38 +604,120 @@ std::size_t Arcollect::db::download::image_memory(void)
 	return 4*sizeof(Uint8)*size.x*size.y; // Assume 8-bits RGBA
 }
 
-void Arcollect::db::download::nuke_image_cache(void)
+void Arcollect::db::download::screen_profile_changed(void)
+{
+	auto iter = last_rendered.begin();
+	while (iter != last_rendered.end()) {
+		Arcollect::db::download& download = *iter;
+		++iter;
+		if (download.artwork_type != ARTWORK_TYPE_IMAGE)
+			continue;
+		// Reload images in view first, they are queued again when rendered
+		if (download.keep_loaded())
+			download.reload_for_screen_profile();
+		else download.unload();
+	}
+}
+
+std::size_t Arcollect::db::download::release_memory(bool critical)
 {
-	// Shutdown threads
-	Arcollect::db::artwork_loader::shutdown_sync();
-	// Unload images
-	auto iter = Arcollect::db::download::last_rendered.begin();
-	while (iter != Arcollect::db::download::last_rendered.end()) {
+	const std::size_t memory_usage = Arcollect::db::artwork_loader::image_memory_usage + source_memory_usage;
+	auto iter = last_rendered.begin();
+	while (iter != last_rendered.end()) {
 		Arcollect::db::download& download = *iter;
 		++iter;
-		if (download.artwork_type == ARTWORK_TYPE_IMAGE)
-			download.unload();
+		if (download.artwork_type != ARTWORK_TYPE_IMAGE)
+			continue;
+		const bool visible = Arcollect::frame_number < download.last_render_frame_number + 3;
+		if (visible || (!critical && (frame_time - download.last_render_timestamp <= std::chrono::seconds(1))))
+			download.release_source();
+		else download.unload();
 	}
-	// Clear various buffers
-	// Note: Loader threads are not running so we don't need to take the mutex
-	last_rendered.clear();
-	Arcollect::db::artwork_loader::pending_main.clear();
-	Arcollect::db::artwork_loader::pending_thread_first.clear();
-	Arcollect::db::artwork_loader::pending_thread_second.clear();
-	Arcollect::db::artwork_loader::done.clear();
-	Arcollect::db::artwork_loader::image_memory_usage = 0;
-	// Restart threads
-	Arcollect::db::artwork_loader::start();
+	return memory_usage - (Arcollect::db::artwork_loader::image_memory_usage + source_memory_usage);
+}
+
+bool Arcollect::db::download::analysis_results_write_due(void)
+{
+	return (pending_analysis_results.size() >= 64)||(!pending_analysis_results.empty() && (Arcollect::frame_time - pending_analysis_results_since > std::chrono::seconds(2)));
+}
+void Arcollect::db::download::write_analysis_results(void)
+{
+	if (pending_analysis_results.empty())
+		return;
+	// Retry later if the database is busy
+	pending_analysis_results_since = Arcollect::frame_time;
+	if (database->exec("BEGIN IMMEDIATE;") != SQLITE_OK)
+		return;
+	std::unique_ptr<SQLite3::stmt> stmt;
+	std::unique_ptr<SQLite3::stmt> placeholder_stmt;
+	std::unique_ptr<SQLite3::stmt> size_stmt;
+	if ((database->prepare("UPDATE downloads SET dwn_bgcolor = ?, dwn_pixelart = ?, dwn_analysis = ? WHERE dwn_id = ?;",stmt) != SQLITE_OK)
+	  ||(database->prepare("UPDATE downloads SET dwn_placeholder = ? WHERE dwn_id = ?;",placeholder_stmt) != SQLITE_OK)
+	  ||(database->prepare("UPDATE downloads SET dwn_width = ?, dwn_height = ? WHERE dwn_id = ?;",size_stmt) != SQLITE_OK)) {
+		std::cerr << "Writing analysis results, failed to prepare: " << database->errmsg() << ". Rollback." << std::endl;
+		database->exec("ROLLBACK;");
+		pending_analysis_results.clear();
+		return;
+	}
+	stmt->bind(3,analysis_version);
+	for (const pending_analysis_result &result: pending_analysis_results) {
+		if (result.has_analysis) {
+			const SDL::Color &color = result.background_color;
+			stmt->bind(1,static_cast<sqlite_int64>((Uint32(color.r) << 24)|(Uint32(color.g) << 16)|(Uint32(color.b) << 8)|Uint32(color.a)));
+			stmt->bind(2,result.is_pixel_art ? 1 : 0);
+			stmt->bind(4,result.dwn_id);
+			if (stmt->step() != SQLITE_DONE) {
+				std::cerr << "Writing analysis results, failed to update download " << result.dwn_id << ": " << database->errmsg() << ". Rollback." << std::endl;
+				database->exec("ROLLBACK;");
+				return;
+			}
+			stmt->reset();
+		}
+		if (!result.placeholder.empty()) {
+			// Store in little-endian
+			std::vector<Uint8> blob;
+			blob.reserve(2*result.placeholder.size());
+			for (Uint16 pixel: result.placeholder) {
+				blob.push_back(pixel & 0xFF);
+				blob.push_back(pixel >> 8);
+			}
+			placeholder_stmt->bind_blob(1,blob.data(),blob.size());
+			placeholder_stmt->bind(2,result.dwn_id);
+			if (placeholder_stmt->step() != SQLITE_DONE) {
+				std::cerr << "Writing placeholder, failed to update download " << result.dwn_id << ": " << database->errmsg() << ". Rollback." << std::endl;
+				database->exec("ROLLBACK;");
+				return;
+			}
+			placeholder_stmt->reset();
+		}
+		if (result.size.x) {
+			size_stmt->bind(1,result.size.x);
+			size_stmt->bind(2,result.size.y);
+			size_stmt->bind(3,result.dwn_id);
+			if (size_stmt->step() != SQLITE_DONE) {
+				std::cerr << "Writing size, failed to update download " << result.dwn_id << ": " << database->errmsg() << ". Rollback." << std::endl;
+				database->exec("ROLLBACK;");
+				return;
+			}
+			size_stmt->reset();
+		}
+	}
+	if (database->exec("COMMIT;") != SQLITE_OK) {
+		std::cerr << "Writing analysis results, failed to commit changes: " << database->errmsg() << ". Rollback." << std::endl;
+		database->exec("ROLLBACK;");
+		return;
+	}
+	pending_analysis_results.clear();
 }
 
 bool Arcollect::db::download::delete_cache(sqlite3_int64 dwn_id, Transaction& transaction)
 {
 	bool to_nuke = transaction.delete_cache(dwn_id);
 	if (to_nuke) {
-		auto iter = downloads_pool.find(dwn_id);
-		if (iter == downloads_pool.end()) {
-			downloads_pool.erase(iter);
-		}
+		// Loaded downloads are referenced by last_rendered, they will be reclaimed
+		std::shared_ptr<Arcollect::db::download> *pointer = downloads_pool.find(dwn_id);
+		if (pointer && ((*pointer)->load_state == UNLOADED))
+			downloads_pool.erase(dwn_id);
 	}
 	return to_nuke;
 }
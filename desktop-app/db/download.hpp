@@ -19,18 +19,23 @@
 #include "../gui/font.hpp"
 #include "../config.hpp"
 #include "../time.hpp"
+#include "../art-reader/image.hpp"
 #include <arcollect-db-downloads.hpp>
+#include <atomic>
 #include <cstddef>
 #include <filesystem>
 #include <list>
 #include <memory>
 #include <variant>
+#include <vector>
 
 namespace SDL {
 	struct Renderer;
 }
 namespace Arcollect {
 	namespace db {
+		template <typename T>
+		struct slab_allocator;
 		/** Download
 		 *
 		 * This class hold data about a download. It's used trough a
@@ -99,6 +104,25 @@ namespace Arcollect {
 				/** If this picture is pixel art
 				 */
 				bool is_pixel_art = false;
+				/** Image analysis algorithm version
+				 *
+				 * #background_color and #is_pixel_art are cached in the database with
+				 * this version number. Results with another version are ignored and
+				 * recomputed, increment it when changing the analysis algorithms.
+				 */
+				static constexpr sqlite_int64 analysis_version = 1;
+				/** If #background_color and #is_pixel_art are known
+				 *
+				 * They are known once read from the database or computed on the full
+				 * resolution image. Analysis is skipped when they are known.
+				 */
+				bool analysis_known = false;
+				/** Placeholder width and height
+				 *
+				 * The placeholder is a tiny #placeholder_size x #placeholder_size RGB565
+				 * image upscaled and displayed while the image is loading.
+				 */
+				static constexpr int placeholder_size = 4;
 			private:
 				// FIXME friend artwork_loader; // For queued_for_load
 				
@@ -133,8 +157,64 @@ namespace Arcollect {
 				/** The requested thumbnail size
 				 */
 				SDL::Point requested_size{0,0};
+				/** Analysis results must be written in the database
+				 *
+				 * Set by load_stage_one() and handled by load_stage_two().
+				 */
+				bool analysis_to_write = false;
+				/** Placeholder pixels
+				 *
+				 * Empty if unknown.
+				 */
+				std::vector<Uint16> placeholder;
+				/** Placeholder computed by load_stage_one()
+				 *
+				 * Moved in #placeholder and written in the database by load_stage_two().
+				 */
+				std::vector<Uint16> placeholder_to_write;
+				/** Cached thumbnail identifier
+				 *
+				 * Computed and used by art_reader::image(), see it.
+				 */
+				std::string thumbnail_id;
+				/** Untransformed pixels
+				 *
+				 * Kept within #source_memory_budget so load_stage_one() only run the
+				 * color transform again when the screen ICC profile change.
+				 */
+				std::unique_ptr<art_reader::source_image> source;
+				/** art_reader::screen_icc_profile_generation() of the loaded image
+				 */
+				unsigned int screen_profile_generation = 0;
+				/** Free #source
+				 */
+				void release_source(void);
+				/** Whether this download hold a slot of the images load limit
+				 *
+				 * load_stage_one() may give up acquiring it when the load is
+				 * cancelled, it must only be released if acquired.
+				 */
+				bool loadlimit_acquired = false;
+				/** Release the images load limit slot if #loadlimit_acquired
+				 */
+				void release_loadlimit(void);
+				/** Set the #transient_thumbnail
+				 * \param texture to set
+				 * \return The #transient_thumbnail
+				 *
+				 * The texture must not be accounted in image_memory_usage anymore.
+				 */
+				std::unique_ptr<SDL::Texture> &set_transient_thumbnail(std::unique_ptr<SDL::Texture> &&texture);
+				/** Reload with the new screen ICC profile
+				 *
+				 * The current texture is shown as #transient_thumbnail until the new
+				 * one is loaded.
+				 * \warning The download must be a LOADED image.
+				 */
+				void reload_for_screen_profile(void);
 			public:
 				download(sqlite_int64 id, std::string &&source, std::filesystem::path &&path, std::string &&mimetype);
+				~download(void);
 				/** Query download for loading
 				 * \return true if the artwork is already loaded
 				 *
@@ -147,13 +227,22 @@ namespace Arcollect {
 				 * Wrapper for queue_for_load() that set the requested_size to the max.
 				 */
 				void queue_full_image_for_load(void);
+				/** Mark the download as prefetched
+				 * \param query_size that will be displayed
+				 * \return true if the download must be queued for prefetch
+				 *
+				 * This keep the download loaded for a few frames like queue_for_load()
+				 * but without queuing it. Arcollect::gui::prefetcher does the queuing.
+				 */
+				bool prefetch(SDL::Point query_size);
 				
 				/** Load (thread-safe part)
+				 * \param threads Number of threads to use for large images
 				 *
 				 * Load the download in memory. This is the thread-safe part, you must
 				 * call load_stage_two() after in the main thread.
 				 */
-				void load_stage_one(void);
+				void load_stage_one(unsigned int threads = 1);
 				
 				/** Load (non thread-safe part)
 				 * \param renderer A reference to the current renderer
@@ -197,10 +286,20 @@ namespace Arcollect {
 							unload();
 							requested_size = query_size;
 							queue_for_load();
-							return transient_thumbnail = std::move(thumbnail);
+							return set_transient_thumbnail(std::move(thumbnail));
 						} else return res;
 					} else return transient_thumbnail;
 				}
+				/** Query the download placeholder
+				 * \return The placeholder RGB565 pixels or NULL if not available
+				 *
+				 * See #placeholder_size.
+				 */
+				const Uint16 *query_placeholder(void) const {
+					if ((rating_taint_level <= Arcollect::config::current_rating)&&!placeholder.empty())
+						return placeholder.data();
+					else return NULL;
+				}
 				bool QuerySize(SDL::Point &art_size) {
 					if (size.x && size.y) {
 						art_size = size;
@@ -218,7 +317,11 @@ namespace Arcollect {
 				 */
 				const sqlite_int64          dwn_id;
 				const std::string           dwn_source;
-				const std::filesystem::path dwn_path;
+				/** The file path relative to Arcollect::path::arco_data_home
+				 *
+				 * It is changed by moved() while the download is #UNLOADED.
+				 */
+				std::filesystem::path       dwn_path;
 				const std::string           dwn_mimetype;
 				SDL::Point size;
 				SDL::Color background_color{0,0,0,0};
@@ -259,6 +362,24 @@ namespace Arcollect {
 				 * This function create or return a cached version of the #Arcollect::db::download.
 				 */
 				static std::shared_ptr<download> &query(sqlite_int64 dwn_id);
+				/** Check if a download file can be moved
+				 * \param dwn_id The download identifier
+				 * \return true if the download is not in memory or #UNLOADED and out
+				 *         of all Arcollect::db::artwork_loader queues
+				 *
+				 * This is the Arcollect::db::downloads::ShardMigration::can_move
+				 * filter, loader threads read the path of queued downloads.
+				 */
+				static bool can_move(sqlite_int64 dwn_id);
+				/** Update the path of a moved download
+				 * \param dwn_id The download identifier
+				 * \param dwn_path The new path
+				 *
+				 * This is the Arcollect::db::downloads::ShardMigration::moved
+				 * notification. The cached #thumbnail_id is reset since thumbnails
+				 * are keyed on the path.
+				 */
+				static void moved(sqlite_int64 dwn_id, const std::filesystem::path &dwn_path);
 				
 				/** Last render list
 				 *
@@ -273,7 +394,7 @@ namespace Arcollect {
 				 *
 				 * Used by the resource manager.
 				 */
-				unsigned int last_render_frame_number;
+				unsigned int last_render_frame_number = 0;
 				
 				/** Timestamp of last render attempt
 				 *
@@ -281,12 +402,30 @@ namespace Arcollect {
 				 * load since a while but are still queued for render.
 				 */
 				Arcollect::time_point last_render_timestamp;
+				/** Frame number until this download is prefetched
+				 *
+				 * Set by prefetch(). Prefetched downloads are kept loaded but not for
+				 * one second as rendered ones, so they are cancelled quickly when the
+				 * user change the navigation direction.
+				 */
+				unsigned int prefetch_frame_number = 0;
 				
 				/** Check wether we should keep this image loaded
 				 *
 				 */
 				bool keep_loaded(void) const {
-					return (Arcollect::frame_number < last_render_frame_number + 3)||(frame_time - last_render_timestamp <= std::chrono::seconds(1));
+					return (Arcollect::frame_number < last_render_frame_number + 3)||(frame_time - last_render_timestamp <= std::chrono::seconds(1))||(Arcollect::frame_number < prefetch_frame_number + 3);
+				}
+				/** Check wether an ongoing load should be cancelled
+				 *
+				 * Unlike keep_loaded() there is no one second grace period, the load
+				 * is cancelled as soon as the download is neither rendered nor
+				 * prefetched since a few frames, typically when scrolled out of view.
+				 *
+				 * It is polled by load_stage_one() in #artwork_loader threads.
+				 */
+				bool load_cancelled(void) const {
+					return (Arcollect::frame_number >= last_render_frame_number + 3)&&(Arcollect::frame_number >= prefetch_frame_number + 3);
 				}
 				
 				/** Nuke a download
@@ -296,12 +435,57 @@ namespace Arcollect {
 				 * \warning It does not remove the download from the database!
 				 */
 				static void nuke(sqlite_int64 dwn_id);
-				/** Clear image cache
+				/** Reclaim unused downloads
+				 *
+				 * Destroy unloaded downloads no longer referenced and not queried
+				 * recently, see Arcollect::db::object_pool::reclaim().
+				 *
+				 * It is called by Arcollect::gui::main() on each frame, and with
+				 * `all` by Arcollect::gui::reclaim_memory().
+				 * \param all Scan all objects and ignore their age
+				 * \return The number of objects destroyed
+				 */
+				static std::size_t reclaim(bool all = false);
+				/** Reload images for a new screen ICC profile
+				 *
+				 * Images rendered recently are reloaded while showing their current
+				 * rendering, others are unloaded. Images with #source are only
+				 * transformed again, loader threads keep running.
+				 *
+				 * It is called by art_reader::set_screen_icc_profile().
+				 */
+				static void screen_profile_changed(void);
+				/** Unload images under memory pressure
+				 * \param critical Only keep images visible in the last frames
+				 * \return The freed image and untransformed pixels memory in bytes
+				 *
+				 * Unlike the main-loop unloading, prefetched images are unloaded and
+				 * #source of kept images is released. Without `critical`, images
+				 * rendered in the last second are kept like keep_loaded() does.
+				 *
+				 * It is called by Arcollect::gui::reclaim_memory().
+				 */
+				static std::size_t release_memory(bool critical);
+				/** Memory used by untransformed pixels in bytes
+				 */
+				static std::atomic<std::size_t> source_memory_usage;
+				/** Untransformed pixels are not kept beyond this memory usage
+				 */
+				static constexpr std::size_t source_memory_budget = std::size_t(256) << 20;
+				/** Check if write_analysis_results() should be called
+				 * \return true if there is results pending for a while or many of them
+				 */
+				static bool analysis_results_write_due(void);
+				/** Write pending analysis results in the database
+				 *
+				 * Images analysis results, placeholders and sizes are cached in the
+				 * database. Writes are batched into one transaction to avoid one commit
+				 * per image load.
 				 *
-				 * This function destroy everything in image caches.
-				 * It is used when changing screens ICC profile.
+				 * It does nothing if the database is locked, results are kept and it
+				 * will be retried later.
 				 */
-				static void nuke_image_cache(void);
+				static void write_analysis_results(void);
 				
 				/** Compare download
 				 *
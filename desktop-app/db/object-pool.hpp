@@ -0,0 +1,305 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file object-pool.hpp
+ *  \brief Pools of database objects (#Arcollect::db::object_pool)
+ */
+#pragma once
+#include "../time.hpp"
+#include <sqlite3.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+namespace Arcollect {
+	namespace db {
+		/** Fixed-size blocks allocator
+		 *
+		 * Blocks are carved from 64KiB chunks and recycled in a free-list. Chunks
+		 * are never returned to the system and slabs are never destroyed, objects
+		 * in static pools may be freed after static destructors ran.
+		 *
+		 * It is used with `std::allocate_shared()` so objects and their control
+		 * block are packed together. Blocks may be freed from loader threads that
+		 * hold the last reference, hence the lock.
+		 */
+		template <std::size_t block_size, std::size_t block_align>
+		class slab {
+			private:
+				static_assert(block_align <= alignof(std::max_align_t),"Over-aligned blocks are not supported");
+				static constexpr std::size_t chunk_size = 65536;
+				static constexpr std::size_t stride = (std::max(block_size,sizeof(void*))+block_align-1)/block_align*block_align;
+				std::mutex lock;
+				void* free_list = nullptr;
+				std::vector<std::unique_ptr<std::byte[]>> chunks;
+				std::size_t chunk_used = chunk_size;
+			public:
+				void* allocate(void) {
+					std::lock_guard<std::mutex> lock_guard(lock);
+					if (free_list) {
+						void* block = free_list;
+						free_list = *static_cast<void**>(block);
+						return block;
+					}
+					if (chunk_used + stride > chunk_size) {
+						chunks.emplace_back(new std::byte[chunk_size]);
+						chunk_used = 0;
+					}
+					void* block = chunks.back().get() + chunk_used;
+					chunk_used += stride;
+					return block;
+				}
+				void deallocate(void* block) {
+					std::lock_guard<std::mutex> lock_guard(lock);
+					*static_cast<void**>(block) = free_list;
+					free_list = block;
+				}
+				static slab& instance(void) {
+					static slab *const instance_slab = new slab();
+					return *instance_slab;
+				}
+		};
+		/** std::allocate_shared() allocator backed by a #slab
+		 *
+		 * Classes with private constructors must befriend it.
+		 */
+		template <typename T>
+		struct slab_allocator {
+			using value_type = T;
+			slab_allocator(void) = default;
+			template <typename U>
+			slab_allocator(const slab_allocator<U>&) {}
+			T* allocate(std::size_t n) {
+				if (n != 1)
+					return static_cast<T*>(::operator new(n*sizeof(T)));
+				return static_cast<T*>(slab<sizeof(T),alignof(T)>::instance().allocate());
+			}
+			void deallocate(T* p, std::size_t n) {
+				if (n != 1)
+					::operator delete(p);
+				else slab<sizeof(T),alignof(T)>::instance().deallocate(p);
+			}
+			template <typename U, typename... Args>
+			void construct(U* p, Args&&... args) {
+				::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+			}
+			template <typename U>
+			void destroy(U* p) {
+				p->~U();
+			}
+			template <typename U>
+			bool operator==(const slab_allocator<U>&) const {
+				return true;
+			}
+		};
+		/** Pool of database objects
+		 * \param T The object type
+		 *
+		 * This is the one-instance-per-id cache behind Arcollect::db::artwork,
+		 * Arcollect::db::download and Arcollect::db::account query() functions.
+		 *
+		 * Objects are stored in slots addressed by a 32-bit index. Ids are mapped
+		 * to slots with a dense open-addressing table to keep lookups cheap as
+		 * they are done for each visible artwork on each frame. Slots are
+		 * allocated in chunks and never move, references returned by find() and
+		 * emplace() stay valid until the object is erased or reclaimed.
+		 *
+		 * Objects are stamped with Arcollect::frame_number on lookup, reclaim()
+		 * drop these that were not looked-up since a while and only referenced by
+		 * the pool.
+		 *
+		 * \warning This is not thread-safe, only use it from the main thread.
+		 */
+		template <typename T>
+		class object_pool {
+			public:
+				using id_type = sqlite_int64;
+			private:
+				/** Slot index marking empty #table entries
+				 */
+				static constexpr std::uint32_t no_slot = std::numeric_limits<std::uint32_t>::max();
+				static constexpr std::size_t slots_per_chunk = 4096;
+				struct slot {
+					std::shared_ptr<T> object;
+					id_type id;
+					/** Last lookup Arcollect::frame_number
+					 */
+					unsigned int last_epoch;
+				};
+				std::vector<std::unique_ptr<slot[]>> slots;
+				std::uint32_t slots_count = 0;
+				std::vector<std::uint32_t> free_slots;
+
+				/** Id to slot index table
+				 *
+				 * Linear-probing table with a power of two size and a 7/8 maximum load
+				 * factor, #no_slot marks empty entries.
+				 */
+				std::vector<std::pair<id_type,std::uint32_t>> table;
+				std::size_t table_used = 0;
+				/** Position of reclaim() in slots
+				 */
+				std::uint32_t reclaim_cursor = 0;
+
+				slot &slot_at(std::uint32_t index) {
+					return slots[index/slots_per_chunk][index%slots_per_chunk];
+				}
+				std::size_t table_hash(id_type id) const {
+					// Database ids are mostly dense, the identity is a good hash
+					return static_cast<std::size_t>(id) & (table.size()-1);
+				}
+				/** Find the table position of an id
+				 * \return The position of the id or of the empty entry to use
+				 */
+				std::size_t table_find(id_type id) const {
+					std::size_t pos = table_hash(id);
+					while ((table[pos].second != no_slot) && (table[pos].first != id))
+						pos = (pos+1) & (table.size()-1);
+					return pos;
+				}
+				void table_grow(void) {
+					std::vector<std::pair<id_type,std::uint32_t>> old_table(table.empty() ? 64 : table.size()*2,{0,no_slot});
+					old_table.swap(table);
+					for (const std::pair<id_type,std::uint32_t> &entry: old_table)
+						if (entry.second != no_slot)
+							table[table_find(entry.first)] = entry;
+				}
+				void table_erase(std::size_t pos) {
+					// Backward shift deletion
+					const std::size_t mask = table.size()-1;
+					std::size_t next = (pos+1) & mask;
+					while (table[next].second != no_slot) {
+						const std::size_t home = table_hash(table[next].first);
+						// Move the entry if its home is not in ]pos;next]
+						if (((next-home) & mask) >= ((next-pos) & mask)) {
+							table[pos] = table[next];
+							pos = next;
+						}
+						next = (next+1) & mask;
+					}
+					table[pos].second = no_slot;
+					table_used--;
+				}
+				/** Free a slot
+				 */
+				void release(std::uint32_t index) {
+					slot &target = slot_at(index);
+					table_erase(table_find(target.id));
+					target.object.reset();
+					free_slots.push_back(index);
+				}
+			public:
+				/** Find an object
+				 * \param id The object id
+				 * \return A pointer to the object in the pool or NULL if not found
+				 */
+				std::shared_ptr<T> *find(id_type id) {
+					if (table.empty())
+						return nullptr;
+					const std::pair<id_type,std::uint32_t> &entry = table[table_find(id)];
+					if (entry.second == no_slot)
+						return nullptr;
+					slot &target = slot_at(entry.second);
+					// Don't dirty the cache line if already stamped
+					if (target.last_epoch != Arcollect::frame_number)
+						target.last_epoch = Arcollect::frame_number;
+					return &target.object;
+				}
+				/** Create a new object
+				 * \param id The object id, must not be in the pool
+				 * \param args to forward to the constructor
+				 * \return The new object in the pool
+				 */
+				template <typename... Args>
+				std::shared_ptr<T> &emplace(id_type id, Args&&... args) {
+					std::shared_ptr<T> object = std::allocate_shared<T>(slab_allocator<T>(),std::forward<Args>(args)...);
+					// Get a slot
+					std::uint32_t index;
+					if (free_slots.empty()) {
+						index = slots_count++;
+						if (index % slots_per_chunk == 0)
+							slots.emplace_back(new slot[slots_per_chunk]);
+					} else {
+						index = free_slots.back();
+						free_slots.pop_back();
+					}
+					slot &target = slot_at(index);
+					target.object = std::move(object);
+					target.id = id;
+					target.last_epoch = Arcollect::frame_number;
+					// Index it, ids are dense so we can afford a high load factor
+					if ((table_used+1)*8 > table.size()*7)
+						table_grow();
+					table[table_find(id)] = {id,index};
+					table_used++;
+					return target.object;
+				}
+				/** Remove an object from the pool
+				 * \param id The object id
+				 *
+				 * The object is destroyed once no longer referenced.
+				 */
+				void erase(id_type id) {
+					if (table.empty())
+						return;
+					const std::uint32_t index = table[table_find(id)].second;
+					if (index != no_slot)
+						release(index);
+				}
+				/** Default reclaim() minimum age in frames
+				 */
+				static constexpr unsigned int reclaim_min_age = 600;
+				/** Default reclaim() slots scanned per call
+				 */
+				static constexpr std::uint32_t reclaim_budget = 256;
+				/** Reclaim unused objects
+				 * \param can_reclaim predicate that may keep an object
+				 * \param min_age in frames since the last lookup
+				 * \param budget of slots to scan
+				 * \return The number of objects freed
+				 *
+				 * Scan slots incrementally and free objects only referenced by the
+				 * pool and not looked-up since `min_age` frames.
+				 */
+				template <typename Predicate>
+				std::size_t reclaim(Predicate can_reclaim, unsigned int min_age = reclaim_min_age, std::uint32_t budget = reclaim_budget) {
+					std::size_t released = 0;
+					for (budget = std::min(budget,slots_count); budget; budget--) {
+						if (reclaim_cursor >= slots_count)
+							reclaim_cursor = 0;
+						const std::uint32_t index = reclaim_cursor++;
+						slot &target = slot_at(index);
+						if (target.object && (target.object.use_count() == 1)
+						 && (Arcollect::frame_number - target.last_epoch > min_age)
+						 && can_reclaim(*target.object)) {
+							release(index);
+							released++;
+						}
+					}
+					return released;
+				}
+				/** Number of objects in the pool
+				 */
+				std::size_t size(void) const {
+					return table_used;
+				}
+		};
+	}
+}
@@ -452,6 +452,7 @@ Arcollect::search::ParsedSearch::ParsedSearch(std::string &&search_terms, Search
 	tokenize(search,tagset_map);
 	sql_query = "SELECT art_artid";
 	sql_query += sorting().sql_select_trailer(search_type);
+	sql_from_pos = sql_query.size();
 	sql_query += " FROM artworks ";
 	for (const std::string_view& join: expr.gen_artworks_sql_joins()) {
 		sql_query.append(join);
@@ -463,6 +464,7 @@ Arcollect::search::ParsedSearch::ParsedSearch(std::string &&search_terms, Search
 	if (sql_query_size == sql_query.size())
 		sql_query += "AND 1 ";
 	sql_query += ")OR(INSTR(lower(art_title),lower(?)) > 0)) AND art_rating <= ? ";
+	sql_order_by_pos = sql_query.size();
 	sql_query += sorting().sql_order_by(search_type);
 	sql_query += ";";
 	sql_bindings.push_back(search);
@@ -501,11 +503,35 @@ void Arcollect::search::ParsedSearch::build_stmt(std::unique_ptr<SQLite3::stmt>
 		}, binding);
 	stmt->bind(i++,Arcollect::config::current_rating);
 }
-std::shared_ptr<Arcollect::db::artwork_collection> Arcollect::search::ParsedSearch::make_shared_collection(void) const
+void Arcollect::search::ParsedSearch::build_ranked_stmt(std::unique_ptr<SQLite3::stmt> &stmt, int limit, const std::vector<sqlite_int64> &restrict_to) const
+{
+	std::string query = "SELECT art_artid";
+	query.append(sql_query,sql_from_pos,sql_order_by_pos-sql_from_pos);
+	if (!restrict_to.empty()) {
+		query += "AND art_artid IN (?";
+		for (std::vector<sqlite_int64>::size_type i = 1; i < restrict_to.size(); i++)
+			query += ",?";
+		query += ") ";
+	}
+	query += "ORDER BY INSTR(lower(art_title),lower(?)) = 0, art_savedate DESC, art_artid DESC LIMIT ?;";
+	if (database->prepare(query.c_str(),stmt))
+		std::cerr << "Ranked search SQL prepare failure: " << database->errmsg() << " Search was: \"" << search << "\". Query was " << query << std::endl;
+	int i = 1;
+	for (const auto& binding: sql_bindings)
+		std::visit([&](auto&& binding) {
+			stmt->bind(i++,binding);
+		}, binding);
+	stmt->bind(i++,Arcollect::config::current_rating);
+	for (sqlite_int64 art_artid: restrict_to)
+		stmt->bind(i++,art_artid);
+	stmt->bind(i++,search);
+	stmt->bind(i++,limit);
+}
+std::shared_ptr<Arcollect::db::artwork_collection> Arcollect::search::ParsedSearch::make_shared_collection(bool fill) const
 {
 	std::unique_ptr<SQLite3::stmt> stmt;
 	build_stmt(stmt);
-	std::shared_ptr<Arcollect::db::artwork_collection> result = std::make_shared<Arcollect::db::artwork_collection_sqlite>(std::move(stmt));
+	std::shared_ptr<Arcollect::db::artwork_collection> result = std::make_shared<Arcollect::db::artwork_collection_sqlite>(std::move(stmt),fill);
 	result->sorting_type = sorting_type();
 	return result;
 }
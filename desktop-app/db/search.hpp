@@ -20,6 +20,7 @@
 #include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
 #include "../gui/font.hpp"
 
 namespace Arcollect {
@@ -86,6 +87,12 @@ namespace Arcollect {
 				/** The generated SQL query
 				 */
 				std::string sql_query;
+				/** Position of the FROM clause in #sql_query
+				 */
+				std::string::size_type sql_from_pos;
+				/** Position of the ORDER BY clause in #sql_query
+				 */
+				std::string::size_type sql_order_by_pos;
 				/** Bindings of the generated SQL query
 				 *
 				 * Parameters bindings
@@ -130,12 +137,28 @@ namespace Arcollect {
 				 *          be invalid when the search is destroyed.
 				 */
 				void build_stmt(std::unique_ptr<SQLite3::stmt> &stmt) const;
-				/** Prepare a SQLite stmt
+				/** Prepare a ranked and bounded SQLite stmt
 				 * \param[out] stmt The output stmt
+				 * \param limit Maximum number of artworks
+				 * \param restrict_to If not empty, only return artworks in this list
 				 * \warning The stmt link on std::string_view stored in #search and will
 				 *          be invalid when the search is destroyed.
+				 *
+				 * Artworks whose title contains the search come first, then the most
+				 * recently saved ones. The sorting type is ignored.
+				 *
+				 * This is intended for external search interfaces that only display a
+				 * few results like the GNOME Shell search provider.
+				 */
+				void build_ranked_stmt(std::unique_ptr<SQLite3::stmt> &stmt, int limit, const std::vector<sqlite_int64> &restrict_to = {}) const;
+				/** Make a collection of results
+				 * \param fill Whether to read all results now, otherwise the collection
+				 *        is filled with Arcollect::db::artwork_collection::fetch()
+				 * \warning The stmt link on std::string_view stored in #search and will
+				 *          be invalid when the search is destroyed. Fill the collection
+				 *          before that.
 				 */
-				std::shared_ptr<Arcollect::db::artwork_collection> make_shared_collection(void) const;
+				std::shared_ptr<Arcollect::db::artwork_collection> make_shared_collection(bool fill = true) const;
 				/** Perform auto-completion
 				 * \param[out] stmt that yield auto-completion items
 				 * \param limit Number of results (have a reasonable default)
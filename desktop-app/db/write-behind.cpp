@@ -0,0 +1,286 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "write-behind.hpp"
+#include "db.hpp"
+#include "../gui/main.hpp"
+#include <arcollect-db-open.hpp>
+#include <arcollect-paths.hpp>
+#include <condition_variable>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace Arcollect::db::write_behind;
+using write_behind_clock = std::chrono::steady_clock;
+
+#if WITH_TEST_COUNTERS
+std::atomic<unsigned int> Arcollect::db::write_behind::commits_count = 0;
+#endif
+
+/** Busy timeout of the background connection in milliseconds
+ *
+ * Writes are retried after #commit_delay if the lock is still held.
+ */
+static constexpr int busy_timeout = 100;
+/** Busy timeout on shutdown() in milliseconds
+ */
+static constexpr int shutdown_busy_timeout = 5000;
+
+struct pending_write {
+	write_function write;
+	done_function done;
+	std::promise<int> promise;
+};
+struct completed_write {
+	done_function done;
+	int code;
+};
+/** Lock protecting all variables below
+ */
+static std::mutex lock;
+static std::condition_variable condition_variable;
+static std::vector<pending_write> pending;
+static write_behind_clock::time_point pending_since;
+/** Writes completed but not processed by poll() yet
+ */
+static std::vector<completed_write> completed;
+/** Files to remove in the background thread
+ */
+static std::vector<std::filesystem::path> files_to_remove;
+static std::thread thread;
+static bool stop = false;
+
+/** Remove files relative to Arcollect::path::arco_data_home
+ */
+static void remove_files_now(const std::vector<std::filesystem::path> &files)
+{
+	for (const std::filesystem::path &filename: files) {
+		std::error_code ec;
+		std::filesystem::remove(Arcollect::path::arco_data_home/filename,ec);
+	}
+}
+/** Complete writes
+ * \param writes to complete, cleared
+ * \param codes of each write
+ */
+static void complete_writes(std::vector<pending_write> &writes, const std::vector<int> &codes)
+{
+	{
+		std::lock_guard<std::mutex> lock_guard(lock);
+		for (std::vector<pending_write>::size_type i = 0; i < writes.size(); i++)
+			completed.push_back({std::move(writes[i].done),codes[i]});
+	}
+	for (std::vector<pending_write>::size_type i = 0; i < writes.size(); i++)
+		writes[i].promise.set_value(codes[i]);
+	writes.clear();
+	Arcollect::gui::wakeup_main();
+}
+/** Check if an SQLite code is a lock error worth retrying
+ */
+static bool is_locked(int code)
+{
+	code &= 0xFF; // Ignore extended codes
+	return (code == SQLITE_BUSY)||(code == SQLITE_LOCKED);
+}
+/** Run writes in one transaction
+ * \param db to write in
+ * \param writes to run, cleared if completed
+ * \return false if the database is locked, writes are kept
+ */
+static bool commit_writes(std::unique_ptr<SQLite3::sqlite3> &db, std::vector<pending_write> &writes)
+{
+	int code = db->exec("BEGIN IMMEDIATE;");
+	if (is_locked(code))
+		return false;
+	std::vector<int> codes;
+	if (code != SQLITE_OK) {
+		std::cerr << "Write-behind, \"BEGIN IMMEDIATE;\" failed: " << db->errmsg() << ". Writes are dropped." << std::endl;
+		codes.assign(writes.size(),code);
+	} else {
+		codes.reserve(writes.size());
+		for (pending_write &write: writes) {
+			db->exec("SAVEPOINT write_behind;");
+			int write_code = write.write(db);
+			if ((write_code == SQLITE_OK)||(write_code == SQLITE_DONE)) {
+				write_code = SQLITE_OK;
+				db->exec("RELEASE write_behind;");
+			} else if (is_locked(write_code)) {
+				// Retry the whole batch later
+				db->exec("ROLLBACK;");
+				return false;
+			} else {
+				std::cerr << "Write-behind, a write failed: " << db->errmsg() << ". Rollback this write." << std::endl;
+				db->exec("ROLLBACK TO write_behind;");
+				db->exec("RELEASE write_behind;");
+			}
+			codes.push_back(write_code);
+		}
+		code = db->exec("COMMIT;");
+		if (is_locked(code)) {
+			std::cerr << "Write-behind, the database is locked on commit: " << db->errmsg() << ". Rollback, writes will be retried." << std::endl;
+			db->exec("ROLLBACK;");
+			return false;
+		} else if (code != SQLITE_OK) {
+			std::cerr << "Write-behind, failed to commit changes: " << db->errmsg() << ". Rollback, writes are dropped." << std::endl;
+			db->exec("ROLLBACK;");
+			codes.assign(writes.size(),code);
+		}
+		#if WITH_TEST_COUNTERS
+		else commits_count++;
+		#endif
+	}
+	// Release resources held by writes in this thread
+	for (pending_write &write: writes)
+		write.write = write_function();
+	complete_writes(writes,codes);
+	return true;
+}
+static void thread_func(void)
+{
+	std::unique_ptr<SQLite3::sqlite3> db = Arcollect::db::open();
+	db->busy_timeout(busy_timeout);
+	std::vector<pending_write> writes;
+	std::unique_lock<std::mutex> lock_guard(lock);
+	while (!stop || !pending.empty() || !files_to_remove.empty()) {
+		condition_variable.wait(lock_guard,[]{return stop || !pending.empty() || !files_to_remove.empty();});
+		if (!files_to_remove.empty()) {
+			std::vector<std::filesystem::path> files = std::move(files_to_remove);
+			files_to_remove.clear();
+			lock_guard.unlock();
+			remove_files_now(files);
+			lock_guard.lock();
+			continue;
+		}
+		if (pending.empty())
+			continue;
+		// Coalesce writes
+		if (!stop)
+			condition_variable.wait_for(lock_guard,commit_delay,[]{return stop;});
+		const bool stopping = stop;
+		if (stopping)
+			db->busy_timeout(shutdown_busy_timeout);
+		writes = std::move(pending);
+		pending.clear();
+		lock_guard.unlock();
+		if (!commit_writes(db,writes) && stopping) {
+			std::cerr << "Write-behind, the database is still locked on shutdown. " << writes.size() << " writes are dropped." << std::endl;
+			complete_writes(writes,std::vector<int>(writes.size(),SQLITE_BUSY));
+		}
+		lock_guard.lock();
+		// Retry later if the database was locked
+		if (!writes.empty()) {
+			pending.insert(pending.begin(),std::make_move_iterator(writes.begin()),std::make_move_iterator(writes.end()));
+			writes.clear();
+		}
+	}
+}
+
+std::future<int> Arcollect::db::write_behind::queue(write_function &&write, done_function &&done)
+{
+	std::future<int> future;
+	{
+		std::lock_guard<std::mutex> lock_guard(lock);
+		if (pending.empty())
+			pending_since = write_behind_clock::now();
+		pending.push_back({std::move(write),std::move(done),std::promise<int>()});
+		future = pending.back().promise.get_future();
+		// Start the thread
+		if (!thread.joinable() && sqlite3_threadsafe()) {
+			stop = false;
+			thread = std::thread(thread_func);
+		}
+	}
+	condition_variable.notify_one();
+	return future;
+}
+void Arcollect::db::write_behind::remove_files(std::vector<std::filesystem::path> &&files)
+{
+	{
+		std::lock_guard<std::mutex> lock_guard(lock);
+		if (thread.joinable() && !stop) {
+			files_to_remove.insert(files_to_remove.end(),std::make_move_iterator(files.begin()),std::make_move_iterator(files.end()));
+			files.clear();
+		}
+	}
+	if (files.empty())
+		condition_variable.notify_one();
+	else remove_files_now(files);
+}
+void Arcollect::db::write_behind::poll(void)
+{
+	std::vector<completed_write> to_process;
+	{
+		std::lock_guard<std::mutex> lock_guard(lock);
+		if (completed.empty())
+			return;
+		to_process.swap(completed);
+	}
+	for (completed_write &write: to_process)
+		if (write.done)
+			write.done(write.code);
+	// Resync in-memory objects, it drop optimistic changes of failed writes and
+	// catch commits made by the main connection in flush()
+	Arcollect::local_data_version_changed();
+}
+bool Arcollect::db::write_behind::flush_due(void)
+{
+	if (sqlite3_threadsafe())
+		return false;
+	std::lock_guard<std::mutex> lock_guard(lock);
+	return !pending.empty() && (write_behind_clock::now() - pending_since >= commit_delay);
+}
+void Arcollect::db::write_behind::flush(void)
+{
+	std::vector<pending_write> writes;
+	{
+		std::lock_guard<std::mutex> lock_guard(lock);
+		writes = std::move(pending);
+		pending.clear();
+	}
+	if (writes.empty() || commit_writes(Arcollect::database,writes))
+		return;
+	// Retry later
+	std::lock_guard<std::mutex> lock_guard(lock);
+	pending.insert(pending.begin(),std::make_move_iterator(writes.begin()),std::make_move_iterator(writes.end()));
+	pending_since = write_behind_clock::now();
+}
+void Arcollect::db::write_behind::shutdown(void)
+{
+	if (thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock_guard(lock);
+			stop = true;
+		}
+		condition_variable.notify_one();
+		thread.join();
+	} else {
+		flush();
+		std::vector<pending_write> writes;
+		{
+			std::lock_guard<std::mutex> lock_guard(lock);
+			writes = std::move(pending);
+			pending.clear();
+		}
+		if (!writes.empty()) {
+			std::cerr << "Write-behind, the database is still locked on shutdown. " << writes.size() << " writes are dropped." << std::endl;
+			complete_writes(writes,std::vector<int>(writes.size(),SQLITE_BUSY));
+		}
+	}
+	poll();
+}
@@ -0,0 +1,120 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file write-behind.hpp
+ *  \brief Asynchronous database writes (#Arcollect::db::write_behind)
+ */
+#pragma once
+#include <sqlite3.hpp>
+#include <config.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+namespace Arcollect {
+	namespace db {
+		/** Write-behind database writer
+		 *
+		 * The GUI must never wait for the database lock that webext-adder may hold
+		 * while saving artworks. Writes are queued with queue() and performed by a
+		 * background thread with its own connection. Writes queued within
+		 * #commit_delay are coalesced into one transaction, each write runs in its
+		 * own savepoint so a failure only rollback this write.
+		 *
+		 * Callers apply changes to in-memory objects optimistically. Once the
+		 * writes are committed, the main connection see a new
+		 * `PRAGMA data_version;` and in-memory objects are synced again.
+		 *
+		 * If SQLite is not thread-safe, there is no background thread and
+		 * Arcollect::gui::main() call flush() on the main thread instead.
+		 *
+		 * \note Writes that only fill caches should not use this. A commit from
+		 *       another connection invalidate all collections in the GUI.
+		 */
+		namespace write_behind {
+			/** A write function
+			 * \param db The connection to use, a transaction is already open
+			 * \return An SQLite code, SQLITE_OK or SQLITE_DONE on success
+			 *
+			 * If the database is locked (SQLITE_BUSY or SQLITE_LOCKED) by the write
+			 * or the commit, the whole transaction is rolled back and retried later.
+			 * A write may run more than once.
+			 * \warning It runs in another thread. Don't touch GUI objects here.
+			 */
+			using write_function = std::function<int(std::unique_ptr<SQLite3::sqlite3> &db)>;
+			/** Completion function
+			 * \param code SQLITE_OK on success, an SQLite error code otherwise
+			 *
+			 * Failures other than locks are also reported on std::cerr.
+			 *
+			 * It runs on the main thread within poll().
+			 */
+			using done_function = std::function<void(int code)>;
+			/** Delay to coalesce writes before commit
+			 */
+			static constexpr std::chrono::milliseconds commit_delay(50);
+			/** Queue a write
+			 * \param write The write function
+			 * \param done Optional completion function
+			 * \return A future resolved with the write result after the commit
+			 *
+			 * This starts the background thread if needed.
+			 */
+			std::future<int> queue(write_function &&write, done_function &&done = done_function());
+			/** Remove files in the background
+			 * \param files to remove, relative to Arcollect::path::arco_data_home
+			 *
+			 * Call this after the commit, typically from a done_function. Files
+			 * are removed synchronously if the background thread is not running.
+			 */
+			void remove_files(std::vector<std::filesystem::path> &&files);
+			/** Process completed writes
+			 *
+			 * Run completion functions and force a resync of in-memory objects
+			 * with local_data_version_changed().
+			 *
+			 * It is called by Arcollect::gui::main() on each frame.
+			 */
+			void poll(void);
+			/** Check if flush() should be called
+			 * \return true if SQLite is not thread-safe and writes are pending
+			 *         since #commit_delay
+			 */
+			bool flush_due(void);
+			/** Perform pending writes on the main thread
+			 *
+			 * This is only meant to be used when SQLite is not thread-safe.
+			 * If the database is locked, writes are kept and retried later.
+			 */
+			void flush(void);
+			/** Commit pending writes and stop the background thread
+			 *
+			 * Writes still pending after a few seconds of lock are failed.
+			 */
+			void shutdown(void);
+			#if WITH_TEST_COUNTERS
+			/** Number of transactions committed
+			 *
+			 * This is for tests and only built with `-Dtest_counters=true`.
+			 */
+			extern std::atomic<unsigned int> commits_count;
+			#endif
+		}
+	}
+}
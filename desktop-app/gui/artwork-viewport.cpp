@@ -15,7 +15,77 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "artwork-viewport.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
 extern SDL::Renderer *renderer;
+
+/** Placeholders atlas
+ *
+ * All placeholders are uploaded in one shared texture instead of creating one
+ * tiny texture per download. Cells are recycled in a round-robin fashion.
+ *
+ * Each cell has a one pixel border that duplicate the placeholder edges, this
+ * avoid neighbours cells bleeding when upscaling with linear filtering.
+ */
+namespace placeholder_atlas {
+	static constexpr int placeholder_size = Arcollect::db::download::placeholder_size;
+	static constexpr int cell_size = placeholder_size+2;
+	static constexpr int cells_per_row = 64;
+	static constexpr int cells_count = cells_per_row*cells_per_row;
+	static std::unique_ptr<SDL::Texture> texture;
+	/** Cells owner dwn_id, 0 if unused
+	 */
+	static std::vector<sqlite_int64> cells_owner(cells_count,0);
+	/** dwn_id to cell index
+	 */
+	static std::unordered_map<sqlite_int64,int> cells;
+	static int next_cell = 0;
+	
+	/** Render a download placeholder
+	 * \param download The download
+	 * \param rect The target rect
+	 * \return false if no placeholder is available
+	 */
+	static bool render(Arcollect::db::download &download, const SDL::Rect &rect)
+	{
+		const Uint16 *pixels = download.query_placeholder();
+		if (!pixels)
+			return false;
+		// Create the atlas
+		if (!texture) {
+			SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY,"linear");
+			texture.reset(SDL::Texture::Create(renderer,SDL_PIXELFORMAT_RGB565,SDL_TEXTUREACCESS_STATIC,cells_per_row*cell_size,cells_per_row*cell_size));
+			SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY,"best");
+			if (!texture)
+				return false;
+		}
+		// Find or upload the placeholder
+		auto iter = cells.find(download.dwn_id);
+		if (iter == cells.end()) {
+			const int cell = next_cell;
+			next_cell = (next_cell+1) % cells_count;
+			if (cells_owner[cell])
+				cells.erase(cells_owner[cell]);
+			cells_owner[cell] = download.dwn_id;
+			iter = cells.emplace(download.dwn_id,cell).first;
+			// Build the cell with borders
+			Uint16 cell_pixels[cell_size*cell_size];
+			for (int y = 0; y < cell_size; y++)
+				for (int x = 0; x < cell_size; x++) {
+					const int src_x = std::clamp(x-1,0,placeholder_size-1);
+					const int src_y = std::clamp(y-1,0,placeholder_size-1);
+					cell_pixels[y*cell_size+x] = pixels[src_y*placeholder_size+src_x];
+				}
+			const SDL::Rect cell_rect{(cell % cells_per_row)*cell_size,(cell / cells_per_row)*cell_size,cell_size,cell_size};
+			texture->Update(&cell_rect,cell_pixels,cell_size*sizeof(Uint16));
+		}
+		const SDL::Rect src_rect{(iter->second % cells_per_row)*cell_size+1,(iter->second / cells_per_row)*cell_size+1,placeholder_size,placeholder_size};
+		renderer->Copy(texture.get(),&src_rect,&rect);
+		return true;
+	}
+}
+
 int Arcollect::gui::artwork_viewport::render(const SDL::Point displacement)
 {
 	// Apply displacement
@@ -34,6 +104,8 @@ int Arcollect::gui::artwork_viewport::render(const SDL::Point displacement)
 	auto &text = download->query_image({rect.w,rect.h});
 	if (text) {
 		return renderer->Copy(text.get(),NULL,&rect);
+	} else if (placeholder_atlas::render(*download,rect)) {
+		return 0;
 	} else {
 		// Render a placeholder
 		renderer->SetDrawColor(0,0,0,192);
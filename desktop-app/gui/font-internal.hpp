@@ -100,6 +100,11 @@ namespace Arcollect {
 			 * 
 			 */
 			void os_init(void);
+			/** System specific shutdown
+			 *
+			 * Persist system specific caches.
+			 */
+			void os_shutdown(void);
 			/** Arcollect FreeType2 render flags
 			 */
 			static constexpr auto ft_flags = 0;
@@ -122,6 +127,11 @@ namespace Arcollect {
 			struct Glyph {
 				SDL::Texture* text;
 				SDL::Rect coordinates;
+				/** Number of Renderable glyphs using this glyph
+				 *
+				 * Unused glyphs are freed by release_memory().
+				 */
+				unsigned int references = 0;
 				
 				/** Create a glyph
 				 *
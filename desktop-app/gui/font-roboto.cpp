@@ -21,13 +21,24 @@
 #include <arcollect-roboto.hpp>
 #include FT_SIZES_H
 static FT_Face face;
-static std::unordered_map<FT_UInt,FT_Size> cache;
+struct size_entry {
+	FT_Size size;
+	/** HarfBuzz font on this size
+	 *
+	 * HarfBuzz take the scale of the active size on creation.
+	 */
+	hb_font_t *font;
+};
+static std::unordered_map<FT_UInt,size_entry> cache;
 static Arcollect::gui::font::FaceGeneric face_generic;
 void Arcollect::gui::font::os_init(void)
 {
 	FT_New_Memory_Face(Arcollect::gui::font::ft_library,(const FT_Byte*)Arcollect::Roboto::Light.data(),Arcollect::Roboto::Light.size(),0,&face);
 	face->generic.data = &face_generic;
 }
+void Arcollect::gui::font::os_shutdown(void)
+{
+}
 FT_Face Arcollect::gui::font::shape_hb_buffer(const Arcollect::gui::font::Renderable::RenderingState& state, hb_buffer_t* buf, Arcollect::gui::font::shape_data*)
 {
 	// Query the font_size
@@ -40,18 +51,17 @@ FT_Face Arcollect::gui::font::shape_hb_buffer(const Arcollect::gui::font::Render
 		FT_New_Size(face,&new_size);
 		FT_Activate_Size(new_size);
 		FT_Set_Pixel_Sizes(face,state.font_height,state.font_height);
-		cache.emplace(key,new_size);
-	} else FT_Activate_Size(iter->second);
+		hb_font_t *new_font = hb_ft_font_create_referenced(face);
+		hb_ft_font_set_load_flags(new_font,ft_flags);
+		iter = cache.emplace(key,size_entry{new_size,new_font}).first;
+	} else FT_Activate_Size(iter->second.size);
 	// Configure the buffer
 	// FIXME Auto-detect better values
 	hb_buffer_set_direction(buf, HB_DIRECTION_LTR);
 	hb_buffer_set_script(buf, HB_SCRIPT_LATIN);
 	hb_buffer_set_language(buf, hb_language_from_string("en", -1));
 	// Shape the buffer
-	hb_font_t *font = hb_ft_font_create_referenced(face);
-	hb_ft_font_set_load_flags(font,ft_flags);
-	hb_shape(font,buf,NULL,0);
-	hb_font_destroy(font);
+	hb_shape(iter->second.font,buf,NULL,0);
 	return face;
 }
 int Arcollect::gui::font::text_run_length(const Arcollect::gui::font::Renderable::RenderingState &state, unsigned int cp_offset, Arcollect::gui::font::shape_data*&)
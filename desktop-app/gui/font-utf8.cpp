@@ -0,0 +1,350 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file font-utf8.cpp
+ *  \brief UTF-8 to UTF-32 transcoding implementation
+ *
+ * Runs of ASCII are widened with SIMD, AVX2 is selected at runtime and SSE2 is
+ * always available on x86-64.
+ *
+ * Blocks with multibyte sequences are validated with SIMD lookup tables as
+ * described in "Validating UTF-8 In Less Than One Instruction Per Byte" by
+ * John Keiser and Daniel Lemire (needs AVX2 or SSSE3), valid blocks are then
+ * decoded without checks. Invalid blocks and the end of the text are decoded
+ * one codepoint at a time by a validating scalar decoder.
+ */
+#include "font-utf8.hpp"
+#include <algorithm>
+#include <cstdint>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ARCOLLECT_UTF8_X86 1
+#include <immintrin.h>
+#else
+#define ARCOLLECT_UTF8_X86 0
+#endif
+
+static constexpr char32_t replacement_character = 0xFFFD;
+
+/** Decode one codepoint
+ * \param[in,out] iter position in the input
+ * \param end of the input
+ * \return The codepoint or #replacement_character
+ */
+static inline char32_t decode_one(const unsigned char *&iter, const unsigned char *const end)
+{
+	const unsigned char lead = *iter++;
+	if (lead < 0x80)
+		return lead;
+	// Get the sequence length and the valid range of the second byte
+	unsigned int length;
+	unsigned char second_min = 0x80, second_max = 0xBF;
+	char32_t codepoint;
+	if ((lead >= 0xC2) && (lead <= 0xDF)) {
+		length = 2;
+		codepoint = lead & 0x1F;
+	} else if ((lead >= 0xE0) && (lead <= 0xEF)) {
+		length = 3;
+		codepoint = lead & 0x0F;
+		if (lead == 0xE0)
+			second_min = 0xA0; // Overlong
+		else if (lead == 0xED)
+			second_max = 0x9F; // Surrogates
+	} else if ((lead >= 0xF0) && (lead <= 0xF4)) {
+		length = 4;
+		codepoint = lead & 0x07;
+		if (lead == 0xF0)
+			second_min = 0x90; // Overlong
+		else if (lead == 0xF4)
+			second_max = 0x8F; // Above U+10FFFF
+	} else return replacement_character;
+	// Read continuation bytes, stop at the end of the maximal subpart
+	if ((iter == end) || (*iter < second_min) || (*iter > second_max))
+		return replacement_character;
+	codepoint = (codepoint << 6) | (*iter++ & 0x3F);
+	for (unsigned int i = 2; i < length; i++) {
+		if ((iter == end) || ((*iter & 0xC0) != 0x80))
+			return replacement_character;
+		codepoint = (codepoint << 6) | (*iter++ & 0x3F);
+	}
+	return codepoint;
+}
+
+/** Decode one codepoint of validated text
+ * \param[in,out] iter position in the input
+ * \return The codepoint
+ */
+static inline char32_t decode_valid(const unsigned char *&iter)
+{
+	const unsigned char lead = *iter;
+	char32_t codepoint;
+	if (lead < 0x80) {
+		codepoint = lead;
+		iter += 1;
+	} else if (lead < 0xE0) {
+		codepoint = ((lead & 0x1F) << 6) | (iter[1] & 0x3F);
+		iter += 2;
+	} else if (lead < 0xF0) {
+		codepoint = ((lead & 0x0F) << 12) | ((iter[1] & 0x3F) << 6) | (iter[2] & 0x3F);
+		iter += 3;
+	} else {
+		codepoint = ((lead & 0x07) << 18) | ((iter[1] & 0x3F) << 12) | ((iter[2] & 0x3F) << 6) | (iter[3] & 0x3F);
+		iter += 4;
+	}
+	return codepoint;
+}
+/** Get the size of the complete sequences in a validated block
+ * \return `size` minus the bytes of a sequence truncated by the block end
+ */
+static inline std::size_t complete_prefix(const unsigned char *block, std::size_t size)
+{
+	for (std::size_t back = 1; back <= 3; back++) {
+		const unsigned char byte = block[size-back];
+		if ((byte & 0xC0) == 0x80)
+			continue; // Continuation byte
+		const std::size_t length = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+		return length > back ? size-back : size;
+	}
+	return size;
+}
+
+#if ARCOLLECT_UTF8_X86
+/** Keiser-Lemire lookup tables error bits
+ *
+ * Each pair of bytes is classified with the high nibble of the first byte, the
+ * low nibble of the first byte and the high nibble of the second byte. An
+ * error bit set in the three lookups is an invalid pair.
+ */
+enum utf8_error: unsigned char {
+	TOO_SHORT      = 1 << 0, // 11______ 0_______ or 11______ 11______
+	TOO_LONG       = 1 << 1, // 0_______ 10______
+	OVERLONG_3     = 1 << 2, // 11100000 100_____
+	TOO_LARGE      = 1 << 3, // 11110100 1001____ and above
+	SURROGATE      = 1 << 4, // 11101101 101_____
+	OVERLONG_2     = 1 << 5, // 1100000_ 10______
+	TOO_LARGE_1000 = 1 << 6, // 11110101 1000____ and above
+	OVERLONG_4     = 1 << 6, // 11110000 1000____
+	TWO_CONTS      = 1 << 7, // 10______ 10______
+	CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS,
+};
+/** High nibble of the first byte lookup table
+ */
+static constexpr unsigned char byte_1_high_table[16] = {
+	// 0_______ ________ <ASCII in byte 1>
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	// 10______ ________ <continuation in byte 1>
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	// 1100____ ________ <two byte lead in byte 1>
+	TOO_SHORT | OVERLONG_2,
+	// 1101____ ________ <two byte lead in byte 1>
+	TOO_SHORT,
+	// 1110____ ________ <three byte lead in byte 1>
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	// 1111____ ________ <four+ byte lead in byte 1>
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+/** Low nibble of the first byte lookup table
+ */
+static constexpr unsigned char byte_1_low_table[16] = {
+	// ____0000 ________
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	// ____0001 ________
+	CARRY | OVERLONG_2,
+	// ____001_ ________
+	CARRY,
+	CARRY,
+	// ____0100 ________
+	CARRY | TOO_LARGE,
+	// ____0101 ________
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	// ____011_ ________
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	// ____1___ ________
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	// ____1101 ________
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+/** High nibble of the second byte lookup table
+ */
+static constexpr unsigned char byte_2_high_table[16] = {
+	// ________ 0_______ <ASCII in byte 2>
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	// ________ 1000____
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+	// ________ 1001____
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	// ________ 101_____
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+	// ________ 11______
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/** Widen whole blocks of ASCII
+ * \return The number of bytes converted
+ *
+ * It stops at the first block with a non-ASCII byte.
+ */
+__attribute__((target("avx2")))
+static std::size_t ascii_avx2(const unsigned char *input, std::size_t size, char32_t *output)
+{
+	std::size_t i = 0;
+	for (; i + 32 <= size; i += 32) {
+		const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input+i));
+		if (_mm256_movemask_epi8(chunk))
+			break;
+		for (std::size_t j = 0; j < 32; j += 8)
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(output+i+j),_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(input+i+j))));
+	}
+	return i;
+}
+__attribute__((target("sse2")))
+static std::size_t ascii_sse2(const unsigned char *input, std::size_t size, char32_t *output)
+{
+	const __m128i zero = _mm_setzero_si128();
+	std::size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input+i));
+		if (_mm_movemask_epi8(chunk))
+			break;
+		const __m128i low  = _mm_unpacklo_epi8(chunk,zero);
+		const __m128i high = _mm_unpackhi_epi8(chunk,zero);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output+i   ),_mm_unpacklo_epi16(low ,zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output+i+4 ),_mm_unpackhi_epi16(low ,zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output+i+8 ),_mm_unpacklo_epi16(high,zero));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output+i+12),_mm_unpackhi_epi16(high,zero));
+	}
+	return i;
+}
+/** Validate a block starting on a sequence boundary
+ * \return The number of bytes of complete sequences or 0 if invalid
+ */
+__attribute__((target("avx2")))
+static std::size_t validate_avx2(const unsigned char *input)
+{
+	const __m256i byte_1_high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(byte_1_high_table)));
+	const __m256i byte_1_low  = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(byte_1_low_table)));
+	const __m256i byte_2_high = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(byte_2_high_table)));
+	const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+	const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input));
+	// Bytes before the block are ASCII since it starts on a boundary
+	const __m256i shifted = _mm256_permute2x128_si256(chunk,chunk,0x08);
+	const __m256i prev1 = _mm256_alignr_epi8(chunk,shifted,15);
+	const __m256i prev2 = _mm256_alignr_epi8(chunk,shifted,14);
+	const __m256i prev3 = _mm256_alignr_epi8(chunk,shifted,13);
+	// Check pairs of bytes
+	const __m256i special_cases = _mm256_and_si256(_mm256_and_si256(
+		_mm256_shuffle_epi8(byte_1_high,_mm256_and_si256(_mm256_srli_epi16(prev1,4),nibble_mask)),
+		_mm256_shuffle_epi8(byte_1_low ,_mm256_and_si256(prev1,nibble_mask))),
+		_mm256_shuffle_epi8(byte_2_high,_mm256_and_si256(_mm256_srli_epi16(chunk,4),nibble_mask)));
+	// Check continuations of 3 and 4 bytes sequences
+	const __m256i must_be_continuation = _mm256_and_si256(_mm256_or_si256(
+		_mm256_subs_epu8(prev2,_mm256_set1_epi8(static_cast<char>(0xE0-0x80))),
+		_mm256_subs_epu8(prev3,_mm256_set1_epi8(static_cast<char>(0xF0-0x80)))),
+		_mm256_set1_epi8(static_cast<char>(0x80)));
+	if (!_mm256_testz_si256(_mm256_xor_si256(must_be_continuation,special_cases),_mm256_xor_si256(must_be_continuation,special_cases)))
+		return 0;
+	return complete_prefix(input,32);
+}
+__attribute__((target("ssse3")))
+static std::size_t validate_ssse3(const unsigned char *input)
+{
+	const __m128i byte_1_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(byte_1_high_table));
+	const __m128i byte_1_low  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(byte_1_low_table));
+	const __m128i byte_2_high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(byte_2_high_table));
+	const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+	const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input));
+	// Bytes before the block are ASCII since it starts on a boundary
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i prev1 = _mm_alignr_epi8(chunk,zero,15);
+	const __m128i prev2 = _mm_alignr_epi8(chunk,zero,14);
+	const __m128i prev3 = _mm_alignr_epi8(chunk,zero,13);
+	// Check pairs of bytes
+	const __m128i special_cases = _mm_and_si128(_mm_and_si128(
+		_mm_shuffle_epi8(byte_1_high,_mm_and_si128(_mm_srli_epi16(prev1,4),nibble_mask)),
+		_mm_shuffle_epi8(byte_1_low ,_mm_and_si128(prev1,nibble_mask))),
+		_mm_shuffle_epi8(byte_2_high,_mm_and_si128(_mm_srli_epi16(chunk,4),nibble_mask)));
+	// Check continuations of 3 and 4 bytes sequences
+	const __m128i must_be_continuation = _mm_and_si128(_mm_or_si128(
+		_mm_subs_epu8(prev2,_mm_set1_epi8(static_cast<char>(0xE0-0x80))),
+		_mm_subs_epu8(prev3,_mm_set1_epi8(static_cast<char>(0xF0-0x80)))),
+		_mm_set1_epi8(static_cast<char>(0x80)));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_xor_si128(must_be_continuation,special_cases),zero)) != 0xFFFF)
+		return 0;
+	return complete_prefix(input,16);
+}
+#endif
+
+/** Transcode with SIMD blocks converters
+ * \param ascii_blocks converter or NULL
+ * \param validate_block validator or NULL
+ * \param block_size of the converter and validator
+ */
+static inline std::size_t utf8_to_utf32_impl(std::string_view input, char32_t *const output, std::size_t (*ascii_blocks)(const unsigned char*, std::size_t, char32_t*), std::size_t (*validate_block)(const unsigned char*), std::size_t block_size)
+{
+	const unsigned char *iter = reinterpret_cast<const unsigned char*>(input.data());
+	const unsigned char *const end = iter + input.size();
+	char32_t *out = output;
+	while (iter != end) {
+		if (ascii_blocks) {
+			const std::size_t converted = ascii_blocks(iter,end-iter,out);
+			iter += converted;
+			out  += converted;
+		}
+		// Decode the block with non-ASCII characters
+		if (validate_block && (static_cast<std::size_t>(end-iter) >= block_size)) {
+			const unsigned char *const valid_end = iter + validate_block(iter);
+			if (valid_end != iter) {
+				while (iter < valid_end)
+					*out++ = decode_valid(iter);
+				continue;
+			}
+		}
+		const unsigned char *const scalar_end = ascii_blocks ? iter + std::min<std::size_t>(block_size,end-iter) : end;
+		while (iter < scalar_end)
+			*out++ = decode_one(iter,end);
+	}
+	return out - output;
+}
+std::size_t Arcollect::gui::font::utf8_to_utf32_scalar(std::string_view input, char32_t *output)
+{
+	return utf8_to_utf32_impl(input,output,nullptr,nullptr,0);
+}
+std::size_t Arcollect::gui::font::utf8_to_utf32(std::string_view input, char32_t *output)
+{
+	#if ARCOLLECT_UTF8_X86
+	static const bool has_avx2 = __builtin_cpu_supports("avx2");
+	static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+	static const bool has_sse2 = __builtin_cpu_supports("sse2");
+	if (has_avx2)
+		return utf8_to_utf32_impl(input,output,ascii_avx2,validate_avx2,32);
+	else if (has_ssse3)
+		return utf8_to_utf32_impl(input,output,ascii_sse2,validate_ssse3,16);
+	else if (has_sse2)
+		return utf8_to_utf32_impl(input,output,ascii_sse2,nullptr,16);
+	else return utf8_to_utf32_scalar(input,output);
+	#else
+	return utf8_to_utf32_scalar(input,output);
+	#endif
+}
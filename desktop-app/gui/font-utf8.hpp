@@ -0,0 +1,45 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file font-utf8.hpp
+ *  \brief UTF-8 to UTF-32 transcoding for Arcollect::gui::font::Elements
+ */
+#pragma once
+#include <cstddef>
+#include <string_view>
+namespace Arcollect {
+	namespace gui {
+		namespace font {
+			/** Decode UTF-8 into UTF-32
+			 * \param input UTF-8 text
+			 * \param[out] output buffer of at least `input.size()` codepoints
+			 * \return The number of codepoints written
+			 *
+			 * Invalid sequences are replaced by an U+FFFD per maximal subpart like
+			 * the Unicode standard recommend.
+			 *
+			 * Runs of ASCII are converted and multibyte sequences validated with
+			 * AVX2, SSSE3 or SSE2 (ASCII only) depending on the CPU.
+			 */
+			std::size_t utf8_to_utf32(std::string_view input, char32_t *output);
+			/** Portable utf8_to_utf32() implementation
+			 *
+			 * It is exposed for testing and benchmarking.
+			 */
+			std::size_t utf8_to_utf32_scalar(std::string_view input, char32_t *output);
+		}
+	}
+}
@@ -16,10 +16,14 @@
  */
 #include <arcollect-debug.hpp>
 #include "font-internal.hpp" // #include "font.hpp"
-#include <locale>
+#include "font-utf8.hpp"
+#include <algorithm>
+#include <cwchar>
+#include <list>
 
 extern SDL::Renderer *renderer;
 FT_Library Arcollect::gui::font::ft_library;
+Arcollect::gui::font::FrameStats Arcollect::gui::font::frame_stats;
 
 void Arcollect::gui::font::init(void)
 {
@@ -27,6 +31,11 @@ void Arcollect::gui::font::init(void)
 	Arcollect::gui::font::os_init();
 }
 
+void Arcollect::gui::font::shutdown(void)
+{
+	Arcollect::gui::font::os_shutdown();
+}
+
 Arcollect::gui::font::Glyph::Glyph(hb_codepoint_t glyphid, FT_Face face)
 {
 	// Render glyph
@@ -64,19 +73,55 @@ std::unordered_map<std::size_t,Arcollect::gui::font::Glyph> Arcollect::gui::font
 
 Arcollect::gui::font::Elements& Arcollect::gui::font::Elements::operator<<(const std::string_view &string)
 {
-	typedef std::codecvt<char32_t,char/*char8_t*/,std::mbstate_t> codecvt_t;
-	// Convert the string in UTF-32
-	std::u32string codepoints;
-	codepoints.resize(string.size());
-	static const codecvt_t &codecvt = std::use_facet<codecvt_t>(std::locale());
-	const char/*char8_t*/* trash8;
-	char32_t* utf32_end;
-	std::mbstate_t codecvt_state;
-	codecvt.in(codecvt_state,&*(string.begin()),&*(string.end()),trash8,&*(codepoints.begin()),&*(codepoints.end()),utf32_end);
-	codepoints.resize(std::distance(codepoints.data(),utf32_end));
-	return operator<<(codepoints);
+	// Convert the string in UTF-32 right in the text
+	const std::size_t old_size = text.size();
+	text.resize(old_size+string.size());
+	const std::size_t codepoints = utf8_to_utf32(string,text.data()+old_size);
+	text.resize(old_size+codepoints);
+	attributes.back().end += codepoints;
+	must_push_new_attribute = true;
+	return *this;
 }
 
+std::vector<std::size_t> Arcollect::gui::font::Elements::paragraphs(void) const
+{
+	std::vector<std::size_t> result{0};
+	const char32_t *const begin = text.data();
+	const char32_t *const end = begin + text.size();
+	for (const char32_t *iter = begin; iter != end; ++iter) {
+		if constexpr (sizeof(wchar_t) == sizeof(char32_t)) {
+			// wmemchr() is vectorized in common libc, it matters on large texts
+			iter = reinterpret_cast<const char32_t*>(std::wmemchr(reinterpret_cast<const wchar_t*>(iter),L'\n',end-iter));
+			if (!iter)
+				break;
+		} else {
+			iter = std::find(iter,end,U'\n');
+			if (iter == end)
+				break;
+		}
+		if (iter != begin)
+			result.push_back(iter-begin);
+	}
+	return result;
+}
+Arcollect::gui::font::Elements Arcollect::gui::font::Elements::slice(std::size_t begin, std::size_t end) const
+{
+	Elements result;
+	result.text = text.substr(begin,end-begin);
+	// Copy attributes in the range
+	auto iter = std::upper_bound(attributes.begin(),attributes.end(),begin,[](std::size_t offset, const Attributes &attributes) {
+		return offset < attributes.end;
+	});
+	if (iter == attributes.end())
+		--iter;
+	result.attributes.clear();
+	do {
+		result.attributes.emplace_back(*iter);
+		result.attributes.back().end = std::clamp<std::size_t>(iter->end,begin,end)-begin;
+	} while ((iter->end < end) && (++iter != attributes.end()));
+	result.must_push_new_attribute = true;
+	return result;
+}
 
 Arcollect::gui::font::RenderConfig::RenderConfig() :
 	base_font_height(14),
@@ -168,12 +213,14 @@ void Arcollect::gui::font::Renderable::append_text_run(unsigned int cp_offset, i
 		add_line(cursor,{cursor.x,static_cast<int>(cursor.y+state.current_line_skip)},{255,255,0,255}); // Add text run mark
 		add_line(cursor,{static_cast<int>(cursor.x+state.current_line_skip),cursor.y},{255,255,0,255}); // Add text run mark
 	}
-	// Create the buffer
-	hb_buffer_t *buf = hb_buffer_create();
+	// Reuse the buffer, Renderable are only made on the main thread
+	static hb_buffer_t *const buf = hb_buffer_create();
+	hb_buffer_clear_contents(buf);
 	hb_buffer_pre_allocate(buf,text.size());
 	hb_buffer_add_utf32(buf,reinterpret_cast<const uint32_t*>(state.text.data()),state.text.size(),cp_offset,cp_count);
 	// Invoke Harfbuzz
 	FT_Face face = Arcollect::gui::font::shape_hb_buffer(state,buf,shape_data);
+	frame_stats.text_runs++;
 	const auto font_line_skip = face->size->metrics.height >> 6;
 	// Prepare glyphs process
 	auto glyph_base = glyphs.size();
@@ -186,7 +233,7 @@ void Arcollect::gui::font::Renderable::append_text_run(unsigned int cp_offset, i
 		// Skip lines
 		state.skip_line(*this,font_line_skip);
 		// Virtually trim glyphs
-		while (glyph_infos->cluster <= cp_offset) {
+		while (glyph_count && (glyph_infos->cluster <= cp_offset)) {
 			++glyph_infos;
 			++glyph_pos;
 			--glyph_count;
@@ -312,13 +359,13 @@ void Arcollect::gui::font::Renderable::append_text_run(unsigned int cp_offset, i
 		cursor.x += glyph_pos[i].x_advance;
 		cursor.y += glyph_pos[i].y_advance;
 	}
-	// Cleanups and late updates
-	hb_buffer_destroy(buf);
+	// Late updates
 	state.text_run_cluster_offset += glyph_count;
 }
 Arcollect::gui::font::Renderable::Renderable(const Attributes* attrib_begin, std::size_t attrib_count, std::u32string_view text, int wrap_width, const RenderConfig& config) :
 	result_size{0,0}
 {
+	frame_stats.renderables++;
 	// Init rendering state
 	RenderingState state {
 		config,
@@ -345,6 +392,7 @@ Arcollect::gui::font::Renderable::Renderable(const Attributes* attrib_begin, std
 	// Align the rest
 	state.attrib_iter = &attrib_begin[attrib_count-1]; // Get back on a correct attrib_iter
 	align_glyphs(state,state.wrap_width - state.cursor.x);
+	result_flow_height = state.cursor.y + state.current_line_skip;
 	
 	// Outline the text in debug mode
 	if (Arcollect::debug.fonts)
@@ -352,6 +400,129 @@ Arcollect::gui::font::Renderable::Renderable(const Attributes* attrib_begin, std
 	// Shrink vectors
 	glyphs.shrink_to_fit();
 	lines.shrink_to_fit();
+	// Reference glyphs
+	for (const GlyphData& glyph: glyphs)
+		glyph.glyph->references++;
+}
+Arcollect::gui::font::Renderable::Renderable(const Renderable& other) :
+	result_size(other.result_size),
+	result_flow_height(other.result_flow_height),
+	glyphs(other.glyphs),
+	lines(other.lines)
+{
+	for (const GlyphData& glyph: glyphs)
+		glyph.glyph->references++;
+}
+Arcollect::gui::font::Renderable::Renderable(Renderable&& other) :
+	result_size(other.result_size),
+	result_flow_height(other.result_flow_height),
+	glyphs(std::move(other.glyphs)),
+	lines(std::move(other.lines))
+{
+	other.glyphs.clear();
+}
+Arcollect::gui::font::Renderable& Arcollect::gui::font::Renderable::operator=(const Renderable& other)
+{
+	// Reference first in case glyphs are shared
+	for (const GlyphData& glyph: other.glyphs)
+		glyph.glyph->references++;
+	for (const GlyphData& glyph: glyphs)
+		glyph.glyph->references--;
+	result_size = other.result_size;
+	result_flow_height = other.result_flow_height;
+	glyphs = other.glyphs;
+	lines = other.lines;
+	return *this;
+}
+Arcollect::gui::font::Renderable& Arcollect::gui::font::Renderable::operator=(Renderable&& other)
+{
+	if (this != &other) {
+		for (const GlyphData& glyph: glyphs)
+			glyph.glyph->references--;
+		result_size = other.result_size;
+		result_flow_height = other.result_flow_height;
+		glyphs = std::move(other.glyphs);
+		lines = std::move(other.lines);
+		other.glyphs.clear();
+	}
+	return *this;
+}
+Arcollect::gui::font::Renderable::~Renderable(void)
+{
+	for (const GlyphData& glyph: glyphs)
+		glyph.glyph->references--;
+}
+
+struct renderable_cache_entry {
+	std::size_t key;
+	int wrap_width;
+	Arcollect::gui::font::RenderConfig config;
+	Arcollect::gui::font::Elements elements;
+	std::shared_ptr<const Arcollect::gui::font::Renderable> renderable;
+};
+/** Renderable::cached() entries, the most recently used first
+ */
+static std::list<renderable_cache_entry> renderable_cache;
+static std::unordered_multimap<std::size_t,decltype(renderable_cache)::iterator> renderable_cache_index;
+static std::size_t hash_combine(std::size_t seed, std::size_t value)
+{
+	return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+std::shared_ptr<const Arcollect::gui::font::Renderable> Arcollect::gui::font::Renderable::cached(const Elements& elements, int wrap_width, const RenderConfig& config)
+{
+	// Compute the key
+	std::size_t key = std::hash<std::u32string_view>()(elements.text);
+	for (const Attributes& attributes: elements.attributes) {
+		key = hash_combine(key,attributes.end);
+		key = hash_combine(key,static_cast<std::size_t>(attributes.alignment));
+		key = hash_combine(key,(attributes.weight.value << 1)|attributes.justify.value);
+		key = hash_combine(key,(attributes.color.r << 24)|(attributes.color.g << 16)|(attributes.color.b << 8)|attributes.color.a);
+		key = hash_combine(key,std::hash<float>()(attributes.font_size.value));
+	}
+	key = hash_combine(key,wrap_width);
+	key = hash_combine(key,(config.base_font_height << 1)|config.always_justify);
+	// Lookup the cache
+	auto range = renderable_cache_index.equal_range(key);
+	for (auto iter = range.first; iter != range.second; ++iter) {
+		const decltype(renderable_cache)::iterator entry = iter->second;
+		if ((entry->wrap_width == wrap_width) && (entry->config == config) && (entry->elements == elements)) {
+			renderable_cache.splice(renderable_cache.begin(),renderable_cache,entry);
+			frame_stats.cache_hits++;
+			return entry->renderable;
+		}
+	}
+	// Shape the text
+	frame_stats.cache_misses++;
+	renderable_cache.push_front({key,wrap_width,config,elements,std::make_shared<const Renderable>(elements,wrap_width,config)});
+	renderable_cache_index.emplace(key,renderable_cache.begin());
+	// Evict the least recently used entry
+	if (renderable_cache.size() > cache_capacity) {
+		const decltype(renderable_cache)::iterator lru = std::prev(renderable_cache.end());
+		range = renderable_cache_index.equal_range(lru->key);
+		for (auto iter = range.first; iter != range.second; ++iter)
+			if (iter->second == lru) {
+				renderable_cache_index.erase(iter);
+				break;
+			}
+		renderable_cache.pop_back();
+	}
+	return renderable_cache.front().renderable;
+}
+std::size_t Arcollect::gui::font::release_memory(bool critical)
+{
+	if (critical) {
+		renderable_cache.clear();
+		renderable_cache_index.clear();
+	}
+	std::size_t freed = 0;
+	for (auto iter = Glyph::glyph_cache.begin(); iter != Glyph::glyph_cache.end();)
+		if (iter->second.references)
+			++iter;
+		else {
+			freed += 4*sizeof(Uint8)*iter->second.coordinates.w*iter->second.coordinates.h;
+			iter = Glyph::glyph_cache.erase(iter);
+		}
+	return freed;
 }
 void Arcollect::gui::font::Renderable::render_tl(int x, int y) const
 {
@@ -17,6 +17,7 @@
 #pragma once
 #include "../sdl2-hpp/SDL.hpp"
 #include <limits>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -59,6 +60,18 @@ namespace Arcollect {
 			/** Init the font rendering engine
 			 */
 			void init(void);
+			/** Save the font rendering engine caches
+			 *
+			 * Fonts remain usable after this call.
+			 */
+			void shutdown(void);
+			/** Free font caches under memory pressure
+			 * \param critical Also drop Renderable::cached() entries
+			 * \return An estimation of the freed memory in bytes
+			 *
+			 * Glyphs no longer used by a Renderable are freed.
+			 */
+			std::size_t release_memory(bool critical);
 			class Renderable;
 			#define Arcollect_gui_font_element_wrapper_boilerplate(TypeName) \
 				constexpr operator decltype(value)&(void) {return value;} \
@@ -181,6 +194,16 @@ namespace Arcollect {
 				/** Font size
 				 */
 				FontSize font_size;
+				/** Compare attributes
+				 *
+				 * Needed by Renderable::cached() to match Elements.
+				 */
+				bool operator==(const Attributes& other) const {
+					return (end == other.end) && (alignment == other.alignment)
+					    && (justify.value == other.justify.value) && (weight.value == other.weight.value)
+					    && (color.r == other.color.r) && (color.g == other.color.g) && (color.b == other.color.b) && (color.a == other.color.a)
+					    && (font_size.value == other.font_size.value);
+				}
 			};
 			/** Text rendering instructions buffer
 			 *
@@ -305,6 +328,26 @@ namespace Arcollect {
 					bool empty(void) const {
 						return text.empty();
 					}
+					/** Text length in codepoints
+					 */
+					std::size_t size(void) const {
+						return text.size();
+					}
+					/** Find paragraphs
+					 * \return Offsets of paragraphs in the text
+					 *
+					 * Paragraphs are separated by '\n'. All but the first one start on
+					 * their '\n' so empty lines keep their height when paragraphs are
+					 * rendered separately with slice().
+					 */
+					std::vector<std::size_t> paragraphs(void) const;
+					/** Extract a part of the text
+					 * \param begin offset in the text
+					 * \param end   offset in the text (excluded)
+					 * \return A new #Elements with the text in [begin;end[ and its
+					 *         attributes
+					 */
+					Elements slice(std::size_t begin, std::size_t end) const;
 					
 					/** Get current attributes
 					 * \return A reference to the current attributes of the text (valid
@@ -319,6 +362,13 @@ namespace Arcollect {
 					const Attributes &current_attributes(void) const {
 						return attributes.back();
 					}
+					/** Compare the content
+					 *
+					 * Text and attributes are compared, not the building state.
+					 */
+					bool operator==(const Elements& other) const {
+						return (text == other.text) && (attributes == other.attributes);
+					}
 					/** Parameter pack builder
 					 * \param args Parameter pack
 					 *
@@ -365,8 +415,32 @@ namespace Arcollect {
 				 */
 				bool always_justify;
 				RenderConfig(void);
+				bool operator==(const RenderConfig& other) const {
+					return (base_font_height == other.base_font_height) && (always_justify == other.always_justify);
+				}
 			};
 			
+			/** Text rendering statistics
+			 *
+			 * Counters are reset by the main-loop on each frame and displayed in the
+			 * `redraws` overlay when `fonts` debugging is on.
+			 */
+			struct FrameStats {
+				/** Number of Renderable shaped
+				 */
+				unsigned int renderables = 0;
+				/** Number of text runs shaped (hb_shape() calls)
+				 */
+				unsigned int text_runs = 0;
+				/** Renderable::cached() hits
+				 */
+				unsigned int cache_hits = 0;
+				/** Renderable::cached() misses
+				 */
+				unsigned int cache_misses = 0;
+			};
+			extern FrameStats frame_stats;
+			
 			/** Opaque struct for implementations usage
 			 */
 			struct shape_data;
@@ -380,6 +454,7 @@ namespace Arcollect {
 					struct RenderingState;
 				private:
 					SDL::Point result_size;
+					int result_flow_height = 0;
 					struct GlyphData {
 						SDL::Point position;
 						Glyph     *glyph;
@@ -462,6 +537,14 @@ namespace Arcollect {
 					inline const SDL::Point size() const {
 						return result_size;
 					}
+					/** Height of the text in the flow
+					 *
+					 * This is where a text following this one would start, unlike
+					 * size() that is the bounding box of glyphs.
+					 */
+					inline int flow_height(void) const {
+						return result_flow_height;
+					}
 					/** Renderable empty constructor
 					 *
 					 * \warning The object is invalid and trying to render is undefined.
@@ -483,7 +566,26 @@ namespace Arcollect {
 					 *
 					 */
 					Renderable(const Elements& elements, const RenderConfig& config) : Renderable(elements,std::numeric_limits<int>::max(),config) {}
-					Renderable(const Renderable&) = default;
+					Renderable(const Renderable& other);
+					Renderable(Renderable&& other);
+					Renderable& operator=(const Renderable& other);
+					Renderable& operator=(Renderable&& other);
+					~Renderable(void);
+					/** Maximum number of entries kept by cached()
+					 */
+					static constexpr std::size_t cache_capacity = 128;
+					/** Render text with caching
+					 * \param elements Elements to add
+					 * \param wrap_width The maximum width
+					 * \param config The configuration to use
+					 * \return The shared Renderable
+					 *
+					 * Use this for text that is rebuilt on each frame but rarely change.
+					 * Results are kept in a least recently used cache keyed by the
+					 * elements content, the wrap_width and the config. Text is only
+					 * shaped on cache miss.
+					 */
+					static std::shared_ptr<const Renderable> cached(const Elements& elements, int wrap_width = std::numeric_limits<int>::max(), const RenderConfig& config = RenderConfig());
 					void render_tl(int x, int y) const;
 					inline void render_tl(SDL::Point topleft_corner) const {
 						return render_tl(topleft_corner.x,topleft_corner.y);
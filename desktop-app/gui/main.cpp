@@ -18,8 +18,11 @@
 #include "../config.hpp"
 #include "../i18n.hpp"
 #include "../art-reader/image.hpp"
+#include "../db/account.hpp"
+#include "../db/artwork.hpp"
 #include "../db/artwork-loader.hpp"
 #include "../db/db.hpp"
+#include "../db/write-behind.hpp"
 #include "../sdl2-hpp/SDL.hpp"
 #include <OpenImageIO/imageio.h> // Enable some stuff
 #undef main // This cause name clash
@@ -27,10 +30,13 @@
 #include "font.hpp"
 #include "modal.hpp"
 #include "slideshow.hpp"
+#include "task.hpp"
 #include "time.hpp"
 #include "window-borders.hpp"
+#include <arcollect-db-downloads.hpp>
 #include <arcollect-debug.hpp>
 #include <arcollect-sqls.hpp>
+#include <future>
 #include <iostream>
 #if WITH_XDG
 #include <stdlib.h> // For setenv()
@@ -44,8 +50,70 @@ SDL::Renderer *renderer;
 #include "sqlite-busy-handler.cpp"
 
 static std::unique_ptr<SQLite3::stmt> preload_artworks_stmt;
+static std::shared_ptr<Arcollect::gui::tasks::state> preload_artworks_task;
 static int window_screen_index;
 
+/** Move downloads of older versions to sharded paths
+ *
+ * Downloads in use are skipped, they will be moved on next start.
+ */
+static Arcollect::gui::task migrate_downloads(void)
+{
+	Arcollect::db::downloads::ShardMigration migration(Arcollect::database);
+	migration.can_move = Arcollect::db::download::can_move;
+	migration.moved = Arcollect::db::download::moved;
+	bool pending = true;
+	while (pending) {
+		// This is background work, don't show the busy screen for it
+		sqlite3_busy_handler((sqlite3*)Arcollect::database.get(),NULL,NULL);
+		pending = migration.step();
+		sqlite3_busy_handler((sqlite3*)Arcollect::database.get(),Arcollect::sqlite_busy::handler,NULL);
+		if (!co_await Arcollect::gui::tasks::yield())
+			co_return;
+	}
+	if (migration.moved_count || migration.skipped_count)
+		std::cerr << "Moved " << migration.moved_count << " downloads to sharded paths, " << migration.skipped_count << " skipped." << std::endl;
+}
+/** Hash downloads of older versions for deduplication
+ *
+ * Files are hashed on another thread, the task only wait for it.
+ */
+static Arcollect::gui::task backfill_hashes(void)
+{
+	Arcollect::db::downloads::HashBackfill backfill(Arcollect::database);
+	while (backfill.list()) {
+		std::future<void> hashing = std::async(std::launch::async,&Arcollect::db::downloads::HashBackfill::hash,&backfill);
+		while (hashing.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready)
+			if (!co_await Arcollect::gui::tasks::yield())
+				co_return; // The future destructor wait for the hashing
+		int code;
+		do {
+			// This is background work, don't show the busy screen for it
+			sqlite3_busy_handler((sqlite3*)Arcollect::database.get(),NULL,NULL);
+			code = backfill.write();
+			sqlite3_busy_handler((sqlite3*)Arcollect::database.get(),Arcollect::sqlite_busy::handler,NULL);
+			if (!co_await Arcollect::gui::tasks::yield())
+				co_return;
+		} while (code == SQLITE_BUSY);
+		if (code != SQLITE_OK)
+			break;
+	}
+	if (backfill.written_count)
+		std::cerr << "Hashed " << backfill.written_count << " existing downloads." << std::endl;
+}
+
+/** Queue thumbnails of preload_artworks_stmt rows for load
+ */
+static Arcollect::gui::task preload_artworks(void)
+{
+	preload_artworks_stmt->reset();
+	while (preload_artworks_stmt->step() == SQLITE_ROW) {
+		Arcollect::db::artwork::query(preload_artworks_stmt->column_int64(0))->get_thumbnail()->queue_for_load();
+		if (!co_await Arcollect::gui::tasks::yield())
+			co_return;
+	}
+}
+
 bool Arcollect::gui::enabled = false;
 
 // animation.hpp variables
@@ -90,6 +158,8 @@ int Arcollect::gui::init(void)
 	Arcollect::set_locale_system();
 	// Load ICC profile
 	Arcollect::art_reader::set_screen_icc_profile(window);
+	// Start artwork loader threads
+	Arcollect::db::artwork_loader::start();
 	// Set custom borders
 	Arcollect::gui::window_borders::init(window);
 	// Prepare preload_artworks stmt
@@ -111,6 +181,8 @@ void Arcollect::gui::start(int argc, char** argv)
 		Arcollect::gui::modal_stack.push_back(Arcollect::gui::background_slideshow);
 		
 		SDL_ShowWindow(window);
+		Arcollect::gui::tasks::start(migrate_downloads());
+		Arcollect::gui::tasks::start(backfill_hashes());
 	}
 	Arcollect::gui::update_background("");
 	// Handle CLI
@@ -130,6 +202,14 @@ void Arcollect::gui::start(int argc, char** argv)
 	window_screen_index =  SDL_GetWindowDisplayIndex(window);
 }
 static Arcollect::time_point loop_end_ticks;
+/** Fallback `PRAGMA data_version;` polling interval
+ *
+ * When #Arcollect::changes_notified, the database is still polled at this
+ * low frequency in case a writer could not notify its changes. The idle loop
+ * wakes up for it.
+ */
+static constexpr auto data_version_poll_interval = std::chrono::seconds(5);
+static Arcollect::time_point last_data_version_poll;
 bool Arcollect::gui::main(void)
 {
 	SDL::Event e;
@@ -138,7 +218,14 @@ bool Arcollect::gui::main(void)
 	// Wait for event
 	bool saved_animation_running = Arcollect::gui::animation_running;
 	Arcollect::gui::animation_running = false;
-	bool has_event = saved_animation_running ? SDL::PollEvent(e) : SDL::WaitEvent(e);
+	bool has_event;
+	if (saved_animation_running)
+		has_event = SDL::PollEvent(e);
+	else if (Arcollect::changes_notified) {
+		// Wake up for the fallback data_version poll
+		const auto poll_timeout = std::chrono::ceil<std::chrono::milliseconds>(last_data_version_poll + data_version_poll_interval - Arcollect::frame_clock::now());
+		has_event = SDL::WaitEventTimeout(e,std::max<int>(1,poll_timeout.count()));
+	} else has_event = SDL::WaitEvent(e);
 	// Check for emergency SFW shortcut (Ctrl+Maj+X)
 	if ((SDL_GetModState()&(KMOD_CTRL|KMOD_SHIFT)) && keyboard_state[SDL_GetScancodeFromKey(SDLK_x)])
 		Arcollect::set_filter_rating(Arcollect::config::RATING_NONE);
@@ -146,6 +233,7 @@ bool Arcollect::gui::main(void)
 	Arcollect::time_point new_ticks = Arcollect::frame_clock::now();
 	Arcollect::frame_time = new_ticks;
 	Arcollect::frame_number++;
+	Arcollect::gui::font::frame_stats = Arcollect::gui::font::FrameStats();
 	// Compute render context
 	Arcollect::gui::modal::render_context render_ctx{*renderer};
 	renderer->GetOutputSize(render_ctx.window_size);
@@ -182,15 +270,33 @@ bool Arcollect::gui::main(void)
 		// Process other events
 		has_event = SDL::PollEvent(e);
 	}
-	// Check for DB updates
-	sqlite_int64 data_version_snapshot = Arcollect::data_version;
-	if (data_version_snapshot != Arcollect::update_data_version()) {
-		// Query artworks to preload
-		if (preload_artworks_stmt) {
-			preload_artworks_stmt->reset();
-			while (preload_artworks_stmt->step() == SQLITE_ROW)
-				Arcollect::db::artwork::query(preload_artworks_stmt->column_int64(0))->get_thumbnail()->queue_for_load();
+	// Process write-behind writes
+	if (Arcollect::db::write_behind::flush_due()) {
+		// Writes are retried, don't show the busy screen for them
+		sqlite3_busy_handler((sqlite3*)Arcollect::database.get(),NULL,NULL);
+		Arcollect::db::write_behind::flush();
+		sqlite3_busy_handler((sqlite3*)Arcollect::database.get(),Arcollect::sqlite_busy::handler,NULL);
+	}
+	Arcollect::db::write_behind::poll();
+	// Check for DB updates, still poll sometimes in case notifications are lost
+	const bool data_version_poll_due = (Arcollect::frame_time - last_data_version_poll) >= data_version_poll_interval;
+	if (!Arcollect::changes_notified || Arcollect::changes_pending || data_version_poll_due) {
+		last_data_version_poll = Arcollect::frame_time;
+		sqlite_int64 data_version_snapshot = Arcollect::data_version;
+		if (data_version_snapshot != Arcollect::update_data_version()) {
+			if (Arcollect::changes_notified && Arcollect::changes_pending && (data_version_snapshot != -1)) {
+				// Preload notified artworks only
+				for (sqlite_int64 art_id: Arcollect::changed_artworks)
+					Arcollect::db::artwork::query(art_id)->get_thumbnail()->queue_for_load();
+			} else if (preload_artworks_stmt) {
+				// Query artworks to preload, restart if already running
+				if (preload_artworks_task)
+					preload_artworks_task->cancel();
+				preload_artworks_task = Arcollect::gui::tasks::start(preload_artworks());
+			}
 		}
+		Arcollect::changed_artworks.clear();
+		Arcollect::changes_pending = false;
 	}
 	// Check for screen change
 	int current_window_screen_index = SDL_GetWindowDisplayIndex(window);
@@ -198,6 +304,8 @@ bool Arcollect::gui::main(void)
 		Arcollect::art_reader::set_screen_icc_profile(window);
 		window_screen_index = current_window_screen_index;
 	}
+	// Resume long operations
+	Arcollect::gui::tasks::run();
 	Arcollect::time_point render_start_ticks = Arcollect::frame_clock::now();
 	// Render frame
 	renderer->SetDrawColor(0,0,0,0);
@@ -210,6 +318,11 @@ bool Arcollect::gui::main(void)
 		// Render
 		Arcollect::gui::modal_get(iter).render(render_ctx);
 	}
+	// Keep drawing frames while tasks are pending
+	if (Arcollect::gui::tasks::pending()) {
+		Arcollect::gui::tasks::render(render_ctx);
+		Arcollect::gui::animation_running = true;
+	}
 	Arcollect::gui::window_borders::render(render_ctx);
 	Arcollect::time_point loader_start_ticks = Arcollect::frame_clock::now();
 	decltype(Arcollect::db::artwork_loader::pending_main)::size_type load_pending_count;
@@ -259,6 +372,17 @@ bool Arcollect::gui::main(void)
 			artwork.unload();
 		else break;
 	}
+	// Reclaim objects not used recently, artworks first as they hold downloads
+	Arcollect::db::artwork::reclaim();
+	Arcollect::db::account::reclaim();
+	Arcollect::db::download::reclaim();
+	// Write image analysis results in the database
+	if (Arcollect::db::download::analysis_results_write_due()) {
+		// This is a cache, don't show the busy screen for it
+		sqlite3_busy_handler((sqlite3*)Arcollect::database.get(),NULL,NULL);
+		Arcollect::db::download::write_analysis_results();
+		sqlite3_busy_handler((sqlite3*)Arcollect::database.get(),Arcollect::sqlite_busy::handler,NULL);
+	}
 	// Redraws debugging
 	if (Arcollect::debug.redraws) {
 		Arcollect::time_point final_ticks = Arcollect::frame_clock::now();
@@ -383,6 +507,12 @@ bool Arcollect::gui::main(void)
 		stats_elements << U"Maximums (last 3 seconds):\n"sv;
 		maximums.print(stats_elements);
 		stats_elements << U"Image memory usage: "sv << std::to_string(Arcollect::db::artwork_loader::image_memory_usage >> 20) << U" MiB"sv;
+		if (Arcollect::debug.fonts) {
+			// Snapshot before shaping stats_elements
+			const Arcollect::gui::font::FrameStats font_stats = Arcollect::gui::font::frame_stats;
+			stats_elements << U"\nText shaped: "sv << std::to_string(font_stats.renderables) << U" renderables, "sv << std::to_string(font_stats.text_runs) << U" runs"sv
+			               << U"\nText cache: "sv << std::to_string(font_stats.cache_hits) << U" hits, "sv << std::to_string(font_stats.cache_misses) << U" misses"sv;
+		}
 		
 		// Render debug window text
 		Arcollect::gui::font::Renderable stats_text(stats_elements,800);
@@ -425,7 +555,13 @@ void Arcollect::gui::stop(void)
 		std::lock_guard<std::mutex> lock_guard(Arcollect::db::artwork_loader::lock);
 		Arcollect::db::artwork_loader::pending_thread_first.clear();
 		Arcollect::db::artwork_loader::pending_thread_second.clear();
+		Arcollect::db::artwork_loader::pending_thread_prefetch.clear();
+		Arcollect::db::artwork_loader::pending_thread_readahead.clear();
 	}
+	// Commit pending writes
+	Arcollect::db::write_behind::shutdown();
+	// Save font caches
+	Arcollect::gui::font::shutdown();
 	Arcollect::gui::enabled = false;
 }
 
@@ -52,7 +52,7 @@ namespace Arcollect {
 			private:
 				/** The text to show
 				 */
-				Arcollect::gui::font::Renderable text_line;
+				std::shared_ptr<const Arcollect::gui::font::Renderable> text_line;
 				/** The thumbnail to render
 				 */
 				std::shared_ptr<Arcollect::db::download> thumbnail;
@@ -70,7 +70,7 @@ namespace Arcollect {
 						
 						// Update renderables
 						thumbnail = item_info.thumbnail;
-						text_line = Arcollect::gui::font::Renderable(elements);
+						text_line = Arcollect::gui::font::Renderable::cached(elements);
 					}
 				}
 			public:
@@ -97,7 +97,7 @@ namespace Arcollect {
 				}
 				SDL::Point size(void) override {
 					check_db_version(); // It's better to check this there
-					SDL::Point size = text_line.size();
+					SDL::Point size = text_line->size();
 					auto icon_size = get_icon_size();
 					size.x += icon_size+4;
 					size.y = std::max(size.y,icon_size);
@@ -123,7 +123,7 @@ namespace Arcollect {
 						SDL::Rect rect{render_target.x,render_target.y + (render_target.h-icon_size)/2,icon_size,icon_size};
 						render_ctx.renderer.Copy(icon.get(),NULL,&rect);
 					}
-					text_line.render_cl(render_target.x + icon_size + 4,render_target.y,render_target.h);
+					text_line->render_cl(render_target.x + icon_size + 4,render_target.y,render_target.h);
 				}
 				menu_db_object_item(const objT &object, click_function onclick = click_function_default) : object(object), onclick(onclick) {}
 		};
@@ -233,18 +233,18 @@ void Arcollect::gui::menu::popup_context(const std::vector<std::shared_ptr<menu_
 }
 
 Arcollect::gui::menu_item_label::menu_item_label(const font::Elements& elements) :
-	text_line(elements)
+	text_line(font::Renderable::cached(elements))
 {
 }
 SDL::Point Arcollect::gui::menu_item_label::size(void)
 {
-	return text_line.size();
+	return text_line->size();
 }
 
 void Arcollect::gui::menu_item_label::render(const render_context& render_ctx)
 {
 	const SDL::Rect& target = render_ctx.render_target;
-	text_line.render_tl(target.x+(target.w-text_line.size().x)/2,target.y+(target.h-text_line.size().y)/2);
+	text_line->render_tl(target.x+(target.w-text_line->size().x)/2,target.y+(target.h-text_line->size().y)/2);
 }
 bool Arcollect::gui::menu_item_label::event(SDL::Event &e, const render_context& render_ctx)
 {
@@ -123,7 +123,7 @@ namespace Arcollect {
 			private:
 				bool pressed = false;
 			protected:
-				Arcollect::gui::font::Renderable text_line;
+				std::shared_ptr<const Arcollect::gui::font::Renderable> text_line;
 			public:
 				virtual void clicked(void) = 0;
 				SDL::Point size(void) override;
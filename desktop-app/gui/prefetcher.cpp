@@ -0,0 +1,76 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "prefetcher.hpp"
+#include "../db/artwork-loader.hpp"
+#include <arcollect-paths.hpp>
+#include <algorithm>
+
+Arcollect::time_point Arcollect::gui::prefetcher::paused_until;
+
+void Arcollect::gui::prefetcher::load(const std::shared_ptr<db::download> &download, SDL::Point size)
+{
+	if ((Arcollect::frame_time < paused_until) || !download->prefetch(size))
+		return;
+	// Check the memory budget
+	std::size_t memory = download->image_memory();
+	if (size.x && size.y && download->size.x && download->size.y)
+		memory = std::min(memory,download->image_memory()*size.x/download->size.x*size.y/download->size.y);
+	if (db::artwork_loader::image_memory_usage + memory_estimation + memory > memory_budget)
+		return;
+	memory_estimation += memory;
+	to_queue.push_back(download);
+}
+void Arcollect::gui::prefetcher::readahead(const std::shared_ptr<db::download> &download)
+{
+	if (download->load_state != download->UNLOADED)
+		return;
+	if (readahead_done.size() > 4096)
+		readahead_done.clear();
+	if (readahead_done.emplace(download->dwn_id).second)
+		to_readahead.emplace_back(Arcollect::path::arco_data_home/download->dwn_path);
+}
+void Arcollect::gui::prefetcher::commit(void)
+{
+	const bool notify = !to_queue.empty() || !to_readahead.empty();
+	{
+		std::lock_guard<std::mutex> lock_guard(db::artwork_loader::lock);
+		// Cancel downloads no longer prefetched
+		auto &pending = db::artwork_loader::pending_thread_prefetch;
+		pending.erase(std::remove_if(pending.begin(),pending.end(),[](const std::shared_ptr<db::download> &download) {
+			if (download->keep_loaded())
+				return false;
+			if (download->load_state == download->LOAD_PENDING_STAGE1)
+				download->load_state = download->UNLOADED;
+			return true;
+		}),pending.end());
+		// Queue new downloads, the most likely last as threads pop from the back
+		for (auto iter = to_queue.rbegin(); iter != to_queue.rend(); ++iter) {
+			(*iter)->load_state = (*iter)->LOAD_PENDING_STAGE1;
+			pending.push_back(std::move(*iter));
+		}
+		// Replace readaheads
+		if (!to_readahead.empty()) {
+			std::reverse(to_readahead.begin(),to_readahead.end());
+			db::artwork_loader::pending_thread_readahead = std::move(to_readahead);
+		}
+	}
+	if (notify)
+		db::artwork_loader::condition_variable.notify_all();
+	to_queue.clear();
+	to_readahead.clear();
+	memory_estimation = 0;
+}
@@ -0,0 +1,81 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include "../db/download.hpp"
+#include <memory>
+#include <unordered_set>
+#include <vector>
+namespace Arcollect {
+	namespace gui {
+		/** Navigation-aware artworks prefetcher
+		 *
+		 * Views feed it at each frame with artworks likely to be displayed soon,
+		 * the most likely first. Nearest artworks are loaded at low priority by
+		 * Arcollect::db::artwork_loader within #memory_budget, farther ones only
+		 * have their file read ahead by the kernel.
+		 *
+		 * Artworks no longer fed are cancelled: they are removed from the loader
+		 * queue and unloaded after a few frames.
+		 *
+		 * Usage is to call load() and readahead() then commit() once per frame.
+		 */
+		class prefetcher {
+			private:
+				/** Downloads to queue in Arcollect::db::artwork_loader
+				 */
+				std::vector<std::shared_ptr<db::download>> to_queue;
+				/** Files to readahead
+				 */
+				std::vector<std::filesystem::path> to_readahead;
+				/** Downloads already read ahead
+				 *
+				 * Used to readahead files only once.
+				 */
+				std::unordered_set<sqlite_int64> readahead_done;
+				/** Estimation of the memory the prefetch will use
+				 */
+				std::size_t memory_estimation = 0;
+			public:
+				/** Memory usage limit to prefetch artworks in bytes
+				 *
+				 * Prefetch is suspended when
+				 * Arcollect::db::artwork_loader::image_memory_usage exceed it.
+				 */
+				static constexpr std::size_t memory_budget = std::size_t(512) << 20;
+				/** Prefetch is suspended until this time
+				 *
+				 * Set by Arcollect::gui::reclaim_memory() so the prefetch does not
+				 * fill the memory again right after a low memory warning.
+				 */
+				static Arcollect::time_point paused_until;
+				/** Prefetch an artwork
+				 * \param download to load
+				 * \param size that will be displayed
+				 */
+				void load(const std::shared_ptr<db::download> &download, SDL::Point size);
+				/** Readahead an artwork file
+				 * \param download to readahead
+				 */
+				void readahead(const std::shared_ptr<db::download> &download);
+				/** Commit requests
+				 *
+				 * Queue new artworks and cancel the others.
+				 */
+				void commit(void);
+		};
+	}
+}
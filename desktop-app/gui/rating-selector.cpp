@@ -172,7 +172,7 @@ void Arcollect::gui::rating_selector::event(SDL::Event &e, SDL::Rect target)
 }
 
 Arcollect::gui::rating_selector_menu::rating_selector_menu(std::function<void(Arcollect::config::Rating)> onratingset, const Arcollect::gui::font::Elements& elements) :
-	text_line(elements)
+	text_line(font::Renderable::cached(elements))
 {
 	selector.has_kid = true;
 	selector.has_mature = true;
@@ -182,7 +182,7 @@ Arcollect::gui::rating_selector_menu::rating_selector_menu(std::function<void(Ar
 Arcollect::gui::rating_selector_menu::rating_selector_menu(void) : rating_selector_menu(Arcollect::set_filter_rating,font::Elements::build(i18n_desktop_app.rating_selector_label)) {}
 SDL::Point Arcollect::gui::rating_selector_menu::size(void)
 {
-	SDL::Point size = text_line.size();
+	SDL::Point size = text_line->size();
 	size.x += (1+selector.has_kid+selector.has_mature+selector.has_adult)*size.y;
 	return size;
 }
@@ -197,7 +197,7 @@ void Arcollect::gui::rating_selector_menu::render(const render_context& render_c
 	// Update rating
 	selector.rating = static_cast<Arcollect::config::Rating>(static_cast<int>(Arcollect::config::current_rating));
 	// Render label
-	text_line.render_tl(target.x,target.y+(target.h-text_line.size().y)/2);
+	text_line->render_tl(target.x,target.y+(target.h-text_line->size().y)/2);
 	//Render selector
 	selector.render(target);
 }
@@ -48,7 +48,7 @@ namespace Arcollect {
 		};
 		class rating_selector_menu: public menu_item {
 			private:
-				Arcollect::gui::font::Renderable text_line;
+				std::shared_ptr<const Arcollect::gui::font::Renderable> text_line;
 			public:
 				rating_selector selector;
 				SDL::Point size(void) override;
@@ -0,0 +1,70 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "reclaim-memory.hpp"
+#include "font.hpp"
+#include "prefetcher.hpp"
+#include "../db/account.hpp"
+#include "../db/artwork.hpp"
+#include "../db/db.hpp"
+#include "../db/download.hpp"
+#include <arcollect-debug.hpp>
+#include <iostream>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+Arcollect::gui::ReclaimedMemory Arcollect::gui::last_reclaimed_memory;
+
+Arcollect::gui::ReclaimedMemory Arcollect::gui::reclaim_memory(MemoryPressure pressure)
+{
+	const bool critical = pressure == MemoryPressure::CRITICAL;
+	ReclaimedMemory result;
+	// Don't fill the memory again right now
+	Arcollect::gui::prefetcher::paused_until = Arcollect::frame_clock::now() + low_memory_prefetch_pause;
+	// Unload images
+	result.images = Arcollect::db::download::release_memory(critical);
+	// Drop unused glyphs
+	result.glyphs = Arcollect::gui::font::release_memory(critical);
+	// Destroy unreferenced objects, artworks first as they hold downloads
+	result.objects += Arcollect::db::artwork::reclaim(true);
+	result.objects += Arcollect::db::account::reclaim(true);
+	result.objects += Arcollect::db::download::reclaim(true);
+	if (critical) {
+		// Release SQLite page cache
+		if (Arcollect::database) {
+			sqlite3 *db = (sqlite3*)Arcollect::database.get();
+			int cache_before, cache_after, highwater;
+			sqlite3_db_status(db,SQLITE_DBSTATUS_CACHE_USED,&cache_before,&highwater,0);
+			sqlite3_db_release_memory(db);
+			sqlite3_db_status(db,SQLITE_DBSTATUS_CACHE_USED,&cache_after,&highwater,0);
+			result.sqlite = cache_before > cache_after ? cache_before - cache_after : 0;
+		}
+		// Return free heap pages to the system
+		#if defined(__GLIBC__)
+		result.malloc_trimmed = malloc_trim(0);
+		#endif
+	}
+	if (Arcollect::debug.memory)
+		std::cerr << (critical ? "Critical" : "Low") << " memory warning, freed "
+		          << (result.images >> 10) << "KiB of images, "
+		          << (result.glyphs >> 10) << "KiB of glyphs, "
+		          << (result.sqlite >> 10) << "KiB of SQLite cache and "
+		          << result.objects << " database objects"
+		          << (result.malloc_trimmed ? ", heap trimmed" : "") << std::endl;
+	last_reclaimed_memory = result;
+	return result;
+}
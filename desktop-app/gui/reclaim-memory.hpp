@@ -0,0 +1,84 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file desktop-app/gui/reclaim-memory.hpp
+ *  \brief Memory reclamation on low memory warnings
+ */
+#pragma once
+#include <chrono>
+#include <cstddef>
+namespace Arcollect {
+	namespace gui {
+		/** Memory pressure level
+		 *
+		 * Levels match org.freedesktop.LowMemoryMonitor `LowMemoryWarning` ones.
+		 */
+		enum class MemoryPressure {
+			/** Memory is low (level 50)
+			 *
+			 * Free resources that are not needed right now.
+			 */
+			LOW,
+			/** Memory is critically low (level 100 and above)
+			 *
+			 * Free everything that is not on the screen.
+			 */
+			CRITICAL,
+		};
+		/** Memory freed by reclaim_memory()
+		 */
+		struct ReclaimedMemory {
+			/** Images and untransformed pixels in bytes
+			 */
+			std::size_t images = 0;
+			/** Glyphs textures in bytes (estimation)
+			 */
+			std::size_t glyphs = 0;
+			/** SQLite page cache in bytes
+			 */
+			std::size_t sqlite = 0;
+			/** Number of database objects destroyed
+			 */
+			std::size_t objects = 0;
+			/** Whether malloc_trim() returned memory to the system
+			 */
+			bool malloc_trimmed = false;
+		};
+		/** Prefetch pause after a low memory warning
+		 */
+		static constexpr auto low_memory_prefetch_pause = std::chrono::seconds(30);
+		/** Result of the last reclaim_memory() call
+		 *
+		 * This is for tests.
+		 */
+		extern ReclaimedMemory last_reclaimed_memory;
+		/** Free memory
+		 * \param pressure level
+		 * \return What have been freed
+		 *
+		 * On #MemoryPressure::LOW, prefetched images and untransformed pixels are
+		 * unloaded, unused glyphs and unreferenced database objects are freed.
+		 *
+		 * On #MemoryPressure::CRITICAL, only images visible in the last frames
+		 * are kept, Renderable::cached() entries are dropped, SQLite page cache is
+		 * released and the heap is trimmed.
+		 *
+		 * With `memory` debugging, freed bytes are printed.
+		 * \warning This must be called from the main thread.
+		 */
+		ReclaimedMemory reclaim_memory(MemoryPressure pressure);
+	}
+}
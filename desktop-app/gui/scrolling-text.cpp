@@ -16,15 +16,16 @@
  */
 #include "../config.hpp"
 #include "scrolling-text.hpp"
+#include <algorithm>
 void Arcollect::gui::scrolling_text::scroll_text(int line_delta, const SDL::Rect &rect)
 {
-	if (renderable) {
+	if (!paragraphs.empty()) {
 		int border = rect.w/10;
 		auto target = scroll.val_target;
 		target += line_delta*Arcollect::config::writing_font_size;
-		if (target > renderable->size().y - rect.h + border + border)
-			target = renderable->size().y - rect.h + border + border;
-		else if (target < 0)
+		if (target > height() - rect.h + border + border)
+			target = height() - rect.h + border + border;
+		if (target < 0)
 			target = 0;
 		scroll = target;
 	}
@@ -50,34 +51,170 @@ Arcollect::gui::font::Elements& Arcollect::gui::scrolling_text::get_elements(voi
 		return wtf;
 	}
 }
+std::size_t Arcollect::gui::scrolling_text::paragraph_length(std::size_t index) const
+{
+	return (index+1 < paragraphs.size() ? paragraphs[index+1].begin : text_length) - paragraphs[index].begin;
+}
+int Arcollect::gui::scrolling_text::estimate_height(std::size_t index) const
+{
+	const int line_height = Arcollect::config::writing_font_size*5/4;
+	const long long length = paragraph_length(index);
+	if (measured_length)
+		// Scale with shaped paragraphs
+		return std::max<long long>(line_height,length*measured_height/measured_length);
+	else {
+		// Assume glyphs are half as wide as tall
+		const long long line_length = std::max(1,layout_width*2/Arcollect::config::writing_font_size);
+		return line_height*(1+length/line_length);
+	}
+}
+void Arcollect::gui::scrolling_text::update_positions(std::size_t from)
+{
+	int y = from ? paragraphs[from-1].y + paragraphs[from-1].height : 0;
+	for (auto iter = paragraphs.begin()+from; iter != paragraphs.end(); ++iter) {
+		iter->y = y;
+		y += iter->height;
+	}
+}
+std::size_t Arcollect::gui::scrolling_text::paragraph_at(int y) const
+{
+	auto iter = std::upper_bound(paragraphs.begin(),paragraphs.end(),y,[](int y, const paragraph &paragraph) {
+		return y < paragraph.y;
+	});
+	return iter == paragraphs.begin() ? 0 : std::distance(paragraphs.begin(),iter)-1;
+}
+int Arcollect::gui::scrolling_text::height(void) const
+{
+	return paragraphs.empty() ? 0 : paragraphs.back().y + paragraphs.back().height;
+}
+void Arcollect::gui::scrolling_text::relayout(int wrap_width)
+{
+	// Remember where we are
+	const int current_scroll = scroll.val_target;
+	const std::size_t anchor = paragraph_at(current_scroll);
+	const float anchor_offset = paragraphs[anchor].height ? static_cast<float>(current_scroll-paragraphs[anchor].y)/paragraphs[anchor].height : 0.f;
+	// Forget the old layout, stale renderables stay until shaped again
+	layout_width = wrap_width;
+	measured_length = measured_height = 0;
+	for (std::size_t index = 0; index < paragraphs.size(); index++) {
+		paragraphs[index].measured = false;
+		paragraphs[index].height = estimate_height(index);
+	}
+	update_positions(0);
+	// Restore the anchor
+	scroll.val_target = scroll.val_origin = paragraphs[anchor].y + static_cast<int>(anchor_offset*paragraphs[anchor].height);
+	scroll.skip_transition();
+}
+bool Arcollect::gui::scrolling_text::need_shaping(std::size_t index) const
+{
+	return !paragraphs[index].renderable || (paragraphs[index].shaped_width != layout_width);
+}
+int Arcollect::gui::scrolling_text::shape(std::size_t index)
+{
+	paragraph &target = paragraphs[index];
+	Arcollect::gui::font::RenderConfig render_config;
+	render_config.base_font_height = Arcollect::config::writing_font_size;
+	render_config.always_justify = true;
+	if (!target.renderable)
+		shaped_paragraphs.push_back(index);
+	target.renderable = std::make_unique<Arcollect::gui::font::Renderable>(get_elements().slice(target.begin,target.begin+paragraph_length(index)),layout_width,render_config);
+	target.shaped_width = layout_width;
+	const int old_height = target.height;
+	if (!target.measured) {
+		target.measured = true;
+		target.height = target.renderable->flow_height();
+		measured_length += paragraph_length(index);
+		measured_height += target.height;
+	}
+	return target.height - old_height;
+}
+void Arcollect::gui::scrolling_text::shape_view(int &current_scroll, int view_height)
+{
+	bool shaped_any = false;
+	/* Shape paragraphs in [top;bot[ relative to the view before the deadline
+	 *
+	 * At least one paragraph is shaped per frame to ensure progress.
+	 * Return true if positions changed.
+	 */
+	const auto shape_range = [&](int top, int bot, Arcollect::frame_clock::time_point deadline) {
+		std::size_t first_changed = paragraphs.size();
+		for (std::size_t index = paragraph_at(current_scroll+top); (index < paragraphs.size()) && (paragraphs[index].y < current_scroll+bot); index++)
+			if (need_shaping(index)) {
+				if (shaped_any && (Arcollect::frame_clock::now() > deadline)) {
+					// Continue on the next frame
+					Arcollect::gui::animation_running = true;
+					break;
+				}
+				const int delta = shape(index);
+				shaped_any = true;
+				if (delta) {
+					first_changed = std::min(first_changed,index);
+					// Keep the view still when paragraphs above change
+					if (paragraphs[index].y + paragraphs[index].height - delta <= current_scroll) {
+						current_scroll += delta;
+						scroll.val_target += delta;
+						scroll.val_origin += delta;
+					}
+				}
+			}
+		if (first_changed == paragraphs.size())
+			return false;
+		update_positions(first_changed);
+		return true;
+	};
+	// Shape the view, estimations may have been too large
+	const auto view_deadline = Arcollect::frame_clock::now() + view_shaping_budget;
+	for (int pass = 0; (pass < 4) && shape_range(0,view_height,view_deadline); pass++);
+	// Shape one view above and below within the budget
+	shape_range(-view_height,2*view_height,Arcollect::frame_clock::now() + margin_shaping_budget);
+	// Drop renderables far from the view
+	const int keep_top = current_scroll - 4*view_height;
+	const int keep_bot = current_scroll + 5*view_height;
+	std::erase_if(shaped_paragraphs,[this,keep_top,keep_bot](std::size_t index) {
+		paragraph &target = paragraphs[index];
+		if ((target.y + target.height >= keep_top) && (target.y <= keep_bot))
+			return false;
+		target.renderable.reset();
+		return true;
+	});
+}
 void Arcollect::gui::scrolling_text::render(Arcollect::gui::modal::render_context render_ctx)
 {
 	auto &target = render_ctx.target;
 	if (!elements_available())
 		return;
 	SDL::Rect progress_bar{target.x,target.y};
-	int current_scroll = scroll;
 	int border = target.w/10;
 	target.x += border;
 	target.y += border;
-	// Shape text if not made already
-	if (!renderable || (target.w != renderable_target_width)) {
-		Arcollect::gui::font::RenderConfig render_config;
-		render_config.base_font_height = Arcollect::config::writing_font_size;
-		render_config.always_justify = true;
-		renderable = std::make_unique<Arcollect::gui::font::Renderable>(get_elements(),target.w-border-border,render_config);
-		renderable_target_width = target.w;
+	// Split paragraphs if not made already
+	if (paragraphs.empty()) {
+		const Arcollect::gui::font::Elements &elements = get_elements();
+		text_length = elements.size();
+		for (std::size_t begin: elements.paragraphs())
+			paragraphs.push_back({begin});
+		layout_width = -1;
+		scroll.val_target = scroll.val_origin = 0;
+		scroll.skip_transition();
 	}
+	// Layout text
+	const int wrap_width = target.w-border-border;
+	if (wrap_width != layout_width)
+		relayout(wrap_width);
+	int current_scroll = scroll;
+	shape_view(current_scroll,target.h);
 	// Render text
-	int max_scroll = renderable->size().y - target.h + border + border;
-	renderable->render_tl(target.x,target.y-current_scroll);
+	int max_scroll = height() - target.h + border + border;
+	for (std::size_t index = paragraph_at(current_scroll); (index < paragraphs.size()) && (paragraphs[index].y < current_scroll+target.h); index++)
+		if (paragraphs[index].renderable)
+			paragraphs[index].renderable->render_tl(target.x,target.y+paragraphs[index].y-current_scroll);
 	// Render progress bar
 	progress_bar.w = target.w;
 	progress_bar.h = Arcollect::config::writing_font_size/8;
 	progress_bar.y += target.h-progress_bar.h;
 	render_ctx.renderer.SetDrawColor(0,0,0,192);
 	render_ctx.renderer.FillRect(progress_bar);
-	progress_bar.w = current_scroll*target.w/max_scroll;
+	progress_bar.w = max_scroll > 0 ? current_scroll*target.w/max_scroll : target.w;
 	render_ctx.renderer.SetDrawColor(255,255,255,192);
 	render_ctx.renderer.FillRect(progress_bar);
 }
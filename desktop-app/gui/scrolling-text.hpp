@@ -21,9 +21,17 @@
 #include "font.hpp"
 #include "modal.hpp"
 #include "../db/download.hpp"
+#include <chrono>
 #include <variant>
+#include <vector>
 namespace Arcollect {
 	namespace gui {
+		/** Scrolling text display
+		 *
+		 * Text is split in paragraphs and only these around the viewport are
+		 * shaped. Heights of other paragraphs are estimated from the shaped ones
+		 * so huge texts open and resize quickly.
+		 */
 		class scrolling_text: public modal {
 			private:
 				std::variant<
@@ -44,15 +52,91 @@ namespace Arcollect {
 				 *          before calling this function.
 				 */
 				Arcollect::gui::font::Elements& get_elements(void);
-				std::unique_ptr<gui::font::Renderable> renderable;
-				int renderable_target_width;
+				struct paragraph {
+					/** Offset in the elements
+					 */
+					std::size_t begin;
+					/** Vertical position
+					 */
+					int y = 0;
+					/** Height, estimated until #measured
+					 */
+					int height = 0;
+					bool measured = false;
+					/** Wrap width #renderable was shaped with
+					 *
+					 * After a resize, the stale renderable is still rendered until the
+					 * paragraph is shaped again.
+					 */
+					int shaped_width = -1;
+					std::unique_ptr<gui::font::Renderable> renderable;
+				};
+				std::vector<paragraph> paragraphs;
+				/** Text length in codepoints
+				 */
+				std::size_t text_length;
+				/** Indexes of paragraphs with a renderable
+				 */
+				std::vector<std::size_t> shaped_paragraphs;
+				/** Wrap width of the layout
+				 */
+				int layout_width = -1;
+				/** Shaped paragraphs statistics for estimations
+				 */
+				long long measured_length;
+				long long measured_height;
+				/** Time budget to shape paragraphs in the viewport per frame
+				 *
+				 * A resize reshape every paragraph in the view, this is split over
+				 * frames to keep the UI responsive.
+				 */
+				static constexpr auto view_shaping_budget = std::chrono::milliseconds(8);
+				/** Time budget to shape paragraphs out of the viewport per frame
+				 */
+				static constexpr auto margin_shaping_budget = std::chrono::milliseconds(4);
+				std::size_t paragraph_length(std::size_t index) const;
+				/** Estimate the height of a paragraph not yet shaped
+				 */
+				int estimate_height(std::size_t index) const;
+				/** Update paragraphs positions
+				 * \param from the first paragraph to update
+				 */
+				void update_positions(std::size_t from);
+				/** Find the paragraph at a position
+				 * \return The paragraph index
+				 */
+				std::size_t paragraph_at(int y) const;
+				/** Reset the layout on width change
+				 *
+				 * The paragraph on top of the view stay on top. Renderables are kept
+				 * until shape_view() replace them.
+				 */
+				void relayout(int wrap_width);
+				/** Check if a paragraph need to be shaped at the current width
+				 */
+				bool need_shaping(std::size_t index) const;
+				/** Shape a paragraph
+				 * \return The height change from the estimation
+				 *
+				 * Positions are not updated.
+				 */
+				int shape(std::size_t index);
+				/** Shape paragraphs around the view
+				 * \param[in,out] current_scroll position
+				 * \param view_height height of the view
+				 */
+				void shape_view(int &current_scroll, int view_height);
+				/** Total text height
+				 */
+				int height(void) const;
 				animation::scrolling<int> scroll;
 				void scroll_text(int line_delta, const SDL::Rect &rect);
 			public:
 				template <typename T>
 				void set(const T& new_elements) {
 					data = new_elements;
-					renderable.reset();
+					paragraphs.clear();
+					shaped_paragraphs.clear();
 				}
 				void render(Arcollect::gui::modal::render_context render_ctx) override;
 				bool event(SDL::Event &e, Arcollect::gui::modal::render_context render_ctx) override;
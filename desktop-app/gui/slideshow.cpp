@@ -22,11 +22,30 @@
 #include "menu-db-object.hpp"
 #include "search-osd.hpp"
 #include "slideshow.hpp"
+#include "task.hpp"
 #include "window-borders.hpp"
 #include <arcollect-debug.hpp>
 
-static std::unique_ptr<Arcollect::search::ParsedSearch> current_background_search(new Arcollect::search::ParsedSearch());
+static std::shared_ptr<Arcollect::search::ParsedSearch> current_background_search(std::make_shared<Arcollect::search::ParsedSearch>());
 static sqlite_int64 slideshow_data_version;
+/** Background collection rebuild in progress
+ */
+static std::shared_ptr<Arcollect::gui::tasks::state> background_rebuild;
+
+/** Fill a collection incrementally and display it
+ * \param search that must outlive the collection stmt
+ * \param new_collection to fill
+ */
+static Arcollect::gui::task rebuild_background(std::shared_ptr<Arcollect::search::ParsedSearch> search, std::shared_ptr<Arcollect::db::artwork_collection> new_collection)
+{
+	Arcollect::gui::tasks::state &state = Arcollect::gui::tasks::current();
+	while (!new_collection->fetch(256)) {
+		state.progress = new_collection->end()-new_collection->begin();
+		if (!co_await Arcollect::gui::tasks::yield())
+			co_return;
+	}
+	Arcollect::gui::update_background(new_collection);
+}
 
 static class background_vgrid: public Arcollect::gui::view_vgrid {
 	Arcollect::gui::artwork_viewport *mousedown_viewport;
@@ -128,9 +147,13 @@ static class background_slideshow: public Arcollect::gui::view_slideshow {
 		if (current_background_search && (slideshow_data_version != Arcollect::data_version)) {
 			// Update version
 			slideshow_data_version = Arcollect::data_version;
-			// Regenerate the stmt
-			std::shared_ptr<Arcollect::db::artwork_collection> new_collection = current_background_search->make_shared_collection();
-			Arcollect::gui::update_background(new_collection);
+			// Regenerate the collection, the current one stay displayed meanwhile
+			if (background_rebuild)
+				background_rebuild->cancel();
+			std::shared_ptr<Arcollect::db::artwork_collection> new_collection = current_background_search->make_shared_collection(!collection);
+			if (collection)
+				background_rebuild = Arcollect::gui::tasks::start(rebuild_background(current_background_search,new_collection));
+			else Arcollect::gui::update_background(new_collection); // Nothing to display yet
 		}
 		if (viewport.artwork && viewport.download)
 			switch (viewport.download->artwork_type) {
@@ -163,7 +186,7 @@ void Arcollect::gui::update_background(std::shared_ptr<Arcollect::db::artwork_co
 
 void Arcollect::gui::update_background(const std::string &search)
 {
-	current_background_search = std::make_unique<Arcollect::search::ParsedSearch>(search,Arcollect::db::SEARCH_ARTWORKS,Arcollect::db::SORT_RANDOM);
+	current_background_search = std::make_shared<Arcollect::search::ParsedSearch>(search,Arcollect::db::SEARCH_ARTWORKS,Arcollect::db::SORT_RANDOM);
 	// Force set_collection on next render()
 	slideshow_data_version = -1;
 }
@@ -39,7 +39,6 @@ namespace Arcollect {
 						} break;
 					}
 				// Render text
-				// TODO Cache that
 				const auto text_elements = Elements::build(FontSize(1.2),
 					Align::CENTER,i18n_desktop_app.db_busy_title,U"\n"sv,
 					FontSize(1),
@@ -48,10 +47,10 @@ namespace Arcollect {
 				);
 				SDL::Point window_size;
 				renderer->GetOutputSize(window_size);
-				Renderable renderable(text_elements,window_size.x/2);
+				const std::shared_ptr<const Renderable> renderable = Renderable::cached(text_elements,window_size.x/2);
 				// Center
-				window_size.x -= renderable.size().x*2;
-				window_size.y -= renderable.size().y*2;
+				window_size.x -= renderable->size().x*2;
+				window_size.y -= renderable->size().y*2;
 				window_size.x /= 2;
 				window_size.y /= 2;
 				// Blank background
@@ -60,7 +59,7 @@ namespace Arcollect {
 				// Draw top bar
 				// TODO Arcollect::gui::window_borders::render();
 				// Draw text
-				renderable.render_tl(window_size);
+				renderable->render_tl(window_size);
 				renderer->Present();
 				return true; // Retry
 			} else return false; // Don't retry
@@ -0,0 +1,128 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "task.hpp"
+#include "../time.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <list>
+
+void Arcollect::gui::task::promise_type::unhandled_exception(void)
+{
+	try {
+		std::rethrow_exception(std::current_exception());
+	} catch (const std::exception &e) {
+		std::cerr << "Task failed: " << e.what() << std::endl;
+	} catch (...) {
+		std::cerr << "Task failed with an unknown exception" << std::endl;
+	}
+}
+Arcollect::gui::task& Arcollect::gui::task::operator=(task &&other)
+{
+	if (coroutine)
+		coroutine.destroy();
+	coroutine = other.coroutine;
+	other.coroutine = nullptr;
+	return *this;
+}
+Arcollect::gui::task::~task(void)
+{
+	if (coroutine)
+		coroutine.destroy();
+}
+bool Arcollect::gui::task::resume(void)
+{
+	coroutine.resume();
+	return coroutine.done();
+}
+
+struct pending_task {
+	Arcollect::gui::task coroutine;
+	std::shared_ptr<Arcollect::gui::tasks::state> state;
+};
+static std::list<pending_task> pending_tasks;
+/** Task being resumed in run()
+ */
+static Arcollect::gui::tasks::state *current_state = nullptr;
+/** End of the current task slice
+ */
+static Arcollect::time_point slice_end;
+
+std::shared_ptr<Arcollect::gui::tasks::state> Arcollect::gui::tasks::start(task &&new_task)
+{
+	std::shared_ptr<state> new_state = std::make_shared<state>();
+	pending_tasks.push_back({std::move(new_task),new_state});
+	return new_state;
+}
+bool Arcollect::gui::tasks::run(void)
+{
+	if (pending_tasks.empty())
+		return false;
+	// Tasks started during this run() wait for the next frame
+	const auto slice = frame_budget/pending_tasks.size();
+	auto iter = pending_tasks.begin();
+	for (auto count = pending_tasks.size(); count; count--) {
+		current_state = iter->state.get();
+		slice_end = Arcollect::frame_clock::now() + slice;
+		if (iter->coroutine.resume()) {
+			iter->state->done = true;
+			iter = pending_tasks.erase(iter);
+		} else ++iter;
+	}
+	current_state = nullptr;
+	return !pending_tasks.empty();
+}
+std::size_t Arcollect::gui::tasks::pending(void)
+{
+	return pending_tasks.size();
+}
+Arcollect::gui::tasks::state &Arcollect::gui::tasks::current(void)
+{
+	return *current_state;
+}
+bool Arcollect::gui::tasks::yield_awaiter::await_ready(void) const noexcept
+{
+	return current_state->cancelled || (Arcollect::frame_clock::now() < slice_end);
+}
+bool Arcollect::gui::tasks::yield_awaiter::await_resume(void) const noexcept
+{
+	return !current_state->cancelled;
+}
+void Arcollect::gui::tasks::render(const modal::render_context &render_ctx)
+{
+	static constexpr int bar_height = 3;
+	SDL::Rect bar{render_ctx.target.x,render_ctx.target.y+render_ctx.target.h,render_ctx.target.w,bar_height};
+	render_ctx.renderer.SetDrawBlendMode(SDL::BLENDMODE_BLEND);
+	for (const pending_task &task: pending_tasks) {
+		const state &task_state = *task.state;
+		bar.y -= bar_height;
+		render_ctx.renderer.SetDrawColor(0,0,0,128);
+		render_ctx.renderer.FillRect(bar);
+		SDL::Rect done_bar = bar;
+		if (task_state.total) {
+			done_bar.w = static_cast<int>(static_cast<double>(bar.w)*std::min(task_state.progress,task_state.total)/task_state.total);
+		} else {
+			// Indeterminate, bounce a quarter wide segment
+			done_bar.w = bar.w/4;
+			const int course = 2*(bar.w-done_bar.w);
+			const int position = course ? static_cast<int>(Arcollect::frame_number*8 % course) : 0;
+			done_bar.x += position < course/2 ? position : course-position;
+		}
+		render_ctx.renderer.SetDrawColor(255,255,255,192);
+		render_ctx.renderer.FillRect(done_bar);
+	}
+}
@@ -0,0 +1,160 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file desktop-app/gui/task.hpp
+ *  \brief Cooperative main thread tasks (#Arcollect::gui::task)
+ *
+ * Long operations that must run on the main thread (they touch in-memory
+ * objects or the main database connection) are written as C++20 coroutines
+ * returning #Arcollect::gui::task. Arcollect::gui::main() resume them within
+ * a #Arcollect::gui::tasks::frame_budget each frame, so the window keep
+ * drawing frames with a progress bar instead of freezing.
+ *
+ * A task periodically `co_await Arcollect::gui::tasks::yield()`, it only
+ * suspend when the budget is exhausted and return false when the task has been
+ * cancelled :
+ * \code
+ * static Arcollect::gui::task count_to(int n) {
+ * 	Arcollect::gui::tasks::state &state = Arcollect::gui::tasks::current();
+ * 	state.total = n;
+ * 	for (state.progress = 0; state.progress < state.total; state.progress++)
+ * 		if (!co_await Arcollect::gui::tasks::yield())
+ * 			co_return; // Cancelled
+ * }
+ * \endcode
+ */
+#pragma once
+#include "modal.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+namespace Arcollect {
+	namespace gui {
+		/** Main thread task coroutine
+		 *
+		 * The coroutine does not run until given to Arcollect::gui::tasks::start().
+		 */
+		class task {
+			public:
+				struct promise_type {
+					task get_return_object(void) {
+						return task(std::coroutine_handle<promise_type>::from_promise(*this));
+					}
+					std::suspend_always initial_suspend(void) noexcept {
+						return {};
+					}
+					std::suspend_always final_suspend(void) noexcept {
+						return {};
+					}
+					void return_void(void) {
+					}
+					void unhandled_exception(void);
+				};
+				using handle = std::coroutine_handle<promise_type>;
+				task(task &&other) : coroutine(other.coroutine) {
+					other.coroutine = nullptr;
+				}
+				task& operator=(task &&other);
+				task(const task&) = delete;
+				task& operator=(const task&) = delete;
+				~task(void);
+				/** Resume the coroutine
+				 * \return true when the coroutine has finished
+				 */
+				bool resume(void);
+			private:
+				handle coroutine;
+				task(handle coroutine) : coroutine(coroutine) {}
+		};
+		namespace tasks {
+			/** Time given to tasks in each frame
+			 *
+			 * It is shared between running tasks.
+			 */
+			static constexpr std::chrono::milliseconds frame_budget(8);
+			/** Task progress and control
+			 */
+			struct state {
+				/** Work done so far
+				 */
+				std::size_t progress = 0;
+				/** Total work or 0 if unknown
+				 *
+				 * The progress bar is indeterminate when unknown.
+				 */
+				std::size_t total = 0;
+				/** Cancellation flag
+				 *
+				 * Set by cancel(), yield() return false once set.
+				 */
+				bool cancelled = false;
+				/** Whether the task has returned
+				 */
+				bool done = false;
+				/** Cancel the task
+				 *
+				 * The task stop at its next yield(), this does nothing if done.
+				 */
+				void cancel(void) {
+					cancelled = true;
+				}
+			};
+			/** Start a task
+			 * \param new_task to run
+			 * \return The task state
+			 *
+			 * The task is first resumed in the next run() call.
+			 */
+			std::shared_ptr<state> start(task &&new_task);
+			/** Resume tasks
+			 * \return true if tasks are still pending
+			 *
+			 * Arcollect::gui::main() call this every frame. Tasks are resumed in
+			 * turn, each within its share of the #frame_budget.
+			 */
+			bool run(void);
+			/** Number of pending tasks
+			 */
+			std::size_t pending(void);
+			/** State of the running task
+			 * \warning Only call this from a task.
+			 */
+			state &current(void);
+			/** Awaitable returned by yield()
+			 */
+			struct yield_awaiter {
+				bool await_ready(void) const noexcept;
+				void await_suspend(std::coroutine_handle<>) const noexcept {
+				}
+				bool await_resume(void) const noexcept;
+			};
+			/** Suspend the task if its budget is exhausted
+			 * \return An awaitable that yield false if the task has been cancelled
+			 *
+			 * Call this often enough, a task is never preempted.
+			 */
+			inline yield_awaiter yield(void) {
+				return {};
+			}
+			/** Render tasks progress
+			 *
+			 * Draw a thin progress bar per pending task at the bottom of the window.
+			 */
+			void render(const modal::render_context &render_ctx);
+		}
+	}
+}
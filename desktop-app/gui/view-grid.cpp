@@ -20,6 +20,8 @@
 #include "../db/account.hpp"
 #include "../db/db.hpp"
 #include "../db/sorting.hpp"
+#include <algorithm>
+#include <cmath>
 void Arcollect::gui::view_vgrid::set_collection(std::shared_ptr<artwork_collection> &new_collection)
 {
 	collection = new_collection;
@@ -81,6 +83,7 @@ void Arcollect::gui::view_vgrid::render(Arcollect::gui::modal::render_context re
 		viewports.pop_back();
 		right_y -= artwork_height + artwork_margin.y;
 	}
+	prefetch_rows();
 	// Render
 	SDL::Point displacement{render_ctx.target.x,render_ctx.target.y-scroll_position};
 	for (auto &lines: viewports)
@@ -93,6 +96,45 @@ void Arcollect::gui::view_vgrid::render(Arcollect::gui::modal::render_context re
 	if (hover)
 		render_viewport_hover(render_ctx,*hover,displacement);
 }
+void Arcollect::gui::view_vgrid::prefetch_rows(void)
+{
+	if (!collection)
+		return;
+	// Update scroll velocity
+	const float elapsed = std::chrono::duration<float>(Arcollect::frame_time - last_prefetch_time).count();
+	last_prefetch_time = Arcollect::frame_time;
+	if ((elapsed > 0.f) && (elapsed < 1.f))
+		scroll_velocity = (scroll_velocity + (scroll_position.val_target - last_scroll_target)/elapsed)/2;
+	else scroll_velocity = 0.f;
+	last_scroll_target = scroll_position.val_target;
+	if (scroll_velocity > 0.f)
+		scroll_direction = +1;
+	else if (scroll_velocity < 0.f)
+		scroll_direction = -1;
+	// Compute the number of artworks to prefetch
+	const int row_height = artwork_height + artwork_margin.y;
+	const int rows = std::clamp(1+static_cast<int>(std::abs(scroll_velocity)*prefetch_lookahead/row_height),1,prefetch_max_rows);
+	const std::size_t per_row = viewports.empty() ? 1 : std::max<std::size_t>(viewports.back().size(),1);
+	std::size_t count = rows*per_row;
+	// Prefetch artworks after the generated rows
+	const auto prefetch_artwork = [&](artwork_collection::iterator iter) {
+		const std::shared_ptr<db::download> &download = db::artwork::query(*iter)->get(displayed_file);
+		SDL::Point size{artwork_height,artwork_height};
+		if (download->size.x && download->size.y)
+			size.x = download->size.x*artwork_height/download->size.y;
+		prefetch.load(download,size);
+	};
+	if (scroll_direction > 0) {
+		const auto end_iter = collection->end();
+		for (auto iter = right_iter; count-- && (iter != end_iter); ++iter)
+			prefetch_artwork(iter);
+	} else {
+		const auto begin_iter = collection->begin();
+		for (auto iter = left_iter; count-- && (iter != begin_iter);)
+			prefetch_artwork(--iter);
+	}
+	prefetch.commit();
+}
 void Arcollect::gui::view_vgrid::render_viewport_hover(const Arcollect::gui::modal::render_context &render_ctx, const artwork_viewport& viewport, SDL::Point offset)
 {
 	// Draw backdrop
@@ -222,8 +264,8 @@ bool Arcollect::gui::view_vgrid::new_line_check_fit(int &free_space, int y, std:
 {
 	// Compute width
 	SDL::Point size;
-	std::shared_ptr<db::artwork> artwork = db::artwork::query(*iter);
-	std::shared_ptr<db::download> download = artwork->get(displayed_file);
+	const std::shared_ptr<db::artwork> &artwork = db::artwork::query(*iter);
+	const std::shared_ptr<db::download> &download = artwork->get(displayed_file);
 	if (!download->QuerySize(size)) {
 		// Size is unknow, skip. Will flush_layout() on next redraw.
 		layout_invalid = true;
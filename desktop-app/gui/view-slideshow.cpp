@@ -16,6 +16,7 @@
  */
 #include "view-slideshow.hpp"
 #include "font.hpp"
+#include "../art-reader/image.hpp"
 #include "../db/account.hpp"
 #include <math.h>
 #include "../i18n.hpp"
@@ -130,6 +131,37 @@ void Arcollect::gui::view_slideshow::set_collection_iterator(const artwork_colle
 		resize(rect);
 	} else viewport.artwork = NULL;
 }
+void Arcollect::gui::view_slideshow::prefetch_around(void)
+{
+	const auto begin = collection->begin();
+	const auto end = collection->end();
+	// Walk in the navigation direction
+	auto iter = collection_iterator;
+	for (int i = 0; i < prefetch_ahead+readahead_ahead; i++) {
+		if (navigation_direction > 0) {
+			if (++iter == end)
+				break;
+		} else if (iter == begin)
+			break;
+		else --iter;
+		std::shared_ptr<db::download> download = db::artwork::query(*iter)->get(displayed_file);
+		if (i < prefetch_ahead)
+			prefetch.load(download,Arcollect::art_reader::nothumbnail_size);
+		else prefetch.readahead(download);
+	}
+	// Walk behind
+	iter = collection_iterator;
+	for (int i = 0; i < prefetch_behind; i++) {
+		if (navigation_direction < 0) {
+			if (++iter == end)
+				break;
+		} else if (iter == begin)
+			break;
+		else --iter;
+		prefetch.load(db::artwork::query(*iter)->get(displayed_file),Arcollect::art_reader::nothumbnail_size);
+	}
+	prefetch.commit();
+}
 void Arcollect::gui::view_slideshow::render_info_incard(const Arcollect::gui::modal::render_context &render_ctx)
 {
 	Arcollect::db::artwork &artwork = *db::artwork::query(*collection_iterator);
@@ -152,12 +184,10 @@ void Arcollect::gui::view_slideshow::render_info_incard(const Arcollect::gui::mo
 	render_rect.w -= 2*box_padding;
 	render_rect.h -= 2*box_padding;
 	// Render text
-	// TODO Cache this
 	Arcollect::gui::font::Elements elements;
 	elements << Arcollect::gui::font::ExactFontSize(font_height  ) << artwork.title() << U"\n"s
 	         << Arcollect::gui::font::ExactFontSize(font_height/4) << artwork.desc();
-	Arcollect::gui::font::Renderable desc_renderable(elements,render_rect.w);
-	desc_renderable.render_tl(render_rect.x,render_rect.y);
+	Arcollect::gui::font::Renderable::cached(elements,render_rect.w)->render_tl(render_rect.x,render_rect.y);
 }
 void Arcollect::gui::view_slideshow::render_click_area(const Arcollect::gui::modal::render_context &render_ctx, ClickArea area, ClickState state)
 {
@@ -210,16 +240,7 @@ void Arcollect::gui::view_slideshow::render_click_area(const Arcollect::gui::mod
 void Arcollect::gui::view_slideshow::render(Arcollect::gui::modal::render_context render_ctx)
 {
 	if (viewport.artwork) {
-		// Preload previous artwork
-		if (collection_iterator != collection->begin()) {
-			db::artwork::query(*--collection_iterator)->get(displayed_file)->queue_full_image_for_load();
-			++collection_iterator;
-		}
-		// Preload next artwork
-		++collection_iterator;
-		if (collection_iterator != collection->end())
-			db::artwork::query(*collection_iterator)->get(displayed_file)->queue_full_image_for_load();
-		--collection_iterator;
+		prefetch_around();
 		// Resize is size is unknow
 			if (!size_know)
 				resize(rect);
@@ -283,6 +304,7 @@ void Arcollect::gui::view_slideshow::go_first(void)
 {
 	if (viewport.artwork) {
 		collection_iterator = collection->begin();
+		navigation_direction = +1;
 		viewport.set_artwork(db::artwork::query(*collection_iterator),displayed_file);
 		target_artwork = viewport.artwork;
 		resize(rect);
@@ -292,6 +314,7 @@ void Arcollect::gui::view_slideshow::go_prev(void)
 {
 	if (viewport.artwork) {
 		if (collection_iterator != collection->begin()) {
+			navigation_direction = -1;
 			viewport.set_artwork(db::artwork::query(*--collection_iterator),displayed_file);
 			target_artwork = viewport.artwork;
 			resize(rect);
@@ -303,6 +326,7 @@ void Arcollect::gui::view_slideshow::go_next(void)
 	if (viewport.artwork) {
 		++collection_iterator;
 		if (collection_iterator != collection->end()) {
+			navigation_direction = +1;
 			viewport.set_artwork(db::artwork::query(*collection_iterator),displayed_file);
 			target_artwork = viewport.artwork;
 			resize(rect);
@@ -313,6 +337,7 @@ void Arcollect::gui::view_slideshow::go_last(void)
 {
 	if (viewport.artwork) {
 		collection_iterator = collection->end();
+		navigation_direction = -1;
 		viewport.set_artwork(db::artwork::query(*--collection_iterator),displayed_file);
 		target_artwork = viewport.artwork;
 		resize(rect);
@@ -18,6 +18,7 @@
 #include "animation.hpp"
 #include "artwork-viewport.hpp"
 #include "font.hpp"
+#include "prefetcher.hpp"
 #include "scrolling-text.hpp"
 #include "view.hpp"
 namespace Arcollect {
@@ -64,6 +65,26 @@ namespace Arcollect {
 				
 				bool size_know = false;
 				db::artwork_collection::iterator collection_iterator;
+				
+				// Prefetching stuff
+				prefetcher prefetch;
+				/** Navigation direction
+				 *
+				 * +1 when going to next artworks, -1 when going to previous ones.
+				 */
+				int navigation_direction = +1;
+				/** Number of artworks to load ahead of the navigation direction
+				 */
+				static constexpr int prefetch_ahead = 3;
+				/** Number of artworks to load behind the navigation direction
+				 */
+				static constexpr int prefetch_behind = 1;
+				/** Number of artworks to readahead after #prefetch_ahead
+				 */
+				static constexpr int readahead_ahead = 8;
+				/** Prefetch artworks around the current one
+				 */
+				void prefetch_around(void);
 				std::unique_ptr<font::Renderable> title_text_cache;
 				
 				enum ClickState {
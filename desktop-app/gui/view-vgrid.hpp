@@ -19,6 +19,7 @@
 #include "animation.hpp"
 #include "artwork-viewport.hpp"
 #include "font.hpp"
+#include "prefetcher.hpp"
 #include <list>
 #include <vector>
 namespace Arcollect {
@@ -70,6 +71,36 @@ namespace Arcollect {
 				/** Perform scrolling
 				 */
 				void do_scroll(int delta);
+				
+				// Prefetching stuff
+				prefetcher prefetch;
+				/** Scroll target at the previous frame
+				 */
+				int last_scroll_target = 0;
+				/** Time of the previous frame
+				 */
+				Arcollect::time_point last_prefetch_time;
+				/** Smoothed scroll velocity in pixels per second
+				 */
+				float scroll_velocity = 0.f;
+				/** Scroll direction
+				 *
+				 * +1 when scrolling down, -1 when scrolling up. Keep the last direction
+				 * when not scrolling.
+				 */
+				int scroll_direction = +1;
+				/** Maximum number of rows to prefetch
+				 */
+				static constexpr int prefetch_max_rows = 6;
+				/** Time ahead to prefetch in seconds
+				 *
+				 * The number of rows to prefetch is what will be displayed in this time
+				 * at the current #scroll_velocity.
+				 */
+				static constexpr float prefetch_lookahead = 0.5f;
+				/** Prefetch rows ahead of the scroll direction
+				 */
+				void prefetch_rows(void);
 				/** Top position of the left (top) line
 				 *
 				 * Used to known when to call new_line_left()
@@ -14,6 +14,12 @@ namespace SDL {
 		inline static Texture* CreateFromSurface(Renderer* renderer, Surface *surface) {
 			return (Texture*)SDL_CreateTextureFromSurface((SDL_Renderer*)renderer,(SDL_Surface*)surface);
 		}
+		inline static Texture* Create(Renderer* renderer, Uint32 format, int access, int w, int h) {
+			return (Texture*)SDL_CreateTexture((SDL_Renderer*)renderer,format,access,w,h);
+		}
+		int Update(const SDL::Rect *rect, const void *pixels, int pitch) {
+			return SDL_UpdateTexture((SDL_Texture*)this,(const SDL_Rect*)rect,pixels,pitch);
+		}
 		int QueryTexture(Uint32 *format, int *access = NULL, int *w = NULL, int *h = NULL) {
 			return SDL_QueryTexture((SDL_Texture*)this,format,access,w,h);
 		}
@@ -101,7 +107,6 @@ namespace SDL {
 /*
     SDL_ComposeCustomBlendMode
     SDL_CreateSoftwareRenderer
-    SDL_CreateTexture
     SDL_CreateTextureFromSurface
     SDL_CreateWindowAndRenderer
     SDL_GL_BindTexture
@@ -144,6 +149,5 @@ namespace SDL {
     SDL_SetTextureBlendMode
     SDL_SetTextureColorMod
     SDL_UnlockTexture
-    SDL_UpdateTexture
     SDL_UpdateYUVTexture
 */
@@ -0,0 +1,154 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-bulk-edit.cpp
+ *  \brief Re-rating and deletion of a large selection benchmark
+ *
+ * Generate a large collection, then re-rate and delete it through an
+ * #Arcollect::db::artwork_collection like the GUI does. One artwork outside
+ * the selection share a download to check reference counting.
+ */
+#include <arcollect-db-open.hpp>
+#include <arcollect-paths.hpp>
+#include "../db/artwork-collections.hpp"
+#include "../db/write-behind.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr int artworks_count = 100000;
+static constexpr auto edit_timeout = std::chrono::seconds(120);
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+/** Wait for a write like the GUI main-loop does
+ * \return The write result
+ */
+static int wait_write(std::future<int> &future)
+{
+	const auto deadline = std::chrono::steady_clock::now() + edit_timeout;
+	while (future.wait_for(std::chrono::milliseconds(1)) != std::future_status::ready) {
+		if (std::chrono::steady_clock::now() > deadline)
+			return SQLITE_BUSY;
+		if (Arcollect::db::write_behind::flush_due())
+			Arcollect::db::write_behind::flush();
+	}
+	Arcollect::db::write_behind::poll();
+	return future.get();
+}
+static sqlite_int64 count(const char* sql)
+{
+	std::unique_ptr<SQLite3::stmt> stmt;
+	Arcollect::database->prepare(sql,stmt);
+	return stmt->step() == SQLITE_ROW ? stmt->column_int64(0) : -1;
+}
+static Arcollect::db::artwork_collection_sqlite selection(void)
+{
+	std::unique_ptr<SQLite3::stmt> stmt;
+	Arcollect::database->prepare("SELECT art_artid FROM artworks WHERE art_artid <= ?;",stmt);
+	stmt->bind(1,artworks_count);
+	return Arcollect::db::artwork_collection_sqlite(std::move(stmt));
+}
+/** Run an edit and report the time
+ */
+template <typename Edit>
+static bool timed_edit(const std::string_view &description, Edit edit)
+{
+	const auto start = std::chrono::steady_clock::now();
+	std::future<int> future = edit();
+	const std::chrono::duration<double,std::milli> queue_time = std::chrono::steady_clock::now() - start;
+	const int code = wait_write(future);
+	const std::chrono::duration<double,std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "# " << description << " " << artworks_count << " artworks: " << elapsed.count() << "ms (" << queue_time.count() << "ms on the caller thread)" << std::endl;
+	return code == SQLITE_OK;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..4" << std::endl;
+	Arcollect::database = Arcollect::db::test_open();
+	std::filesystem::create_directories(Arcollect::path::artwork_pool);
+
+	// Generate the collection
+	std::cout << "# Generating " << artworks_count << " artworks" << std::endl;
+	std::unique_ptr<SQLite3::stmt> insert_download_stmt;
+	std::unique_ptr<SQLite3::stmt> insert_artwork_stmt;
+	Arcollect::database->exec("BEGIN IMMEDIATE;");
+	Arcollect::database->prepare("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_lastedit) VALUES (?,?,'image/png',0);",insert_download_stmt);
+	Arcollect::database->prepare("INSERT INTO artworks (art_artid,art_dwnid,art_platform,art_title,art_source,art_rating,art_partof) VALUES (?,?,'test','Artwork',?,0,?);",insert_artwork_stmt);
+	for (int i = 1; i <= artworks_count+1; i++) {
+		// The last artwork share the first download
+		const int dwn_id = i > artworks_count ? 1 : i;
+		const std::string filename = "art-"+std::to_string(i)+".png";
+		if (i <= artworks_count) {
+			std::ofstream(Arcollect::path::artwork_pool/filename);
+			const std::string path = "artworks/"+filename;
+			insert_download_stmt->reset();
+			insert_download_stmt->bind(1,i);
+			insert_download_stmt->bind(2,path);
+			if (insert_download_stmt->step() != SQLITE_DONE) {
+				std::cout << "Bail out! Failed to insert download " << i << ": " << Arcollect::database->errmsg() << std::endl;
+				return 1;
+			}
+		}
+		const std::string source = "https://arcollect.test/"+std::to_string(i);
+		insert_artwork_stmt->reset();
+		insert_artwork_stmt->bind(1,i);
+		insert_artwork_stmt->bind(2,dwn_id);
+		insert_artwork_stmt->bind(3,source);
+		insert_artwork_stmt->bind(4,i);
+		if (insert_artwork_stmt->step() != SQLITE_DONE) {
+			std::cout << "Bail out! Failed to insert artwork " << i << ": " << Arcollect::database->errmsg() << std::endl;
+			return 1;
+		}
+	}
+	Arcollect::database->exec("COMMIT;");
+
+	// Re-rate
+	const bool rated = timed_edit("Rating",[]() {
+		return selection().db_set_rating(Arcollect::config::RATING_ADULT);
+	});
+	tap_result(rated && (count("SELECT COUNT(*) FROM artworks WHERE art_rating = 18;") == artworks_count),"Rate all artworks");
+
+	// Delete
+	const bool deleted = timed_edit("Deleting",[]() {
+		return selection().db_delete();
+	});
+	tap_result(deleted && (count("SELECT COUNT(*) FROM artworks;") == 1),"Delete all artworks");
+	tap_result(count("SELECT COUNT(*) FROM downloads;") == 1,"Keep downloads still referenced");
+
+	// Wait for files removal
+	const auto start = std::chrono::steady_clock::now();
+	Arcollect::db::write_behind::shutdown();
+	const std::chrono::duration<double,std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "# Files removal finished " << elapsed.count() << "ms after the commit" << std::endl;
+	std::size_t files_left = 0;
+	for (const std::filesystem::directory_entry &entry: std::filesystem::directory_iterator(Arcollect::path::artwork_pool))
+		files_left += entry.is_regular_file();
+	tap_result(files_left == 1,"Remove files of deleted downloads");
+	return result_code;
+}
@@ -0,0 +1,160 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-file-source.cpp
+ *  \brief #Arcollect::art_reader::file_source I/O cost on a cold page cache
+ *
+ * Load many small thumbnails-like PNG and a large TIFF through OIIO own I/O
+ * and through an Arcollect::art_reader::file_source. Files are evicted from
+ * the page cache before each pass with `posix_fadvise(POSIX_FADV_DONTNEED)`.
+ *
+ * `read()` syscalls are counted with the `syscr` field of `/proc/self/io`.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../art-reader/image.hpp"
+#include "../art-reader/file-source.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+static constexpr int thumbnails_count = 500;
+static constexpr int thumbnail_size = 256;
+static constexpr int large_size = 4096;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+/** Read syscalls count of this process
+ */
+static unsigned long long read_syscalls(void)
+{
+	std::ifstream io("/proc/self/io");
+	std::string key;
+	unsigned long long value;
+	while (io >> key >> value)
+		if (key == "syscr:")
+			return value;
+	return 0;
+}
+/** Evict files from the page cache
+ */
+static void drop_caches(const std::vector<std::filesystem::path> &files)
+{
+	for (const std::filesystem::path &path: files) {
+		const int fd = open(path.c_str(),O_RDONLY|O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		fdatasync(fd);
+		posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+static bool write_image(const std::filesystem::path &path, int size)
+{
+	std::vector<unsigned char> pixels(static_cast<std::size_t>(size)*size*3);
+	for (std::size_t i = 0; i < pixels.size(); i++)
+		pixels[i] = (i*7) ^ (i/(size*3));
+	OIIO::ImageOutput::unique_ptr output = OIIO::ImageOutput::create(path.native());
+	if (!output || !output->open(path.native(),OIIO::ImageSpec(size,size,3,OIIO::TypeDesc::UINT8)) || !output->write_image(OIIO::TypeDesc::UINT8,pixels.data()))
+		return false;
+	return output->close();
+}
+/** Load files on a cold cache
+ * \param[out] syscalls performed
+ * \return Milliseconds, negative if a file failed to load
+ */
+template <typename Loader>
+static double measure(const std::vector<std::filesystem::path> &files, Loader loader, unsigned long long &syscalls)
+{
+	drop_caches(files);
+	const unsigned long long syscalls_before = read_syscalls();
+	const auto start = std::chrono::steady_clock::now();
+	bool success = true;
+	for (const std::filesystem::path &path: files) {
+		std::unique_ptr<SDL::Surface> surface(loader(path));
+		success &= surface != nullptr;
+	}
+	const std::chrono::duration<double,std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	// Don't count our own /proc/self/io read
+	syscalls = read_syscalls() - syscalls_before - 1;
+	return success ? elapsed.count() : -1;
+}
+static SDL::Surface *load_oiio(const std::filesystem::path &path)
+{
+	OIIO::ImageInput::unique_ptr image = OIIO::ImageInput::open(path.native());
+	return image ? Arcollect::art_reader::load_surface(*image) : NULL;
+}
+static SDL::Surface *load_file_source(const std::filesystem::path &path)
+{
+	Arcollect::art_reader::file_source source(path);
+	OIIO::ImageInput::unique_ptr image = source.open_image(path);
+	return image ? Arcollect::art_reader::load_surface(*image) : NULL;
+}
+static void compare(const std::string_view &name, const std::vector<std::filesystem::path> &files)
+{
+	unsigned long long oiio_syscalls, source_syscalls;
+	const double oiio_time = measure(files,load_oiio,oiio_syscalls);
+	const double source_time = measure(files,load_file_source,source_syscalls);
+	std::cout << "# " << name << ": OIIO " << oiio_time << "ms " << oiio_syscalls << " read(),"
+		<< " file_source " << source_time << "ms " << source_syscalls << " read()" << std::endl;
+	tap_result((oiio_time >= 0) && (source_time >= 0) && (source_syscalls < oiio_syscalls),std::string(name)+" use less read() with file_source");
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..2" << std::endl;
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path test_root = std::filesystem::path(cache_home_env).parent_path()/"bench-files";
+	std::filesystem::remove_all(test_root);
+	std::filesystem::create_directories(test_root);
+
+	// Generate files
+	std::vector<std::filesystem::path> thumbnails;
+	for (int i = 0; i < thumbnails_count; i++) {
+		thumbnails.push_back(test_root/("thumbnail-"+std::to_string(i)+".png"));
+		if (!write_image(thumbnails.back(),thumbnail_size)) {
+			std::cout << "Bail out! Failed to write " << thumbnails.back() << std::endl;
+			return 1;
+		}
+	}
+	const std::vector<std::filesystem::path> large = {test_root/"large.tif"};
+	if (!write_image(large.front(),large_size)) {
+		std::cout << "Bail out! Failed to write " << large.front() << std::endl;
+		return 1;
+	}
+
+	compare(std::to_string(thumbnails_count)+" thumbnails",thumbnails);
+	compare("Large image",large);
+	return result_code;
+}
@@ -0,0 +1,107 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-font-coverage.cpp
+ *  \brief Mixed-script titles shaping benchmark
+ *
+ * Shape a list of titles mixing latin, cyrillic, greek, CJK and emojis twice.
+ * The first pass resolve fallback faces with fontconfig, the second one use
+ * the coverage map. Then check the coverage map is persisted in
+ * `$XDG_CACHE_HOME/arcollect/font-coverage`.
+ *
+ * The GUI runs with the SDL dummy video driver.
+ */
+#include <arcollect-db-open.hpp>
+#include "../db/db.hpp"
+#include "../gui/font.hpp"
+#include "../gui/main.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr int title_count = 2000;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+using duration = std::chrono::duration<double,std::milli>;
+static duration shape(const std::vector<Arcollect::gui::font::Elements> &titles)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (const Arcollect::gui::font::Elements &title: titles)
+		Arcollect::gui::font::Renderable(title,400);
+	return std::chrono::steady_clock::now() - start;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..2" << std::endl;
+	SDL_setenv("SDL_VIDEODRIVER","dummy",1);
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path cache_home = cache_home_env;
+	std::filesystem::remove_all(cache_home);
+	std::filesystem::create_directories(cache_home);
+	Arcollect::database = Arcollect::db::test_open();
+
+	// Start the GUI
+	if (Arcollect::gui::init()) {
+		std::cout << "Bail out! Failed to init the GUI" << std::endl;
+		return 1;
+	}
+
+	// Generate titles
+	static constexpr std::string_view words[] = {"Sunset","over","the","lake","Закат","над","озером","Ηλιοβασίλεμα","夕焼け","の","湖","노을","호수","日落","🌅","🦊","café","Übung"};
+	std::mt19937 rng(42);
+	std::vector<Arcollect::gui::font::Elements> titles;
+	titles.reserve(title_count);
+	for (int i = 0; i < title_count; i++) {
+		std::string title;
+		for (int count = 2+rng()%6; count; count--) {
+			title += words[rng()%std::size(words)];
+			title += ' ';
+		}
+		titles.push_back(Arcollect::gui::font::Elements::build(std::string_view(title)));
+	}
+
+	// Shape them
+	const duration cold_time = shape(titles);
+	const duration warm_time = shape(titles);
+	std::cout << "# Shaped " << title_count << " titles in " << cold_time.count() << "ms with an empty coverage map, " << warm_time.count() << "ms after" << std::endl;
+	tap_result(warm_time < cold_time,"Shaping is faster with a filled coverage map");
+
+	// Check persistence
+	Arcollect::gui::font::shutdown();
+	const std::filesystem::path coverage_path = cache_home/"arcollect"/"font-coverage";
+	std::error_code ec;
+	tap_result(std::filesystem::file_size(coverage_path,ec) > 0,"Coverage map is saved");
+	return result_code;
+}
@@ -0,0 +1,164 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-native-decode.cpp
+ *  \brief Native decoders throughput
+ *
+ * Decode a mixed corpus of JPEG, PNG and WebP with OIIO and with
+ * Arcollect::art_reader::load_native() and report images per second.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../art-reader/image.hpp"
+#include "../art-reader/file-source.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#if WITH_LIBWEBP
+#include <webp/encode.h>
+#endif
+
+static constexpr int image_width = 1920;
+static constexpr int image_height = 1080;
+static constexpr int images_per_format = 10;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+static void tap_skip(const std::string_view &description, const std::string_view &reason)
+{
+	std::cout << "ok " << test_num++ << " - " << description << " # SKIP " << reason << std::endl;
+}
+
+static bool same_pixels(const SDL::Surface &a, const SDL::Surface &b)
+{
+	if ((a.w != b.w) || (a.h != b.h) || (a.format->format != b.format->format))
+		return false;
+	for (int y = 0; y < a.h; y++)
+		if (std::memcmp(static_cast<const char*>(a.pixels)+y*a.pitch,static_cast<const char*>(b.pixels)+y*b.pitch,a.w*a.format->BytesPerPixel))
+			return false;
+	return true;
+}
+static SDL::Surface *load_oiio(const std::filesystem::path &path)
+{
+	OIIO::ImageInput::unique_ptr image = OIIO::ImageInput::open(path.native());
+	return image ? Arcollect::art_reader::load_surface(*image) : NULL;
+}
+static SDL::Surface *load_native(const std::filesystem::path &path)
+{
+	OIIO::ImageSpec spec;
+	return Arcollect::art_reader::load_native(Arcollect::art_reader::file_source(path),spec);
+}
+/** Decode files and report the throughput
+ * \return Images per second, 0 if a file failed to decode
+ */
+template <typename Loader>
+static double images_per_second(const std::vector<std::filesystem::path> &files, Loader loader)
+{
+	const auto start = std::chrono::steady_clock::now();
+	for (const std::filesystem::path &path: files) {
+		std::unique_ptr<SDL::Surface> surface(loader(path));
+		if (!surface)
+			return 0;
+	}
+	const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return files.size()/elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..2" << std::endl;
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path test_root = std::filesystem::path(cache_home_env).parent_path();
+	std::filesystem::create_directories(test_root);
+	OIIO::attribute("threads",1);
+
+	// Generate the corpus, a noisy gradient
+	std::vector<unsigned char> pixels(image_width*image_height*3);
+	unsigned int noise = 1;
+	for (std::size_t i = 0; i < pixels.size(); i++) {
+		noise = noise*1103515245+12345;
+		pixels[i] = ((i/3)%image_width)*192/image_width + ((noise >> 16) & 63);
+	}
+	std::vector<std::filesystem::path> jpeg_files;
+	std::vector<std::filesystem::path> png_files;
+	std::vector<std::filesystem::path> webp_files;
+	for (int i = 0; i < images_per_format; i++) {
+		for (const char* extension: {".jpg",".png"}) {
+			const std::filesystem::path path = test_root/("corpus-"+std::to_string(i)+extension);
+			OIIO::ImageOutput::unique_ptr output = OIIO::ImageOutput::create(path.native());
+			if (!output || !output->open(path.native(),OIIO::ImageSpec(image_width,image_height,3,OIIO::TypeDesc::UINT8)) || !output->write_image(OIIO::TypeDesc::UINT8,pixels.data())) {
+				std::cout << "Bail out! Failed to write " << path << std::endl;
+				return 1;
+			}
+			output->close();
+			(extension == std::string_view(".jpg") ? jpeg_files : png_files).push_back(path);
+		}
+		#if WITH_LIBWEBP
+		const std::filesystem::path path = test_root/("corpus-"+std::to_string(i)+".webp");
+		uint8_t* webp_data;
+		const std::size_t webp_size = WebPEncodeRGB(pixels.data(),image_width,image_height,3*image_width,90,&webp_data);
+		std::ofstream(path,std::ios::binary).write(reinterpret_cast<const char*>(webp_data),webp_size);
+		WebPFree(webp_data);
+		webp_files.push_back(path);
+		#endif
+	}
+
+	// Measure
+	std::vector<std::filesystem::path> mixed_files;
+	double mixed_oiio = 0;
+	double mixed_native = 0;
+	for (const auto &format: {std::make_pair("JPEG",&jpeg_files),std::make_pair("PNG",&png_files),std::make_pair("WebP",&webp_files)}) {
+		if (format.second->empty())
+			continue;
+		const double oiio = images_per_second(*format.second,load_oiio);
+		const double native = images_per_second(*format.second,load_native);
+		std::cout << "# " << format.first << ": OIIO " << oiio << " images/s, native " << native << " images/s" << std::endl;
+		// Only compare formats both can read
+		if (oiio && native)
+			mixed_files.insert(mixed_files.end(),format.second->begin(),format.second->end());
+	}
+	if (!mixed_files.empty()) {
+		mixed_oiio = images_per_second(mixed_files,load_oiio);
+		mixed_native = images_per_second(mixed_files,load_native);
+		std::cout << "# Mixed corpus of " << mixed_files.size() << " images: OIIO " << mixed_oiio << " images/s, native " << mixed_native << " images/s" << std::endl;
+	}
+
+	#if WITH_LIBPNG
+	std::unique_ptr<SDL::Surface> native(load_native(png_files.front()));
+	std::unique_ptr<SDL::Surface> oiio(load_oiio(png_files.front()));
+	tap_result(native && oiio && same_pixels(*native,*oiio),"Native PNG decoder match OIIO pixels");
+	#else
+	tap_skip("Native PNG decoder match OIIO pixels","Built without libpng");
+	#endif
+	if (mixed_files.empty())
+		tap_skip("Native decoders are faster on a mixed corpus","Built without native decoders");
+	else tap_result(mixed_native > mixed_oiio,"Native decoders are faster on a mixed corpus");
+	return result_code;
+}
@@ -0,0 +1,134 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-object-pools.cpp
+ *  \brief Memory and lookup cost of #Arcollect::db::object_pool
+ *
+ * Compare the pool with the `std::unordered_map<id,std::shared_ptr<T>>` it
+ * replaced, using placeholder objects of the size of Arcollect::db::artwork
+ * and Arcollect::db::download. Memory is measured with glibc `mallinfo2()`.
+ */
+#include "../db/artwork.hpp"
+#include "../db/object-pool.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <malloc.h>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr int objects_count = 100000;
+static constexpr int lookups_count = 10000000;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+static std::size_t heap_usage(void)
+{
+	#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+	return mallinfo2().uordblks;
+	#else
+	return 0;
+	#endif
+}
+/** Measure a container
+ * \param fill function that insert objects_count objects
+ * \param lookup function that return the object address
+ * \param[out] memory used
+ * \return Nanoseconds per lookup
+ */
+template <typename Fill, typename Lookup>
+static double measure(Fill fill, Lookup lookup, std::size_t &memory)
+{
+	const std::size_t heap_before = heap_usage();
+	fill();
+	memory = heap_usage() - heap_before;
+	// Random lookups
+	std::mt19937 rng(42);
+	std::vector<sqlite_int64> ids(lookups_count/100);
+	for (sqlite_int64 &id: ids)
+		id = 1+rng()%objects_count;
+	std::uintptr_t checksum = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (int pass = 0; pass < 100; pass++)
+		for (sqlite_int64 id: ids)
+			checksum += reinterpret_cast<std::uintptr_t>(lookup(id));
+	const std::chrono::duration<double,std::nano> elapsed = std::chrono::steady_clock::now() - start;
+	if (!checksum)
+		std::cout << "# Null checksum" << std::endl;
+	return elapsed.count()/lookups_count;
+}
+/** Compare the old map with the pool
+ * \param object_size of the object
+ * \param make_shared_before if the old code used `std::make_shared()` instead
+ *        of `std::shared_ptr(new T)` with a separate control block
+ */
+template <std::size_t object_size, bool make_shared_before>
+static void bench(const std::string_view &name)
+{
+	struct placeholder {
+		sqlite_int64 id;
+		std::byte payload[object_size-sizeof(sqlite_int64)];
+		placeholder(sqlite_int64 id) : id(id) {}
+	};
+	std::size_t map_memory;
+	double map_lookup;
+	{
+		std::unordered_map<sqlite_int64,std::shared_ptr<placeholder>> map;
+		map_lookup = measure([&]() {
+			for (sqlite_int64 id = 1; id <= objects_count; id++)
+				if (make_shared_before)
+					map.emplace(id,std::make_shared<placeholder>(id));
+				else map.emplace(id,std::shared_ptr<placeholder>(new placeholder(id)));
+		},[&](sqlite_int64 id) {
+			return map.find(id)->second.get();
+		},map_memory);
+	}
+	std::size_t pool_memory;
+	double pool_lookup;
+	{
+		Arcollect::db::object_pool<placeholder> pool;
+		pool_lookup = measure([&]() {
+			for (sqlite_int64 id = 1; id <= objects_count; id++)
+				pool.emplace(id,id);
+		},[&](sqlite_int64 id) {
+			return pool.find(id)->get();
+		},pool_memory);
+	}
+	std::cout << "# " << name << " (" << object_size << " bytes) per " << objects_count << " objects:"
+		<< " std::unordered_map " << map_memory/1024 << "KiB " << map_lookup << "ns/lookup,"
+		<< " object_pool " << pool_memory/1024 << "KiB " << pool_lookup << "ns/lookup" << std::endl;
+	tap_result(!heap_usage() || (pool_memory < map_memory),std::string(name)+" pool use less memory");
+	tap_result(pool_lookup < map_lookup,std::string(name)+" pool lookups are faster");
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..4" << std::endl;
+	bench<sizeof(Arcollect::db::artwork),false>("artwork");
+	bench<sizeof(Arcollect::db::download),true>("download");
+	return result_code;
+}
@@ -0,0 +1,142 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-parallel-decode.cpp
+ *  \brief Time-to-display of a single huge image
+ *
+ * Load one huge image with a color managed screen on one thread like when
+ * the loader is busy, then on all cores like when the slideshow wait for
+ * this only image. Both a tiled TIFF and a PNG are measured.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../art-reader/image.hpp"
+#define CMSREGISTER // Remove warnings about 'register' keyword
+#include "lcms2.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static constexpr int image_width = 6144;
+static constexpr int image_height = 6144;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+/** Load an image and report the time
+ * \return The surface
+ */
+static std::unique_ptr<SDL::Surface> timed_load(const std::filesystem::path &path, unsigned int threads, double &milliseconds)
+{
+	std::string thumbnail_id;
+	const auto start = std::chrono::steady_clock::now();
+	std::unique_ptr<SDL::Surface> surface(Arcollect::art_reader::image(path,Arcollect::art_reader::nothumbnail_size,thumbnail_id,Arcollect::art_reader::cancel_function(),threads));
+	const std::chrono::duration<double,std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	milliseconds = elapsed.count();
+	return surface;
+}
+static bool same_pixels(const SDL::Surface &a, const SDL::Surface &b)
+{
+	if ((a.w != b.w) || (a.h != b.h) || (a.format->format != b.format->format))
+		return false;
+	for (int y = 0; y < a.h; y++)
+		if (std::memcmp(static_cast<const char*>(a.pixels)+y*a.pitch,static_cast<const char*>(b.pixels)+y*b.pitch,a.w*a.format->BytesPerPixel))
+			return false;
+	return true;
+}
+static void bench(const std::filesystem::path &path, const std::string_view &name)
+{
+	const unsigned int cores = std::max(1u,std::thread::hardware_concurrency());
+	double single_time;
+	double parallel_time;
+	std::unique_ptr<SDL::Surface> single = timed_load(path,1,single_time);
+	std::unique_ptr<SDL::Surface> parallel = timed_load(path,cores,parallel_time);
+	std::cout << "# " << name << " " << image_width << "×" << image_height << ": "
+		<< single_time << "ms on 1 thread, " << parallel_time << "ms on " << cores << " threads" << std::endl;
+	tap_result(single && parallel && same_pixels(*single,*parallel),std::string(name)+" parallel loads give the same pixels");
+	if (cores > 1)
+		tap_result(parallel_time < single_time,std::string(name)+" parallel loads are faster");
+	else std::cout << "ok " << test_num++ << " - " << name << " parallel loads are faster # SKIP Only one core" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..4" << std::endl;
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path cache_home = cache_home_env;
+	const std::filesystem::path test_root = cache_home.parent_path();
+	std::filesystem::remove_all(cache_home);
+	std::filesystem::create_directories(cache_home);
+	// Configure like the GUI does, with an AdobeRGB screen to force color transforms
+	OIIO::attribute("threads",1);
+	{
+		static const cmsCIExyY D65 = {0.3127,0.3291,1};
+		static const cmsCIExyYTRIPLE AdobeRGBPrimaries = {{0.64,0.33,1},{0.21,0.71,1},{0.15,0.06,1}};
+		cmsToneCurve *gamma = cmsBuildGamma(NULL,2.2);
+		cmsToneCurve *gamma_triplet[3] = {gamma,gamma,gamma};
+		cmsHPROFILE screen_profile = cmsCreateRGBProfile(&D65,&AdobeRGBPrimaries,gamma_triplet);
+		cmsUInt32Number icc_size = 0;
+		cmsSaveProfileToMem(screen_profile,NULL,&icc_size);
+		std::vector<char> icc_profile(icc_size);
+		cmsSaveProfileToMem(screen_profile,icc_profile.data(),&icc_size);
+		Arcollect::art_reader::set_screen_icc_profile(std::string_view(icc_profile.data(),icc_profile.size()));
+		cmsCloseProfile(screen_profile);
+		cmsFreeToneCurve(gamma);
+	}
+
+	// Generate a noisy gradient
+	std::cout << "# Generating a " << image_width << "×" << image_height << " image" << std::endl;
+	std::vector<unsigned char> pixels(static_cast<std::size_t>(image_width)*image_height*3);
+	unsigned int noise = 1;
+	for (std::size_t i = 0; i < pixels.size(); i++) {
+		noise = noise*1103515245+12345;
+		pixels[i] = ((i/3)%image_width)*192/image_width + ((noise >> 16) & 63);
+	}
+	for (const char* extension: {".tif",".png"}) {
+		const std::filesystem::path path = test_root/(std::string("huge")+extension);
+		OIIO::ImageSpec spec(image_width,image_height,3,OIIO::TypeDesc::UINT8);
+		if (extension == std::string_view(".tif")) {
+			spec.tile_width = spec.tile_height = 256;
+			spec.attribute("compression","zip");
+		}
+		OIIO::ImageOutput::unique_ptr output = OIIO::ImageOutput::create(path.native());
+		if (!output || !output->open(path.native(),spec) || !output->write_image(OIIO::TypeDesc::UINT8,pixels.data())) {
+			std::cout << "Bail out! Failed to write " << path << std::endl;
+			return 1;
+		}
+		output->close();
+	}
+	pixels = std::vector<unsigned char>();
+
+	bench(test_root/"huge.tif","Tiled TIFF");
+	bench(test_root/"huge.png","PNG");
+	return result_code;
+}
@@ -0,0 +1,94 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-rtf.cpp
+ *  \brief Large RTF stories parsing benchmark
+ *
+ * Generate a 10MB RTF story like word processors write them and compare
+ * its parsing time with the UTF-8 conversion of the same text as plain-text.
+ */
+#include "../art-reader/text.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr std::size_t story_size = 10*1024*1024;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..2" << std::endl;
+	// Generate the story
+	static constexpr std::string_view words[] = {"the","quick","brown","fox","jumps","over","lazy","dog","and","runs","away","from","caf\\'e9","hunter","in","forest"};
+	std::mt19937 rng(42);
+	std::string rtf = "{\\rtf1\\ansi\\ansicpg1252\\deff0{\\fonttbl{\\f0\\fnil\\fcharset0 Calibri;}}\r\n{\\colortbl ;\\red0\\green0\\blue255;}\r\n{\\*\\generator Riched20 10.0.19041}\\viewkind4\\uc1\r\n\\pard\\sa200\\sl276\\slmult1\\f0\\fs22\\lang9 ";
+	std::string plain;
+	rtf.reserve(story_size+1024);
+	plain.reserve(story_size);
+	while (rtf.size() < story_size) {
+		for (int count = 1+rng()%200; count; count--) {
+			const std::string_view word = words[rng()%std::size(words)];
+			switch (rng()%32) {
+				case 0: {
+					rtf += "\\b ";
+					rtf += word;
+					rtf += "\\b0 ";
+				} break;
+				case 1: {
+					rtf += "\\ldblquote ";
+					rtf += word;
+					rtf += "\\rdblquote ";
+				} break;
+				default: {
+					rtf += word;
+					rtf += ' ';
+				} break;
+			}
+			plain += word;
+			plain += ' ';
+		}
+		rtf += "\\par\r\n";
+		plain += "\n\n";
+	}
+	rtf += '}';
+
+	// Parse it
+	auto start = std::chrono::steady_clock::now();
+	const Arcollect::gui::font::Elements elements = Arcollect::art_reader::text_rtf(rtf.data(),rtf.data()+rtf.size());
+	const std::chrono::duration<double,std::milli> rtf_time = std::chrono::steady_clock::now() - start;
+	tap_result(elements.size() >= plain.size()*9/10,"Parse the whole story");
+
+	// Convert the plain-text
+	start = std::chrono::steady_clock::now();
+	const Arcollect::gui::font::Elements plain_elements = Arcollect::gui::font::Elements::build(std::string_view(plain));
+	const std::chrono::duration<double,std::milli> plain_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# Parsed " << (rtf.size() >> 20) << "MB of RTF in " << rtf_time.count() << "ms ("
+	          << rtf.size()/rtf_time.count()/1000 << "MB/s), plain-text conversion in " << plain_time.count() << "ms" << std::endl;
+	tap_result(rtf_time < plain_time*4,"RTF parsing is less than 4 times slower than plain-text conversion");
+	return result_code;
+}
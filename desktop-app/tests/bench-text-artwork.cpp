@@ -0,0 +1,129 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-text-artwork.cpp
+ *  \brief Large text artworks opening and resizing benchmark
+ *
+ * Generate a 10MB plain-text story and compare the first frame and a resize
+ * of an #Arcollect::gui::scrolling_text with shaping the whole text at once
+ * like it used to be. The GUI runs with the SDL dummy video driver.
+ */
+#include <arcollect-db-open.hpp>
+#include "../art-reader/text.hpp"
+#include "../config.hpp"
+#include "../db/db.hpp"
+#include "../gui/main.hpp"
+#include "../gui/scrolling-text.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+extern SDL::Renderer *renderer;
+
+static constexpr std::size_t text_size = 10*1024*1024;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+using duration = std::chrono::duration<double,std::milli>;
+/** Render one frame of the text
+ * \return The frame time
+ */
+static duration render(Arcollect::gui::scrolling_text &text, int width, int height)
+{
+	Arcollect::gui::modal::render_context render_ctx{*renderer,{0,0,width,height}};
+	const auto start = std::chrono::steady_clock::now();
+	text.render(render_ctx);
+	return std::chrono::steady_clock::now() - start;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..3" << std::endl;
+	SDL_setenv("SDL_VIDEODRIVER","dummy",1);
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path test_root = std::filesystem::path(cache_home_env).parent_path();
+	std::filesystem::create_directories(test_root);
+	Arcollect::database = Arcollect::db::test_open();
+
+	// Generate the story
+	const std::filesystem::path story = test_root/"story.txt";
+	{
+		static constexpr std::string_view words[] = {"the","quick","brown","fox","jumps","over","lazy","dog","and","runs","away","from","hunter","in","forest"};
+		std::mt19937 rng(42);
+		std::string content;
+		content.reserve(text_size+1024);
+		while (content.size() < text_size) {
+			// Paragraphs of 1 to 200 words, with some empty lines
+			for (int count = 1+rng()%200; count; count--) {
+				content += words[rng()%std::size(words)];
+				content += ' ';
+			}
+			content += rng()%4 ? "\n" : "\n\n";
+		}
+		std::ofstream(story,std::ios::binary) << content;
+	}
+
+	// Start the GUI
+	if (Arcollect::gui::init()) {
+		std::cout << "Bail out! Failed to init the GUI" << std::endl;
+		return 1;
+	}
+
+	// Load the story
+	auto start = std::chrono::steady_clock::now();
+	const Arcollect::gui::font::Elements elements = Arcollect::art_reader::text(story,"text/plain; charset=utf-8");
+	const duration load_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# Loaded " << (text_size >> 20) << "MB in " << load_time.count() << "ms" << std::endl;
+	tap_result(elements.size() >= text_size,"Load the whole text");
+
+	// Shape everything like before
+	Arcollect::gui::font::RenderConfig render_config;
+	render_config.base_font_height = Arcollect::config::writing_font_size;
+	render_config.always_justify = true;
+	start = std::chrono::steady_clock::now();
+	{
+		Arcollect::gui::font::Renderable full_text(elements,1024,render_config);
+	}
+	const duration full_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# Full shaping in " << full_time.count() << "ms" << std::endl;
+
+	// Virtualized shaping
+	Arcollect::gui::scrolling_text text;
+	text.set(elements);
+	const duration first_frame = render(text,1280,800);
+	const duration resize_frame = render(text,1000,800);
+	std::cout << "# First frame in " << first_frame.count() << "ms, after resize in " << resize_frame.count() << "ms" << std::endl;
+	tap_result(first_frame*10 < full_time,"First frame is 10 times faster than full shaping");
+	tap_result(resize_frame*10 < full_time,"Resize is 10 times faster than full shaping");
+	return result_code;
+}
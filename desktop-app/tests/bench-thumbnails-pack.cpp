@@ -0,0 +1,127 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-thumbnails-pack.cpp
+ *  \brief Grid fill benchmark of XDG thumbnails versus the thumbnails pack
+ *
+ * Write thumbnails for fake originals, then load them as the grid does with
+ * and without the pack. Cold runs evict files from the page cache with
+ * `posix_fadvise(POSIX_FADV_DONTNEED)`, it is a best-effort.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../art-reader/image.hpp"
+#include "../config.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+static constexpr int thumbnails_count = 100;
+static const SDL::Point grid_cell_size{200,200};
+
+/** Evict a directory files from the page cache
+ */
+static void drop_cache(const std::filesystem::path &root)
+{
+	std::error_code ec;
+	for (const std::filesystem::directory_entry &entry: std::filesystem::recursive_directory_iterator(root,ec)) {
+		if (!entry.is_regular_file())
+			continue;
+		int fd = open(entry.path().c_str(),O_RDONLY|O_CLOEXEC);
+		if (fd < 0)
+			continue;
+		fdatasync(fd);
+		posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+static int test_num = 1;
+static int result_code = 0;
+/** Load all thumbnails like a grid fill and report the time
+ * \param originals to load
+ * \param thumbnail_ids cached for each original
+ * \param description of the run
+ */
+static void grid_fill(std::vector<std::filesystem::path> &originals, std::vector<std::string> &thumbnail_ids, const std::string_view &description)
+{
+	const auto start = std::chrono::steady_clock::now();
+	bool success = true;
+	unsigned int checksum = 0;
+	for (std::size_t i = 0; i < originals.size(); i++) {
+		std::unique_ptr<SDL::Surface> surface(Arcollect::art_reader::image(originals[i],grid_cell_size,thumbnail_ids[i]));
+		if (!surface) {
+			success = false;
+			continue;
+		}
+		// Touch pixels as a texture upload would do
+		for (int y = 0; y < surface->h; y++)
+			for (int x = 0; x < surface->pitch; x += 64)
+				checksum += static_cast<const Uint8*>(surface->pixels)[y*surface->pitch+x];
+	}
+	const std::chrono::duration<double,std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << " # " << elapsed.count() << "ms for " << originals.size() << " thumbnails (checksum " << checksum << ")" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..4" << std::endl;
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path cache_home = cache_home_env;
+	const std::filesystem::path test_root = cache_home.parent_path();
+	std::filesystem::remove_all(cache_home);
+	std::filesystem::create_directories(cache_home);
+
+	// Write thumbnails of fake originals, only stat() is done on them
+	std::cout << "# Writing " << thumbnails_count << " thumbnails in " << cache_home << std::endl;
+	Arcollect::config::thumbnails_pack = 1;
+	std::unique_ptr<SDL::Surface> surface(reinterpret_cast<SDL::Surface*>(SDL_CreateRGBSurfaceWithFormat(0,2048,1536,32,SDL_PIXELFORMAT_ABGR8888)));
+	std::vector<std::filesystem::path> originals;
+	std::vector<std::string> thumbnail_ids(thumbnails_count);
+	for (int i = 0; i < thumbnails_count; i++) {
+		for (int y = 0; y < surface->h; y++)
+			for (int x = 0; x < surface->w; x++)
+				static_cast<Uint32*>(surface->pixels)[y*surface->pitch/4+x] = 0xFF000000u|((Uint32(x)*Uint32(y)*Uint32(i+1))&0xFFFFFFu);
+		originals.emplace_back(test_root/("original-"+std::to_string(i)+".png"));
+		std::ofstream(originals.back()) << "Not an image";
+		Arcollect::art_reader::write_thumbnail(originals.back(),*surface,OIIO::ImageSpec(surface->w,surface->h,4,OIIO::TypeDesc::UINT8),thumbnail_ids[i]);
+	}
+
+	// XDG thumbnails
+	Arcollect::config::thumbnails_pack = 0;
+	drop_cache(cache_home);
+	grid_fill(originals,thumbnail_ids,"Cold grid fill from XDG thumbnails");
+	grid_fill(originals,thumbnail_ids,"Warm grid fill from XDG thumbnails");
+	// Thumbnails pack
+	Arcollect::config::thumbnails_pack = 1;
+	drop_cache(cache_home);
+	grid_fill(originals,thumbnail_ids,"Cold grid fill from the thumbnails pack");
+	grid_fill(originals,thumbnail_ids,"Warm grid fill from the thumbnails pack");
+
+	return result_code;
+}
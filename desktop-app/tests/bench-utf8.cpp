@@ -0,0 +1,97 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file bench-utf8.cpp
+ *  \brief UTF-8 to UTF-32 transcoding throughput benchmark
+ *
+ * Compare Arcollect::gui::font::utf8_to_utf32() throughput with `std::codecvt`
+ * on 10MB of ASCII, 10MB of mixed latin and CJK text and 10MB of CJK and
+ * cyrillic text without ASCII.
+ */
+#include "../gui/font-utf8.hpp"
+#include <chrono>
+#include <iostream>
+#include <locale>
+#include <random>
+#include <string>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr std::size_t text_size = 10*1024*1024;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+using duration = std::chrono::duration<double,std::milli>;
+static void bench(const std::string_view &name, const std::string &text)
+{
+	std::u32string output(text.size(),U'\0');
+	// std::codecvt
+	using codecvt_t = std::codecvt<char32_t,char,std::mbstate_t>;
+	const codecvt_t &codecvt = std::use_facet<codecvt_t>(std::locale());
+	std::mbstate_t state{};
+	const char *from_next;
+	char32_t *to_next;
+	auto start = std::chrono::steady_clock::now();
+	codecvt.in(state,text.data(),text.data()+text.size(),from_next,output.data(),output.data()+output.size(),to_next);
+	const duration codecvt_time = std::chrono::steady_clock::now() - start;
+	const std::size_t codecvt_count = to_next-output.data();
+	// utf8_to_utf32()
+	start = std::chrono::steady_clock::now();
+	const std::size_t count = Arcollect::gui::font::utf8_to_utf32(text,output.data());
+	const duration time = std::chrono::steady_clock::now() - start;
+	std::cout << "# " << name << ": std::codecvt " << text.size()/codecvt_time.count()/1000 << "MB/s, utf8_to_utf32() " << text.size()/time.count()/1000 << "MB/s" << std::endl;
+	tap_result((count == codecvt_count) && (time < codecvt_time),std::string(name)+" conversion is faster than std::codecvt");
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..3" << std::endl;
+	std::mt19937 rng(42);
+	static constexpr std::string_view latin_words[] = {"the","quick","brown","fox","jumps","over","lazy","dog","café","naïve","déjà","vu"};
+	static constexpr std::string_view cjk_words[] = {"狐","犬","森の","走る","猎人","빠른","갈색","여우"};
+
+	std::string text;
+	text.reserve(text_size+64);
+	while (text.size() < text_size) {
+		text += latin_words[rng()%8];
+		text += rng()%16 ? ' ' : '\n';
+	}
+	bench("ASCII",text);
+
+	text.clear();
+	while (text.size() < text_size) {
+		text += rng()%4 ? latin_words[rng()%std::size(latin_words)] : cjk_words[rng()%std::size(cjk_words)];
+		text += rng()%16 ? ' ' : '\n';
+	}
+	bench("Mixed",text);
+
+	text.clear();
+	static constexpr std::string_view cyrillic_words[] = {"лиса","собака","лес"};
+	while (text.size() < text_size) {
+		text += rng()%4 ? cjk_words[rng()%std::size(cjk_words)] : cyrillic_words[rng()%std::size(cyrillic_words)];
+		text += rng()%16 ? "、" : "。";
+	}
+	bench("Multibyte",text);
+	return result_code;
+}
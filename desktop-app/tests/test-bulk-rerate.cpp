@@ -0,0 +1,163 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-bulk-rerate.cpp
+ *  \brief GUI responsiveness during a large re-rating
+ *
+ * Run the GUI main-loop with the SDL dummy video driver on a large collection,
+ * re-rate all artworks like the edit menu does and check that frames keep
+ * being produced while the ratings are applied and the background collection
+ * is rebuilt.
+ */
+#include <arcollect-db-open.hpp>
+#include <arcollect-paths.hpp>
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../db/artwork-collection.hpp"
+#include "../db/db.hpp"
+#include "../db/search.hpp"
+#include "../gui/main.hpp"
+#include "../gui/task.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr int artworks_count = 100000;
+/** Longest acceptable frame
+ *
+ * Generous for slow machines, rebuilding the collection at once take longer.
+ */
+static constexpr auto max_frame_time = std::chrono::milliseconds(100);
+static constexpr auto rerate_timeout = std::chrono::seconds(60);
+
+using duration = std::chrono::duration<double,std::milli>;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+/** Run one main-loop iteration without blocking
+ * \return The frame time
+ */
+static duration run_frame(void)
+{
+	const auto start = std::chrono::steady_clock::now();
+	Arcollect::gui::wakeup_main();
+	Arcollect::gui::main();
+	return std::chrono::steady_clock::now() - start;
+}
+static sqlite_int64 count(const char* sql)
+{
+	std::unique_ptr<SQLite3::stmt> stmt;
+	Arcollect::database->prepare(sql,stmt);
+	return stmt->step() == SQLITE_ROW ? stmt->column_int64(0) : -1;
+}
+/** A task that never ends unless cancelled
+ */
+static Arcollect::gui::task endless(void)
+{
+	while (co_await Arcollect::gui::tasks::yield());
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..4" << std::endl;
+	SDL_setenv("SDL_VIDEODRIVER","dummy",1);
+	Arcollect::database = Arcollect::db::test_open();
+	std::filesystem::create_directories(Arcollect::path::artwork_pool);
+
+	// Generate the collection, all artworks share one small image
+	std::cout << "# Generating " << artworks_count << " artworks" << std::endl;
+	OIIO::ImageSpec spec(64,64,3,OIIO::TypeDesc::UINT8);
+	std::vector<unsigned char> pixels(spec.image_bytes(),128);
+	auto output = OIIO::ImageOutput::create("png");
+	if (!output->open((Arcollect::path::artwork_pool/"art.png").string(),spec) || !output->write_image(OIIO::TypeDesc::UINT8,pixels.data())) {
+		std::cout << "Bail out! Failed to write art.png: " << output->geterror() << std::endl;
+		return 1;
+	}
+	output->close();
+	std::unique_ptr<SQLite3::stmt> insert_artwork_stmt;
+	Arcollect::database->exec("BEGIN IMMEDIATE;");
+	Arcollect::database->exec("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_width,dwn_height,dwn_lastedit) VALUES (1,'artworks/art.png','image/png',64,64,0);");
+	Arcollect::database->prepare("INSERT INTO artworks (art_artid,art_dwnid,art_platform,art_title,art_source,art_rating,art_partof) VALUES (?,1,'test','Artwork',?,0,?);",insert_artwork_stmt);
+	for (int i = 1; i <= artworks_count; i++) {
+		const std::string source = "https://arcollect.test/"+std::to_string(i);
+		insert_artwork_stmt->reset();
+		insert_artwork_stmt->bind(1,i);
+		insert_artwork_stmt->bind(2,source);
+		insert_artwork_stmt->bind(3,i);
+		if (insert_artwork_stmt->step() != SQLITE_DONE) {
+			std::cout << "Bail out! Failed to insert artwork " << i << ": " << Arcollect::database->errmsg() << std::endl;
+			return 1;
+		}
+	}
+	Arcollect::database->exec("COMMIT;");
+
+	// Start the GUI, re-rated artworks stay visible
+	if (Arcollect::gui::init()) {
+		std::cout << "Bail out! Failed to init the GUI" << std::endl;
+		return 1;
+	}
+	Arcollect::set_filter_rating(Arcollect::config::RATING_ADULT);
+	Arcollect::gui::start(1,argv);
+	for (int i = 0; (i < 10) || Arcollect::gui::tasks::pending(); i++)
+		run_frame();
+
+	// Re-rate
+	std::shared_ptr<Arcollect::db::artwork_collection> collection = Arcollect::search::ParsedSearch(std::string_view(""),Arcollect::db::SEARCH_ARTWORKS,Arcollect::db::SORT_NONE).make_shared_collection();
+	const sqlite_int64 data_version_before = Arcollect::data_version;
+	auto start = std::chrono::steady_clock::now();
+	std::future<int> future = collection->db_set_rating(Arcollect::config::RATING_MATURE);
+	const duration call_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# db_set_rating() returned in " << call_time.count() << "ms" << std::endl;
+	tap_result(call_time < max_frame_time,"Re-rating returns without blocking");
+	// Run frames until ratings are applied and the background is rebuilt
+	unsigned int frames = 0;
+	unsigned int task_frames = 0;
+	duration longest_frame(0);
+	bool timeout = false;
+	while ((Arcollect::data_version == data_version_before) || Arcollect::gui::tasks::pending()) {
+		if (std::chrono::steady_clock::now() - start > rerate_timeout) {
+			timeout = true;
+			break;
+		}
+		longest_frame = std::max(longest_frame,run_frame());
+		frames++;
+		task_frames += Arcollect::gui::tasks::pending() != 0;
+	}
+	const duration total_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# " << frames << " frames in " << total_time.count() << "ms, " << task_frames << " with tasks pending, longest frame " << longest_frame.count() << "ms" << std::endl;
+	tap_result(!timeout && (task_frames > 1) && (longest_frame < max_frame_time),"Frames keep being produced during the re-rate");
+	tap_result((future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) && (future.get() == SQLITE_OK) && (count("SELECT COUNT(*) FROM artworks WHERE art_rating = 16;") == artworks_count),"Ratings are committed");
+
+	// Cancellation
+	std::shared_ptr<Arcollect::gui::tasks::state> endless_state = Arcollect::gui::tasks::start(endless());
+	for (int i = 0; i < 3; i++)
+		run_frame();
+	const bool was_running = !endless_state->done;
+	endless_state->cancel();
+	run_frame();
+	tap_result(was_running && endless_state->done && !Arcollect::gui::tasks::pending(),"Cancelled task stops at its next yield");
+	return result_code;
+}
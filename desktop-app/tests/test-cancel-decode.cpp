@@ -0,0 +1,140 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-cancel-decode.cpp
+ *  \brief Image loads cancellation testing
+ *
+ * Decode a slow synthetic image and check that cancellation stops the decode
+ * within one chunk, then check that cancelled loads of a real image don't
+ * write thumbnails. Thumbnails are stored in a temporary `XDG_CACHE_HOME`.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../art-reader/image.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+static constexpr int image_width = 256;
+static constexpr int image_height = 2048;
+static constexpr auto row_delay = std::chrono::microseconds(50);
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+/** Slow synthetic decoder
+ *
+ * Each scanline takes #row_delay to decode.
+ */
+class slow_input: public OIIO::ImageInput {
+	public:
+		std::atomic<int> rows_read = 0;
+		slow_input(void) {
+			m_spec = OIIO::ImageSpec(image_width,image_height,4,OIIO::TypeDesc::UINT8);
+		}
+		const char *format_name(void) const override {
+			return "slow";
+		}
+		bool open(const std::string &name, OIIO::ImageSpec &newspec) override {
+			newspec = m_spec;
+			return true;
+		}
+		bool close(void) override {
+			return true;
+		}
+		bool read_native_scanline(int subimage, int miplevel, int y, int z, void *data) override {
+			std::this_thread::sleep_for(row_delay);
+			std::memset(data,0x80,m_spec.scanline_bytes());
+			rows_read++;
+			return true;
+		}
+};
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..4" << std::endl;
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path cache_home = cache_home_env;
+	const std::filesystem::path test_root = cache_home.parent_path();
+	std::filesystem::remove_all(cache_home);
+	std::filesystem::create_directories(cache_home);
+
+	// Uncancelled decode
+	auto start = std::chrono::steady_clock::now();
+	slow_input full_input;
+	std::unique_ptr<SDL::Surface> surface(Arcollect::art_reader::load_surface(full_input,[]() {
+		return false;
+	}));
+	const std::chrono::duration<double,std::milli> full_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# Full decode in " << full_time.count() << "ms" << std::endl;
+	tap_result(surface && (full_input.rows_read == image_height),"Uncancelled decodes read all rows");
+	surface.reset();
+
+	// Cancel in the middle of the decode
+	const int chunk_rows = Arcollect::art_reader::load_chunk_size/(4*image_width);
+	const int cancel_after_rows = image_height/4+1;
+	slow_input cancelled_input;
+	start = std::chrono::steady_clock::now();
+	surface.reset(Arcollect::art_reader::load_surface(cancelled_input,[&cancelled_input]() {
+		return cancelled_input.rows_read >= cancel_after_rows;
+	}));
+	const std::chrono::duration<double,std::milli> cancelled_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# Cancelled decode after " << cancelled_input.rows_read << " rows in " << cancelled_time.count() << "ms" << std::endl;
+	tap_result(!surface && (cancelled_input.rows_read < cancel_after_rows+chunk_rows),"Cancelled decodes stop within one chunk");
+
+	// Write a real image large enough to get thumbnails
+	const std::filesystem::path original = test_root/"original.png";
+	{
+		std::vector<unsigned char> pixels(1024*1024*4,0x80);
+		OIIO::ImageOutput::unique_ptr output = OIIO::ImageOutput::create(original.native());
+		if (!output || !output->open(original.native(),OIIO::ImageSpec(1024,1024,4,OIIO::TypeDesc::UINT8)) || !output->write_image(OIIO::TypeDesc::UINT8,pixels.data())) {
+			std::cout << "Bail out! Failed to write " << original << std::endl;
+			return 1;
+		}
+		output->close();
+	}
+
+	// Cancelled loads don't write thumbnails
+	std::string thumbnail_id;
+	surface.reset(Arcollect::art_reader::image(original,Arcollect::art_reader::nothumbnail_size,thumbnail_id,[]() {
+		return true;
+	}));
+	tap_result(!surface && Arcollect::art_reader::find_thumbnail(original,128).empty(),"Cancelled loads don't write thumbnails");
+
+	// Loads that are not cancelled do
+	surface.reset(Arcollect::art_reader::image(original,Arcollect::art_reader::nothumbnail_size,thumbnail_id,[]() {
+		return false;
+	}));
+	tap_result(surface && !Arcollect::art_reader::find_thumbnail(original,128).empty(),"Uncancelled loads write thumbnails");
+
+	return result_code;
+}
@@ -13,6 +13,7 @@
 { \
 	foreach_param_step(start_window_mode,instructions); \
 	foreach_param_step(current_rating,instructions); \
+	foreach_param_step(thumbnails_pack,instructions); \
 }
 #define foreach_param(instructions) \
 { \
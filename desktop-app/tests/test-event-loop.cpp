@@ -0,0 +1,141 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-event-loop.cpp
+ *  \brief epoll D-Bus main-loop testing
+ *
+ * Attach a connection to a private session bus (Meson run this test in
+ * `dbus-run-session`) to the event-loop and emit signals on another one. Check
+ * they are dispatched and that nothing wake the loop up while idle, in daemon
+ * and in GUI mode.
+ */
+#include "../xdg/event-loop.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr int idle_ms = 1000;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+static unsigned int signals_received = 0;
+static DBusHandlerResult count_signal(DBusConnection *conn, DBusMessage *message, void*)
+{
+	if (dbus_message_is_signal(message,"me.d_spirits.arcollect.Test","Ping")) {
+		signals_received++;
+		return DBUS_HANDLER_RESULT_HANDLED;
+	}
+	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void emit_ping(DBusConnection *emitter)
+{
+	DBusMessage *signal = dbus_message_new_signal("/","me.d_spirits.arcollect.Test","Ping");
+	dbus_connection_send(emitter,signal,NULL);
+	dbus_connection_flush(emitter);
+	dbus_message_unref(signal);
+}
+
+/** Run the event-loop like main-xdg.cpp does
+ */
+static void run_and_dispatch(DBus::Connection &conn, int timeout_ms)
+{
+	Arcollect::dbus::event_loop::run(timeout_ms);
+	while (conn.dispatch() == DBUS_DISPATCH_DATA_REMAINS);
+}
+
+using duration = std::chrono::duration<double,std::milli>;
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13" << std::endl;
+	if (!std::getenv("DBUS_SESSION_BUS_ADDRESS")) {
+		std::cout << "1..0 # SKIP No D-Bus session bus" << std::endl;
+		return 0;
+	}
+	std::cout << "1..5" << std::endl;
+	if (SDL::Init(SDL::INIT_EVENTS)) {
+		std::cout << "Bail out! SDL initialization failed: " << SDL::GetError() << std::endl;
+		return 1;
+	}
+	if (Arcollect::dbus::event_loop::init()) {
+		std::cout << "Bail out! Failed to init the event-loop" << std::endl;
+		return 1;
+	}
+	dbus_threads_init_default();
+	DBus::Connection conn(DBus::BUS_SESSION);
+	Arcollect::dbus::event_loop::attach(conn);
+	conn.add_match("type='signal',interface='me.d_spirits.arcollect.Test'",NULL);
+	conn.add_filter(count_signal);
+	DBusConnection *emitter = dbus_bus_get_private(DBUS_BUS_SESSION,NULL);
+	// Flush pending replies of add_match()
+	for (int i = 0; i < 10; i++)
+		run_and_dispatch(conn,10);
+
+	// Daemon mode
+	emit_ping(emitter);
+	for (int i = 0; (i < 20) && !signals_received; i++)
+		run_and_dispatch(conn,100);
+	tap_result(signals_received == 1,"Signal is dispatched");
+	run_and_dispatch(conn,0); // Consume dispatch wake-ups
+	auto start = std::chrono::steady_clock::now();
+	int idle_result = Arcollect::dbus::event_loop::run(idle_ms);
+	const duration idle_time = std::chrono::steady_clock::now() - start;
+	std::cout << "# Daemon mode woke up after " << idle_time.count() << "ms" << std::endl;
+	tap_result((idle_result == 0) && (idle_time.count() >= idle_ms*0.9),"Idle daemon sleeps until the timeout");
+
+	// GUI mode
+	Arcollect::dbus::event_loop::start_gui_wakeups();
+	SDL::Event e;
+	unsigned int idle_wakeups = 0;
+	start = std::chrono::steady_clock::now();
+	while (std::chrono::steady_clock::now()-start < std::chrono::milliseconds(idle_ms))
+		if (SDL_WaitEventTimeout(&e,idle_ms/10)) {
+			idle_wakeups++;
+			run_and_dispatch(conn,0);
+		}
+	std::cout << "# GUI mode woke up " << idle_wakeups << " times in " << idle_ms << "ms" << std::endl;
+	tap_result(idle_wakeups == 0,"Idle GUI is not woken up");
+	emit_ping(emitter);
+	bool woken_up = false;
+	for (int i = 0; (i < 10) && (signals_received < 2); i++)
+		if (SDL_WaitEventTimeout(&e,100)) {
+			woken_up |= e.type == SDL_USEREVENT;
+			run_and_dispatch(conn,0);
+		}
+	tap_result(woken_up && (signals_received == 2),"Signal wakes the GUI up");
+	Arcollect::dbus::event_loop::stop_gui_wakeups();
+
+	// Daemon mode again
+	emit_ping(emitter);
+	for (int i = 0; (i < 20) && (signals_received < 3); i++)
+		run_and_dispatch(conn,100);
+	tap_result(signals_received == 3,"Signal is dispatched after GUI wake-ups stop");
+
+	dbus_connection_close(emitter);
+	dbus_connection_unref(emitter);
+	return result_code;
+}
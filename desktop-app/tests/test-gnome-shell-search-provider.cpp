@@ -0,0 +1,214 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-gnome-shell-search-provider.cpp
+ *  \brief GNOME Shell search provider D-Bus testing
+ *
+ * Serve the search provider on a private session bus (Meson run this test in
+ * `dbus-run-session`) and query it like GNOME Shell does.
+ */
+#include <arcollect-db-open.hpp>
+#include <arcollect-paths.hpp>
+#include <config.h>
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../art-reader/image.hpp"
+#include "../db/db.hpp"
+#include "../xdg/dbus.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr int artworks_count = 300;
+static constexpr const char* search_provider_intf = "org.gnome.Shell.SearchProvider2";
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+static void append_strings(DBus::append_iterator &iter, const std::vector<std::string> &strings)
+{
+	DBus::append_iterator array;
+	iter.open_container('a',"s",array);
+	for (const std::string &string: strings)
+		array << string.c_str();
+	iter.close_container(array);
+}
+/** Call a search provider method
+ * \param client connection
+ * \param method name
+ * \param args to append as arrays of strings
+ * \return The reply or NULL on error
+ */
+static DBusMessage *call(DBusConnection *client, const char* method, const std::vector<std::vector<std::string>> &args)
+{
+	DBusMessage *message = dbus_message_new_method_call(ARCOLLECT_DBUS_NAME_STR,ARCOLLECT_DBUS_PATH_STR,search_provider_intf,method);
+	DBus::append_iterator append_iter(message);
+	for (const std::vector<std::string> &arg: args)
+		append_strings(append_iter,arg);
+	DBusError error;
+	dbus_error_init(&error);
+	DBusMessage *reply = dbus_connection_send_with_reply_and_block(client,message,5000,&error);
+	dbus_message_unref(message);
+	if (dbus_error_is_set(&error)) {
+		std::cout << "# " << method << " failed: " << error.message << std::endl;
+		dbus_error_free(&error);
+		return NULL;
+	}
+	return reply;
+}
+/** Call a result set method
+ */
+static std::vector<std::string> get_result_set(DBusConnection *client, const char* method, const std::vector<std::vector<std::string>> &args)
+{
+	std::vector<std::string> results;
+	DBusMessage *reply = call(client,method,args);
+	if (reply) {
+		for (auto iter: DBus::Message::iterator(reply))
+			results.emplace_back(iter.get_basic<const char*>());
+		dbus_message_unref(reply);
+	}
+	return results;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13" << std::endl;
+	if (!std::getenv("DBUS_SESSION_BUS_ADDRESS")) {
+		std::cout << "1..0 # SKIP No D-Bus session bus" << std::endl;
+		return 0;
+	}
+	std::cout << "1..7" << std::endl;
+	dbus_threads_init_default();
+	Arcollect::database = Arcollect::db::test_open();
+	std::filesystem::create_directories(Arcollect::path::artwork_pool);
+
+	// Generate the collection, with a thumbnail for the first artwork
+	std::unique_ptr<SQLite3::stmt> insert_download_stmt;
+	std::unique_ptr<SQLite3::stmt> insert_artwork_stmt;
+	Arcollect::database->prepare("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_lastedit) VALUES (?,?,'image/png',0);",insert_download_stmt);
+	Arcollect::database->prepare("INSERT INTO artworks (art_artid,art_dwnid,art_platform,art_title,art_source,art_rating,art_partof,art_savedate) VALUES (?,?,'test',?,?,0,?,?);",insert_artwork_stmt);
+	for (int i = 1; i <= artworks_count; i++) {
+		const std::string path = "artworks/art-"+std::to_string(i)+".png";
+		const std::string title = "Artwork "+std::to_string(i);
+		const std::string source = "https://arcollect.test/"+std::to_string(i);
+		insert_download_stmt->reset();
+		insert_download_stmt->bind(1,i);
+		insert_download_stmt->bind(2,path);
+		insert_artwork_stmt->reset();
+		insert_artwork_stmt->bind(1,i);
+		insert_artwork_stmt->bind(2,i);
+		insert_artwork_stmt->bind(3,title);
+		insert_artwork_stmt->bind(4,source);
+		insert_artwork_stmt->bind(5,i);
+		insert_artwork_stmt->bind(6,i);
+		if ((insert_download_stmt->step() != SQLITE_DONE) || (insert_artwork_stmt->step() != SQLITE_DONE)) {
+			std::cout << "Bail out! Failed to insert artwork " << i << ": " << Arcollect::database->errmsg() << std::endl;
+			return 1;
+		}
+	}
+	const std::filesystem::path thumbnailed = Arcollect::path::arco_data_home/"artworks"/"art-1.png";
+	std::ofstream(thumbnailed) << "Not an image";
+	std::string thumbnail_id;
+	std::unique_ptr<SDL::Surface> surface(reinterpret_cast<SDL::Surface*>(SDL_CreateRGBSurfaceWithFormat(0,512,512,32,SDL_PIXELFORMAT_ABGR8888)));
+	Arcollect::art_reader::write_thumbnail(thumbnailed,*surface,OIIO::ImageSpec(512,512,4,OIIO::TypeDesc::UINT8),thumbnail_id);
+
+	// Serve the search provider
+	DBusError error;
+	dbus_error_init(&error);
+	DBus::Connection server(DBus::BUS_SESSION,&error);
+	if (dbus_error_is_set(&error)) {
+		std::cout << "Bail out! Failed to connect to the session bus: " << error.message << std::endl;
+		return 1;
+	}
+	server.bus_request_name(ARCOLLECT_DBUS_NAME_STR,DBUS_NAME_FLAG_DO_NOT_QUEUE);
+	dbus_connection_register_fallback(server,"/",&Arcollect::dbus::root_handler_vtable,NULL);
+	std::atomic<bool> serving = true;
+	std::thread server_thread([&]() {
+		while (serving)
+			server.read_write_dispatch(50);
+	});
+	DBusConnection *client = dbus_bus_get_private(DBUS_BUS_SESSION,NULL);
+
+	// Initial search is capped and ranked by savedate
+	const std::vector<std::string> initial = get_result_set(client,"GetInitialResultSet",{{"artwork"}});
+	std::cout << "# GetInitialResultSet returned " << initial.size() << " results" << std::endl;
+	tap_result(!initial.empty() && (initial.size() < static_cast<std::size_t>(artworks_count)),"Initial result set is capped");
+	tap_result(!initial.empty() && (initial.front() == std::to_string(artworks_count)),"Most recent artworks come first");
+
+	// Repeated search comes from the cache and must be identical
+	tap_result(get_result_set(client,"GetInitialResultSet",{{"artwork"}}) == initial,"Repeated search is stable");
+
+	// Subsearch only return previous results
+	const std::vector<std::string> subsearch = get_result_set(client,"GetSubsearchResultSet",{initial,{"artwork","29"}});
+	std::cout << "# GetSubsearchResultSet returned " << subsearch.size() << " results" << std::endl;
+	tap_result(!subsearch.empty() && std::all_of(subsearch.begin(),subsearch.end(),[&](const std::string &id) {
+		return std::find(initial.begin(),initial.end(),id) != initial.end();
+	}),"Subsearch results are within previous results");
+	
+	// Cached results of the same terms are not reused with other previous results
+	const std::vector<std::string> fewer_previous(initial.begin(),initial.begin()+std::min<std::size_t>(initial.size(),10));
+	const std::vector<std::string> restricted = get_result_set(client,"GetSubsearchResultSet",{fewer_previous,{"artwork"}});
+	tap_result(!restricted.empty() && std::all_of(restricted.begin(),restricted.end(),[&](const std::string &id) {
+		return std::find(fewer_previous.begin(),fewer_previous.end(),id) != fewer_previous.end();
+	}),"Cached subsearch results depend on previous results");
+
+	// Result metas
+	std::vector<std::string> metas_names;
+	std::string thumbnail_gicon;
+	DBusMessage *reply = call(client,"GetResultMetas",{{"1",subsearch.empty() ? "2" : subsearch.front()}});
+	if (reply) {
+		for (auto meta: DBus::Message::iterator(reply)) {
+			std::string id, name, gicon;
+			for (auto entry: meta) {
+				DBus::Message::iterator entry_iter = entry.recurse();
+				const std::string key = entry_iter.get_basic<const char*>();
+				const std::string value = (++entry_iter).recurse().get_basic<const char*>();
+				if (key == "id")
+					id = value;
+				else if (key == "name")
+					name = value;
+				else if (key == "gicon")
+					gicon = value;
+			}
+			metas_names.push_back(name);
+			if (id == "1")
+				thumbnail_gicon = gicon;
+		}
+		dbus_message_unref(reply);
+	}
+	tap_result((metas_names.size() == 2) && (metas_names[0] == "Artwork 1"),"Metas are returned in requested order");
+	std::cout << "# Artwork 1 gicon is " << thumbnail_gicon << std::endl;
+	tap_result(thumbnail_gicon.ends_with(thumbnail_id+".png"),"gicon point to the XDG thumbnail");
+
+	// Cleanup
+	dbus_connection_close(client);
+	dbus_connection_unref(client);
+	serving = false;
+	server_thread.join();
+	return result_code;
+}
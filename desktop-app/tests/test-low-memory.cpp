@@ -0,0 +1,143 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-low-memory.cpp
+ *  \brief Low memory warnings testing
+ *
+ * Emit `LowMemoryWarning` signals on a private session bus (Meson run this test
+ * in `dbus-run-session`) like the desktop portal does and check resources are
+ * reclaimed. The GUI runs with the SDL dummy video driver.
+ */
+#include <arcollect-db-open.hpp>
+#include "../db/artwork.hpp"
+#include "../db/db.hpp"
+#include "../gui/font-internal.hpp"
+#include "../gui/main.hpp"
+#include "../gui/reclaim-memory.hpp"
+#include "../time.hpp"
+#include "../xdg/dbus.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+static unsigned int exit_if_idle_calls = 0;
+void Arcollect::dbus::exit_if_idle(void)
+{
+	exit_if_idle_calls++;
+}
+
+/** Emit a LowMemoryWarning and dispatch it
+ * \return true if Arcollect::gui::reclaim_memory() has been called
+ */
+static bool emit_warning(DBus::Connection &app, DBusConnection *emitter, const char* path, const char* interface, std::uint8_t level)
+{
+	Arcollect::gui::last_reclaimed_memory.objects = static_cast<std::size_t>(-1);
+	DBusMessage *signal = dbus_message_new_signal(path,interface,"LowMemoryWarning");
+	dbus_message_append_args(signal,DBUS_TYPE_BYTE,&level,DBUS_TYPE_INVALID);
+	dbus_connection_send(emitter,signal,NULL);
+	dbus_connection_flush(emitter);
+	dbus_message_unref(signal);
+	// Wait for the signal
+	for (int i = 0; i < 20; i++) {
+		app.read_write_dispatch(50);
+		if (Arcollect::gui::last_reclaimed_memory.objects != static_cast<std::size_t>(-1))
+			return true;
+	}
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13" << std::endl;
+	if (!std::getenv("DBUS_SESSION_BUS_ADDRESS")) {
+		std::cout << "1..0 # SKIP No D-Bus session bus" << std::endl;
+		return 0;
+	}
+	std::cout << "1..6" << std::endl;
+	SDL_setenv("SDL_VIDEODRIVER","dummy",1);
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	std::filesystem::create_directories(std::filesystem::path(cache_home_env).parent_path());
+	dbus_threads_init_default();
+	Arcollect::database = Arcollect::db::test_open();
+	if (Arcollect::gui::init()) {
+		std::cout << "Bail out! Failed to init the GUI" << std::endl;
+		return 1;
+	}
+
+	// Listen like main-xdg.cpp does
+	DBusError error;
+	dbus_error_init(&error);
+	DBus::Connection app(DBus::BUS_SESSION,&error);
+	if (dbus_error_is_set(&error)) {
+		std::cout << "Bail out! Failed to connect to the session bus: " << error.message << std::endl;
+		return 1;
+	}
+	app.add_match("type='signal',interface='org.freedesktop.portal.MemoryMonitor',sender='org.freedesktop.portal.Desktop',member='LowMemoryWarning'",NULL);
+	app.add_match("type='signal',interface='org.freedesktop.LowMemoryMonitor',member='LowMemoryWarning'",NULL);
+	app.add_filter(Arcollect::dbus::handle_LowMemoryWarning);
+	// Pretend to be the desktop portal
+	DBusConnection *portal = dbus_bus_get_private(DBUS_BUS_SESSION,NULL);
+	dbus_bus_request_name(portal,"org.freedesktop.portal.Desktop",DBUS_NAME_FLAG_DO_NOT_QUEUE,NULL);
+
+	// Fill caches
+	Arcollect::gui::font::Renderable kept(Arcollect::gui::font::Elements::build("Kept text"sv));
+	Arcollect::gui::font::Renderable::cached(Arcollect::gui::font::Elements::build("Cached text"sv));
+	Arcollect::gui::font::Renderable(Arcollect::gui::font::Elements::build("Unused glyphs XYZ"sv));
+	for (Arcollect::db::artwork_id art_id = 1; art_id <= 50; art_id++)
+		Arcollect::db::artwork::query(art_id);
+	Arcollect::frame_number++;
+	const std::size_t glyphs_count = Arcollect::gui::font::Glyph::glyph_cache.size();
+
+	// Ignored levels
+	tap_result(!emit_warning(app,portal,"/org/freedesktop/portal/desktop","org.freedesktop.portal.MemoryMonitor",10),"Level 10 is ignored");
+
+	// Low memory
+	const bool low_handled = emit_warning(app,portal,"/org/freedesktop/portal/desktop","org.freedesktop.portal.MemoryMonitor",50);
+	const Arcollect::gui::ReclaimedMemory low_result = Arcollect::gui::last_reclaimed_memory;
+	const std::size_t low_glyphs_count = Arcollect::gui::font::Glyph::glyph_cache.size();
+	std::cout << "# Glyphs count " << glyphs_count << " -> " << low_glyphs_count << ", " << low_result.objects << " objects destroyed" << std::endl;
+	tap_result(low_handled && low_result.glyphs && (low_glyphs_count < glyphs_count),"Low level frees unused glyphs");
+	tap_result(low_handled && (low_result.objects >= 50),"Low level destroys unreferenced objects");
+	tap_result(exit_if_idle_calls == 0,"Low level does not exit");
+
+	// Critical memory from org.freedesktop.LowMemoryMonitor
+	const bool critical_handled = emit_warning(app,portal,"/org/freedesktop/LowMemoryMonitor","org.freedesktop.LowMemoryMonitor",100);
+	const std::size_t critical_glyphs_count = Arcollect::gui::font::Glyph::glyph_cache.size();
+	std::cout << "# Glyphs count " << low_glyphs_count << " -> " << critical_glyphs_count << std::endl;
+	tap_result(critical_handled && (critical_glyphs_count < low_glyphs_count) && critical_glyphs_count,"Critical level frees cached text but keep used glyphs");
+	tap_result(exit_if_idle_calls == 1,"Critical level exit when the GUI is hidden");
+
+	dbus_connection_close(portal);
+	dbus_connection_unref(portal);
+	return result_code;
+}
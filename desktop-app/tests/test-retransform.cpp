@@ -0,0 +1,121 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-retransform.cpp
+ *  \brief Screen ICC profile changes testing
+ *
+ * Load an image keeping its untransformed pixels, change the screen profile
+ * and check that Arcollect::art_reader::retransform() gives the same pixels
+ * as decoding the file again.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../art-reader/image.hpp"
+#define CMSREGISTER // Remove warnings about 'register' keyword
+#include "lcms2.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static constexpr int image_size = 256;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+static bool same_pixels(const SDL::Surface &a, const SDL::Surface &b)
+{
+	if ((a.w != b.w) || (a.h != b.h) || (a.format->BytesPerPixel != b.format->BytesPerPixel))
+		return false;
+	for (int y = 0; y < a.h; y++)
+		if (std::memcmp(static_cast<const char*>(a.pixels)+y*a.pitch,static_cast<const char*>(b.pixels)+y*b.pitch,a.w*a.format->BytesPerPixel))
+			return false;
+	return true;
+}
+static void set_screen_profile(cmsHPROFILE profile)
+{
+	cmsUInt32Number icc_size = 0;
+	cmsSaveProfileToMem(profile,NULL,&icc_size);
+	std::vector<char> icc_profile(icc_size);
+	cmsSaveProfileToMem(profile,icc_profile.data(),&icc_size);
+	Arcollect::art_reader::set_screen_icc_profile(std::string_view(icc_profile.data(),icc_profile.size()));
+	cmsCloseProfile(profile);
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..4" << std::endl;
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path cache_home = cache_home_env;
+	std::filesystem::remove_all(cache_home);
+	std::filesystem::create_directories(cache_home);
+
+	// Write a saturated gradient, color transforms change it
+	const std::filesystem::path original = cache_home.parent_path()/"original.png";
+	{
+		std::vector<unsigned char> pixels;
+		for (int y = 0; y < image_size; y++)
+			for (int x = 0; x < image_size; x++) {
+				pixels.push_back(x);
+				pixels.push_back(y);
+				pixels.push_back(255-x);
+			}
+		OIIO::ImageOutput::unique_ptr output = OIIO::ImageOutput::create(original.native());
+		if (!output || !output->open(original.native(),OIIO::ImageSpec(image_size,image_size,3,OIIO::TypeDesc::UINT8)) || !output->write_image(OIIO::TypeDesc::UINT8,pixels.data())) {
+			std::cout << "Bail out! Failed to write " << original << std::endl;
+			return 1;
+		}
+		output->close();
+	}
+
+	// Load on an AdobeRGB screen
+	static const cmsCIExyY D65 = {0.3127,0.3291,1};
+	static const cmsCIExyYTRIPLE AdobeRGBPrimaries = {{0.64,0.33,1},{0.21,0.71,1},{0.15,0.06,1}};
+	cmsToneCurve *gamma = cmsBuildGamma(NULL,2.2);
+	cmsToneCurve *gamma_triplet[3] = {gamma,gamma,gamma};
+	set_screen_profile(cmsCreateRGBProfile(&D65,&AdobeRGBPrimaries,gamma_triplet));
+	cmsFreeToneCurve(gamma);
+	const unsigned int generation = Arcollect::art_reader::screen_icc_profile_generation();
+	std::string thumbnail_id;
+	Arcollect::art_reader::source_image source;
+	std::unique_ptr<SDL::Surface> adobe_rgb(Arcollect::art_reader::image(original,Arcollect::art_reader::nothumbnail_size,thumbnail_id,Arcollect::art_reader::cancel_function(),1,&source));
+	tap_result(adobe_rgb && source.surface && !same_pixels(*adobe_rgb,*source.surface),"Untransformed pixels are kept");
+
+	// Move to a linear sRGB screen
+	static const cmsCIExyYTRIPLE sRGBPrimaries = {{0.64,0.33,1},{0.30,0.60,1},{0.15,0.06,1}};
+	gamma = cmsBuildGamma(NULL,1.0);
+	gamma_triplet[0] = gamma_triplet[1] = gamma_triplet[2] = gamma;
+	set_screen_profile(cmsCreateRGBProfile(&D65,&sRGBPrimaries,gamma_triplet));
+	cmsFreeToneCurve(gamma);
+	tap_result(Arcollect::art_reader::screen_icc_profile_generation() != generation,"Profile changes bump the generation");
+	std::unique_ptr<SDL::Surface> retransformed(Arcollect::art_reader::retransform(source));
+	std::unique_ptr<SDL::Surface> decoded(Arcollect::art_reader::image(original,Arcollect::art_reader::nothumbnail_size,thumbnail_id));
+	tap_result(retransformed && decoded && same_pixels(*retransformed,*decoded),"retransform() match a new decode");
+	tap_result(adobe_rgb && retransformed && !same_pixels(*adobe_rgb,*retransformed),"retransform() use the new profile");
+	return result_code;
+}
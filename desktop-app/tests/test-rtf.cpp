@@ -0,0 +1,96 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-rtf.cpp
+ *  \brief RTF reader regression testing
+ *
+ * Parse a corpus of small RTF documents and compare the result with the
+ * expected #Arcollect::gui::font::Elements.
+ */
+#include "../art-reader/text.hpp"
+#include <iostream>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+using Arcollect::gui::font::Elements;
+using Arcollect::gui::font::Weight;
+struct test_case {
+	std::string_view description;
+	std::string_view rtf;
+	Elements expected;
+};
+static const Elements plain_elements;
+static const test_case corpus[] = {
+	{"Plain text",
+		"{\\rtf1\\ansi Hello world}",
+		Elements::build(U"Hello world"sv)},
+	{"Bold",
+		"{\\rtf1\\ansi Hello \\b bold\\b0  end}",
+		Elements::build(U"Hello "sv,Weight(200),U"bold"sv,Weight(80),U" end"sv)},
+	{"Plain",
+		"{\\rtf1\\ansi \\b x\\plain y}",
+		Elements::build(Weight(200),U"x"sv,plain_elements.current_attributes(),U"y"sv)},
+	{"Groups don't restore formatting",
+		"{\\rtf1\\ansi The quick brown fox jumps over the lazy dog{\\b and bold text that is long enough}\\par}",
+		Elements::build(U"The quick brown fox jumps over the lazy dog"sv,Weight(200),U"and bold text that is long enough\n\n"sv)},
+	{"Line breaks and escapes",
+		"{\\rtf1\\ansi A\\par B\\line C\\{\\}\\\\}",
+		Elements::build(U"A\n\nB\nC{}\\"sv)},
+	{"Quotes and bullets",
+		"{\\rtf1\\ansi \\ldblquote Hi\\rdblquote \\lquote x\\rquote \\bullet}",
+		Elements::build(U"“Hi”‘x’•"sv)},
+	{"Skipped groups",
+		"{\\rtf1\\ansi{\\fonttbl{\\f0 Arial;}}{\\colortbl;\\red0\\green0\\blue0;}{\\*\\generator Foo;}{\\info{\\title Bar}}Text}",
+		Elements::build(U"Text"sv)},
+	{"Source line breaks are ignored",
+		"{\\rtf1\\ansi one\r\ntwo\nthree}",
+		Elements::build(U"onetwothree"sv)},
+	{"Codepage escapes",
+		"{\\rtf1\\ansi\\ansicpg1252 caf\\'e9 \\'80}",
+		Elements::build(U"café €"sv)},
+	{"Codepage bytes",
+		"{\\rtf1\\ansi\\ansicpg1252 na\xEFve and a long enough text to \xE9\xE9\xE9 fill}",
+		Elements::build(U"naïve and a long enough text to ééé fill"sv)},
+	{"Unknown commands",
+		"{\\rtf1\\ansi\\deff0\\fs24\\pard\\sa200 Text\\fs-2 more}",
+		Elements::build(U"Textmore"sv)},
+	{"Missing \\rtf",
+		"{\\b x}",
+		Elements::build(SDL::Color(255,0,0,255),"RTF documents must begin with an \\rtf1 command"sv)},
+	{"Unsupported version",
+		"{\\rtf2 x}",
+		Elements::build(SDL::Color(255,0,0,255),"RTF version 2 not supported (Arcollect only support 1.x versions)"sv)},
+	{"Unsupported charset",
+		"{\\rtf1\\mac x}",
+		Elements::build(SDL::Color(255,0,0,255),"Only \\ansi encoding is supported, document use \\mac"sv)},
+	{"Mismatched '}'",
+		"{\\rtf1 a}}",
+		Elements::build(U"Mismatched '}' in RTF file"sv)},
+};
+
+int main(int argc, char *argv[])
+{
+	int test_num = 1;
+	int result_code = 0;
+	std::cout << "TAP version 13\n1.." << std::size(corpus) << std::endl;
+	for (const test_case &test: corpus) {
+		const Elements result = Arcollect::art_reader::text_rtf(test.rtf.data(),test.rtf.data()+test.rtf.size());
+		if (!(result == test.expected)) {
+			std::cout << "not ";
+			result_code = 1;
+		}
+		std::cout << "ok " << test_num++ << " - " << test.description << std::endl;
+	}
+	return result_code;
+}
@@ -0,0 +1,163 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-slideshow-prefetch.cpp
+ *  \brief Slideshow next artwork latency measurement
+ *
+ * Run the GUI main-loop with the SDL dummy video driver on a generated
+ * collection and measure the time to get the next artwork loaded after
+ * go_next() and go_prev() calls, while leaving some time to the prefetcher.
+ */
+#include <arcollect-db-open.hpp>
+#include <arcollect-paths.hpp>
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../db/db.hpp"
+#include "../gui/main.hpp"
+#include "../gui/slideshow.hpp"
+#include "../gui/view-slideshow.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr int artworks_count = 16;
+/** Time spent looking at each artwork
+ */
+static constexpr auto dwell_time = std::chrono::milliseconds(500);
+/** Maximum time to wait an artwork
+ */
+static constexpr auto load_timeout = std::chrono::seconds(10);
+
+using latency = std::chrono::duration<double,std::milli>;
+/** Number of artworks already loaded when navigating
+ */
+static long ready_count = 0;
+
+/** Run one main-loop iteration without blocking
+ */
+static void run_frame(void)
+{
+	Arcollect::gui::wakeup_main();
+	Arcollect::gui::main();
+}
+static bool current_artwork_loaded(void)
+{
+	std::shared_ptr<Arcollect::db::artwork> &artwork = Arcollect::gui::background_slideshow.target_artwork;
+	return artwork && (artwork->get_artwork()->load_state == Arcollect::db::download::LOADED);
+}
+/** Navigate and measure the time to get the artwork loaded
+ * \param navigate function
+ * \param[out] latencies to append the measure into
+ * \return false on timeout
+ */
+static bool measure(void (Arcollect::gui::view_slideshow::*navigate)(void), std::vector<latency> &latencies)
+{
+	// Look at the current artwork
+	const auto dwell_end = std::chrono::steady_clock::now() + dwell_time;
+	while (std::chrono::steady_clock::now() < dwell_end)
+		run_frame();
+	// Navigate
+	const auto start = std::chrono::steady_clock::now();
+	(Arcollect::gui::background_slideshow.*navigate)();
+	if (current_artwork_loaded())
+		ready_count++;
+	while (!current_artwork_loaded()) {
+		if (std::chrono::steady_clock::now() - start > load_timeout)
+			return false;
+		run_frame();
+	}
+	latencies.emplace_back(std::chrono::steady_clock::now() - start);
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..3" << std::endl;
+	SDL_setenv("SDL_VIDEODRIVER","dummy",1);
+	Arcollect::database = Arcollect::db::test_open();
+	std::filesystem::create_directories(Arcollect::path::artwork_pool);
+
+	// Generate the collection
+	std::cout << "# Generating " << artworks_count << " artworks" << std::endl;
+	std::unique_ptr<SQLite3::stmt> insert_download_stmt;
+	std::unique_ptr<SQLite3::stmt> insert_artwork_stmt;
+	Arcollect::database->prepare("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_lastedit) VALUES (?,?,'image/png',0);",insert_download_stmt);
+	Arcollect::database->prepare("INSERT INTO artworks (art_artid,art_dwnid,art_platform,art_title,art_source,art_rating,art_partof) VALUES (?,?,'test',?,?,0,?);",insert_artwork_stmt);
+	OIIO::ImageSpec spec(1600,1200,3,OIIO::TypeDesc::UINT8);
+	std::vector<unsigned char> pixels(spec.image_bytes());
+	for (int i = 1; i <= artworks_count; i++) {
+		for (std::size_t p = 0; p < pixels.size(); p++)
+			pixels[p] = static_cast<unsigned char>(p*i/7);
+		const std::string filename = "art-"+std::to_string(i)+".png";
+		auto output = OIIO::ImageOutput::create("png");
+		if (!output->open((Arcollect::path::artwork_pool/filename).string(),spec) || !output->write_image(OIIO::TypeDesc::UINT8,pixels.data())) {
+			std::cout << "Bail out! Failed to write " << filename << ": " << output->geterror() << std::endl;
+			return 1;
+		}
+		output->close();
+		const std::string path = "artworks/"+filename;
+		const std::string title = "Artwork "+std::to_string(i);
+		const std::string source = "https://arcollect.test/"+std::to_string(i);
+		insert_download_stmt->reset();
+		insert_download_stmt->bind(1,i);
+		insert_download_stmt->bind(2,path);
+		insert_artwork_stmt->reset();
+		insert_artwork_stmt->bind(1,i);
+		insert_artwork_stmt->bind(2,i);
+		insert_artwork_stmt->bind(3,title);
+		insert_artwork_stmt->bind(4,source);
+		insert_artwork_stmt->bind(5,i);
+		if ((insert_download_stmt->step() != SQLITE_DONE) || (insert_artwork_stmt->step() != SQLITE_DONE)) {
+			std::cout << "Bail out! Failed to insert artwork " << i << ": " << Arcollect::database->errmsg() << std::endl;
+			return 1;
+		}
+	}
+
+	// Start the GUI
+	if (Arcollect::gui::init()) {
+		std::cout << "Bail out! Failed to init the GUI" << std::endl;
+		return 1;
+	}
+	Arcollect::gui::start(1,argv);
+
+	// Navigate
+	std::vector<latency> latencies;
+	bool success = true;
+	for (int i = 1; success && (i < artworks_count*3/4); i++)
+		success = measure(&Arcollect::gui::view_slideshow::go_next,latencies);
+	for (int i = 1; success && (i < artworks_count/4); i++)
+		success = measure(&Arcollect::gui::view_slideshow::go_prev,latencies);
+	std::cout << (success ? "ok" : "not ok") << " 1 - Navigate in the slideshow" << std::endl;
+
+	// Report the distribution
+	std::sort(latencies.begin(),latencies.end());
+	if (!latencies.empty()) {
+		std::cout << "# Next artwork latency over " << latencies.size() << " navigations:"
+			<< " min=" << latencies.front().count() << "ms"
+			<< " median=" << latencies[latencies.size()/2].count() << "ms"
+			<< " p90=" << latencies[latencies.size()*9/10].count() << "ms"
+			<< " max=" << latencies.back().count() << "ms" << std::endl;
+	}
+	std::cout << "# " << ready_count << " artworks were ready before navigation" << std::endl;
+	const bool prefetched = !latencies.empty() && (ready_count >= static_cast<long>(latencies.size()*3/4));
+	std::cout << (prefetched ? "ok" : "not ok") << " 2 - Most artworks are prefetched" << std::endl;
+	const bool fast = !latencies.empty() && (latencies[latencies.size()/2] < latency(50));
+	std::cout << (fast ? "ok" : "not ok") << " 3 - Median latency is below 50ms" << std::endl;
+
+	Arcollect::gui::stop();
+	return success && prefetched && fast ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-thumbnails-xdg.cpp
+ *  \brief Thumbnails lookup filesystem accesses testing
+ *
+ * Check that the thumbnails index avoid filesystem accesses for missing
+ * thumbnails. Thumbnails are stored in a temporary `XDG_CACHE_HOME`.
+ *
+ * Accesses are counted by #Arcollect::art_reader::thumbnail_fs_accesses that
+ * only exists with `-Dtest_counters=true`, the test is skipped otherwise.
+ */
+#include <OpenImageIO/imageio.h> // Enable some stuff
+#include "../art-reader/file-source.hpp"
+#include "../art-reader/image.hpp"
+#include <config.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#if WITH_TEST_COUNTERS
+using Arcollect::art_reader::thumbnail_fs_accesses;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << " # " << thumbnail_fs_accesses << " filesystem accesses" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..5" << std::endl;
+	// Setup a blank XDG_CACHE_HOME (set by Meson)
+	const char* cache_home_env = std::getenv("XDG_CACHE_HOME");
+	if (!cache_home_env) {
+		std::cout << "Bail out! XDG_CACHE_HOME is not set" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path cache_home = cache_home_env;
+	const std::filesystem::path test_root = cache_home.parent_path();
+	std::filesystem::remove_all(cache_home);
+	std::filesystem::create_directories(cache_home/"thumbnails"/"large");
+	std::cout << "# Using XDG_CACHE_HOME=" << cache_home << std::endl;
+	// Create a fake original image, only stat() is done on it
+	const std::filesystem::path original = test_root/"original.png";
+	std::ofstream(original) << "Not an image";
+	
+	// Missing thumbnails lookups cost only the index seeding
+	std::string thumbnail_id;
+	// Declared before the thumbnail that read from it
+	Arcollect::art_reader::file_source source;
+	thumbnail_fs_accesses = 0;
+	for (int i = 0; i < 1000; i++) {
+		std::string missing_id;
+		Arcollect::art_reader::load_thumbnail(test_root/("missing-"+std::to_string(i)+".png"),{200,200},missing_id,source);
+	}
+	const unsigned int seed_accesses = thumbnail_fs_accesses;
+	tap_result(seed_accesses <= 4,"1000 missing thumbnails lookups only list thumbnails directories");
+	
+	// Write a thumbnail
+	std::unique_ptr<SDL::Surface> surface(reinterpret_cast<SDL::Surface*>(SDL_CreateRGBSurfaceWithFormat(0,2048,2048,32,SDL_PIXELFORMAT_ABGR8888)));
+	Arcollect::art_reader::write_thumbnail(original,*surface,OIIO::ImageSpec(2048,2048,4,OIIO::TypeDesc::UINT8),thumbnail_id);
+	tap_result(!thumbnail_id.empty(),"The thumbnail identifier is cached");
+	
+	// Load it
+	thumbnail_fs_accesses = 0;
+	OIIO::ImageInput::unique_ptr thumbnail = Arcollect::art_reader::load_thumbnail(original,{200,200},thumbnail_id,source);
+	tap_result(thumbnail && (thumbnail_fs_accesses <= 2),"The written thumbnail is found with one stat() and one open()");
+	thumbnail.reset();
+	
+	// Too small thumbnails are not looked up
+	thumbnail_fs_accesses = 0;
+	thumbnail = Arcollect::art_reader::load_thumbnail(original,{1000,1000},thumbnail_id,source);
+	tap_result(!thumbnail && !thumbnail_fs_accesses,"No filesystem access when existing thumbnails are too small");
+	
+	// Missing thumbnails lookups are free now
+	thumbnail_fs_accesses = 0;
+	for (int i = 0; i < 1000; i++) {
+		std::string missing_id;
+		Arcollect::art_reader::load_thumbnail(test_root/("missing-"+std::to_string(i)+".png"),{200,200},missing_id,source);
+	}
+	tap_result(!thumbnail_fs_accesses,"No filesystem access for missing thumbnails");
+	
+	return result_code;
+}
+#else
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..0 # SKIP Filesystem accesses are only counted with -Dtest_counters=true" << std::endl;
+	return 0;
+}
+#endif
@@ -0,0 +1,185 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-utf8.cpp
+ *  \brief UTF-8 to UTF-32 transcoding testing
+ *
+ * Compare Arcollect::gui::font::utf8_to_utf32() with `std::codecvt` that was
+ * used before on random valid texts, and check random bytes and known invalid
+ * sequences are replaced by U+FFFD. Multibyte texts are also compared with the
+ * scalar decoder to check SIMD validation.
+ */
+#include "../gui/font-utf8.hpp"
+#include <iostream>
+#include <locale>
+#include <optional>
+#include <random>
+#include <string>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+static constexpr int fuzz_iterations = 20000;
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+/** Convert with std::codecvt
+ * \return The text or nothing if std::codecvt rejected it
+ */
+static std::optional<std::u32string> codecvt_convert(const std::string &string)
+{
+	using codecvt_t = std::codecvt<char32_t,char,std::mbstate_t>;
+	static const codecvt_t &codecvt = std::use_facet<codecvt_t>(std::locale());
+	std::u32string result(string.size(),U'\0');
+	std::mbstate_t state{};
+	const char *from_next;
+	char32_t *to_next;
+	if (codecvt.in(state,string.data(),string.data()+string.size(),from_next,result.data(),result.data()+result.size(),to_next) != codecvt_t::ok)
+		return std::nullopt;
+	result.resize(to_next-result.data());
+	return result;
+}
+static std::u32string convert(const std::string &string, bool scalar = false)
+{
+	std::u32string result(string.size(),U'\0');
+	result.resize(scalar ? Arcollect::gui::font::utf8_to_utf32_scalar(string,result.data()) : Arcollect::gui::font::utf8_to_utf32(string,result.data()));
+	return result;
+}
+static void append_utf8(std::string &string, char32_t codepoint)
+{
+	if (codepoint < 0x80)
+		string += static_cast<char>(codepoint);
+	else if (codepoint < 0x800) {
+		string += static_cast<char>(0xC0|(codepoint >> 6));
+		string += static_cast<char>(0x80|(codepoint & 0x3F));
+	} else if (codepoint < 0x10000) {
+		string += static_cast<char>(0xE0|(codepoint >> 12));
+		string += static_cast<char>(0x80|((codepoint >> 6) & 0x3F));
+		string += static_cast<char>(0x80|(codepoint & 0x3F));
+	} else {
+		string += static_cast<char>(0xF0|(codepoint >> 18));
+		string += static_cast<char>(0x80|((codepoint >> 12) & 0x3F));
+		string += static_cast<char>(0x80|((codepoint >> 6) & 0x3F));
+		string += static_cast<char>(0x80|(codepoint & 0x3F));
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..5" << std::endl;
+	std::mt19937 rng(42);
+
+	// Random valid texts with ASCII runs of random length
+	bool success = true;
+	for (int i = 0; success && (i < fuzz_iterations); i++) {
+		std::string string;
+		std::u32string expected;
+		for (int count = rng()%16; count; count--) {
+			for (int ascii = rng()%80; ascii; ascii--) {
+				const char32_t chr = 0x20+rng()%0x5F;
+				string += static_cast<char>(chr);
+				expected += chr;
+			}
+			char32_t codepoint;
+			do {
+				static constexpr char32_t planes_end[] = {0x80,0x800,0x10000,0x110000};
+				codepoint = rng()%planes_end[rng()%std::size(planes_end)];
+			} while ((codepoint >= 0xD800) && (codepoint <= 0xDFFF));
+			append_utf8(string,codepoint);
+			expected += codepoint;
+		}
+		const std::optional<std::u32string> reference = codecvt_convert(string);
+		success = reference && (*reference == expected) && (convert(string) == expected) && (convert(string,true) == expected);
+	}
+	tap_result(success,"Valid texts are converted like std::codecvt");
+
+	// Random bytes
+	success = true;
+	for (int i = 0; success && (i < fuzz_iterations); i++) {
+		std::string string;
+		for (int length = rng()%100; length; length--)
+			// Bias toward ASCII and continuation bytes
+			string += static_cast<char>(rng()%2 ? rng()%0x80 : 0x80+rng()%0x80);
+		const std::u32string result = convert(string);
+		for (char32_t codepoint: result)
+			success &= (codepoint <= 0x10FFFF) && ((codepoint < 0xD800) || (codepoint > 0xDFFF));
+		success &= result == convert(string,true);
+		const std::optional<std::u32string> reference = codecvt_convert(string);
+		if (reference)
+			success &= result == *reference;
+		else success &= result.find(U'�') != result.npos;
+	}
+	tap_result(success,"Random bytes are converted to valid codepoints");
+
+	// Known invalid sequences
+	static const std::pair<std::string_view,std::u32string_view> invalid_sequences[] = {
+		{"\xC0\xAF",U"��"},                 // Overlong
+		{"\xE0\x80\xAF",U"���"},       // Overlong
+		{"\xE2\x82" "A",U"�" "A"},               // Truncated
+		{"\xED\xA0\x80",U"���"},       // Surrogate
+		{"\xF4\x90\x80\x80",U"����"}, // Above U+10FFFF
+		{"\xF0\x9F\x98",U"�"},                   // Truncated at the end
+		{"\xFF" "a\x80",U"�" "a�"},         // Invalid bytes
+	};
+	success = true;
+	for (const auto &sequence: invalid_sequences)
+		for (std::size_t prefix = 0; prefix < 70; prefix++) {
+			// Move the sequence across SIMD blocks boundaries
+			const std::string string = std::string(prefix,'x')+std::string(sequence.first);
+			success &= convert(string) == std::u32string(prefix,U'x')+std::u32string(sequence.second);
+		}
+	tap_result(success,"Invalid sequences are replaced by U+FFFD");
+
+	// Non-ASCII characters at every position of SIMD blocks
+	success = true;
+	for (std::size_t length = 0; length < 100; length++)
+		for (std::size_t position = 0; position <= length; position++) {
+			std::string string(length,'a');
+			string.insert(position,"é");
+			std::u32string expected(length,U'a');
+			expected.insert(position,U"é");
+			success &= convert(string) == expected;
+		}
+	tap_result(success,"Non-ASCII characters are found in all positions");
+
+	// Multibyte texts with a corrupted byte
+	success = true;
+	for (int i = 0; success && (i < fuzz_iterations); i++) {
+		std::string string;
+		for (int count = rng()%40; count; count--) {
+			char32_t codepoint;
+			do {
+				static constexpr char32_t planes_start[] = {0x80,0x800,0x10000};
+				static constexpr char32_t planes_end[] = {0x800,0x10000,0x110000};
+				const int plane = rng()%std::size(planes_end);
+				codepoint = planes_start[plane]+rng()%(planes_end[plane]-planes_start[plane]);
+			} while ((codepoint >= 0xD800) && (codepoint <= 0xDFFF));
+			append_utf8(string,codepoint);
+		}
+		if (!string.empty() && (i % 2))
+			string[rng()%string.size()] = static_cast<char>(rng());
+		success &= convert(string) == convert(string,true);
+	}
+	tap_result(success,"Multibyte texts are validated like the scalar decoder");
+	return result_code;
+}
@@ -0,0 +1,161 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test-write-behind.cpp
+ *  \brief Write-behind queue testing
+ *
+ * Queue writes while another connection hold the write lock, like
+ * webext-adder does while saving artworks, and check that queuing never
+ * block and that writes land once the lock is released.
+ */
+#include <arcollect-db-open.hpp>
+#include "../db/db.hpp"
+#include "../db/write-behind.hpp"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../sdl2-hpp/SDL.hpp" // For SDL_main
+
+using namespace Arcollect::db;
+
+static constexpr int writes_count = 100;
+static constexpr auto write_timeout = std::chrono::seconds(5);
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+static void tap_skip(const std::string_view &description, const std::string_view &reason)
+{
+	std::cout << "ok " << test_num++ << " - " << description << " # SKIP " << reason << std::endl;
+}
+
+/** Queue a rating update
+ */
+static std::future<int> queue_rating(int rating)
+{
+	return write_behind::queue([rating](std::unique_ptr<SQLite3::sqlite3> &db) {
+		std::unique_ptr<SQLite3::stmt> stmt;
+		if (db->prepare("UPDATE artworks SET art_rating = ? WHERE art_artid = 1;",stmt))
+			return db->extended_errcode();
+		stmt->bind(1,rating);
+		return stmt->step();
+	});
+}
+/** Wait for futures like the GUI main-loop does
+ * \return true if all writes succeeded
+ */
+static bool wait_futures(std::vector<std::future<int>> &futures)
+{
+	const auto deadline = std::chrono::steady_clock::now() + write_timeout;
+	for (std::future<int> &future: futures) {
+		while (future.wait_for(std::chrono::milliseconds(10)) != std::future_status::ready) {
+			if (std::chrono::steady_clock::now() > deadline)
+				return false;
+			if (write_behind::flush_due())
+				write_behind::flush();
+		}
+		if (future.get() != SQLITE_OK)
+			return false;
+	}
+	write_behind::poll();
+	return true;
+}
+static int current_rating(void)
+{
+	std::unique_ptr<SQLite3::stmt> stmt;
+	Arcollect::database->prepare("SELECT art_rating FROM artworks WHERE art_artid = 1;",stmt);
+	return stmt->step() == SQLITE_ROW ? stmt->column_int(0) : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	std::cout << "TAP version 13\n1..7" << std::endl;
+	Arcollect::database = Arcollect::db::test_open();
+	if (Arcollect::database->exec("INSERT INTO downloads (dwn_id,dwn_path,dwn_mimetype,dwn_lastedit) VALUES (1,'artworks/art-1.png','image/png',0);")
+	 || Arcollect::database->exec("INSERT INTO artworks (art_artid,art_dwnid,art_platform,art_title,art_source,art_rating,art_partof) VALUES (1,1,'test','Artwork 1','https://arcollect.test/1',0,1);")) {
+		std::cout << "Bail out! Failed to insert the artwork: " << Arcollect::database->errmsg() << std::endl;
+		return 1;
+	}
+
+	// Hold the write lock on another connection
+	std::unique_ptr<SQLite3::sqlite3> blocker = Arcollect::db::open();
+	blocker->exec("BEGIN IMMEDIATE;");
+
+	// Queue writes
+	#if WITH_TEST_COUNTERS
+	const unsigned int commits_before = write_behind::commits_count;
+	#endif
+	std::vector<std::future<int>> futures;
+	const auto queue_start = std::chrono::steady_clock::now();
+	for (int i = 1; i <= writes_count; i++)
+		futures.push_back(queue_rating(i));
+	const std::chrono::duration<double,std::milli> queue_time = std::chrono::steady_clock::now() - queue_start;
+	std::cout << "# Queued " << writes_count << " writes in " << queue_time.count() << "ms" << std::endl;
+	tap_result(queue_time < std::chrono::milliseconds(50),"Queuing writes does not wait for the lock");
+
+	// Writes must wait for the lock
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	if (write_behind::flush_due())
+		write_behind::flush();
+	tap_result(futures.back().wait_for(std::chrono::seconds(0)) != std::future_status::ready,"Writes wait while the database is locked");
+
+	// Release the lock
+	blocker->exec("COMMIT;");
+	tap_result(wait_futures(futures),"Writes succeed once the lock is released");
+	#if WITH_TEST_COUNTERS
+	const unsigned int commits = write_behind::commits_count - commits_before;
+	std::cout << "# " << writes_count << " writes committed in " << commits << " transactions" << std::endl;
+	tap_result(commits <= 3,"Writes are coalesced");
+	#else
+	tap_skip("Writes are coalesced","Commits are only counted with -Dtest_counters=true");
+	#endif
+	tap_result(current_rating() == writes_count,"Last write wins");
+
+	// A failing write does not rollback its neighbors
+	futures.clear();
+	std::future<int> failing = write_behind::queue([](std::unique_ptr<SQLite3::sqlite3> &db) {
+		return db->exec("UPDATE no_such_table SET column = 0;");
+	});
+	futures.push_back(queue_rating(42));
+	const bool others_succeed = wait_futures(futures);
+	tap_result((failing.get() != SQLITE_OK) && others_succeed && (current_rating() == 42),"Failing writes are isolated");
+
+	// A locked write retry the whole transaction
+	futures.clear();
+	std::atomic<int> attempts = 0;
+	futures.push_back(write_behind::queue([&attempts](std::unique_ptr<SQLite3::sqlite3> &db) {
+		if (!attempts++) {
+			db->exec("UPDATE artworks SET art_rating = 100 WHERE art_artid = 1;");
+			return SQLITE_BUSY;
+		}
+		return db->exec("UPDATE artworks SET art_rating = 43 WHERE art_artid = 1;");
+	}));
+	futures.push_back(queue_rating(44));
+	tap_result(wait_futures(futures) && (attempts == 2) && (current_rating() == 44),"Locked writes are retried");
+
+	write_behind::shutdown();
+	return result_code;
+}
@@ -0,0 +1,32 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+#include "dbus.hpp"
+#include "../db/db.hpp"
+
+const char Arcollect::dbus::artworks_changed_match[] = "type='signal',interface='" ARCOLLECT_DBUS_COLLECTION_INTF_STR "',member='ArtworksChanged'";
+
+DBusHandlerResult Arcollect::dbus::handle_ArtworksChanged(DBusConnection *conn, DBusMessage *message, void*)
+{
+	if (dbus_message_is_signal(message,ARCOLLECT_DBUS_COLLECTION_INTF_STR,"ArtworksChanged")) {
+		dbus_int64_t *art_ids;
+		int count;
+		if (dbus_message_get_args(message,NULL,DBUS_TYPE_ARRAY,DBUS_TYPE_INT64,&art_ids,&count,DBUS_TYPE_INVALID))
+			Arcollect::notify_changes(reinterpret_cast<const sqlite_int64*>(art_ids),count);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	} else return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
@@ -0,0 +1,326 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "event-loop.hpp"
+#include "../gui/main.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static int epoll_fd = -1;
+/** eventfd written by wakeup()
+ */
+static int wakeup_fd = -1;
+/** eventfd written to let the GUI wake-up thread poll again or stop
+ */
+static int gui_rearm_fd = -1;
+
+/** File descriptor registered in the epoll
+ *
+ * D-Bus may put multiple watches on the same file descriptor (one readable and
+ * one writable) while the epoll want each file descriptor only once.
+ */
+struct source {
+	/** D-Bus watches on this file descriptor
+	 */
+	std::vector<DBusWatch*> watches;
+	/** D-Bus timeout if this is a timerfd
+	 */
+	DBusTimeout *timeout = NULL;
+	/** Whether the file descriptor is in the epoll
+	 *
+	 * Watches file descriptors without enabled watches are removed from the
+	 * epoll, else it would still report hang-ups and errors on them.
+	 */
+	bool registered = false;
+};
+/** Sources by file descriptor
+ *
+ * \note epoll events store the file descriptor and not a source pointer because
+ *       D-Bus callbacks may remove sources while a batch of events is handled.
+ */
+static std::unordered_map<int,source> sources;
+
+static std::uint32_t watch_epoll_events(const source &src)
+{
+	std::uint32_t events = 0;
+	for (DBusWatch *watch: src.watches)
+		if (dbus_watch_get_enabled(watch)) {
+			auto watch_flags = dbus_watch_get_flags(watch);
+			if (watch_flags & DBUS_WATCH_READABLE)
+				events |= EPOLLIN;
+			if (watch_flags & DBUS_WATCH_WRITABLE)
+				events |= EPOLLOUT;
+		}
+	return events;
+}
+static void update_watch_fd(int fd, source &src)
+{
+	struct epoll_event event;
+	event.events = watch_epoll_events(src);
+	event.data.fd = fd;
+	int op;
+	if (event.events)
+		op = src.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	else if (src.registered)
+		op = EPOLL_CTL_DEL;
+	else return;
+	src.registered = event.events;
+	// The fd may be already closed when removing, ignore errors then
+	if ((epoll_ctl(epoll_fd,op,fd,&event) == -1) && (op != EPOLL_CTL_DEL))
+		perror("In update_watch_fd(), epoll_ctl() failed");
+}
+static dbus_bool_t dbus_add_watch(DBusWatch *watch, void *data)
+{
+	int fd = dbus_watch_get_unix_fd(watch);
+	source &src = sources[fd];
+	src.watches.push_back(watch);
+	update_watch_fd(fd,src);
+	return true;
+}
+static void dbus_watch_toggled(DBusWatch *watch, void *data)
+{
+	int fd = dbus_watch_get_unix_fd(watch);
+	auto iter = sources.find(fd);
+	if (iter != sources.end())
+		update_watch_fd(fd,iter->second);
+	else std::cerr << "In dbus_watch_toggled(watch=" << watch << "), the watch was not found." << std::endl;
+}
+static void dbus_remove_watch(DBusWatch *watch, void *data)
+{
+	int fd = dbus_watch_get_unix_fd(watch);
+	auto iter = sources.find(fd);
+	if (iter != sources.end()) {
+		std::erase(iter->second.watches,watch);
+		update_watch_fd(fd,iter->second);
+		if (iter->second.watches.empty())
+			sources.erase(iter);
+	} else std::cerr << "In dbus_remove_watch(watch=" << watch << "), the watch was not found." << std::endl;
+}
+
+static void arm_timeout(DBusTimeout *timeout)
+{
+	int fd = static_cast<int>(reinterpret_cast<std::intptr_t>(dbus_timeout_get_data(timeout)));
+	struct itimerspec spec{};
+	if (dbus_timeout_get_enabled(timeout)) {
+		int interval = dbus_timeout_get_interval(timeout);
+		spec.it_interval.tv_sec  = interval/1000;
+		spec.it_interval.tv_nsec = (interval%1000)*1000000L;
+		spec.it_value = spec.it_interval;
+		if (!interval)
+			spec.it_value.tv_nsec = 1; // Zero would disarm the timer
+	}
+	if (timerfd_settime(fd,0,&spec,NULL) == -1)
+		perror("In arm_timeout(), timerfd_settime() failed");
+}
+static dbus_bool_t dbus_add_timeout(DBusTimeout *timeout, void *data)
+{
+	int fd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC);
+	if (fd == -1) {
+		perror("In dbus_add_timeout(), timerfd_create() failed");
+		return false;
+	}
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+	if (epoll_ctl(epoll_fd,EPOLL_CTL_ADD,fd,&event) == -1) {
+		perror("In dbus_add_timeout(), epoll_ctl() failed");
+		close(fd);
+		return false;
+	}
+	sources[fd].timeout = timeout;
+	dbus_timeout_set_data(timeout,reinterpret_cast<void*>(static_cast<std::intptr_t>(fd)),NULL);
+	arm_timeout(timeout);
+	return true;
+}
+static void dbus_timeout_toggled(DBusTimeout *timeout, void *data)
+{
+	arm_timeout(timeout);
+}
+static void dbus_remove_timeout(DBusTimeout *timeout, void *data)
+{
+	int fd = static_cast<int>(reinterpret_cast<std::intptr_t>(dbus_timeout_get_data(timeout)));
+	auto iter = sources.find(fd);
+	if (iter == sources.end() || (iter->second.timeout != timeout))
+		std::cerr << "In dbus_remove_timeout(timeout=" << timeout << "), the timeout was not found." << std::endl;
+	else {
+		epoll_ctl(epoll_fd,EPOLL_CTL_DEL,fd,NULL);
+		close(fd);
+		sources.erase(iter);
+	}
+}
+static void dbus_wakeup_main(void*)
+{
+	Arcollect::dbus::event_loop::wakeup();
+}
+
+int Arcollect::dbus::event_loop::init(void)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		perror("epoll_create1() failed");
+		return 1;
+	}
+	wakeup_fd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+	gui_rearm_fd = eventfd(0,EFD_CLOEXEC);
+	if ((wakeup_fd == -1)||(gui_rearm_fd == -1)) {
+		perror("eventfd() failed");
+		return 1;
+	}
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.fd = wakeup_fd;
+	if (epoll_ctl(epoll_fd,EPOLL_CTL_ADD,wakeup_fd,&event) == -1) {
+		perror("epoll_ctl() on the wake-up eventfd failed");
+		return 1;
+	}
+	return 0;
+}
+
+void Arcollect::dbus::event_loop::attach(DBus::Connection &conn)
+{
+	dbus_connection_set_watch_functions(conn,dbus_add_watch,dbus_remove_watch,dbus_watch_toggled,NULL,NULL);
+	dbus_connection_set_timeout_functions(conn,dbus_add_timeout,dbus_remove_timeout,dbus_timeout_toggled,NULL,NULL);
+	dbus_connection_set_wakeup_main_function(conn,dbus_wakeup_main,NULL,NULL);
+}
+
+void Arcollect::dbus::event_loop::wakeup(void)
+{
+	std::uint64_t one = 1;
+	if (write(wakeup_fd,&one,sizeof(one)) == -1 && errno != EAGAIN)
+		perror("In Arcollect::dbus::event_loop::wakeup(), write() failed");
+}
+
+static std::thread gui_wakeup_thread;
+static std::atomic_bool gui_wakeup_running = false;
+/** Set when the helper thread wait for run() to rearm it
+ */
+static std::atomic_bool gui_wakeup_pending = false;
+static void gui_rearm(void)
+{
+	std::uint64_t one = 1;
+	if (write(gui_rearm_fd,&one,sizeof(one)) == -1)
+		perror("In gui_rearm(), write() failed");
+}
+static void gui_wakeup_thread_main(void)
+{
+	// Let the main thread handle signals
+	sigset_t sigset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_BLOCK,&sigset,NULL);
+	struct pollfd fds[2];
+	fds[0].fd = epoll_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = gui_rearm_fd;
+	fds[1].events = POLLIN;
+	while (gui_wakeup_running) {
+		if (poll(fds,2,-1) == -1)
+			continue;
+		if (fds[0].revents & POLLIN) {
+			gui_wakeup_pending = true;
+			Arcollect::gui::wakeup_main();
+		}
+		if ((fds[0].revents|fds[1].revents) & POLLIN) {
+			// Block until run() or stop_gui_wakeups() rearm us
+			std::uint64_t value;
+			if (read(gui_rearm_fd,&value,sizeof(value)) == -1)
+				perror("In gui_wakeup_thread_main(), read() failed");
+		}
+	}
+}
+void Arcollect::dbus::event_loop::start_gui_wakeups(void)
+{
+	if (!gui_wakeup_running) {
+		gui_wakeup_running = true;
+		gui_wakeup_thread = std::thread(gui_wakeup_thread_main);
+	}
+}
+void Arcollect::dbus::event_loop::stop_gui_wakeups(void)
+{
+	if (gui_wakeup_running) {
+		gui_wakeup_running = false;
+		gui_rearm();
+		gui_wakeup_thread.join();
+		gui_wakeup_pending = false;
+	}
+}
+
+int Arcollect::dbus::event_loop::run(int timeout_ms)
+{
+	struct epoll_event events[16];
+	int event_count = epoll_wait(epoll_fd,events,std::size(events),timeout_ms);
+	if (event_count == -1)
+		return -1;
+	int handled = 0;
+	for (int i = 0; i < event_count; i++) {
+		int fd = events[i].data.fd;
+		if (fd == wakeup_fd) {
+			std::uint64_t value;
+			read(wakeup_fd,&value,sizeof(value));
+			continue;
+		}
+		// Previous callbacks may have removed the source
+		auto iter = sources.find(fd);
+		if (iter == sources.end())
+			continue;
+		if (DBusTimeout *timeout = iter->second.timeout) {
+			std::uint64_t expirations;
+			if ((read(fd,&expirations,sizeof(expirations)) > 0) && dbus_timeout_get_enabled(timeout))
+				dbus_timeout_handle(timeout);
+		} else {
+			int flags = 0;
+			if (events[i].events & EPOLLIN)
+				flags |= DBUS_WATCH_READABLE;
+			if (events[i].events & EPOLLOUT)
+				flags |= DBUS_WATCH_WRITABLE;
+			if (events[i].events & EPOLLERR)
+				flags |= DBUS_WATCH_ERROR;
+			if (events[i].events & EPOLLHUP)
+				flags |= DBUS_WATCH_HANGUP;
+			// Copy the list, dbus_watch_handle() may change it
+			const std::vector<DBusWatch*> watches = iter->second.watches;
+			for (DBusWatch *watch: watches) {
+				// Check the watch has not been removed by the previous one
+				iter = sources.find(fd);
+				if ((iter == sources.end())||(std::find(iter->second.watches.begin(),iter->second.watches.end(),watch) == iter->second.watches.end()))
+					break;
+				if (dbus_watch_get_enabled(watch)) {
+					int watch_flags = flags & (dbus_watch_get_flags(watch)|DBUS_WATCH_ERROR|DBUS_WATCH_HANGUP);
+					if (watch_flags) {
+						dbus_watch_handle(watch,watch_flags);
+						handled++;
+					}
+				}
+			}
+		}
+	}
+	// Let the GUI wake-up thread poll again
+	if (gui_wakeup_pending.exchange(false))
+		gui_rearm();
+	return handled;
+}
@@ -0,0 +1,66 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file desktop-app/xdg/event-loop.hpp
+ *  \brief epoll based D-Bus main-loop
+ *
+ * D-Bus watches file descriptors are registered once in an epoll instance and
+ * each D-Bus timeout get a timerfd in it, so the daemon sleep in epoll_wait()
+ * until something really happen.
+ *
+ * When the GUI is enabled, the main thread sleep in SDL_WaitEvent() instead.
+ * A helper thread then wait on the epoll file descriptor and wake the GUI with
+ * Arcollect::gui::wakeup_main() when it become readable. It does not poll the
+ * epoll again until run() has processed events.
+ *
+ * \note This use Linux epoll, timerfd and eventfd APIs.
+ */
+#pragma once
+#include "dbus-helper.hpp"
+namespace Arcollect {
+	namespace dbus {
+		namespace event_loop {
+			/** Init the event-loop
+			 * \return Zero on success
+			 */
+			int init(void);
+			/** Make the event-loop handle a connection watches and timeouts
+			 */
+			void attach(DBus::Connection &conn);
+			/** Wait and handle events
+			 * \param timeout_ms passed to epoll_wait()
+			 * \return The number of D-Bus watches handled or -1 with `errno` set
+			 *
+			 * Timeouts and wake-ups are handled but not counted.
+			 */
+			int run(int timeout_ms);
+			/** Wake run() up from any thread
+			 */
+			void wakeup(void);
+			/** Start GUI wake-ups
+			 *
+			 * Start the helper thread that call Arcollect::gui::wakeup_main() when
+			 * events are pending. Does nothing if already started.
+			 */
+			void start_gui_wakeups(void);
+			/** Stop GUI wake-ups
+			 *
+			 * Does nothing if not started.
+			 */
+			void stop_gui_wakeups(void);
+		}
+	}
+}
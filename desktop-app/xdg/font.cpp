@@ -19,7 +19,17 @@
  *  \todo Support multi charset reading
  */
 #include "fontconfig.hpp"
+#include "../art-reader/image.hpp"
 #include "../gui/font-internal.hpp"
+#include <arcollect-debug.hpp>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
 #include FT_SIZES_H
 static Fc::Config fc_config(FcInitLoadConfigAndFonts());
 
@@ -45,6 +55,11 @@ static FT_Face face_by_filename(const std::string& filename, FT_Long index) {
 struct face_size_entry {
 	FT_Face face;
 	FT_Size size;
+	/** HarfBuzz font on this face and size
+	 *
+	 * HarfBuzz take the scale of the active size on creation.
+	 */
+	hb_font_t *font;
 	Fc::Pattern pattern;
 	face_size_entry(const std::string& filename, FT_Long index, const Arcollect::gui::font::Renderable::RenderingState& state) :
 		face(face_by_filename(filename,index))
@@ -53,8 +68,11 @@ struct face_size_entry {
 		FT_New_Size(face,&size);
 		FT_Activate_Size(size);
 		FT_Set_Pixel_Sizes(face,state.font_height,state.font_height);
+		font = hb_ft_font_create_referenced(face);
+		hb_ft_font_set_load_flags(font,Arcollect::gui::font::ft_flags);
 	}
 	~face_size_entry(void) {
+		hb_font_destroy(font);
 		FT_Done_Face(face);
 		FT_Done_Size(size);
 	}
@@ -69,55 +87,350 @@ static std::unordered_map<std::size_t,face_size_entry> face_size_entries;
 static std::size_t hash_state(const Arcollect::gui::font::Renderable::RenderingState& state) {
 	return std::hash<FT_UInt>()(state.font_height^(state.attrib_iter->weight.value << 8)^(state.font_height << 15));
 }
-static Fc::Pattern &lookup_pattern(const Arcollect::gui::font::Renderable::RenderingState& state, char32_t character)
-{
-	static std::unordered_map<std::size_t,std::vector<Fc::Pattern>> cache;
-	std::vector<Fc::Pattern> &patterns = cache[hash_state(state)];
-	// Lookup pattern 
-	for (auto& pattern: patterns) {
-		FcCharSet* charset;
-		FcPatternGetCharSet(pattern,FC_CHARSET,0,&charset);
-		if (FcCharSetHasChar(charset,character))
-			return pattern;
+
+/** A face selected by fontconfig
+ *
+ * Faces are referenced by their 1-based index in #coverage_faces, 0 means no
+ * face.
+ */
+struct coverage_face {
+	std::string filename;
+	int index;
+	/** Hash of #filename and #index
+	 */
+	std::size_t hash;
+	/** Codepoints of the face
+	 *
+	 * It is queried lazily for faces loaded from the coverage file.
+	 */
+	FcCharSet *charset;
+	coverage_face(std::string &&filename, int index, FcCharSet *charset) :
+		filename(std::move(filename)),
+		index(index),
+		hash(std::hash<std::string>()(this->filename)^index),
+		charset(charset)
+	{
 	}
+	coverage_face(const coverage_face&) = delete;
+	~coverage_face(void) {
+		if (charset)
+			FcCharSetDestroy(charset);
+	}
+	const FcCharSet *get_charset(void) {
+		if (!charset) {
+			// Ask fontconfig cache
+			Fc::Pattern pattern(FcPatternBuild(NULL,
+				FC_FILE ,FcTypeString ,filename.c_str(),
+				FC_INDEX,FcTypeInteger,index,
+			NULL));
+			FcObjectSet *object_set = FcObjectSetBuild(FC_CHARSET,NULL);
+			FcFontSet *font_set = FcFontList(fc_config,pattern,object_set);
+			FcObjectSetDestroy(object_set);
+			FcCharSet *font_charset;
+			if (font_set && font_set->nfont && (FcPatternGetCharSet(font_set->fonts[0],FC_CHARSET,0,&font_charset) == FcResultMatch))
+				charset = FcCharSetCopy(font_charset);
+			else charset = FcCharSetCreate();
+			if (font_set)
+				FcFontSetDestroy(font_set);
+		}
+		return charset;
+	}
+};
+/** Faces selected by fontconfig
+ *
+ * This is a std::deque because #shape_data points to faces.
+ */
+static std::deque<coverage_face> coverage_faces;
+
+/** Codepoint to face map for a font size and weight
+ *
+ * This is a two-level table over blocks of 256 codepoints. Blocks are
+ * allocated and filled lazily, so a codepoint cost a fontconfig query only
+ * once, and most codepoints cost only two memory reads.
+ */
+struct coverage_map {
+	FT_UInt font_height;
+	int weight;
+	/** Faces in the order fontconfig selected them
+	 *
+	 * Faces are tried in this order before asking fontconfig for a new one.
+	 */
+	std::vector<std::uint16_t> faces;
+	using block = std::array<std::uint16_t,256>;
+	std::unique_ptr<block> blocks[0x110000 >> 8];
+	std::uint16_t &entry(char32_t chr) {
+		std::unique_ptr<block> &block_ptr = blocks[chr >> 8];
+		if (!block_ptr)
+			block_ptr = std::make_unique<block>(block{});
+		return (*block_ptr)[chr & 0xFF];
+	}
+};
+static std::unordered_map<std::uint64_t,coverage_map> coverage_maps;
+/** Whether coverage maps changed since loaded
+ */
+static bool coverage_dirty = false;
+
+static coverage_map &get_coverage_map(FT_UInt font_height, int weight)
+{
+	coverage_map &map = coverage_maps[(std::uint64_t(font_height) << 32)|static_cast<std::uint32_t>(weight)];
+	map.font_height = font_height;
+	map.weight = weight;
+	return map;
+}
+static std::uint16_t intern_face(std::string &&filename, int index, FcCharSet *charset)
+{
+	for (std::size_t i = 0; i < coverage_faces.size(); i++)
+		if ((coverage_faces[i].index == index) && (coverage_faces[i].filename == filename)) {
+			if (!coverage_faces[i].charset)
+				coverage_faces[i].charset = charset;
+			else if (charset)
+				FcCharSetDestroy(charset);
+			return i+1;
+		}
+	coverage_faces.emplace_back(std::move(filename),index,charset);
+	return coverage_faces.size();
+}
+static coverage_face &lookup_face(coverage_map &map, char32_t character)
+{
+	if (character > 0x10FFFF)
+		character = U'�';
+	std::uint16_t &entry = map.entry(character);
+	if (entry)
+		return coverage_faces[entry-1];
+	
+	// -- Cache miss, try known faces
+	coverage_dirty = true;
+	for (std::uint16_t face: map.faces)
+		if (FcCharSetHasChar(coverage_faces[face-1].get_charset(),character)) {
+			entry = face;
+			return coverage_faces[face-1];
+		}
 	
-	// -- No pattern found! Lookup for one.
+	// -- No face found! Lookup for one.
 	FcResult res;
 	Fc::CharSet charset;
 	charset.AddChar(character);
 	Fc::Pattern pattern(FcPatternBuild(NULL,
 		FC_FAMILY,FcTypeString ,"system-ui",
 		FC_COLOR ,FcTypeBool   ,false,
-		FC_WEIGHT,FcTypeInteger,state.attrib_iter->weight,
+		FC_WEIGHT,FcTypeInteger,map.weight,
 	NULL));
 	pattern.Add(FC_CHARSET,charset);
-	pattern.Add(FC_PIXEL_SIZE,static_cast<int>(state.font_height));
+	pattern.Add(FC_PIXEL_SIZE,static_cast<int>(map.font_height));
 	FcDefaultSubstitute(pattern);
 	fc_config.Substitute(pattern,FcMatchPattern);
-	patterns.emplace_back(FcFontMatch(fc_config,pattern,&res));
-	return patterns.back();
+	Fc::Pattern match(FcFontMatch(fc_config,pattern,&res));
+	FcChar8 *fc_filename = NULL;
+	int face_index = 0;
+	FcCharSet *face_charset = NULL;
+	if (match.handle) {
+		FcPatternGetString(match,FC_FILE,0,&fc_filename);
+		FcPatternGetInteger(match,FC_INDEX,0,&face_index);
+		if (FcPatternGetCharSet(match,FC_CHARSET,0,&face_charset) == FcResultMatch)
+			face_charset = FcCharSetCopy(face_charset);
+		else face_charset = NULL;
+	}
+	entry = intern_face(fc_filename ? reinterpret_cast<const char*>(fc_filename) : "",face_index,face_charset);
+	if (std::find(map.faces.begin(),map.faces.end(),entry) == map.faces.end())
+		map.faces.push_back(entry);
+	return coverage_faces[entry-1];
+}
+
+/** Coverage file magic
+ *
+ * Change the version when the format change.
+ */
+static constexpr char coverage_file_magic[16] = {'A','r','c','o','l','l','e','c','t','F','c','C','o','v','0','1'};
+struct coverage_file_header {
+	char magic[sizeof(coverage_file_magic)];
+	/** fontconfig configuration stamp
+	 *
+	 * See coverage_config_stamp().
+	 */
+	std::uint64_t config_stamp;
+	std::uint32_t face_count;
+	std::uint32_t map_count;
+};
+/* The header is followed by `face_count` faces:
+ * - std::uint32_t index
+ * - std::uint32_t filename size
+ * - The filename
+ *
+ * Then by `map_count` maps:
+ * - std::uint32_t font_height
+ * - std::int32_t weight
+ * - std::uint32_t faces count and faces as std::uint16_t
+ * - std::uint32_t ranges count and ranges as #coverage_file_range
+ */
+struct coverage_file_range {
+	std::uint32_t first;
+	std::uint32_t last;
+	std::uint32_t face;
+};
+
+static std::filesystem::path coverage_file_path(void)
+{
+	return Arcollect::art_reader::lookup_cache_root()/"arcollect"/"font-coverage";
+}
+/** Compute fontconfig configuration stamp
+ *
+ * fontconfig does not expose its configuration time, this is a hash of the
+ * modification times of configuration files and font directories, what
+ * FcConfigUptoDate() checks.
+ */
+static std::uint64_t coverage_config_stamp(void)
+{
+	std::uint64_t stamp = 0xcbf29ce484222325;
+	const auto hash_bytes = [&stamp](const void *data, std::size_t size) {
+		for (std::size_t i = 0; i < size; i++)
+			stamp = (stamp ^ static_cast<const unsigned char*>(data)[i]) * 0x100000001b3;
+	};
+	for (FcStrList *list: {FcConfigGetConfigFiles(fc_config),FcConfigGetFontDirs(fc_config)}) {
+		if (!list)
+			continue;
+		while (FcChar8 *path = FcStrListNext(list)) {
+			struct stat path_stat;
+			const std::int64_t mtime = stat(reinterpret_cast<const char*>(path),&path_stat) ? 0 : path_stat.st_mtime;
+			hash_bytes(path,std::strlen(reinterpret_cast<const char*>(path)));
+			hash_bytes(&mtime,sizeof(mtime));
+		}
+		FcStrListDone(list);
+	}
+	return stamp;
+}
+
+static bool coverage_load(std::istream &stream)
+{
+	const auto read = [&stream](auto &value) {
+		return static_cast<bool>(stream.read(reinterpret_cast<char*>(&value),sizeof(value)));
+	};
+	coverage_file_header header;
+	if (!read(header) || std::memcmp(header.magic,coverage_file_magic,sizeof(coverage_file_magic)) || (header.config_stamp != coverage_config_stamp()))
+		return false;
+	for (std::uint32_t i = 0; i < header.face_count; i++) {
+		std::uint32_t index, filename_size;
+		if (!read(index) || !read(filename_size) || (filename_size > 4096))
+			return false;
+		std::string filename(filename_size,'\0');
+		if (!stream.read(filename.data(),filename_size))
+			return false;
+		coverage_faces.emplace_back(std::move(filename),index,nullptr);
+	}
+	for (std::uint32_t i = 0; i < header.map_count; i++) {
+		std::uint32_t font_height, face_count, range_count;
+		std::int32_t weight;
+		if (!read(font_height) || !read(weight) || !read(face_count))
+			return false;
+		coverage_map &map = get_coverage_map(font_height,weight);
+		map.faces.resize(face_count);
+		for (std::uint16_t &face: map.faces)
+			if (!read(face) || !face || (face > header.face_count))
+				return false;
+		if (!read(range_count))
+			return false;
+		for (std::uint32_t j = 0; j < range_count; j++) {
+			coverage_file_range range;
+			if (!read(range) || (range.first > range.last) || (range.last > 0x10FFFF) || !range.face || (range.face > header.face_count))
+				return false;
+			for (char32_t chr = range.first; chr <= range.last; chr++)
+				map.entry(chr) = range.face;
+		}
+	}
+	return true;
+}
+static bool coverage_save(std::ostream &stream)
+{
+	const auto write = [&stream](const auto &value) {
+		stream.write(reinterpret_cast<const char*>(&value),sizeof(value));
+	};
+	coverage_file_header header{};
+	std::memcpy(header.magic,coverage_file_magic,sizeof(coverage_file_magic));
+	header.config_stamp = coverage_config_stamp();
+	header.face_count = coverage_faces.size();
+	header.map_count = coverage_maps.size();
+	write(header);
+	for (const coverage_face &face: coverage_faces) {
+		write(static_cast<std::uint32_t>(face.index));
+		write(static_cast<std::uint32_t>(face.filename.size()));
+		stream.write(face.filename.data(),face.filename.size());
+	}
+	for (const auto &map: coverage_maps) {
+		write(static_cast<std::uint32_t>(map.second.font_height));
+		write(static_cast<std::int32_t>(map.second.weight));
+		write(static_cast<std::uint32_t>(map.second.faces.size()));
+		for (std::uint16_t face: map.second.faces)
+			write(face);
+		// Merge codepoints into ranges
+		std::vector<coverage_file_range> ranges;
+		for (std::size_t block = 0; block < std::size(map.second.blocks); block++)
+			if (map.second.blocks[block])
+				for (std::size_t i = 0; i < 256; i++) {
+					const std::uint16_t face = (*map.second.blocks[block])[i];
+					const std::uint32_t chr = (block << 8)|i;
+					if (!face)
+						continue;
+					if (!ranges.empty() && (ranges.back().face == face) && (ranges.back().last+1 == chr))
+						ranges.back().last = chr;
+					else ranges.push_back({chr,chr,face});
+				}
+		write(static_cast<std::uint32_t>(ranges.size()));
+		stream.write(reinterpret_cast<const char*>(ranges.data()),ranges.size()*sizeof(coverage_file_range));
+	}
+	return static_cast<bool>(stream.flush());
 }
 
 void Arcollect::gui::font::os_init(void)
 {
+	const std::filesystem::path path = coverage_file_path();
+	std::ifstream stream(path,std::ios::binary);
+	if (!stream)
+		return;
+	if (coverage_load(stream)) {
+		if (Arcollect::debug.fonts)
+			std::cerr << "Loaded " << coverage_faces.size() << " faces coverage for " << coverage_maps.size() << " font sizes from " << path.string() << std::endl;
+	} else {
+		// Outdated or corrupted
+		if (Arcollect::debug.fonts)
+			std::cerr << "Discarding " << path.string() << std::endl;
+		coverage_maps.clear();
+		coverage_faces.clear();
+	}
+}
+
+void Arcollect::gui::font::os_shutdown(void)
+{
+	if (!coverage_dirty)
+		return;
+	const std::filesystem::path path = coverage_file_path();
+	std::filesystem::path temp_path = path;
+	temp_path += ".new";
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(),ec);
+	bool success;
+	{
+		std::ofstream stream(temp_path,std::ios::binary|std::ios::trunc);
+		success = stream && coverage_save(stream);
+	}
+	if (success)
+		std::filesystem::rename(temp_path,path,ec);
+	if (!success || ec) {
+		std::cerr << "Failed to write " << path.string() << std::endl;
+		std::filesystem::remove(temp_path,ec);
+		return;
+	}
+	coverage_dirty = false;
 }
 
 struct Arcollect::gui::font::shape_data {
-	Fc::Pattern pattern;
+	const coverage_face &face;
 };
 
 FT_Face Arcollect::gui::font::shape_hb_buffer(const Arcollect::gui::font::Renderable::RenderingState& state, hb_buffer_t* buf, Arcollect::gui::font::shape_data* data)
 {
-	Fc::Pattern &pattern = data->pattern;
-	// Read config
-	FcChar8 *fc_filename;
-	int face_index;
-	FcPatternGetString(pattern,FC_FILE,0,&fc_filename);
-	FcPatternGetInteger(pattern,FC_INDEX,0,&face_index);
-	std::string filename(reinterpret_cast<const char*>(fc_filename));
+	const coverage_face &face_info = data->face;
 	// Cast ray in cache
-	std::size_t key = std::hash<decltype(filename)>()(filename) ^ hash_state(state) ^ face_index;
-	auto iter = face_size_entries.try_emplace(key,filename,face_index,state).first;
+	std::size_t key = face_info.hash ^ hash_state(state);
+	auto iter = face_size_entries.try_emplace(key,face_info.filename,face_info.index,state).first;
 	// Setup face
 	FT_Face face = iter->second.activate();
 	Arcollect::gui::font::FaceGeneric &generic = *static_cast<Arcollect::gui::font::FaceGeneric*>(face->generic.data);
@@ -128,10 +441,7 @@ FT_Face Arcollect::gui::font::shape_hb_buffer(const Arcollect::gui::font::Render
 	hb_buffer_set_script(buf, HB_SCRIPT_LATIN);
 	hb_buffer_set_language(buf, hb_language_from_string("en", -1));
 	// Shape the buffer
-	hb_font_t *font = hb_ft_font_create_referenced(face);
-	hb_ft_font_set_load_flags(font,ft_flags);
-	hb_shape(font,buf,NULL,0);
-	hb_font_destroy(font);
+	hb_shape(iter->second.font,buf,NULL,0);
 	// Cleanups
 	delete data;
 	return face;
@@ -140,6 +450,7 @@ int Arcollect::gui::font::text_run_length(const Arcollect::gui::font::Renderable
 {
 	decltype(cp_offset) start_offset = cp_offset;
 	auto     current_attrib_iter = state.attrib_iter;
+	coverage_map &map = get_coverage_map(state.font_height,state.attrib_iter->weight.value);
 	do {
 		const char32_t chr = state.text[start_offset];
 		// Check if we're not on a blank
@@ -150,7 +461,7 @@ int Arcollect::gui::font::text_run_length(const Arcollect::gui::font::Renderable
 		if (++start_offset >= state.text.size()) {
 			// FIXME This is a dirty workaround
 			data = new Arcollect::gui::font::shape_data{
-				lookup_pattern(state,U'A'),
+				lookup_face(map,U'A'),
 			};
 			return state.text.size()-cp_offset;
 		}
@@ -163,13 +474,8 @@ int Arcollect::gui::font::text_run_length(const Arcollect::gui::font::Renderable
 	// Allocate data and invoke FontConfig
 	if (current_attrib_iter->end <= start_offset)
 		++current_attrib_iter;
-	data = new Arcollect::gui::font::shape_data{
-		lookup_pattern(state,state.text[start_offset]),
-	};
-	FcCharSet* charset;
-	FcPatternGetCharSet(data->pattern,FC_CHARSET,0,&charset);
-	FcPatternReference(data->pattern);
-	auto hash = FcPatternHash(data->pattern);
+	const coverage_face &face = lookup_face(map,state.text[start_offset]);
+	data = new Arcollect::gui::font::shape_data{face};
 	// Find where we should break
 	for (auto chr_i = start_offset + 1; chr_i < state.text.size(); ++chr_i) {
 		const char32_t chr = state.text[chr_i];
@@ -187,8 +493,8 @@ int Arcollect::gui::font::text_run_length(const Arcollect::gui::font::Renderable
 		if ((chr <= 0x20)
 			 ||(chr == 0x00A0))
 			continue;
-		// -- No known pattern -> Lookup one
-		if (hash != FcPatternHash(lookup_pattern(state,chr)))
+		// Break when the face changes
+		if (&lookup_face(map,chr) != &face)
 			return chr_i - cp_offset;
 	}
 	// We processed all text
@@ -15,13 +15,57 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include "dbus.hpp"
-#include "../db/artwork.hpp"
+#include "../art-reader/image.hpp"
+#include "../config.hpp"
 #include "../db/db.hpp"
 #include "../db/search.hpp"
 #include "../gui/main.hpp"
 #include <arcollect-paths.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+/** Maximum number of results returned to GNOME Shell
+ *
+ * GNOME Shell only display a few results per provider, sending more is a waste
+ * of D-Bus bandwidth.
+ */
+static constexpr int max_results = 100;
+/** Size of GNOME Shell icons to lookup
+ */
+static constexpr int gicon_size = 128;
+
+/** Results cache entry
+ */
+struct result_cache_entry {
+	/** The search string
+	 */
+	std::string search;
+	/** Arcollect::data_version when the search was done
+	 */
+	sqlite_int64 data_version;
+	/** Arcollect::config::current_rating when the search was done
+	 */
+	int rating;
+	/** If the results were restricted to previous results in a subsearch
+	 */
+	bool restricted;
+	/** Sorted previous results if #restricted
+	 */
+	std::vector<sqlite_int64> previous;
+	/** The artworks ids
+	 */
+	std::vector<std::string> results;
+};
+/** Results LRU cache, most recently used first
+ *
+ * GNOME Shell often repeat searches while the user types and erase characters.
+ */
+static std::list<result_cache_entry> result_cache;
+static constexpr std::list<result_cache_entry>::size_type result_cache_size = 8;
 
-std::unique_ptr<SQLite3::stmt> Arcollect::dbus::gnome_shell_search_provider_result_metas_stmt;
 static std::string gnome_shell_search_string(DBus::Message::iterator terms)
 {
 	std::string search_string;
@@ -31,25 +75,70 @@ static std::string gnome_shell_search_string(DBus::Message::iterator terms)
 		search_string.pop_back();
 	return search_string;
 }
-static DBusHandlerResult GetResultSet(DBus::Connection &conn, DBusMessage *message, DBus::Message::iterator terms)
+/** Lookup the #result_cache
+ * \param search string
+ * \param previous Sorted previous results, NULL for an initial search
+ * \return The cached results or NULL
+ *
+ * Results must have been restricted to the same previous results.
+ */
+static const std::vector<std::string> *result_cache_lookup(const std::string &search, const std::vector<sqlite_int64> *previous)
+{
+	for (auto iter = result_cache.begin(); iter != result_cache.end(); ++iter)
+		if ((iter->search == search)
+		  &&(iter->data_version == Arcollect::data_version)
+		  &&(iter->rating == Arcollect::config::current_rating)
+		  &&(iter->restricted == (previous != NULL))
+		  &&(!previous || (iter->previous == *previous))) {
+			result_cache.splice(result_cache.begin(),result_cache,iter);
+			return &result_cache.front().results;
+		}
+	return NULL;
+}
+/** Perform a search
+ * \param search string
+ * \param previous results to restrict the search into, NULL for an initial search
+ * \return The results, stored in the #result_cache
+ */
+static const std::vector<std::string> &search_results(std::string &&search, const std::vector<sqlite_int64> *previous)
+{
+	// Lookup the cache
+	Arcollect::update_data_version();
+	std::vector<sqlite_int64> sorted_previous;
+	if (previous) {
+		sorted_previous = *previous;
+		std::sort(sorted_previous.begin(),sorted_previous.end());
+	}
+	const std::vector<std::string> *cached = result_cache_lookup(search,previous ? &sorted_previous : NULL);
+	if (cached)
+		return *cached;
+	// Make a new entry
+	if (result_cache.size() >= result_cache_size)
+		result_cache.pop_back();
+	result_cache.push_front({search,Arcollect::data_version,Arcollect::config::current_rating,previous != NULL,std::move(sorted_previous),{}});
+	std::vector<std::string> &results = result_cache.front().results;
+	// Nothing can match if previous results are empty
+	if (previous && previous->empty())
+		return results;
+	// Run the search
+	std::unique_ptr<SQLite3::stmt> stmt;
+	Arcollect::search::ParsedSearch(std::move(search),Arcollect::db::SEARCH_ARTWORKS,Arcollect::db::SORT_NONE).build_ranked_stmt(stmt,max_results,previous ? *previous : std::vector<sqlite_int64>());
+	while (stmt->step() == SQLITE_ROW)
+		results.emplace_back(std::to_string(stmt->column_int64(0)));
+	return results;
+}
+static DBusHandlerResult GetResultSet(DBus::Connection &conn, DBusMessage *message, DBus::Message::iterator terms, const std::vector<sqlite_int64> *previous)
 {
 	// Rebuild search_string that we'll retokenize again
-	std::string search_string = gnome_shell_search_string(terms);
+	const std::vector<std::string> &search_result = search_results(gnome_shell_search_string(terms),previous);
 	
 	// Prepare reply
 	DBusMessage *reply = dbus_message_new_method_return(message);
 	DBus::append_iterator append_iter(reply);
 	DBus::append_iterator results;
 	append_iter.open_container('a',"s",results);
-	
-	// Build statement
-	std::unique_ptr<SQLite3::stmt> stmt;
-	
-	Arcollect::search::ParsedSearch(search_string,Arcollect::db::SEARCH_ARTWORKS,Arcollect::db::SORT_RANDOM).build_stmt(stmt);
-	while (stmt->step() == SQLITE_ROW) {
-		// Append artwork id
-		results << std::to_string(stmt->column_int64(0)).c_str();
-	}
+	for (const std::string &art_id: search_result)
+		results << art_id.c_str();
 	append_iter.close_container(results);
 	
 	// Send message
@@ -57,6 +146,18 @@ static DBusHandlerResult GetResultSet(DBus::Connection &conn, DBusMessage *messa
 	dbus_message_unref(reply);
 	return DBUS_HANDLER_RESULT_HANDLED;
 }
+static DBusHandlerResult GetSubsearchResultSet(DBus::Connection &conn, DBusMessage *message)
+{
+	DBus::Message::iterator iter(message);
+	// Parse previous results
+	std::vector<sqlite_int64> previous;
+	for (auto result: iter)
+		previous.push_back(std::atoll(result.get_basic<const char*>()));
+	if (previous.size() > static_cast<std::size_t>(max_results))
+		// Not from us, search from scratch rather than binding too much ids
+		return GetResultSet(conn,message,++iter,NULL);
+	return GetResultSet(conn,message,++iter,&previous);
+}
 
 static void add_dbus_dict_sv(DBus::append_iterator& result, const char* key, const char* value)
 {
@@ -69,24 +170,61 @@ static void add_dbus_dict_sv(DBus::append_iterator& result, const char* key, con
 		dict.close_container(variant);
 	result.close_container(dict);
 }
+/** Artwork metadata for GNOME Shell
+ */
+struct result_meta {
+	std::string name;
+	std::string description;
+	std::string gicon;
+};
 static DBusHandlerResult GetResultMetas(DBus::Connection &conn, DBusMessage *message)
 {
+	// Parse ids
+	std::vector<const char*> ids;
+	for (auto iter: DBus::Message::iterator(message))
+		ids.push_back(iter.get_basic<const char*>());
+	// Query all metadata at once
+	std::unordered_map<sqlite_int64,result_meta> metas;
+	if (!ids.empty()) {
+		std::string query = "SELECT art_artid, coalesce(art_title,''), coalesce(trim(art_desc),''), data.dwn_path, thumb.dwn_path FROM artworks JOIN downloads AS data ON data.dwn_id = art_dwnid LEFT JOIN downloads AS thumb ON thumb.dwn_id = art_thumbnail WHERE art_artid IN (?";
+		for (decltype(ids)::size_type i = 1; i < ids.size(); i++)
+			query += ",?";
+		query += ");";
+		std::unique_ptr<SQLite3::stmt> stmt;
+		if (Arcollect::database->prepare(query.c_str(),stmt))
+			std::cerr << "Failed to prepare GNOME Shell result metas query: " << Arcollect::database->errmsg() << std::endl;
+		else {
+			int i = 1;
+			for (const char* id: ids)
+				stmt->bind(i++,static_cast<sqlite_int64>(std::atoll(id)));
+			while (stmt->step() == SQLITE_ROW) {
+				result_meta &meta = metas[stmt->column_int64(0)];
+				meta.name = stmt->column_string(1);
+				meta.description = stmt->column_string(2);
+				// Prefer an existing XDG thumbnail over the full-size original
+				const std::filesystem::path data_path = Arcollect::path::arco_data_home/stmt->column_text(3);
+				std::filesystem::path gicon = Arcollect::art_reader::find_thumbnail(data_path,gicon_size);
+				if (gicon.empty())
+					gicon = stmt->column_type(4) == SQLITE_NULL ? data_path : Arcollect::path::arco_data_home/stmt->column_text(4);
+				meta.gicon = gicon.string();
+			}
+		}
+	}
 	// Prepare reply
 	DBusMessage *reply = dbus_message_new_method_return(message);
 	DBus::append_iterator append_iter(reply);
 	DBus::append_iterator results;
 	append_iter.open_container('a',"a{sv}",results);
-	// Loop
-	for (auto iter: DBus::Message::iterator(message)) {
-		const char* id = iter.get_basic<const char*>();
-		std::shared_ptr<Arcollect::db::artwork> artwork = Arcollect::db::artwork::query(std::atoi(id));
-		if (artwork) {
+	// Loop in requested order
+	for (const char* id: ids) {
+		auto iter = metas.find(std::atoll(id));
+		if (iter != metas.end()) {
 			DBus::append_iterator result;
 			results.open_container('a',"{sv}",result);
 			add_dbus_dict_sv(result,"id",id);
-			add_dbus_dict_sv(result,"name",artwork->title().c_str());
-			add_dbus_dict_sv(result,"description",artwork->desc().c_str());
-			add_dbus_dict_sv(result,"gicon",(Arcollect::path::arco_data_home/artwork->get(Arcollect::db::artwork::FILE_THUMBNAIL)->dwn_path).string().c_str());
+			add_dbus_dict_sv(result,"name",iter->second.name.c_str());
+			add_dbus_dict_sv(result,"description",iter->second.description.c_str());
+			add_dbus_dict_sv(result,"gicon",iter->second.gicon.c_str());
 			results.close_container(result);
 		}
 	}
@@ -118,9 +256,9 @@ static DBusHandlerResult LaunchSearch(DBus::Connection &conn, DBusMessage *messa
 DBusHandlerResult Arcollect::dbus::gnome_shell_search_provider_intf(DBus::Connection &conn, DBusMessage *message)
 {
 	if (dbus_message_has_member(message,"GetInitialResultSet")) {
-		return GetResultSet(conn,message,  DBus::Message::iterator(message));
+		return GetResultSet(conn,message,DBus::Message::iterator(message),NULL);
 	} else if (dbus_message_has_member(message,"GetSubsearchResultSet")) {
-		return GetResultSet(conn,message,++DBus::Message::iterator(message));
+		return GetSubsearchResultSet(conn,message);
 	} else if (dbus_message_has_member(message,"GetResultMetas")) {
 		return GetResultMetas(conn,message);
 	} else if (dbus_message_has_member(message,"ActivateResult")) {
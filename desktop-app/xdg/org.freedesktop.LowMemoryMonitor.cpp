@@ -16,6 +16,7 @@
  */
 #include "dbus.hpp"
 #include "../gui/main.hpp"
+#include "../gui/reclaim-memory.hpp"
 
 DBusHandlerResult Arcollect::dbus::handle_LowMemoryWarning(DBusConnection *conn, DBusMessage *message, void*)
 {
@@ -27,12 +28,14 @@ DBusHandlerResult Arcollect::dbus::handle_LowMemoryWarning(DBusConnection *conn,
 			if (value == 255) return DBUS_HANDLER_RESULT_HANDLED; // FIXME Daemon seem to always throw a 255 after the normal signal ???
 			if (value <  50) return DBUS_HANDLER_RESULT_HANDLED;
 			//  50 -> Memory is low, should free up unneeded resources so they can be used elsewhere.
-			// TODO Perform a quick GC
-			if (value < 100) return DBUS_HANDLER_RESULT_HANDLED;
+			if (value < 100) {
+				Arcollect::gui::reclaim_memory(Arcollect::gui::MemoryPressure::LOW);
+				return DBUS_HANDLER_RESULT_HANDLED;
+			}
 			// 100 -> Should try harder to free up unneeded resources. If does not need to stay running, it is a good time to quit.
 			if (!Arcollect::gui::enabled)
 				Arcollect::dbus::exit_if_idle();
-			// TODO Perform an aggressive garbage collection
+			Arcollect::gui::reclaim_memory(Arcollect::gui::MemoryPressure::CRITICAL);
 		}
 		return DBUS_HANDLER_RESULT_HANDLED;
 	} else return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
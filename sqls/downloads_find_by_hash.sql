@@ -1,5 +1,5 @@
 /* Arcollect -- An artwork collection manager
- * Copyright (C) 2021 DevilishSpirits (aka D-Spirits or Luc B.)
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -14,11 +14,10 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
-/* Delete an artwork given an art_artid
+/* Find downloads with the same content hash
  *
- * This is a query where you must bind the art_artid to remove.
- *
- * It may return multiple columns with the download ids to erase
+ * It is invoked with the hash in ?1 and the dwn_id to exclude in ?2.
  */
-DELETE FROM artworks             WHERE art_artid  = ?
-	RETURNING art_dwnid, art_thumbnail;
+SELECT dwn_id, dwn_path FROM downloads
+	WHERE (dwn_hash = ?1) AND (dwn_id != ?2)
+	ORDER BY dwn_id;
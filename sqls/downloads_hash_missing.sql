@@ -0,0 +1,23 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/* List downloads without a content hash
+ *
+ * It is invoked with the last seen dwn_id in ?1 and the batch size in ?2.
+ */
+SELECT dwn_id, dwn_path FROM downloads
+	WHERE (dwn_hash IS NULL) AND (dwn_id > ?1)
+	ORDER BY dwn_id LIMIT ?2;
@@ -31,7 +31,7 @@ BEGIN IMMEDIATE;
 		PRIMARY KEY (key)
 	);
 	INSERT INTO arcollect_infos (key,value) VALUES
-		('schema_version',3), /* Schema version - Used to upgrade the DB if needed */
+		('schema_version',7), /* Schema version - Used to upgrade the DB if needed */
 		('bootstrap_date',strftime('%s','now')) /* Bootstrap date - When the database was bootstraped/the user started using Arcollect */
 	;
 	
@@ -45,16 +45,40 @@ BEGIN IMMEDIATE;
 	 *
 	 * Note about dwn_width/dwn_height: Upon insertion, these values are set to
 	 * NULL. The desktop-app will set these when loading the artwork.
+	 *
+	 * Note about dwn_bgcolor/dwn_pixelart/dwn_analysis: These are results of the
+	 * desktop-app image analysis, cached to know them before decoding the image.
+	 * dwn_analysis is the analysis algorithm version, results are ignored and
+	 * recomputed if it does not match the desktop-app one. NULL if the download
+	 * has not been analysed yet.
+	 *
+	 * Note about dwn_placeholder: This is a tiny 4x4 RGB565 little-endian image
+	 * the desktop-app upscale and show while the real image is loading. NULL if
+	 * not computed yet.
+	 *
+	 * Note about dwn_hash: This is the XXH64 of the file content, stored as a
+	 * signed integer. The webext-adder use it to reuse an existing download
+	 * when the same file is fetched from another URL. NULL if unknown.
+	 *
+	 * Note about dwn_path: Files are stored in two levels of shards like
+	 * `artworks/X/Y/filename`. Older versions stored them flat, the desktop-app
+	 * move them in the background. Downloads with the same content share the
+	 * same dwn_path, the file is removed with the last download using it.
 	 */
 	CREATE TABLE downloads (
 		dwn_id       INTEGER NOT NULL UNIQUE, /* Download unique ID           */
 		dwn_source   TEXT             UNIQUE, /* Download URL                 */
-		dwn_path     TEXT    NOT NULL UNIQUE, /* Download path                */
+		dwn_path     TEXT    NOT NULL       , /* Download path                */
 		dwn_mimetype TEXT    NOT NULL       , /* Download file type           */
 		dwn_etag     TEXT                   , /* Download etag                */
 		dwn_width    INTEGER                , /* Download width in pixels     */
 		dwn_height   INTEGER                , /* Download height in pixels    */
 		dwn_lastedit INTEGER NOT NULL       , /* Last edit time for If-Modified-Since */
+		dwn_bgcolor  INTEGER                , /* Detected background color (0xRRGGBBAA) */
+		dwn_pixelart INTEGER                , /* 1 if the image is pixel-art */
+		dwn_analysis INTEGER                , /* Version of the analysis */
+		dwn_placeholder BLOB                , /* Tiny preview of the image */
+		dwn_hash     INTEGER                , /* XXH64 of the file content */
 		PRIMARY KEY (dwn_id)
 	);
 	
@@ -283,4 +307,21 @@ BEGIN IMMEDIATE;
 		FOREIGN KEY (art_artid) REFERENCES artworks(art_artid) ON DELETE CASCADE,
 		PRIMARY KEY (art_artid,cmp_source)
 	);
+	
+	/* Downloads references indexes
+	 *
+	 * They speed-up foreign keys enforcement when deleting downloads and
+	 * reference counting in bulk deletions.
+	 */
+	CREATE INDEX artworks_art_dwnid     ON artworks (art_dwnid);
+	CREATE INDEX artworks_art_thumbnail ON artworks (art_thumbnail);
+	CREATE INDEX accounts_acc_icon      ON accounts (acc_icon);
+	CREATE INDEX acc_icons_dwn_id       ON acc_icons(dwn_id);
+	
+	/* Downloads content indexes
+	 *
+	 * They speed-up duplicated downloads lookup and shared files checks.
+	 */
+	CREATE INDEX downloads_dwn_hash ON downloads (dwn_hash);
+	CREATE INDEX downloads_dwn_path ON downloads (dwn_path);
 COMMIT;
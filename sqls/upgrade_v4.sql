@@ -0,0 +1,30 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/* This SQL upgrade a v3 database to the v4 format.
+ */
+/* Begin transaction */
+BEGIN IMMEDIATE;
+	/* Add image analysis results in the downloads table */
+	ALTER TABLE downloads ADD COLUMN dwn_bgcolor  INTEGER; /* Detected background color (0xRRGGBBAA) */
+	ALTER TABLE downloads ADD COLUMN dwn_pixelart INTEGER; /* 1 if the image is pixel-art */
+	ALTER TABLE downloads ADD COLUMN dwn_analysis INTEGER; /* Version of the analysis */
+	
+	/* Write the new DB version */
+	INSERT OR REPLACE INTO arcollect_infos (key,value) VALUES ('schema_version',4);
+
+/* Finish transaction */
+COMMIT;
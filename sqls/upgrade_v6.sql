@@ -0,0 +1,31 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/* This SQL upgrade a v5 database to the v6 format.
+ */
+/* Begin transaction */
+BEGIN IMMEDIATE;
+	/* Index downloads references */
+	CREATE INDEX artworks_art_dwnid     ON artworks (art_dwnid);
+	CREATE INDEX artworks_art_thumbnail ON artworks (art_thumbnail);
+	CREATE INDEX accounts_acc_icon      ON accounts (acc_icon);
+	CREATE INDEX acc_icons_dwn_id       ON acc_icons(dwn_id);
+	
+	/* Write the new DB version */
+	INSERT OR REPLACE INTO arcollect_infos (key,value) VALUES ('schema_version',6);
+
+/* Finish transaction */
+COMMIT;
@@ -0,0 +1,81 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/* This SQL upgrade a v6 database to the v7 format.
+ *
+ * Hashes are backfilled by the desktop-app afterward.
+ */
+/* Prepare upgrade */
+PRAGMA foreign_keys = OFF;
+/* Begin transaction */
+BEGIN IMMEDIATE;
+	/* Upgrade the downloads table, dwn_path is no longer unique */
+	CREATE TABLE downloads_upgrade_v7 (
+		dwn_id       INTEGER NOT NULL UNIQUE, /* Download unique ID           */
+		dwn_source   TEXT             UNIQUE, /* Download URL                 */
+		dwn_path     TEXT    NOT NULL       , /* Download path                */
+		dwn_mimetype TEXT    NOT NULL       , /* Download file type           */
+		dwn_etag     TEXT                   , /* Download etag                */
+		dwn_width    INTEGER                , /* Download width in pixels     */
+		dwn_height   INTEGER                , /* Download height in pixels    */
+		dwn_lastedit INTEGER NOT NULL       , /* Last edit time for If-Modified-Since */
+		dwn_bgcolor  INTEGER                , /* Detected background color (0xRRGGBBAA) */
+		dwn_pixelart INTEGER                , /* 1 if the image is pixel-art */
+		dwn_analysis INTEGER                , /* Version of the analysis */
+		dwn_placeholder BLOB                , /* Tiny preview of the image */
+		dwn_hash     INTEGER                , /* XXH64 of the file content */
+		PRIMARY KEY (dwn_id)
+	);
+	INSERT OR ROLLBACK INTO downloads_upgrade_v7 (
+		dwn_id,
+		dwn_source,
+		dwn_path,
+		dwn_mimetype,
+		dwn_etag,
+		dwn_width,
+		dwn_height,
+		dwn_lastedit,
+		dwn_bgcolor,
+		dwn_pixelart,
+		dwn_analysis,
+		dwn_placeholder
+	) SELECT
+		dwn_id,
+		dwn_source,
+		dwn_path,
+		dwn_mimetype,
+		dwn_etag,
+		dwn_width,
+		dwn_height,
+		dwn_lastedit,
+		dwn_bgcolor,
+		dwn_pixelart,
+		dwn_analysis,
+		dwn_placeholder
+	FROM downloads;
+	DROP TABLE downloads;
+	ALTER TABLE downloads_upgrade_v7 RENAME TO downloads;
+	
+	/* Index the content hash and shared paths */
+	CREATE INDEX downloads_dwn_hash ON downloads (dwn_hash);
+	CREATE INDEX downloads_dwn_path ON downloads (dwn_path);
+	
+	/* Write the new DB version */
+	INSERT OR REPLACE INTO arcollect_infos (key,value) VALUES ('schema_version',7);
+
+/* Finish transaction and cleanups */
+COMMIT;
+PRAGMA foreign_keys = ON;
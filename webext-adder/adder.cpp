@@ -29,6 +29,7 @@
 #include "json-shared-helpers.hpp"
 #include "json_escaper.hpp"
 #include "download.hpp"
+#include "notify.hpp"
 /** \file webext-adder/adder.cpp
  *  \brief Artwork addition routines
  *
@@ -668,7 +669,7 @@ static sqlite_int64 alloc_comicid(SQLite3::sqlite3 &db, SQLite3::stmt &alloc_com
 	alloc_comicid_stmt.reset();
 	return result;
 }
-static std::optional<std::string> do_add(char* iter, char* const end, std::string_view &transaction_id, Arcollect::db::downloads::Transaction &dwn_transaction)
+static std::optional<std::string> do_add(char* iter, char* const end, std::string_view &transaction_id, Arcollect::db::downloads::Transaction &dwn_transaction, std::vector<sqlite_int64> &changed_artworks)
 {
 	using namespace Arcollect::json;
 	Arcollect::WebextAdder::NetworkSession network_session(dwn_transaction);
@@ -1028,6 +1029,7 @@ static std::optional<std::string> do_add(char* iter, char* const end, std::strin
 				case SQLITE_ROW: {
 					// Save artwork
 					artwork.cache.emplace(db_artwork(*db,*update_stmt));
+					changed_artworks.push_back(artwork.cache->art_artid);
 					if (update_stmt->step() != SQLITE_DONE)
 						return std::string("Failed to update artwork (in SQLITE_ROW handling): "+std::string(db->errmsg()));
 				} break;
@@ -1053,6 +1055,7 @@ static std::optional<std::string> do_add(char* iter, char* const end, std::strin
 			switch (insert_stmt->step()) {
 				case SQLITE_ROW: {
 					artwork.cache.emplace(db_artwork(*db,*insert_stmt));
+					changed_artworks.push_back(artwork.cache->art_artid);
 					if (insert_stmt->step() != SQLITE_DONE)
 						return std::string("Failed to insert artwork (in SQLITE_ROW handling): "+std::string(db->errmsg()));
 				} break;
@@ -1256,8 +1259,9 @@ std::string process_json(char* begin, char* const end)
 	// Perform addition
 	std::optional<std::string> reason;
 	Arcollect::db::downloads::Transaction dwn_transaction(db);
+	std::vector<sqlite_int64> changed_artworks;
 	try {
-		reason = do_add(begin,end,transaction_id,dwn_transaction);
+		reason = do_add(begin,end,transaction_id,dwn_transaction,changed_artworks);
 	} catch (std::exception &e) {
 		reason = std::string(e.what());
 	}
@@ -1272,7 +1276,11 @@ std::string process_json(char* begin, char* const end)
 			reason = std::string(errmsg);
 			if (errmsg != default_errmsg)
 				sqlite3_free(errmsg);
-		} else dwn_transaction.commit();
+		} else {
+			dwn_transaction.commit();
+			// Tell the desktop app
+			Arcollect::WebextAdder::notify_artworks_changed(changed_artworks);
+		}
 	}
 	
 	std::string result_json = "{\"success\":";
@@ -291,9 +291,22 @@ size_t Arcollect::WebextAdder::Download::curl_first_write_callback(char *ptr, si
 	// Tell curl to write in our file
 	if (Arcollect::debug.webext_adder)
 		std::cerr << ": downloading...";
-	curl_easy_setopt(easyhandle,CURLOPT_WRITEFUNCTION,fwrite);
-	curl_easy_setopt(easyhandle,CURLOPT_WRITEDATA,file);
-	return fwrite(ptr,size,nmemb,file);
+	curl_easy_setopt(easyhandle,CURLOPT_WRITEFUNCTION,curl_hashing_write_callback);
+	curl_easy_setopt(easyhandle,CURLOPT_WRITEDATA,this);
+	return curl_hashing_write_callback(ptr,size,nmemb,this);
+}
+size_t Arcollect::WebextAdder::Download::curl_hashing_write_callback(char *ptr, size_t size, size_t nmemb, Download *self) noexcept
+{
+	self->hasher.Update(ptr,size*nmemb);
+	return fwrite(ptr,size,nmemb,self->file);
+}
+void Arcollect::WebextAdder::Download::deduplicate(void)
+{
+	std::string error = session.cache.deduplicate(download_infos,hasher.Final());
+	if (!error.empty())
+		throw std::runtime_error(std::string("Failed to deduplicate download: ")+error);
+	if (Arcollect::debug.webext_adder)
+		std::cerr << " (" << download_infos.dwn_path().string() << ")";
 }
 sqlite_int64 Arcollect::WebextAdder::Download::perform(const std::string_view& target, const std::string_view &referer)
 {
@@ -370,7 +383,9 @@ sqlite_int64 Arcollect::WebextAdder::Download::perform(const std::string_view& t
 			// Cleanups
 			switch (curl_res) {
 				case CURLE_OK: {
-					// Do nothing special
+					// Reuse an identical download
+					if (file)
+						deduplicate();
 					if (Arcollect::debug.webext_adder)
 						std::cerr << ": 200 OK." << std::endl;
 					
@@ -423,6 +438,10 @@ sqlite_int64 Arcollect::WebextAdder::Download::perform(const std::string_view& t
 					uint32_t current_word = 0;
 					int bits_count = 0;
 					std::ofstream output((Arcollect::path::arco_data_home/download_infos.dwn_path()));
+					const auto write_byte = [&](uint8_t byte) {
+						output << byte;
+						hasher.Update(&byte,sizeof(byte));
+					};
 					for (char digit: data_string) {
 						// Compute the 6-bits word
 						current_word <<= 6;
@@ -445,9 +464,9 @@ sqlite_int64 Arcollect::WebextAdder::Download::perform(const std::string_view& t
 						// Shift or dump
 						if (bits_count == 24-6) {
 							// Write bytes
-							output << static_cast<uint8_t>((current_word >> 16)&0xff)
-							       << static_cast<uint8_t>((current_word >>  8)&0xff)
-							       << static_cast<uint8_t>((current_word >>  0)&0xff);
+							write_byte((current_word >> 16)&0xff);
+							write_byte((current_word >>  8)&0xff);
+							write_byte((current_word >>  0)&0xff);
 							bits_count = 0;
 							current_word = 0;
 						} else bits_count += 6;
@@ -456,9 +475,12 @@ sqlite_int64 Arcollect::WebextAdder::Download::perform(const std::string_view& t
 					std::cerr << "Finish with " << bits_count << " bits" << std::endl;
 					bits_count >>= (8-bits_count)%8;
 					if (bits_count >= 16)
-						output << static_cast<uint8_t>((current_word >> 8)&0xff);
+						write_byte((current_word >> 8)&0xff);
 					if (bits_count >= 8)
-						output << static_cast<uint8_t>((current_word >> 0)&0xff);	
+						write_byte((current_word >> 0)&0xff);
+					output.close();
+					// Reuse an identical download
+					deduplicate();
 					// Return
 					return session.url_cache[cache_key] = download_infos.dwn_id();
 				} else throw std::runtime_error(std::string("Failed to perform transaction: ")+error);
@@ -16,6 +16,7 @@
  */
 #pragma once
 #include <arcollect-db-downloads.hpp>
+#include <xxh64.hpp>
 #include <filesystem>
 #include <string_view>
 #include <unordered_map>
@@ -174,6 +175,23 @@ namespace Arcollect {
 				 *       has been called at least once, aka the result is not empty.
 				 */
 				FILE* file = NULL;
+				/** Content hasher
+				 *
+				 * The file content is hashed while written to find duplicates.
+				 */
+				XXH64_CTX hasher;
+				/** curl write callback
+				 *
+				 * The [CURLOPT_WRITEFUNCTION](https://curl.se/libcurl/c/CURLOPT_WRITEFUNCTION.html)
+				 * set by curl_first_write_callback(), a fwrite() that feed the #hasher.
+				 */
+				static size_t curl_hashing_write_callback(char *ptr, size_t size, size_t nmemb, Download *self) noexcept;
+				/** Deduplicate the written file
+				 *
+				 * Call Arcollect::db::downloads::Transaction::deduplicate() with the
+				 * #hasher result, throw an exception on error.
+				 */
+				void deduplicate(void);
 				/** Wrapper for curl_first_write_callback() member function
 				 */
 				static size_t curl_first_write_callback_wrapper(char *ptr, size_t size, size_t nmemb, Download *self) noexcept;
@@ -182,7 +200,7 @@ namespace Arcollect {
 				 *
 				 * This is the first [CURLOPT_WRITEFUNCTION](https://curl.se/libcurl/c/CURLOPT_WRITEFUNCTION.html).
 				 * It perform checks and Arcollect::db::downloads::Transaction::write_cache()
-				 * then switch to a plain fwrite().
+				 * then switch to curl_hashing_write_callback().
 				 */
 				size_t curl_first_write_callback(char *ptr, size_t size, size_t nmemb) noexcept;
 				/** Assert if the HTTP request failed
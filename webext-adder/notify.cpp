@@ -0,0 +1,62 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <config.h>
+#include "notify.hpp"
+#include <arcollect-debug.hpp>
+#include <iostream>
+#if WITH_XDG
+#include <dbus/dbus.h>
+
+/** Session bus connection
+ *
+ * It is opened on the first notification and kept for next ones.
+ */
+static DBusConnection *session_bus = NULL;
+static bool session_bus_failed = false;
+
+void Arcollect::WebextAdder::notify_artworks_changed(const std::vector<sqlite_int64> &art_ids)
+{
+	if (!session_bus) {
+		if (session_bus_failed)
+			return;
+		DBusError error;
+		dbus_error_init(&error);
+		session_bus = dbus_bus_get(DBUS_BUS_SESSION,&error);
+		if (!session_bus) {
+			session_bus_failed = true;
+			if (Arcollect::debug.webext_adder)
+				std::cerr << "Cannot notify changes, failed to connect to the session bus: " << error.message << std::endl;
+			dbus_error_free(&error);
+			return;
+		}
+		dbus_connection_set_exit_on_disconnect(session_bus,false);
+	}
+	DBusMessage *signal = dbus_message_new_signal(ARCOLLECT_DBUS_PATH_STR,ARCOLLECT_DBUS_COLLECTION_INTF_STR,"ArtworksChanged");
+	const dbus_int64_t *ids = reinterpret_cast<const dbus_int64_t*>(art_ids.data());
+	static_assert(sizeof(*ids) == sizeof(sqlite_int64));
+	dbus_message_append_args(signal,DBUS_TYPE_ARRAY,DBUS_TYPE_INT64,&ids,static_cast<int>(art_ids.size()),DBUS_TYPE_INVALID);
+	dbus_connection_send(session_bus,signal,NULL);
+	dbus_connection_flush(session_bus);
+	dbus_message_unref(signal);
+	if (Arcollect::debug.webext_adder)
+		std::cerr << "Notified " << art_ids.size() << " changed artworks" << std::endl;
+}
+#else
+void Arcollect::WebextAdder::notify_artworks_changed(const std::vector<sqlite_int64> &art_ids)
+{
+}
+#endif
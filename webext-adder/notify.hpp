@@ -0,0 +1,44 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file webext-adder/notify.hpp
+ *  \brief Change notification to the running desktop app
+ *
+ * On XDG platforms, committed submissions are announced with the
+ * `ArtworksChanged` signal on the session bus :
+ *
+ *     <interface name="me.d_spirits.arcollect.Collection">
+ *       <signal name="ArtworksChanged">
+ *         <arg type="ax" name="artworks"/>
+ *       </signal>
+ *     </interface>
+ *
+ * The desktop app then refresh these artworks instead of polling the database.
+ */
+#pragma once
+#include <sqlite3.hpp>
+#include <vector>
+
+namespace Arcollect {
+	namespace WebextAdder {
+		/** Notify that artworks have been committed
+		 * \param art_ids Added or updated artworks ids
+		 *
+		 * This does nothing on non-XDG platforms or without a session bus.
+		 */
+		void notify_artworks_changed(const std::vector<sqlite_int64> &art_ids);
+	}
+}
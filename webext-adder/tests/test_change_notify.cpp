@@ -0,0 +1,185 @@
+/* Arcollect -- An artwork collection manager
+ * Copyright (C) 2022 DevilishSpirits (aka D-Spirits or Luc B.)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+/** \file test_change_notify.cpp
+ *  \brief Test webext-adder change notifications
+ *
+ * Listen for `ArtworksChanged` like the desktop app does on a private session
+ * bus (Meson run this test in `dbus-run-session`) while feeding a webext-adder
+ * process working on the same temporary database.
+ */
+#include <arcollect-db-open.hpp>
+#include "../../desktop-app/db/db.hpp"
+#include "../../desktop-app/xdg/dbus.hpp"
+#include "../../desktop-app/xdg/event-loop.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static constexpr std::string_view dummy_data = "data:text/plain;base64,QXJjb2xsZWN0";
+
+static int test_num = 1;
+static int result_code = 0;
+static void tap_result(bool success, const std::string_view &description)
+{
+	if (!success) {
+		std::cout << "not ";
+		result_code = 1;
+	}
+	std::cout << "ok " << test_num++ << " - " << description << std::endl;
+}
+
+void Arcollect::dbus::exit_if_idle(void)
+{
+}
+
+static int adder_stdin;
+static int adder_stdout;
+/** Send a JSON to the webext-adder
+ * \return Whether the webext-adder succeeded
+ */
+static bool submit(const std::string &json)
+{
+	std::uint32_t len = json.size();
+	if ((write(adder_stdin,&len,sizeof(len)) != sizeof(len))||(write(adder_stdin,json.data(),len) != len))
+		return false;
+	if (read(adder_stdout,&len,sizeof(len)) != sizeof(len))
+		return false;
+	std::string result(len,'\0');
+	for (std::size_t done = 0; done < len;) {
+		ssize_t count = read(adder_stdout,result.data()+done,len-done);
+		if (count <= 0)
+			return false;
+		done += count;
+	}
+	return result.starts_with("{\"success\":true");
+}
+static std::string artwork_json(const std::string_view &source, const std::string_view &title)
+{
+	return "{\"source\":\"" + std::string(source) + "\",\"title\":\"" + std::string(title) + "\",\"data\":\"" + std::string(dummy_data) + "\"}";
+}
+
+/** Run the event-loop like main-xdg.cpp does
+ * \return Whether changes are pending
+ */
+static bool wait_changes(DBus::Connection &conn, int iterations = 20)
+{
+	for (int i = 0; (i < iterations) && !Arcollect::changes_pending; i++) {
+		Arcollect::dbus::event_loop::run(100);
+		while (conn.dispatch() == DBUS_DISPATCH_DATA_REMAINS);
+	}
+	return Arcollect::changes_pending;
+}
+/** Do what the GUI does on changes
+ * \return Notified artworks, sorted
+ */
+static std::vector<sqlite_int64> consume_changes(void)
+{
+	std::vector<sqlite_int64> art_ids = std::move(Arcollect::changed_artworks);
+	std::sort(art_ids.begin(),art_ids.end());
+	Arcollect::changed_artworks.clear();
+	Arcollect::changes_pending = false;
+	Arcollect::update_data_version();
+	return art_ids;
+}
+static std::vector<sqlite_int64> query_artworks(const char* where)
+{
+	std::vector<sqlite_int64> art_ids;
+	std::unique_ptr<SQLite3::stmt> stmt;
+	Arcollect::database->prepare("SELECT art_artid FROM artworks WHERE "+std::string(where)+" ORDER BY art_artid;",stmt);
+	while (stmt->step() == SQLITE_ROW)
+		art_ids.push_back(stmt->column_int64(0));
+	return art_ids;
+}
+
+int main(void)
+{
+	std::cout << "TAP version 13" << std::endl;
+	if (!std::getenv("DBUS_SESSION_BUS_ADDRESS")) {
+		std::cout << "1..0 # SKIP No D-Bus session bus" << std::endl;
+		return 0;
+	}
+	const char* adder_path = std::getenv("ARCOLLECT_WEBEXT_ADDER_PATH");
+	if (!adder_path) {
+		std::cout << "Bail out! ARCOLLECT_WEBEXT_ADDER_PATH is not set" << std::endl;
+		return 1;
+	}
+	std::cout << "1..6" << std::endl;
+	Arcollect::database = Arcollect::db::test_open();
+
+	// Listen like main-xdg.cpp does
+	if (Arcollect::dbus::event_loop::init()) {
+		std::cout << "Bail out! Failed to init the event-loop" << std::endl;
+		return 1;
+	}
+	dbus_threads_init_default();
+	DBus::Connection conn(DBus::BUS_SESSION);
+	Arcollect::dbus::event_loop::attach(conn);
+	conn.add_match(Arcollect::dbus::artworks_changed_match,NULL);
+	conn.add_filter(Arcollect::dbus::handle_ArtworksChanged);
+	Arcollect::changes_notified = true;
+	consume_changes();
+
+	// Start the webext-adder
+	int stdin_pipe[2], stdout_pipe[2];
+	if (pipe(stdin_pipe) || pipe(stdout_pipe)) {
+		std::cout << "Bail out! pipe() failed" << std::endl;
+		return 1;
+	}
+	pid_t adder_pid = fork();
+	if (adder_pid == 0) {
+		dup2(stdin_pipe[0],0);
+		dup2(stdout_pipe[1],1);
+		close(stdin_pipe[1]);
+		close(stdout_pipe[0]);
+		execl(adder_path,"arcollect-webext-adder",NULL);
+		std::_Exit(127);
+	}
+	close(stdin_pipe[0]);
+	close(stdout_pipe[1]);
+	adder_stdin = stdin_pipe[1];
+	adder_stdout = stdout_pipe[0];
+
+	// New artworks
+	const bool added = submit("{\"platform\":\"test\",\"artworks\":["+artwork_json("art1","First")+","+artwork_json("art2","Second")+"]}");
+	tap_result(added,"Artworks are added");
+	const bool added_notified = wait_changes(conn);
+	const sqlite_int64 data_version_before = Arcollect::data_version;
+	const std::vector<sqlite_int64> added_ids = consume_changes();
+	tap_result(added_notified && (added_ids == query_artworks("TRUE")) && (added_ids.size() == 2),"Added artworks are notified");
+	tap_result(data_version_before != Arcollect::data_version,"Notification matches a data_version change");
+
+	// Failed submission
+	const bool failure_added = submit("{\"platform\":\"test\",\"artworks\":{}}");
+	tap_result(!failure_added && !wait_changes(conn,5),"Failed submission is not notified");
+
+	// Artwork update
+	const bool updated = submit("{\"platform\":\"test\",\"artworks\":["+artwork_json("art1","First (edited)")+"]}");
+	const bool updated_notified = wait_changes(conn);
+	tap_result(updated && updated_notified,"Artwork update is notified");
+	tap_result(consume_changes() == query_artworks("art_source = 'art1'"),"Only the updated artwork is notified");
+
+	// Stop the webext-adder
+	close(adder_stdin);
+	waitpid(adder_pid,NULL,0);
+	close(adder_stdout);
+	return result_code;
+}